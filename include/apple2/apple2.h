@@ -8,7 +8,14 @@
 struct apple2;
 typedef struct apple2 apple2;
 
+#include "apple2/bd.h"
 #include "apple2/dd.h"
+#include "apple2/gdb.h"
+#include "apple2/heat.h"
+#include "apple2/reflect.h"
+#include "apple2/replay.h"
+#include "apple2/rewind.h"
+#include "apple2/watch.h"
 #include "mos6502/mos6502.h"
 #include "vm_bitfont.h"
 #include "vm_screen.h"
@@ -42,6 +49,12 @@ typedef struct apple2 apple2;
  */
 #define APPLE2_APPLESOFT_MAIN 0xE000
 
+/*
+ * The number of cycles in one frame of NTSC video: 65 cycles a scan
+ * line, and 262 scan lines.
+ */
+#define APPLE2_FRAME_CYCLES (65 * 262)
+
 enum color_modes {
     COLOR_GREEN,
     COLOR_AMBER,
@@ -334,6 +347,48 @@ struct apple2 {
      */
     apple2dd *selected_drive;
 
+    /*
+     * This is the block device card in slot 5, which can hold a ProDOS
+     * volume much larger than a floppy disk.
+     */
+    apple2bd *blockdev;
+
+    /*
+     * The checkpoints we've taken as the machine runs, which let the
+     * debugger go backwards in time.
+     */
+    apple2_rewind *rewind;
+
+    /*
+     * What we use to record the inputs the machine is given, or to
+     * replay inputs we recorded before.
+     */
+    apple2_replay *replay;
+
+    /*
+     * If we've been asked to, this is where we publish the state of the
+     * machine for other programs to watch (see apple2.reflect.c).
+     */
+    apple2_reflect *reflect;
+
+    /*
+     * The watchpoints we've set on memory, if we've set any (see
+     * apple2.watch.c).
+     */
+    apple2_watch *watch;
+
+    /*
+     * If we've been asked to, this is where we listen for a remote
+     * debugger (see apple2.gdb.c).
+     */
+    apple2_gdb *gdb;
+
+    /*
+     * If we've been asked to, this is where we count the machine's
+     * accesses to memory (see apple2.heat.c).
+     */
+    apple2_heat *heat;
+
     /*
      * If paused is true, then execution of opcodes is suspended.
      */
@@ -350,14 +405,33 @@ struct apple2 {
      * If this is true, then we will disassemble opcodes as we execute.
      */
     bool disasm;
+
+    /*
+     * When snap_pending is true, we are waiting for the machine to go
+     * idle after booting so we can record a snapshot of it (see
+     * apple2.snap.c); kb_polls is how many times in a row it has polled
+     * the keyboard without finding a key.
+     */
+    bool snap_pending;
+    int kb_polls;
+
+    /*
+     * How many times the keyboard has been polled with no key waiting,
+     * since whoever is interested last set this back to zero. A machine
+     * which does little else is just waiting for someone to type (see
+     * apple2.pool.c).
+     */
+    unsigned int kb_empty_polls;
 };
 
 extern apple2 *apple2_create(int, int);
+extern apple2 *apple2_fork(apple2 *);
 extern bool apple2_is_double_video(apple2 *);
 extern int apple2_boot(apple2 *);
 extern void apple2_clear_strobe(apple2 *);
 extern void apple2_free(apple2 *);
 extern void apple2_notify_refresh(apple2 *);
+extern void apple2_power_on(apple2 *);
 extern void apple2_press_key(apple2 *, vm_8bit);
 extern void apple2_release_key(apple2 *);
 extern void apple2_reset(apple2 *);
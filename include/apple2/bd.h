@@ -0,0 +1,135 @@
+#ifndef _APPLE2_BLOCK_DEVICE_H_
+#define _APPLE2_BLOCK_DEVICE_H_
+
+/*
+ * Forward declaration of apple2bd, for the same reasons we have one in
+ * dd.h.
+ */
+struct apple2bd;
+typedef struct apple2bd apple2bd;
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "apple2/apple2.h"
+#include "vm_bits.h"
+#include "vm_segment.h"
+
+/*
+ * The block device card lives in slot 5, which gives it the ROM page at
+ * $C500 and the soft switches from $C0D0 to $C0DF.
+ */
+#define APPLE2_BD_SLOT 5
+
+/*
+ * Every block in ProDOS (and SmartPort) is 512 bytes.
+ */
+#define APPLE2_BD_BLOCK_SIZE 512
+
+/*
+ * ProDOS addresses blocks with 16 bits, so the largest volume it can
+ * work with is 65,535 blocks, or just shy of 32 megabytes.
+ */
+#define APPLE2_BD_MAX_BLOCKS 65535
+
+/*
+ * When ROM code reads from these switches, we trap into the emulator
+ * and carry out a ProDOS or SmartPort call on the program's behalf.
+ */
+#define APPLE2_BD_PRODOS_TRAP 0xC0D0
+#define APPLE2_BD_SMARTPORT_TRAP 0xC0D1
+
+/*
+ * These are the error codes that ProDOS and SmartPort calls return in
+ * the A register (with the carry flag set, if the code is not zero).
+ */
+enum apple2_bd_error {
+    BD_OK = 0x00,
+    BD_BADCMD = 0x01,
+    BD_BADPCNT = 0x04,
+    BD_BADUNIT = 0x11,
+    BD_BADCTL = 0x21,
+    BD_IOERROR = 0x27,
+    BD_NODRIVE = 0x28,
+    BD_NOWRITE = 0x2B,
+    BD_BADBLOCK = 0x2D,
+};
+
+/*
+ * These are the commands which ProDOS passes in through its zero page
+ * parameters, and SmartPort passes inline after the JSR to its entry
+ * point. (SmartPort defines more commands than these, but the rest are
+ * for character devices.)
+ */
+enum apple2_bd_command {
+    BD_STATUS = 0x00,
+    BD_READ = 0x01,
+    BD_WRITE = 0x02,
+    BD_FORMAT = 0x03,
+    BD_CONTROL = 0x04,
+    BD_INIT = 0x05,
+};
+
+/*
+ * A block device reads and writes blocks through a backend. The default
+ * backend works with a disk image of ProDOS-ordered blocks on the host,
+ * but others may supply their own functions to (for example) generate
+ * blocks on the fly.
+ */
+typedef int (*apple2_bd_reader)(apple2bd *, size_t, vm_8bit *);
+typedef int (*apple2_bd_writer)(apple2bd *, size_t, const vm_8bit *);
+typedef void (*apple2_bd_closer)(apple2bd *);
+
+struct apple2bd {
+    /*
+     * These are the functions we call to read and write a single block
+     * on the device; and also the function to call when the device is
+     * ejected, if the backend needs to tidy up (it may be NULL).
+     */
+    apple2_bd_reader read_block;
+    apple2_bd_writer write_block;
+    apple2_bd_closer close;
+
+    /*
+     * Any data which the backend needs to keep for itself.
+     */
+    void *backend;
+
+    /*
+     * The image backend works directly with the file descriptor of the
+     * stream we were given. We don't read the image into memory; blocks
+     * are read and written as they are asked for.
+     */
+    FILE *stream;
+    int fd;
+
+    /*
+     * This is the number of blocks the device holds.
+     */
+    size_t blocks;
+
+    /*
+     * A device is online when it has something in it for us to read.
+     */
+    bool online;
+
+    /*
+     * If this is true, any write to the device will fail.
+     */
+    bool write_protect;
+};
+
+extern SEGMENT_READER(apple2_bd_switch_read);
+extern apple2bd *apple2_bd_create();
+extern apple2bd *apple2_bd_fork(apple2bd *);
+extern int apple2_bd_init_rom(vm_segment *);
+extern int apple2_bd_insert(apple2bd *, FILE *);
+extern int apple2_bd_prodos(apple2 *);
+extern int apple2_bd_read_block(apple2bd *, size_t, vm_8bit *);
+extern int apple2_bd_smartport(apple2 *);
+extern int apple2_bd_write_block(apple2bd *, size_t, const vm_8bit *);
+extern void apple2_bd_eject(apple2bd *);
+extern void apple2_bd_free(apple2bd *);
+extern void apple2_bd_map(vm_segment *);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _APPLE2_COND_H_
+#define _APPLE2_COND_H_
+
+#include <stdbool.h>
+
+#include "mos6502/mos6502.h"
+#include "vm_bits.h"
+
+/*
+ * The most bytes of code a condition may compile to, and the deepest
+ * its stack may go when we evaluate it.
+ */
+#define COND_CODE_MAX 128
+#define COND_STACK_MAX 16
+
+/*
+ * These are the operations of our bytecode. Every one of them pops
+ * what it works on from the stack and pushes its result, except
+ * COND_NUM and COND_REG, which push something; they are followed in the
+ * code by a 16-bit number (low byte first), or a register from enum
+ * cond_reg.
+ */
+enum cond_op {
+    COND_END,
+    COND_NUM,
+    COND_REG,
+    COND_MEM,
+    COND_NOT,
+    COND_NEG,
+    COND_ADD,
+    COND_SUB,
+    COND_AND,
+    COND_OR,
+    COND_XOR,
+    COND_EQ,
+    COND_NE,
+    COND_LT,
+    COND_LE,
+    COND_GT,
+    COND_GE,
+    COND_LAND,
+    COND_LOR,
+};
+
+enum cond_reg {
+    COND_A,
+    COND_X,
+    COND_Y,
+    COND_P,
+    COND_S,
+    COND_PC,
+};
+
+typedef struct {
+    /*
+     * The code we compiled, which always ends in COND_END.
+     */
+    vm_8bit code[COND_CODE_MAX];
+    int len;
+
+    /*
+     * What we compiled it from, so we can show it back to you.
+     */
+    char *source;
+} apple2_cond;
+
+extern apple2_cond *apple2_cond_create(const char *);
+extern bool apple2_cond_eval(apple2_cond *, mos6502 *);
+extern void apple2_cond_free(apple2_cond *);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _APPLE2_CONV_H_
+#define _APPLE2_CONV_H_
+
+#include <stdbool.h>
+
+#include "apple2/dd.h"
+#include "apple2/enc.h"
+#include "vm_segment.h"
+
+/*
+ * The size of a NIB file as other emulators write them: 35 tracks of
+ * 6,656 bytes each. (Our own data segment for an encoded disk is a bit
+ * larger than this; see _140K_NIB_.)
+ */
+#define APPLE2_CONV_NIB_SIZE (ENC_NUM_TRACKS * ENC_ETRACK)
+
+/*
+ * A single image to convert: where it comes from, where it goes, and
+ * the formats of each. Once the job has run, result will hold OK or an
+ * error code.
+ */
+typedef struct {
+    char *src;
+    char *dest;
+    int from;
+    int to;
+    int result;
+} apple2_conv_job;
+
+extern const char *apple2_conv_ext(int);
+extern int apple2_conv_file(apple2_conv_job *, bool);
+extern int apple2_conv_run(apple2_conv_job *, int, int, bool);
+extern int apple2_conv_type(const char *);
+extern vm_segment *apple2_conv_canon(int, vm_segment *);
+extern vm_segment *apple2_conv_image(int, int, vm_segment *);
+
+#endif
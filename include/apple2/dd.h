@@ -9,6 +9,7 @@ struct apple2dd;
 typedef struct apple2dd apple2dd;
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/stat.h>
 
@@ -55,6 +56,20 @@ enum apple2_dd_mode {
 
 #define MAX_DRIVE_STEPS 70
 
+/*
+ * The number of whole tracks the head can visit, given the number of
+ * half-track steps it can take.
+ */
+#define DD_NUM_TRACKS ((MAX_DRIVE_STEPS / 2) + 1)
+
+/*
+ * We keep a histogram of how far the head moves when it seeks. Each
+ * bucket holds the seeks whose distance (in half-tracks) falls within
+ * a power of two: bucket 0 is a distance of 1; bucket 1 is 2-3; bucket
+ * 2 is 4-7; and so forth. The last bucket holds anything larger.
+ */
+#define DD_SEEK_BUCKETS 8
+
 /*
  * This is the last _accessible_ sector position within a track (you can
  * have 0 - 4095).
@@ -71,6 +86,51 @@ enum apple2_dd_mode {
 #define DD_PHASE3 0x4
 #define DD_PHASE4 0x8
 
+/*
+ * These are counters we keep on the activity of a drive, which are
+ * handy when you want to know what some software is actually doing
+ * with the disk (and how hard it's working to do it). They are printed
+ * by the debugger, and again when the emulator exits.
+ */
+typedef struct {
+    /*
+     * The number of bytes read from, and written to, the disk. Sync
+     * bytes are the $FF bytes which pad out the space between fields on
+     * a track; software has to read past them to find the data it
+     * wants, and we count how many of those it skipped over.
+     */
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t sync_skipped;
+
+    /*
+     * Every half-track step the head took, and the histogram of seek
+     * distances (see DD_SEEK_BUCKETS). A seek begins with the first
+     * step after the head has been still, and ends with the next read
+     * or write; seek_from is the track position where it began.
+     */
+    uint64_t half_steps;
+    uint64_t seeks[DD_SEEK_BUCKETS];
+    int seek_from;
+    bool seeking;
+
+    /*
+     * The number of cycles the motor has been on. If the motor is on
+     * right now, motor_since is the cycle count at which it was turned
+     * on, and the time since then hasn't been added in yet.
+     */
+    uint64_t motor_cycles;
+    uint64_t motor_since;
+
+    /*
+     * The number of sectors read from each track. We count a sector
+     * each time we read the prologue of a data field ($D5 $AA $AD);
+     * prologue holds the last three bytes we read, so we can see it.
+     */
+    uint64_t sector_reads[DD_NUM_TRACKS];
+    uint32_t prologue;
+} apple2_dd_stats;
+
 struct apple2dd {
     /*
      * Inside the disk drive there is a stepper motor, and it's
@@ -182,32 +242,44 @@ struct apple2dd {
     bool write_protect;
 
     /*
-     * This is not a technical part of the Disk II drive. When this
-     * field is true, we will not shift the head after a read or a
-     * write; when false, we will. This is mainly useful for code like
-     * the disassembler which just wants to look at data and not apply
-     * other side-effects.
+     * A track is dirty if it's been written to since the disk was
+     * inserted (or last saved). When we save the state of the machine,
+     * these are the only tracks whose data we need to keep; the rest
+     * can be rebuilt from the disk image.
+     */
+    bool dirty[DD_NUM_TRACKS];
+
+    /*
+     * Our activity counters, for which see the struct above.
      */
-    bool locked;
+    apple2_dd_stats stats;
 };
 
 extern SEGMENT_READER(apple2_dd_switch_read);
 extern SEGMENT_WRITER(apple2_dd_switch_write);
 extern apple2dd *apple2_dd_create();
+extern apple2dd *apple2_dd_fork(apple2dd *);
 extern int apple2_dd_decode(apple2dd *);
 extern int apple2_dd_encode(apple2dd *);
 extern int apple2_dd_insert(apple2dd *, FILE *, int);
 extern int apple2_dd_position(apple2dd *);
+extern int apple2_dd_reset_tracks(apple2dd *, const bool *);
 extern int apple2_dd_sector_num(int, int);
+extern int apple2_dd_seek_bucket(int);
+extern uint64_t apple2_dd_motor_cycles(apple2dd *, uint64_t);
 extern vm_8bit apple2_dd_read(apple2dd *);
 extern vm_8bit apple2_dd_switch_rw(apple2dd *);
+extern void apple2_dd_count_read(apple2dd *, vm_8bit);
 extern void apple2_dd_eject(apple2dd *);
 extern void apple2_dd_free(apple2dd *);
 extern void apple2_dd_map(vm_segment *);
+extern void apple2_dd_motor(apple2dd *, bool, uint64_t);
 extern void apple2_dd_phaser(apple2dd *, int);
 extern void apple2_dd_save(apple2dd *);
 extern void apple2_dd_set_mode(apple2dd *, int);
+extern void apple2_dd_seek_end(apple2dd *);
 extern void apple2_dd_shift(apple2dd *, int);
+extern void apple2_dd_stats_dump(apple2dd *, const char *, FILE *, uint64_t);
 extern void apple2_dd_step(apple2dd *, int);
 extern void apple2_dd_switch_drive(apple2 *, size_t);
 extern void apple2_dd_switch_latch(apple2dd *, vm_8bit);
@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 
+#include "mos6502/mos6502.h"
+#include "vm_bits.h"
+
 struct apple2_debug_args;
 typedef struct apple2_debug_args apple2_debug_args;
 
@@ -56,6 +59,13 @@ struct apple2_debug_args {
      */
     char *target;
 
+    /*
+     * Whatever is left of the input after the arguments above, as it
+     * was given (spaces and all), or NULL if there's nothing left. This
+     * is where break finds its condition.
+     */
+    char *rest;
+
     /*
      * The command our arguments are attached to; from here we can call
      * the handler with ourselves. (Very meta.)
@@ -68,28 +78,62 @@ struct apple2_debug_args {
 
 extern int apple2_debug_addr(const char *);
 extern bool apple2_debug_broke(int);
+extern bool apple2_debug_stop(mos6502 *);
 extern char *apple2_debug_next_arg(char **);
 extern char *apple2_debug_prompt();
 extern apple2_debug_cmd *apple2_debug_find_cmd(const char *);
+extern int apple2_debug_break_if(int, const char *);
 extern void apple2_debug_break(int);
 extern void apple2_debug_execute(const char *);
 extern void apple2_debug_quit();
 extern void apple2_debug_unbreak(int);
 extern void apple2_debug_unbreak_all();
+extern unsigned short apple2_debug_break_pages[];
+
+/*
+ * Return true if the CPU should stop at its PC. This is the same answer
+ * apple2_debug_stop() gives, but the run loop asks it before every
+ * instruction; so we first look at whether there's any breakpoint on
+ * the page the PC is in, which (for every page with no breakpoints,
+ * which is usually all of them) is as far as we need to go.
+ */
+static inline bool
+apple2_debug_trap(mos6502 *cpu)
+{
+    return apple2_debug_break_pages[cpu->PC >> 8] &&
+        apple2_debug_stop(cpu);
+}
 
 extern DEBUG_CMD(break);
+extern DEBUG_CMD(calls);
 extern DEBUG_CMD(dblock);
+extern DEBUG_CMD(dinsert);
 extern DEBUG_CMD(disasm);
+extern DEBUG_CMD(dstat);
+extern DEBUG_CMD(finish);
 extern DEBUG_CMD(hdump);
+extern DEBUG_CMD(heatmap);
 extern DEBUG_CMD(help);
 extern DEBUG_CMD(hidump);
 extern DEBUG_CMD(jump);
+extern DEBUG_CMD(loadstate);
+extern DEBUG_CMD(next);
 extern DEBUG_CMD(printaddr);
 extern DEBUG_CMD(printstate);
+extern DEBUG_CMD(profile);
 extern DEBUG_CMD(quit);
+extern DEBUG_CMD(rcontinue);
 extern DEBUG_CMD(resume);
+extern DEBUG_CMD(rstep);
+extern DEBUG_CMD(run);
+extern DEBUG_CMD(savestate);
 extern DEBUG_CMD(step);
 extern DEBUG_CMD(unbreak);
+extern DEBUG_CMD(until);
+extern DEBUG_CMD(until_frame);
+extern DEBUG_CMD(unwatch);
+extern DEBUG_CMD(watch);
+extern DEBUG_CMD(watches);
 extern DEBUG_CMD(writeaddr);
 extern DEBUG_CMD(writestate);
 
@@ -1,5 +1,5 @@
-#ifndef _APPLE2_REFLECT_H_
-#define _APPLE2_REFLECT_H_
+#ifndef _APPLE2_EVENT_H_
+#define _APPLE2_EVENT_H_
 
 #include "vm_event.h"
 
@@ -0,0 +1,120 @@
+#ifndef _APPLE2_GDB_H_
+#define _APPLE2_GDB_H_
+
+/*
+ * Forward declaration of apple2_gdb, for the same reasons we have one
+ * in dd.h.
+ */
+struct apple2_gdb;
+typedef struct apple2_gdb apple2_gdb;
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "apple2/apple2.h"
+
+/*
+ * The largest packet we'll take or send, not counting the $ at the
+ * front and the checksum at the end. We tell the client about this in
+ * our reply to qSupported.
+ */
+#define GDB_PACKET_MAX 0x400
+
+/*
+ * The most we'll hold of what we have to send the client, but which it
+ * hasn't taken from us yet. A client that lets this much pile up isn't
+ * listening, and we let go of it.
+ */
+#define GDB_OUT_MAX (GDB_PACKET_MAX * 4)
+
+/*
+ * How many cycles go by between looks at the socket while the machine
+ * is running. That's about a hundredth of a second; soon enough that
+ * nobody waits on us, and seldom enough that looking costs nothing to
+ * speak of.
+ */
+#define GDB_POLL_CYCLES 10000
+
+/*
+ * While the machine is paused, we wait this many milliseconds for
+ * something to come in over the socket before we give up the loop; so
+ * that a paused machine doesn't spin.
+ */
+#define GDB_PAUSED_WAIT_MS 10
+
+/*
+ * The signals we give in our stop replies: SIGINT, for when we were
+ * told to stop, and SIGTRAP, for a breakpoint, watchpoint, or step.
+ */
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+
+/*
+ * The registers, in the order the g packet gives them. Each is one byte
+ * but the PC, which is two (low byte first).
+ */
+enum gdb_reg {
+    GDB_REG_A,
+    GDB_REG_X,
+    GDB_REG_Y,
+    GDB_REG_P,
+    GDB_REG_S,
+    GDB_REG_PC,
+    GDB_REG_COUNT,
+};
+
+struct apple2_gdb {
+    /*
+     * The socket we listen on, and the one we talk to a client on (or
+     * -1, if no client is attached).
+     */
+    int listen_fd;
+    int client_fd;
+
+    /*
+     * If we listen on a UNIX socket, this is its path, which we remove
+     * when we're freed; otherwise it's NULL.
+     */
+    char *path;
+
+    /*
+     * What we've read from the client that we haven't dealt with yet.
+     */
+    char in[GDB_PACKET_MAX * 2];
+    int in_len;
+
+    /*
+     * What we mean to send the client, but couldn't yet, because its
+     * socket was full; we send it when the socket has room again. If
+     * more piles up than we can hold, we set overflow, and let go of
+     * the client on the next tick.
+     */
+    char out[GDB_OUT_MAX];
+    int out_len;
+    bool overflow;
+
+    /*
+     * If true, the client has asked us not to acknowledge its packets
+     * (nor to expect it to acknowledge ours).
+     */
+    bool no_ack;
+
+    /*
+     * If true, the client has let the machine run, and is waiting to
+     * hear that it stopped; when it does, signal says why.
+     */
+    bool running;
+    int signal;
+
+    /*
+     * The cycle count at which we'll next look at the socket.
+     */
+    uint64_t next;
+};
+
+extern apple2_gdb *apple2_gdb_create(const char *);
+extern int apple2_gdb_checksum(const char *, int);
+extern void apple2_gdb_free(apple2_gdb *);
+extern void apple2_gdb_tick(apple2_gdb *, apple2 *);
+
+#endif
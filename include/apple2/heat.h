@@ -0,0 +1,81 @@
+#ifndef _APPLE2_HEAT_H_
+#define _APPLE2_HEAT_H_
+
+/*
+ * Forward declaration of apple2_heat, for the same reasons we have one
+ * in dd.h.
+ */
+struct apple2_heat;
+typedef struct apple2_heat apple2_heat;
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apple2/apple2.h"
+#include "mos6502/mos6502.h"
+#include "vm_segment.h"
+
+/*
+ * The number of pages (of 256 bytes) we count accesses to in each bank
+ * of memory; which is every page the CPU can address.
+ */
+#define HEAT_PAGES 0x100
+
+/*
+ * The soft switches live in the page at $C000; we count accesses to
+ * each address there, rather than to the page as a whole.
+ */
+#define HEAT_SWITCH_PAGE 0xC0
+
+/*
+ * Where an access ended up: main memory, aux memory, or ROM. (The soft
+ * switches are counted apart from these.)
+ */
+enum heat_bank {
+    HEAT_MAIN,
+    HEAT_AUX,
+    HEAT_ROM,
+    HEAT_BANKS,
+};
+
+struct apple2_heat {
+    /*
+     * The machine we count for. A fork of it shares our read and write
+     * mappers, as it does with watchpoints (see apple2_fork()); but we
+     * only count what the machine itself does.
+     */
+    apple2 *mach;
+
+    /*
+     * If false, our mappers only pass accesses along. Once our mappers
+     * are in place, they stay there until the machine goes away; so
+     * this is how we stop counting.
+     */
+    bool counting;
+
+    /*
+     * The number of reads and writes in each page of each bank, and of
+     * each address in the page of soft switches.
+     */
+    uint64_t page_reads[HEAT_BANKS][HEAT_PAGES];
+    uint64_t page_writes[HEAT_BANKS][HEAT_PAGES];
+    uint64_t switch_reads[0x100];
+    uint64_t switch_writes[0x100];
+
+    /*
+     * The read and write mappers which were in main (0) and aux (1)
+     * memory for each address before we put our own there.
+     */
+    vm_segment_read_fn reads[2][MOS6502_MEMSIZE];
+    vm_segment_write_fn writes[2][MOS6502_MEMSIZE];
+};
+
+extern int apple2_heat_start(apple2 *);
+extern void apple2_heat_csv(apple2_heat *, FILE *);
+extern void apple2_heat_dump(apple2_heat *, FILE *);
+extern void apple2_heat_free(apple2_heat *);
+extern void apple2_heat_reset(apple2_heat *);
+extern void apple2_heat_stop(apple2_heat *);
+
+#endif
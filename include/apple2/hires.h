@@ -6,5 +6,7 @@
 
 extern void apple2_hires_draw(apple2 *, int);
 extern void apple2_hires_dump(apple2 *, FILE *);
+extern void apple2_hires_frame(apple2 *, FILE *);
+extern void apple2_hires_row(apple2 *, int, vm_color *);
 
 #endif
@@ -0,0 +1,126 @@
+#ifndef _APPLE2_HOSTDIR_H_
+#define _APPLE2_HOSTDIR_H_
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "apple2/bd.h"
+
+/*
+ * This is the layout of the volume we build. Blocks 0 and 1 are where
+ * the boot loader would go (we leave them empty); blocks 2 through 5
+ * are the volume directory; and then we have the volume bitmap. Files
+ * begin immediately after the bitmap.
+ */
+#define HOSTDIR_DIR_BLOCK 2
+#define HOSTDIR_DIR_BLOCKS 4
+#define HOSTDIR_BITMAP_BLOCK 6
+#define HOSTDIR_BITMAP_BLOCKS \
+    ((APPLE2_BD_MAX_BLOCKS + 4095) / 4096)
+#define HOSTDIR_FIRST_FILE_BLOCK \
+    (HOSTDIR_BITMAP_BLOCK + HOSTDIR_BITMAP_BLOCKS)
+
+/*
+ * Every directory entry is 39 bytes, and there are 13 to a block. The
+ * first entry in the volume directory is the volume header, which
+ * leaves room for 51 files.
+ */
+#define HOSTDIR_ENTRY_LENGTH 0x27
+#define HOSTDIR_ENTRIES_PER_BLOCK 0x0D
+#define HOSTDIR_MAX_FILES \
+    ((HOSTDIR_DIR_BLOCKS * HOSTDIR_ENTRIES_PER_BLOCK) - 1)
+
+/*
+ * The longest name ProDOS allows, and the largest file.
+ */
+#define HOSTDIR_NAME_MAX 15
+#define HOSTDIR_EOF_MAX 0xFFFFFF
+
+/*
+ * The storage types of ProDOS files we work with. (There are more,
+ * like subdirectories, but we only present plain files.)
+ */
+enum hostdir_storage {
+    HOSTDIR_SEEDLING = 1,
+    HOSTDIR_SAPLING = 2,
+    HOSTDIR_TREE = 3,
+};
+
+/*
+ * A file in the host directory, and where we've laid it out within the
+ * volume. The blocks of a file are contiguous: first the key block,
+ * then (for a tree) the index blocks, and then the data blocks.
+ */
+typedef struct {
+    char name[HOSTDIR_NAME_MAX + 1];
+    char *path;
+    vm_8bit type;
+    int storage;
+    size_t eof;
+    time_t mtime;
+
+    size_t start;
+    size_t nblocks;
+    size_t nindex;
+    size_t ndata;
+
+    /*
+     * Once this is true, every block of the file is held in the
+     * overlay, and we no longer read from the host file to generate
+     * its blocks.
+     */
+    bool pinned;
+} hostdir_file;
+
+/*
+ * What a directory entry looked like the last time we committed the
+ * volume back to the host. If the entry hasn't changed, and none of
+ * its blocks have been written since, we have nothing to do for it.
+ */
+typedef struct {
+    char name[HOSTDIR_NAME_MAX + 1];
+    int storage;
+    size_t key;
+    size_t eof;
+} hostdir_entry;
+
+typedef struct {
+    /*
+     * The host directory we are presenting, and the name of the volume
+     * we present it as.
+     */
+    char *dir;
+    char name[HOSTDIR_NAME_MAX + 1];
+
+    /*
+     * The files we found in the directory when we built the volume.
+     */
+    hostdir_file *files;
+    int nfiles;
+
+    /*
+     * The first block which isn't used by anything in the volume.
+     */
+    size_t first_free;
+
+    /*
+     * Any block that the guest writes is kept here; we read from the
+     * overlay before we try to generate anything. The dirty bitmap
+     * records which blocks have been written since our last commit.
+     */
+    vm_8bit **overlay;
+    vm_8bit *dirty;
+
+    /*
+     * The directory entries as of our last commit.
+     */
+    hostdir_entry *entries;
+    int nentries;
+} apple2_hostdir;
+
+extern int apple2_hostdir_commit(apple2bd *);
+extern int apple2_hostdir_insert(apple2bd *, const char *);
+extern int apple2_hostdir_name(char *, const char *);
+extern vm_8bit apple2_hostdir_type(const char *);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _APPLE2_NCACHE_H_
+#define _APPLE2_NCACHE_H_
+
+#include <stdint.h>
+
+#include "vm_segment.h"
+
+/*
+ * If we ever change the way we encode disk images, then everything
+ * already in a cache is wrong. Bumping this number changes every key we
+ * compute, which has the effect of starting over with an empty cache.
+ */
+#define NCACHE_VERSION 1
+
+/*
+ * The largest path we'll build for a cache entry.
+ */
+#define NCACHE_PATH_MAX 1024
+
+extern int apple2_ncache_path(char *, size_t, const char *, uint64_t, int);
+extern int apple2_ncache_store(const char *, vm_segment *);
+extern uint64_t apple2_ncache_key(int, vm_segment *);
+extern vm_segment *apple2_ncache_encode(int, vm_segment *);
+extern vm_segment *apple2_ncache_load(const char *);
+
+#endif
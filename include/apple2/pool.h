@@ -0,0 +1,151 @@
+#ifndef _APPLE2_POOL_H_
+#define _APPLE2_POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apple2/apple2.h"
+#include "vm_bits.h"
+
+/*
+ * A machine which polls the keyboard at least once every this many
+ * cycles of a slice, without finding a key, is only waiting for one. The
+ * monitor and BASIC poll about once every dozen cycles while they wait;
+ * a game which checks the keyboard once a frame is nowhere close.
+ */
+#define POOL_IDLE_CYCLES 64
+
+/*
+ * The number of keys we'll hold for a machine until it gets around to
+ * reading them.
+ */
+#define POOL_KEYS 64
+
+enum apple2_pool_state {
+    POOL_READY,         // in some worker's queue, waiting to run
+    POOL_RUNNING,       // being run by a worker right now
+    POOL_PARKED,        // waiting for a key, and in no queue at all
+    POOL_DONE,          // has used up its budget of cycles
+};
+
+/*
+ * An instance is a machine the pool is running, along with what the
+ * pool needs to know to run it fairly. We don't own the machine; you
+ * free it yourself, once you've freed the pool.
+ */
+typedef struct {
+    apple2 *mach;
+
+    /*
+     * The lock guards the state, and the keys we've been given but
+     * haven't typed into the machine yet.
+     */
+    pthread_mutex_t lock;
+    int state;
+    vm_8bit keys[POOL_KEYS];
+    int key_head;
+    int nkeys;
+
+    /*
+     * If budget is not zero, the instance is done once it has run that
+     * many cycles.
+     */
+    uint64_t budget;
+
+    /*
+     * The worker whose queue we go back into when we've been parked.
+     */
+    int home;
+
+    /*
+     * When we last went into a queue, in nanoseconds (see pool_now()).
+     */
+    uint64_t queued_at;
+
+    /*
+     * These are our statistics. Slices and cycles are how much we've
+     * been run; run_ns is how long that took; wait_ns is how long we've
+     * spent in queues, waiting to run, and max_wait_ns the longest we've
+     * waited at once. Parks is how many times we've been parked.
+     */
+    uint64_t slices;
+    uint64_t cycles;
+    uint64_t run_ns;
+    uint64_t wait_ns;
+    uint64_t max_wait_ns;
+    uint64_t parks;
+} apple2_pool_inst;
+
+struct apple2_pool;
+
+/*
+ * Each worker has a thread, and a queue of the instances it is going to
+ * run. It runs them from the front of the queue, and puts them back at
+ * the end; a worker with nothing to do steals from the end of someone
+ * else's queue.
+ */
+typedef struct {
+    struct apple2_pool *pool;
+    int id;
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    apple2_pool_inst **queue;
+    int head;
+    int count;
+    int cap;
+
+    uint64_t slices;
+    uint64_t steals;
+} apple2_pool_worker;
+
+typedef struct apple2_pool {
+    int nworkers;
+    apple2_pool_worker *workers;
+    uint64_t quantum;
+
+    /*
+     * Every instance we were given, whatever its state. This has a lock
+     * of its own, which comes first in the order we take locks (see
+     * apple2.pool.c).
+     */
+    pthread_mutex_t insts_lock;
+    apple2_pool_inst **insts;
+    int ninsts;
+    int cap;
+
+    /*
+     * The lock guards everything below it. Pending is the number of
+     * instances in all of the queues, and running the number being run
+     * at this moment. Workers with nothing to do wait on work; anyone
+     * waiting for the pool to go quiet waits on quiet.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t quiet;
+    int pending;
+    int running;
+    bool started;
+    bool stop;
+
+    /*
+     * The time at which we started, and how long we've spent running
+     * in all, so we can work out our throughput.
+     */
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+} apple2_pool;
+
+extern apple2_pool *apple2_pool_create(int, uint64_t);
+extern apple2_pool_inst *apple2_pool_add(apple2_pool *, apple2 *, uint64_t);
+extern double apple2_pool_fairness(apple2_pool *);
+extern int apple2_pool_key(apple2_pool *, apple2_pool_inst *, vm_8bit);
+extern int apple2_pool_start(apple2_pool *);
+extern void apple2_pool_free(apple2_pool *);
+extern void apple2_pool_stats_dump(apple2_pool *, FILE *);
+extern void apple2_pool_stop(apple2_pool *);
+extern void apple2_pool_wait(apple2_pool *);
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef _APPLE2_REFLECT_H_
+#define _APPLE2_REFLECT_H_
+
+/*
+ * Forward declaration of apple2_reflect, for the same reasons we have
+ * one in dd.h.
+ */
+struct apple2_reflect;
+typedef struct apple2_reflect apple2_reflect;
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "apple2/apple2.h"
+#include "vm_bits.h"
+
+/*
+ * This is how the shared memory begins, so that anyone who opens it
+ * can tell it's ours ("ERCR"), and which layout it has. If the layout
+ * below ever changes, the version must too.
+ */
+#define REFLECT_MAGIC 0x52435245
+#define REFLECT_VERSION 1
+
+/*
+ * The size of main and aux memory; this is APPLE2_MEMORY_SIZE, which we
+ * can't see from here without going in circles (mem.h includes
+ * apple2.h, which includes us).
+ */
+#define REFLECT_MEMORY_SIZE 0x11000
+
+/*
+ * This is what is in the shared memory. Everything in it is fixed in
+ * size, so a program written in anything at all can make sense of it,
+ * given this layout and the byte order of the machine we're running on.
+ *
+ * Since we don't stop to wait for anyone who is reading it, we use a
+ * sequence number to let them know when they've caught us in the
+ * middle of an update. The number is odd while we're writing, and goes
+ * up by two each frame. To read a consistent copy, a reader should:
+ *
+ *   1. read seq, and wait for it to be even;
+ *   2. copy whatever it wants;
+ *   3. read seq again, and start over if it's changed.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint32_t seq;
+
+    /*
+     * The size of this struct, so a reader can check it has mapped all
+     * of it.
+     */
+    uint32_t size;
+
+    /*
+     * The registers of the CPU.
+     */
+    uint16_t PC;
+    uint8_t A;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t P;
+    uint8_t S;
+
+    /*
+     * The soft-switch state: the display mode, memory mode, and bank
+     * switch flags (see apple2.h), and whether the keyboard strobe is
+     * set.
+     */
+    uint8_t display_mode;
+    uint8_t memory_mode;
+    uint8_t bank_switch;
+    uint8_t strobe;
+
+    /*
+     * Which drive is selected (1 or 2), and where the heads of both
+     * drives are, in half-tracks.
+     */
+    uint8_t selected_drive;
+    uint8_t track_pos[2];
+
+    /*
+     * The number of cycles the machine has run, the number of
+     * instructions, and the number of frames we've published.
+     */
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t frames;
+
+    /*
+     * Our performance counters: how fast the machine ran over the last
+     * frame, in emulated cycles per second of real time; how many times
+     * it polled the keyboard with no key waiting; and the host time, in
+     * nanoseconds, at which we published this frame.
+     */
+    uint64_t cycles_per_sec;
+    uint64_t kb_empty_polls;
+    uint64_t host_ns;
+
+    /*
+     * All of main and aux memory, just as it is in their segments. (The
+     * last 4k of each is the second bank of bank-switched RAM; see
+     * apple2.mem.c.)
+     */
+    vm_8bit main[REFLECT_MEMORY_SIZE];
+    vm_8bit aux[REFLECT_MEMORY_SIZE];
+} apple2_reflect_state;
+
+struct apple2_reflect {
+    /*
+     * The name of the shared memory object, its descriptor, and our
+     * mapping of it.
+     */
+    char *name;
+    int fd;
+    apple2_reflect_state *state;
+
+    /*
+     * The cycle count at which we'll next update the state, and the
+     * cycle count and host time of the last update.
+     */
+    uint64_t next;
+    uint64_t last_cycles;
+    uint64_t last_ns;
+
+    /*
+     * The number of instructions executed so far; whoever runs the
+     * machine counts these for us by calling apple2_reflect_tick().
+     */
+    uint64_t instructions;
+};
+
+extern apple2_reflect *apple2_reflect_create(const char *);
+extern void apple2_reflect_free(apple2_reflect *);
+extern void apple2_reflect_tick(apple2_reflect *, apple2 *);
+extern void apple2_reflect_update(apple2_reflect *, apple2 *);
+
+#endif
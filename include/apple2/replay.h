@@ -0,0 +1,101 @@
+#ifndef _APPLE2_REPLAY_H_
+#define _APPLE2_REPLAY_H_
+
+/*
+ * Forward declaration of apple2_replay, for the same reasons we have
+ * one in dd.h.
+ */
+struct apple2_replay;
+typedef struct apple2_replay apple2_replay;
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apple2/apple2.h"
+#include "vm_bits.h"
+
+/*
+ * After the state at the beginning of a recording, we write these four
+ * bytes and then the version of the event format. As with states, we
+ * won't replay a recording from a version we don't know.
+ */
+#define REPLAY_MAGIC "ERCR"
+#define REPLAY_VERSION 1
+
+enum apple2_replay_mode {
+    REPLAY_OFF,
+    REPLAY_RECORD,
+    REPLAY_PLAY,
+};
+
+/*
+ * These are the kinds of events we record; each is written as a tag
+ * byte followed by its data (see replay.c).
+ */
+enum apple2_replay_event {
+    REPLAY_KEY = 0x1,
+    REPLAY_NOISE = 0x2,
+    REPLAY_DISK = 0x3,
+};
+
+struct apple2_replay {
+    /*
+     * Whether we're recording, replaying, or neither; and the stream
+     * we're doing it with. We don't own the stream, and don't close it.
+     */
+    int mode;
+    FILE *stream;
+
+    /*
+     * The cycle count of the last timed event we wrote or replayed. Timed
+     * events record the cycles since the one before them, which keeps
+     * the numbers (and the stream) small.
+     */
+    uint64_t stamp;
+
+    /*
+     * When we are replaying, this is the tag of the next event in the
+     * stream, and (if it is timed) the cycle count at which the machine
+     * should see it.
+     */
+    int next;
+    uint64_t next_cycles;
+
+    /*
+     * Also when replaying: where in the stream the next event begins,
+     * which tells us how much of the stream the machine has seen.
+     */
+    long mark;
+
+    /*
+     * The keyboard as the machine has last seen it.
+     */
+    vm_8bit key;
+    bool pressed;
+
+    /*
+     * How many events we've written or read.
+     */
+    uint64_t events;
+
+    /*
+     * If quiet, we don't log it when we stop. The rewind ring keeps
+     * replays of its own, and stops and starts them all the time.
+     */
+    bool quiet;
+};
+
+extern apple2_replay *apple2_replay_create();
+extern int apple2_replay_disk(apple2_replay *, apple2 *, int);
+extern int apple2_replay_events(apple2_replay *, apple2 *, FILE *, int);
+extern int apple2_replay_insert(apple2_replay *, apple2 *, int, FILE *, int);
+extern int apple2_replay_play(apple2_replay *, apple2 *, FILE *);
+extern int apple2_replay_record(apple2_replay *, apple2 *, FILE *);
+extern vm_8bit apple2_replay_noise(apple2_replay *);
+extern void apple2_replay_put_noise(apple2_replay *, vm_8bit);
+extern void apple2_replay_free(apple2_replay *);
+extern void apple2_replay_stop(apple2_replay *);
+extern void apple2_replay_tick(apple2_replay *, apple2 *);
+
+#endif
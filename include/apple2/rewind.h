@@ -0,0 +1,115 @@
+#ifndef _APPLE2_REWIND_H_
+#define _APPLE2_REWIND_H_
+
+/*
+ * Forward declaration of apple2_rewind, for the same reasons we have
+ * one in dd.h.
+ */
+struct apple2_rewind;
+typedef struct apple2_rewind apple2_rewind;
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apple2/apple2.h"
+#include "apple2/replay.h"
+#include "vm_bits.h"
+
+/*
+ * We take a checkpoint of the machine every REWIND_INTERVAL cycles,
+ * which is about a tenth of a second of emulated time, and we keep
+ * REWIND_POINTS of them; so we can rewind about six seconds.
+ */
+#define REWIND_INTERVAL 100000
+#define REWIND_POINTS 64
+
+/*
+ * A checkpoint in the rewind ring. The newest checkpoint is kept in
+ * full (see the last field of apple2_rewind); every other checkpoint is
+ * kept as a delta which, applied to the state of the checkpoint after
+ * it, gives us its own state. Most of memory doesn't change from one
+ * checkpoint to the next, so the deltas are usually quite small.
+ */
+typedef struct {
+    /*
+     * The cycle count of the machine when we took the checkpoint.
+     */
+    uint64_t cycles;
+
+    /*
+     * The delta (NULL for the newest checkpoint), and the length of the
+     * state it produces.
+     */
+    vm_8bit *delta;
+    size_t delta_len;
+    size_t len;
+
+    /*
+     * What came into the machine from outside between this checkpoint
+     * and the next (or now, for the newest), written as replay events
+     * (see replay.c): the noise it was given, and any change in the
+     * keyboard or the disk drives.
+     */
+    char *events;
+    size_t events_len;
+} apple2_rewind_point;
+
+struct apple2_rewind {
+    /*
+     * The checkpoints we have, as a ring; first is the oldest, and
+     * there are count of them.
+     */
+    apple2_rewind_point points[REWIND_POINTS];
+    int first;
+    int count;
+
+    /*
+     * The full state of the newest checkpoint.
+     */
+    vm_8bit *last;
+    size_t last_len;
+
+    /*
+     * How many cycles we wait between checkpoints, and the cycle count
+     * at which we'll take the next one.
+     */
+    uint64_t interval;
+    uint64_t next;
+
+    /*
+     * The replay we write the newest checkpoint's events with, and the
+     * replay we read events back with when we run forward from a
+     * checkpoint; and the streams they use, which we own.
+     */
+    apple2_replay *log;
+    apple2_replay *play;
+    FILE *out;
+    FILE *in;
+
+    /*
+     * We're rewound when we've restored the newest checkpoint, and are
+     * replaying its events rather than writing them; and we're running
+     * when apple2_rewind_run_to() is taking us forward.
+     */
+    bool rewound;
+    bool running;
+};
+
+extern apple2_rewind *apple2_rewind_create(uint64_t);
+extern int apple2_rewind_checkpoint(apple2_rewind *, apple2 *);
+extern int apple2_rewind_continue(apple2_rewind *, apple2 *);
+extern int apple2_rewind_disk(apple2_rewind *, apple2 *, int);
+extern vm_8bit apple2_rewind_noise(apple2_rewind *, apple2 *);
+extern int apple2_rewind_restore(apple2_rewind *, apple2 *, int);
+extern int apple2_rewind_run_to(apple2 *, uint64_t);
+extern int apple2_rewind_step(apple2_rewind *, apple2 *);
+extern size_t apple2_rewind_delta(vm_8bit **, const vm_8bit *, size_t,
+                                  const vm_8bit *, size_t);
+extern vm_8bit *apple2_rewind_patch(const vm_8bit *, size_t, const vm_8bit *,
+                                    size_t, size_t);
+extern void apple2_rewind_clear(apple2_rewind *);
+extern void apple2_rewind_free(apple2_rewind *);
+extern void apple2_rewind_tick(apple2_rewind *, apple2 *);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _APPLE2_RUNAHEAD_H_
+#define _APPLE2_RUNAHEAD_H_
+
+#include "apple2/apple2.h"
+
+/*
+ * The most frames we'll run ahead. Much more than a few, and what you
+ * see starts to guess at input you haven't given yet.
+ */
+#define RUNAHEAD_MAX_FRAMES 8
+
+extern apple2 *apple2_runahead(apple2 *, int);
+extern void apple2_runahead_draw(apple2 *, int);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _APPLE2_SNAP_H_
+#define _APPLE2_SNAP_H_
+
+#include <stdint.h>
+
+#include "apple2/apple2.h"
+
+/*
+ * If we ever change what goes into a snapshot key, then every snapshot
+ * already in a cache is suspect; bumping this number changes every key
+ * we compute.
+ */
+#define SNAP_VERSION 1
+
+/*
+ * The largest path we'll build for a snapshot.
+ */
+#define SNAP_PATH_MAX 1024
+
+/*
+ * We consider the machine to be idle once it has polled the keyboard
+ * this many times in a row without finding a key. A program waiting at
+ * a prompt polls the keyboard all the time; a program that's still
+ * booting generally doesn't poll it at all.
+ */
+#define SNAP_IDLE_POLLS 10000
+
+extern int apple2_snap_path(char *, size_t, const char *, uint64_t);
+extern int apple2_snap_restore(apple2 *);
+extern int apple2_snap_store(apple2 *);
+extern uint64_t apple2_snap_key(apple2 *);
+extern void apple2_snap_idle(apple2 *);
+extern void apple2_snap_poll(apple2 *, bool);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _APPLE2_STATE_H_
+#define _APPLE2_STATE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apple2/apple2.h"
+#include "vm_bits.h"
+
+/*
+ * Every state file begins with these four bytes, and then the version
+ * of the format it was written in. If we change the format in any way,
+ * we must bump the version; we won't try to load a state from a version
+ * we don't know.
+ */
+#define STATE_MAGIC "ERCS"
+#define STATE_VERSION 1
+
+/*
+ * This is the length of the header which precedes the state data in a
+ * file (see state.c for its layout).
+ */
+#define STATE_HEADER_SIZE 32
+
+/*
+ * These are the flags you may pass when saving a state. If the state
+ * is compressed, it is smaller, but it can't be loaded directly out of
+ * a mapping of the file; we have to inflate it first.
+ */
+enum apple2_state_flags {
+    STATE_DEFAULT = 0x0,
+    STATE_COMPRESS = 0x1,
+};
+
+/*
+ * A buffer which we serialize a machine into, or deserialize it from.
+ * When we are reading, the size is the length of the data, and pos is
+ * where we will read next; when we are writing, the size is how much
+ * room we've allocated, and pos is how much of it we've used.
+ */
+typedef struct {
+    vm_8bit *data;
+    size_t size;
+    size_t pos;
+
+    /*
+     * If we ever read beyond the end of the data, or we can't get the
+     * memory we need to write more, this is set to an error code, and
+     * everything else we do with the buffer is ignored.
+     */
+    int err;
+} apple2_state_buf;
+
+extern int apple2_state_decode(apple2 *, const vm_8bit *, size_t);
+extern int apple2_state_encode(apple2 *, apple2_state_buf *);
+extern int apple2_state_load(apple2 *, FILE *);
+extern int apple2_state_save(apple2 *, FILE *, int);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef _APPLE2_TEXT_H_
 #define _APPLE2_TEXT_H_
 
+#include <stdio.h>
+
 #include "apple2/apple2.h"
 #include "vm_bitfont.h"
 #include "vm_bits.h"
@@ -11,5 +13,6 @@ extern int apple2_text_area(vm_area *, vm_bitfont *, size_t);
 extern int apple2_text_col(size_t);
 extern int apple2_text_row(size_t);
 extern void apple2_text_draw(apple2 *, size_t);
+extern void apple2_text_dump(apple2 *, FILE *);
 
 #endif
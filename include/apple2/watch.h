@@ -0,0 +1,92 @@
+#ifndef _APPLE2_WATCH_H_
+#define _APPLE2_WATCH_H_
+
+/*
+ * Forward declaration of apple2_watch, for the same reasons we have one
+ * in dd.h.
+ */
+struct apple2_watch;
+typedef struct apple2_watch apple2_watch;
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apple2/apple2.h"
+#include "vm_bits.h"
+#include "vm_segment.h"
+
+/*
+ * The most watchpoints we'll keep at once.
+ */
+#define WATCH_MAX 16
+
+/*
+ * The number of pages (of 256 bytes) in the address space of the CPU,
+ * which is what we watch.
+ */
+#define WATCH_PAGES 0x100
+
+/*
+ * The kinds of access a watchpoint can catch: any read, any write, or
+ * a write which changes what's in memory. A watchpoint may catch more
+ * than one kind.
+ */
+enum watch_kind {
+    WATCH_READ = 0x1,
+    WATCH_WRITE = 0x2,
+    WATCH_CHANGE = 0x4,
+};
+
+typedef struct {
+    vm_16bit from;
+    vm_16bit to;
+    int kind;
+
+    /*
+     * The number of times we caught an access.
+     */
+    uint64_t hits;
+} apple2_watch_point;
+
+struct apple2_watch {
+    /*
+     * The machine we watch. A fork of it shares our read and write
+     * mappers, and so needs us to find the mappers we displaced (see
+     * apple2_fork()); but we only report what the machine itself does.
+     */
+    apple2 *mach;
+
+    apple2_watch_point points[WATCH_MAX];
+    int npoints;
+
+    /*
+     * The read and write mappers which were in main and aux memory for
+     * each address before we put our own there, which we call in turn;
+     * the pages we haven't watched anything on are NULL.
+     */
+    vm_segment_read_fn *reads[2][WATCH_PAGES];
+    vm_segment_write_fn *writes[2][WATCH_PAGES];
+
+    /*
+     * A bit for each address in main and aux memory, which is set if our
+     * mappers are somewhere in its chain of mappers. That may not be at
+     * the top, if something (like the heatmap) put its own mappers in
+     * after ours; so we can't just look at the segment's tables to know.
+     */
+    vm_8bit hooked[2][WATCH_PAGES * 0x100 / 8];
+
+    /*
+     * If this is true, we don't report anything we catch. (We are
+     * quiet while the machine is replaying what it's already done.)
+     */
+    bool quiet;
+};
+
+extern int apple2_watch_add(apple2 *, vm_16bit, vm_16bit, int);
+extern int apple2_watch_kind(const char *);
+extern int apple2_watch_remove(apple2 *, vm_16bit);
+extern void apple2_watch_dump(apple2_watch *, FILE *);
+extern void apple2_watch_free(apple2_watch *);
+
+#endif
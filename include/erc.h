@@ -0,0 +1,79 @@
+#ifndef _ERC_H_
+#define _ERC_H_
+
+/*
+ * This is the interface to liberc, for programs which want to run
+ * emulated machines themselves rather than by way of the erc program.
+ * Nothing here needs SDL to be initialized, or anything to be put in
+ * the DI container; you can have as many machines as you like, and run
+ * each from whatever thread you like (though only from one thread at a
+ * time).
+ *
+ * A simple job might look like this:
+ *
+ *   erc_machine *m = erc_create();
+ *   erc_insert(m, 1, "game.dsk", ERC_DISK_DEFAULT);
+ *   erc_reset(m);
+ *   erc_run(m, 1000000);
+ *   erc_text(m, buf, sizeof(buf));
+ *   erc_free(m);
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * The functions which can fail return ERC_OK, or one of these errors.
+ */
+enum erc_status {
+    ERC_OK = 1,
+    ERC_ERR_OOM,        // out of memory
+    ERC_ERR_OOB,        // out of bounds
+    ERC_ERR_BADFILE,    // a file we couldn't use
+    ERC_ERR_BADOPT,     // a bad argument
+    ERC_ERR_INVALID,    // something we can't do right now
+};
+
+enum erc_disk_flags {
+    ERC_DISK_DEFAULT = 0x0,
+
+    /*
+     * Write changes to the disk back to its file when it's ejected (or
+     * when the machine is freed). Without this, whatever the machine
+     * writes to the disk is lost once it's gone.
+     */
+    ERC_DISK_WRITE = 0x1,
+};
+
+/*
+ * The framebuffer is the hires screen, as 24-bit RGB dots; the text
+ * screen is 24 lines of 40 characters, each ending in a newline, and
+ * then a NUL.
+ */
+#define ERC_FRAME_WIDTH 280
+#define ERC_FRAME_HEIGHT 192
+#define ERC_FRAME_SIZE (ERC_FRAME_WIDTH * ERC_FRAME_HEIGHT * 3)
+#define ERC_TEXT_SIZE ((24 * 41) + 1)
+
+typedef struct erc_machine erc_machine;
+
+extern bool erc_key_ready(erc_machine *);
+extern erc_machine *erc_create();
+extern int erc_frame(erc_machine *, uint8_t *, size_t);
+extern int erc_insert(erc_machine *, int, const char *, int);
+extern int erc_key(erc_machine *, uint8_t);
+extern int erc_load(erc_machine *, const uint8_t *, size_t);
+extern int erc_read(erc_machine *, uint16_t, uint8_t *, size_t);
+extern int erc_save(erc_machine *, uint8_t **, size_t *);
+extern int erc_text(erc_machine *, char *, size_t);
+extern int erc_write(erc_machine *, uint16_t, const uint8_t *, size_t);
+extern uint64_t erc_cycles(erc_machine *);
+extern uint64_t erc_run(erc_machine *, uint64_t);
+extern void erc_eject(erc_machine *, int);
+extern void erc_free(erc_machine *);
+extern void erc_log(FILE *);
+extern void erc_reset(erc_machine *);
+
+#endif
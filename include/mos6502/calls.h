@@ -0,0 +1,100 @@
+#ifndef _MOS6502_CALLS_H_
+#define _MOS6502_CALLS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mos6502/mos6502.h"
+
+/*
+ * The deepest our shadow call stack goes. Each JSR pushes two bytes on
+ * the real stack, so the real one can't hold more than 128 calls; but
+ * software that abandons its calls without returning from them, and
+ * never pulls their addresses off the stack either, could fool us into
+ * going deeper. Past this, we stop following.
+ */
+#define CALLS_MAX_DEPTH 256
+
+/*
+ * The most nodes we'll have in our call tree. A node is a subroutine,
+ * as called by way of one particular chain of callers; once we have
+ * this many, new chains are counted with the deepest caller we already
+ * know.
+ */
+#define CALLS_MAX_NODES 65536
+
+/*
+ * This is a frame on our shadow call stack.
+ */
+typedef struct {
+    /*
+     * The node in the call tree for this call.
+     */
+    int node;
+
+    /*
+     * The address of the subroutine that was called, and the value of
+     * the S register before the call. Once S is back up to that, the
+     * return address is gone from the stack, and so is the call--
+     * whether the subroutine returned with an RTS, or pulled the address
+     * off the stack and went elsewhere. (S may have wrapped around the
+     * stack page to get there; see mos6502_calls_count().)
+     */
+    vm_16bit addr;
+    vm_8bit S;
+
+    /*
+     * The cycle count when the call was made.
+     */
+    uint64_t start;
+} mos6502_calls_frame;
+
+/*
+ * A node in the call tree. The root of the tree (node zero) is
+ * everything that ran outside of any call we saw made.
+ */
+typedef struct {
+    vm_16bit addr;
+    int parent;
+    int child;
+    int sibling;
+
+    /*
+     * The cycles spent in this node's subroutine itself, not counting
+     * the subroutines it called.
+     */
+    uint64_t cycles;
+} mos6502_calls_node;
+
+struct mos6502_calls {
+    mos6502_calls_frame stack[CALLS_MAX_DEPTH];
+    int depth;
+
+    mos6502_calls_node *nodes;
+    int nnodes;
+    int cap;
+
+    /*
+     * For every subroutine, the number of times it was called; the
+     * cycles spent in it, and in everything it called (its inclusive
+     * cycles); and the cycles spent in it alone (its exclusive cycles).
+     */
+    uint64_t calls[MOS6502_MEMSIZE];
+    uint64_t inclusive[MOS6502_MEMSIZE];
+    uint64_t exclusive[MOS6502_MEMSIZE];
+
+    /*
+     * The cycles spent outside of any call, and in all.
+     */
+    uint64_t top_cycles;
+    uint64_t cycles;
+};
+
+extern int mos6502_calls_start(mos6502 *);
+extern void mos6502_calls_count(mos6502_calls *, mos6502 *, vm_8bit, int);
+extern void mos6502_calls_dump(mos6502_calls *, FILE *, int);
+extern void mos6502_calls_folded(mos6502_calls *, FILE *);
+extern void mos6502_calls_free(mos6502_calls *);
+extern void mos6502_calls_stop(mos6502 *);
+
+#endif
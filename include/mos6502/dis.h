@@ -12,6 +12,7 @@ extern void mos6502_dis_jump_label(mos6502 *, vm_16bit, int, int);
 extern void mos6502_dis_jump_unlabel(int);
 extern void mos6502_dis_label(char *, int, int);
 extern void mos6502_dis_operand(mos6502 *, char *, int, int, int, vm_16bit);
+extern void mos6502_dis_print(mos6502 *, FILE *, int, vm_8bit, vm_16bit);
 extern void mos6502_dis_scan(mos6502 *, FILE *, int, int);
 
 #endif
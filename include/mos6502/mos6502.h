@@ -2,6 +2,7 @@
 #define _MOS6502_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "vm_bits.h"
 #include "vm_segment.h"
@@ -12,6 +13,18 @@
  */
 #define MOS6502_MEMSIZE     65536
 
+/*
+ * The profiles a CPU may keep of what it executes (see mos6502.prof.c),
+ * and of the calls it makes (see mos6502.calls.c); and the trace it may
+ * record (see mos6502.trace.c).
+ */
+struct mos6502_prof;
+typedef struct mos6502_prof mos6502_prof;
+struct mos6502_calls;
+typedef struct mos6502_calls mos6502_calls;
+struct mos6502_trace;
+typedef struct mos6502_trace mos6502_trace;
+
 /*
  * This is a small macro to make it a bit simpler to set bytes ahead of
  * the PC register position; useful in testing.
@@ -125,6 +138,14 @@ typedef struct {
      */
     vm_16bit PC;
 
+    /*
+     * The number of cycles the processor has spent since it was
+     * created. This isn't a register, of course; but it's the only
+     * clock we have, and other parts of the machine (like the disk
+     * drives) use it to tell how much time has passed.
+     */
+    uint64_t cycles;
+
     /*
      * This is the accumulator register. It's used in most arithmetic
      * operations, and anything like that which you need to do will end
@@ -150,6 +171,14 @@ typedef struct {
      * far into the stack we've gone.
      */
     vm_8bit S;
+
+    /*
+     * If these aren't NULL, we count everything we execute into them.
+     * They're ours; we free them when we're freed.
+     */
+    mos6502_prof *prof;
+    mos6502_calls *calls;
+    mos6502_trace *trace;
 } mos6502;
 
 /*
@@ -173,6 +202,7 @@ extern mos6502 *mos6502_create(vm_segment *, vm_segment *);
 extern mos6502_instruction_handler mos6502_get_instruction_handler(vm_8bit);
 extern vm_16bit mos6502_get16(mos6502 *, size_t);
 extern vm_8bit mos6502_get(mos6502 *, size_t);
+extern vm_8bit mos6502_peek(mos6502 *, size_t);
 extern vm_8bit mos6502_pop_stack(mos6502 *);
 extern void mos6502_execute(mos6502 *);
 extern void mos6502_free(mos6502 *);
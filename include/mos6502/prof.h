@@ -0,0 +1,48 @@
+#ifndef _MOS6502_PROF_H_
+#define _MOS6502_PROF_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mos6502/mos6502.h"
+
+/*
+ * The number of address modes we count (see enum addr_mode in
+ * mos6502.enums.h).
+ */
+#define PROF_MODES 16
+
+/*
+ * How many hot spots we show in a dump, unless we're told otherwise.
+ */
+#define PROF_HOT_SPOTS 20
+
+/*
+ * A profile of what the CPU has executed: for every address, opcode,
+ * and address mode, the number of instructions we executed there (or
+ * with it), and the number of cycles those instructions took. A CPU
+ * only keeps a profile if it's been given one (see
+ * mos6502_prof_start()); one which hasn't pays nothing more for it than
+ * a NULL check.
+ */
+struct mos6502_prof {
+    uint64_t pc_execs[MOS6502_MEMSIZE];
+    uint64_t pc_cycles[MOS6502_MEMSIZE];
+
+    uint64_t op_execs[256];
+    uint64_t op_cycles[256];
+
+    uint64_t mode_execs[PROF_MODES];
+    uint64_t mode_cycles[PROF_MODES];
+
+    uint64_t execs;
+    uint64_t cycles;
+};
+
+extern int mos6502_prof_start(mos6502 *);
+extern void mos6502_prof_clear(mos6502_prof *);
+extern void mos6502_prof_count(mos6502_prof *, vm_16bit, vm_8bit, int, int);
+extern void mos6502_prof_dump(mos6502 *, FILE *, int);
+extern void mos6502_prof_stop(mos6502 *);
+
+#endif
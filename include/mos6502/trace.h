@@ -0,0 +1,106 @@
+#ifndef _MOS6502_TRACE_H_
+#define _MOS6502_TRACE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mos6502/mos6502.h"
+
+/*
+ * A trace file begins with this ("ERCT"), and the version of the record
+ * layout below; if that ever changes, the version must too.
+ */
+#define TRACE_MAGIC 0x54435245
+#define TRACE_VERSION 1
+
+/*
+ * The number of records the ring buffer holds. This must be a power of
+ * two.
+ */
+#define TRACE_RING (1 << 16)
+
+/*
+ * How long the flusher sleeps, in microseconds, when it finds nothing
+ * to write.
+ */
+#define TRACE_FLUSH_USEC 1000
+
+/*
+ * A record of one instruction, as the CPU was just before it executed
+ * it--plus the effective address it used, which we only know after.
+ * Records are written to the trace file just as they are here, in the
+ * byte order of the machine we're running on.
+ */
+typedef struct {
+    uint64_t cycles;
+    uint16_t PC;
+    uint16_t eff_addr;
+    uint8_t opcode;
+    uint8_t oper[2];
+    uint8_t A;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t P;
+    uint8_t S;
+} mos6502_trace_rec;
+
+/*
+ * And this is how a trace file begins.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rec_size;
+    uint32_t reserved;
+} mos6502_trace_header;
+
+struct mos6502_trace {
+    /*
+     * The ring of records. The CPU adds records at head, and the
+     * flusher thread writes them out from tail; each only ever changes
+     * its own.
+     */
+    mos6502_trace_rec *ring;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+
+    FILE *stream;
+    pthread_t flusher;
+    atomic_bool stop;
+
+    /*
+     * We only record instructions whose address is between lo and hi,
+     * inclusive; and of those, only one in every sample of them.
+     * skipped counts down to the next one we record.
+     */
+    vm_16bit lo;
+    vm_16bit hi;
+    unsigned int sample;
+    unsigned int skipped;
+
+    /*
+     * The number of records we've made, and the number of times we
+     * found the ring full and had to wait for the flusher.
+     */
+    uint64_t records;
+    uint64_t stalls;
+
+    /*
+     * If we couldn't write to the stream, this is ERR_BADFILE, and we
+     * stop recording.
+     */
+    _Atomic int err;
+};
+
+extern int mos6502_trace_decode(FILE *, FILE *);
+extern int mos6502_trace_start(mos6502 *, FILE *, vm_16bit, vm_16bit,
+                               unsigned int);
+extern mos6502_trace_rec *mos6502_trace_next(mos6502_trace *, mos6502 *);
+extern void mos6502_trace_commit(mos6502_trace *, mos6502 *);
+extern void mos6502_trace_free(mos6502_trace *);
+extern void mos6502_trace_stop(mos6502 *);
+
+#endif
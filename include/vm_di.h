@@ -4,6 +4,9 @@
 enum vm_di_entry {
     VM_CPU,
     VM_MACHINE,
+
+    // The name of a shared memory object into which we should publish
+    // the machine's state as it runs
     VM_REFLECT,
     VM_OUTPUT,
 
@@ -26,6 +29,55 @@ enum vm_di_entry {
     // The log file to which we will output our disassembly
     VM_DISASM_LOG,
 
+    // The directory where we keep nibbilized copies of disk images we
+    // have encoded before
+    VM_NIBCACHE,
+
+    // A ProDOS volume to put in the block device
+    VM_VOLUME,
+
+    // A host directory to present as a ProDOS volume in the block
+    // device
+    VM_HOSTDIR,
+
+    // A saved machine state to load once we've booted
+    VM_STATE,
+
+    // The directory where we keep snapshots of machines that have
+    // finished booting
+    VM_SNAPCACHE,
+
+    // A stream to record the machine's inputs into, or to replay them
+    // from
+    VM_RECORD,
+    VM_REPLAY,
+
+    // The number of frames we should run ahead when we draw the screen
+    VM_RUNAHEAD,
+
+    // A stream to write a profile of what the CPU executed into, when
+    // we're done
+    VM_PROFILE,
+
+    // A stream to write the call graph of what the CPU executed into,
+    // as folded stacks, when we're done
+    VM_CALLGRAPH,
+
+    // A stream to write a binary trace of what the CPU executes into;
+    // the range of addresses to trace, as two ints; and the number of
+    // instructions we sample one of
+    VM_TRACE,
+    VM_TRACE_RANGE,
+    VM_TRACE_SAMPLE,
+
+    // The address (a port, host:port, or path to a UNIX socket) at
+    // which we listen for a remote debugger
+    VM_GDB,
+
+    // A stream to write the counts of the machine's memory accesses
+    // into, as CSV, when we're done
+    VM_HEATMAP,
+
     // This value is the size of the DI container we will construct. As
     // you can see, it's quite a bit higher than what would be implied
     // by the number of enum values currently defined--and it is so we
@@ -0,0 +1,19 @@
+#ifndef _VM_HASH_H_
+#define _VM_HASH_H_
+
+#include <stdint.h>
+
+#include "vm_bits.h"
+#include "vm_segment.h"
+
+/*
+ * This is the starting value of any hash we compute. (It's the 64-bit
+ * FNV offset basis, if you care about that sort of thing.)
+ */
+#define VM_HASH_INIT 0xcbf29ce484222325ULL
+
+extern uint64_t vm_hash_buf(uint64_t, const vm_8bit *, size_t);
+extern uint64_t vm_hash_int(uint64_t, uint64_t);
+extern uint64_t vm_hash_segment(uint64_t, vm_segment *);
+
+#endif
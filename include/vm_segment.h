@@ -1,6 +1,8 @@
 #ifndef _VM_SEGMENT_H_
 #define _VM_SEGMENT_H_
 
+#include <stdbool.h>
+
 #include "vm_bits.h"
 #include "log.h"
 
@@ -35,6 +37,28 @@ typedef void (*vm_segment_write_fn)(vm_segment *, size_t, vm_8bit, void *);
 #define vm_segment_bounds_check(segment, index) \
 	(index == index % segment->size)
 
+/*
+ * When a segment is forked, its memory is frozen into a shared object
+ * which the segment and its fork both map privately (see
+ * vm_segment_fork()). This is that object; it's freed when the last
+ * segment which maps it is freed.
+ */
+typedef struct {
+    int refs;
+
+    /*
+     * The descriptor of the shared object, and the length of it (which
+     * is the size of the segment, rounded up to a whole page).
+     */
+    int fd;
+    size_t len;
+
+    /*
+     * A read-only view of what's in the shared object.
+     */
+    const vm_8bit *view;
+} vm_segment_base;
+
 struct vm_segment {
 
     /*
@@ -57,19 +81,63 @@ struct vm_segment {
      */
     vm_segment_read_fn *read_table;
     vm_segment_write_fn *write_table;
+
+    /*
+     * If true, then the memory field was not allocated by us, but is a
+     * private mapping of a file (see vm_segment_map()). That memory must
+     * be unmapped rather than freed.
+     */
+    bool mapped;
+
+    /*
+     * This is given to the read and write mappers, so they know which
+     * machine they are working for. If it's NULL, they are given
+     * whatever machine is in the DI container.
+     */
+    void *mach;
+
+    /*
+     * If the segment has been forked, or is itself a fork, then this is
+     * the frozen memory that its own memory is a private mapping of.
+     */
+    vm_segment_base *base;
+
+    /*
+     * A fork shares the read and write tables of the segment it was
+     * forked from, until one of them maps an address of its own. This
+     * counts the segments sharing the tables; it's NULL if we have
+     * never shared them.
+     */
+    int *table_refs;
+
+    /*
+     * If these are non-NULL, they are how we peek at (and poke into)
+     * an address; see vm_segment_peek(). They're given the same things
+     * a read or write mapper is, but unlike a mapper, they must never
+     * change anything but the byte they're asked to poke.
+     */
+    vm_segment_read_fn peek;
+    vm_segment_write_fn poke;
 };
 
 extern int vm_segment_copy(vm_segment *, vm_segment *, size_t, size_t, size_t);
 extern int vm_segment_copy_buf(vm_segment *, const vm_8bit *, size_t, size_t, size_t);
 extern int vm_segment_fread(vm_segment *, FILE *, size_t, size_t);
 extern int vm_segment_fwrite(vm_segment *, FILE *, size_t, size_t);
+extern int vm_segment_peek_range(vm_segment *, vm_8bit *, size_t, size_t);
+extern int vm_segment_poke(vm_segment *, size_t, vm_8bit);
 extern int vm_segment_read_map(vm_segment *, size_t, vm_segment_read_fn);
+extern int vm_segment_read_range(vm_segment *, vm_8bit *, size_t, size_t);
 extern int vm_segment_set(vm_segment *, size_t, vm_8bit);
 extern int vm_segment_set16(vm_segment *, size_t, vm_16bit);
 extern int vm_segment_write_map(vm_segment *, size_t, vm_segment_write_fn);
+extern int vm_segment_write_range(vm_segment *, const vm_8bit *, size_t, size_t);
 extern vm_16bit vm_segment_get16(vm_segment *, size_t);
 extern vm_8bit vm_segment_get(vm_segment *, size_t);
+extern vm_8bit vm_segment_peek(vm_segment *, size_t);
 extern vm_segment *vm_segment_create(size_t);
+extern vm_segment *vm_segment_fork(vm_segment *);
+extern vm_segment *vm_segment_map(int, size_t);
 extern void vm_segment_free(vm_segment *);
 extern void vm_segment_hexdump(vm_segment *, FILE *, size_t, size_t);
 
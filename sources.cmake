@@ -1,6 +1,9 @@
 set(erc_sources
 	apple2/apple2.c
 	apple2/bank.c
+	apple2/bd.c
+	apple2/cond.c
+	apple2/conv.c
 	apple2/dbuf.c
 	apple2/dd.c
 	apple2/debug.c
@@ -8,28 +11,45 @@ set(erc_sources
 	apple2/draw.c
 	apple2/enc.c
 	apple2/event.c
+	apple2/gdb.c
+	apple2/heat.c
 	apple2/hires.c
+	apple2/hostdir.c
 	apple2/kb.c
 	apple2/lores.c
 	apple2/mem.c
+	apple2/ncache.c
 	apple2/pc.c
+	apple2/pool.c
+	apple2/reflect.c
+	apple2/replay.c
+	apple2/rewind.c
+	apple2/runahead.c
+	apple2/snap.c
+	apple2/state.c
 	apple2/text.c
+	apple2/watch.c
+	erc.c
 	log.c
 	mos6502/mos6502.c
 	mos6502/addr.c
 	mos6502/arith.c
 	mos6502/bits.c
 	mos6502/branch.c
+	mos6502/calls.c
 	mos6502/dis.c
 	mos6502/exec.c
 	mos6502/loadstor.c
+	mos6502/prof.c
 	mos6502/stat.c
+	mos6502/trace.c
 	objstore.c
 	option.c
 	vm_area.c
 	vm_bitfont.c
 	vm_di.c
 	vm_event.c
+	vm_hash.c
 	vm_screen.c
 	vm_segment.c
 	)
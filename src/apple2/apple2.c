@@ -11,9 +11,16 @@
 #include "apple2/apple2.h"
 #include "apple2/debug.h"
 #include "apple2/draw.h"
+#include "apple2/hostdir.h"
 #include "apple2/mem.h"
+#include "apple2/runahead.h"
+#include "apple2/snap.h"
+#include "apple2/state.h"
 #include "mos6502/dis.h"
+#include "mos6502/calls.h"
 #include "mos6502/enums.h"
+#include "mos6502/prof.h"
+#include "mos6502/trace.h"
 #include "objstore.h"
 #include "option.h"
 #include "vm_di.h"
@@ -52,6 +59,9 @@ apple2_create(int width, int height)
     mach->paused = false;
     mach->debug = false;
     mach->disasm = false;
+    mach->snap_pending = false;
+    mach->kb_polls = 0;
+    mach->kb_empty_polls = 0;
 
     // Forward set these to NULL in case we fail to build the machine
     // properly; that way, we won't try to free garbage data
@@ -65,6 +75,13 @@ apple2_create(int width, int height)
     mach->drive1 = NULL;
     mach->drive2 = NULL;
     mach->selected_drive = NULL;
+    mach->blockdev = NULL;
+    mach->rewind = NULL;
+    mach->replay = NULL;
+    mach->reflect = NULL;
+    mach->watch = NULL;
+    mach->gdb = NULL;
+    mach->heat = NULL;
 
     // This is more-or-less the same setup you do in apple2_reset(). We
     // need to hard-set these values because apple2_set_bank_switch
@@ -120,6 +137,27 @@ apple2_create(int width, int height)
     // By default, the selected drive should be drive1
     mach->selected_drive = mach->drive1;
 
+    mach->blockdev = apple2_bd_create();
+    if (mach->blockdev == NULL) {
+        log_crit("Could not create block device!");
+        apple2_free(mach);
+        return NULL;
+    }
+
+    mach->rewind = apple2_rewind_create(REWIND_INTERVAL);
+    if (mach->rewind == NULL) {
+        log_crit("Could not create rewind ring!");
+        apple2_free(mach);
+        return NULL;
+    }
+
+    mach->replay = apple2_replay_create();
+    if (mach->replay == NULL) {
+        log_crit("Could not create replay!");
+        apple2_free(mach);
+        return NULL;
+    }
+
     // Let's build our screen abstraction!
     mach->screen = vm_screen_create();
     if (mach->screen == NULL) {
@@ -163,6 +201,114 @@ apple2_create(int width, int height)
     return mach;
 }
 
+/*
+ * Return a fork of the given machine: a new machine in exactly the
+ * state the parent is in, which from then on goes its own way. This is
+ * cheap, since the fork shares the parent's memory until one of them
+ * writes to it (see vm_segment_fork()); you can fork the same machine
+ * thousands of times, and try something different in each.
+ *
+ * A fork has no window and no fonts; it's meant to be run, not looked
+ * at. Its disks are never saved, and its block device is read-only
+ * (and must be freed before the parent's).
+ */
+apple2 *
+apple2_fork(apple2 *parent)
+{
+    apple2 *mach;
+
+    mach = malloc(sizeof(apple2));
+    if (mach == NULL) {
+        log_crit("Could not allocate memory for machine fork");
+        return NULL;
+    }
+
+    // Most of the state of the machine is in fields we can simply
+    // copy; the rest we must fork or build for ourselves.
+    *mach = *parent;
+
+    mach->cpu = NULL;
+    mach->main = NULL;
+    mach->aux = NULL;
+    mach->rom = NULL;
+    mach->screen = NULL;
+    mach->sysfont = NULL;
+    mach->invfont = NULL;
+    mach->drive1 = NULL;
+    mach->drive2 = NULL;
+    mach->selected_drive = NULL;
+    mach->blockdev = NULL;
+    mach->rewind = NULL;
+    mach->replay = NULL;
+    mach->reflect = NULL;
+    mach->gdb = NULL;
+
+    // But we keep the parent's watchpoints (and its heatmap): our
+    // memory starts out with its mappers, and if any of those are
+    // watchpoints, they'll need to find the mappers they displaced.
+    // (They won't report or count what we do.)
+
+    mach->paused = false;
+    mach->debug = false;
+    mach->disasm = false;
+    mach->snap_pending = false;
+
+    mach->main = vm_segment_fork(parent->main);
+    mach->aux = vm_segment_fork(parent->aux);
+    mach->rom = vm_segment_fork(parent->rom);
+    if (mach->main == NULL || mach->aux == NULL || mach->rom == NULL) {
+        log_crit("Could not fork memory!");
+        apple2_free(mach);
+        return NULL;
+    }
+
+    // The mappers must work with us, not with the parent
+    mach->main->mach = mach;
+    mach->aux->mach = mach;
+
+    mach->cpu = mos6502_create(mach->main, mach->main);
+    if (mach->cpu == NULL) {
+        log_crit("Could not fork CPU!");
+        apple2_free(mach);
+        return NULL;
+    }
+
+    *mach->cpu = *parent->cpu;
+
+    // The profiles are the parent's; what the fork does isn't part of
+    // them
+    mach->cpu->prof = NULL;
+    mach->cpu->calls = NULL;
+    mach->cpu->trace = NULL;
+    apple2_set_memory_mode(mach, parent->memory_mode);
+
+    mach->drive1 = apple2_dd_fork(parent->drive1);
+    mach->drive2 = apple2_dd_fork(parent->drive2);
+    mach->blockdev = apple2_bd_fork(parent->blockdev);
+    mach->rewind = apple2_rewind_create(parent->rewind->interval);
+    mach->replay = apple2_replay_create();
+    mach->screen = vm_screen_create();
+
+    if (mach->drive1 == NULL || mach->drive2 == NULL ||
+        mach->blockdev == NULL || mach->rewind == NULL ||
+        mach->replay == NULL) {
+        log_crit("Could not fork machine!");
+        apple2_free(mach);
+        return NULL;
+    }
+
+    mach->selected_drive = parent->selected_drive == parent->drive2
+        ? mach->drive2
+        : mach->drive1;
+
+    if (parent->screen) {
+        mach->screen->last_key = parent->screen->last_key;
+        mach->screen->key_pressed = parent->screen->key_pressed;
+    }
+
+    return mach;
+}
+
 /*
  * Change the bank switch flags for the apple 2.
  */
@@ -217,6 +363,23 @@ apple2_is_double_video(apple2 *mach)
         mach->display_mode & DISPLAY_DHIRES;
 }
 
+/*
+ * Do what the machine does when it's first switched on, which is to
+ * reset itself with the Applesoft interpreter as the place to go once
+ * it's done.
+ */
+void
+apple2_power_on(apple2 *mach)
+{
+    // To begin with, we need to set the reset vector to the Applesoft
+    // interpeter.
+    vm_segment_set16(mach->main, APPLE2_RESET_VECTOR,
+                     APPLE2_APPLESOFT_MAIN);
+
+    // Run the reset routine to get the machine ready to go.
+    apple2_reset(mach);
+}
+
 /*
  * Try to "boot" the apple2 machine. Look for input sources indicated in
  * the option system and load those into our disk drives.
@@ -248,13 +411,127 @@ apple2_boot(apple2 *mach)
         }
     }
 
-    // To begin with, we need to set the reset vector to the Applesoft
-    // interpeter.
-    vm_segment_set16(mach->main, APPLE2_RESET_VECTOR,
-                     APPLE2_APPLESOFT_MAIN);
+    // A ProDOS volume goes into the block device; that can either be an
+    // image, or a directory on the host, but not both.
+    stream = (FILE *)vm_di_get(VM_VOLUME);
+    if (stream && vm_di_get(VM_HOSTDIR)) {
+        log_crit("Only one of a volume or host directory may be given");
+        return ERR_BADOPT;
+    }
 
-    // Run the reset routine to get the machine ready to go.
-    apple2_reset(mach);
+    if (vm_di_get(VM_HOSTDIR)) {
+        err = apple2_hostdir_insert(mach->blockdev,
+                                    (const char *)vm_di_get(VM_HOSTDIR));
+        if (err != OK) {
+            log_crit("Unable to insert host directory into block device");
+            return err;
+        }
+    }
+
+    if (stream) {
+        err = apple2_bd_insert(mach->blockdev, stream);
+        if (err != OK) {
+            log_crit("Unable to insert volume into block device");
+            return err;
+        }
+    }
+
+    apple2_power_on(mach);
+
+    // If we were given a saved state, we can pick up right where it
+    // left off. This has to come last, because the state expects the
+    // same disks to be in the drives.
+    stream = (FILE *)vm_di_get(VM_STATE);
+    if (stream) {
+        err = apple2_state_load(mach, stream);
+        if (err != OK) {
+            log_crit("Unable to load machine state");
+            return err;
+        }
+    } else if (vm_di_get(VM_SNAPCACHE)) {
+        // Otherwise, if we've booted this way before, we may have a
+        // snapshot to skip ahead with. (If we don't, this arranges for
+        // one to be recorded.)
+        apple2_snap_restore(mach);
+    }
+
+    // A recording begins with a state of its own, so a replay takes the
+    // place of any state or snapshot we loaded above. (And we don't
+    // want a snapshot of it.)
+    stream = (FILE *)vm_di_get(VM_REPLAY);
+    if (stream) {
+        mach->snap_pending = false;
+
+        err = apple2_replay_play(mach->replay, mach, stream);
+        if (err != OK) {
+            log_crit("Unable to replay recording");
+            return err;
+        }
+    } else if ((stream = (FILE *)vm_di_get(VM_RECORD))) {
+        err = apple2_replay_record(mach->replay, mach, stream);
+        if (err != OK) {
+            log_crit("Unable to begin recording");
+            return err;
+        }
+    }
+
+    if (vm_di_get(VM_PROFILE)) {
+        err = mos6502_prof_start(mach->cpu);
+        if (err != OK) {
+            log_crit("Unable to start profiler");
+            return err;
+        }
+    }
+
+    if (vm_di_get(VM_CALLGRAPH)) {
+        err = mos6502_calls_start(mach->cpu);
+        if (err != OK) {
+            log_crit("Unable to start call profiler");
+            return err;
+        }
+    }
+
+    if (vm_di_get(VM_HEATMAP)) {
+        err = apple2_heat_start(mach);
+        if (err != OK) {
+            log_crit("Unable to start heatmap");
+            return err;
+        }
+    }
+
+    stream = (FILE *)vm_di_get(VM_TRACE);
+    if (stream) {
+        int *range = (int *)vm_di_get(VM_TRACE_RANGE);
+        int *sample = (int *)vm_di_get(VM_TRACE_SAMPLE);
+
+        err = mos6502_trace_start(mach->cpu, stream,
+                                  range ? range[0] : 0,
+                                  range ? range[1] : 0xFFFF,
+                                  sample ? *sample : 1);
+        if (err != OK) {
+            log_crit("Unable to start trace");
+            return err;
+        }
+    }
+
+    // If anyone wants to watch us run, give them somewhere to do it
+    if (vm_di_get(VM_REFLECT)) {
+        mach->reflect = apple2_reflect_create(
+            (const char *)vm_di_get(VM_REFLECT));
+        if (mach->reflect == NULL) {
+            log_crit("Unable to create reflection");
+            return ERR_BADFILE;
+        }
+
+        apple2_reflect_update(mach->reflect, mach);
+    }
+
+    if (vm_di_get(VM_GDB)) {
+        mach->gdb = apple2_gdb_create((const char *)vm_di_get(VM_GDB));
+        if (mach->gdb == NULL) {
+            return ERR_BADFILE;
+        }
+    }
 
     return OK;
 }
@@ -313,6 +590,36 @@ apple2_free(apple2 *mach)
         apple2_dd_free(mach->drive2);
     }
 
+    if (mach->rewind) {
+        apple2_rewind_free(mach->rewind);
+    }
+
+    if (mach->replay) {
+        apple2_replay_free(mach->replay);
+    }
+
+    if (mach->reflect) {
+        apple2_reflect_free(mach->reflect);
+    }
+
+    if (mach->gdb) {
+        apple2_gdb_free(mach->gdb);
+    }
+
+    // A fork shares its parent's watchpoints, which aren't its to free
+    if (mach->watch && mach->watch->mach == mach) {
+        apple2_watch_free(mach->watch);
+    }
+
+    // Nor is its parent's heatmap
+    if (mach->heat && mach->heat->mach == mach) {
+        apple2_heat_free(mach->heat);
+    }
+
+    if (mach->blockdev) {
+        apple2_bd_free(mach->blockdev);
+    }
+
     if (mach->screen) {
         vm_screen_free(mach->screen);
     }
@@ -333,6 +640,7 @@ void
 apple2_run_loop(apple2 *mach)
 {
     FILE *dlog = (FILE *)vm_di_get(VM_DISASM_LOG);
+    int *runahead = (int *)vm_di_get(VM_RUNAHEAD);
     int sleep = 5;
 
     if (dlog != NULL) {
@@ -348,26 +656,28 @@ apple2_run_loop(apple2 *mach)
             i = 0;
         }
 
+        apple2_replay_tick(mach->replay, mach);
+
         if (vm_screen_last_key(mach->screen)) {
             mach->strobe = true;
         }
 
-        if (apple2_debug_broke(mach->cpu->PC)) {
+        // This is the only place we look for a breakpoint. If we find
+        // one, we stay paused until a debugger command (like resume or
+        // step) takes it away, so we needn't look again before we
+        // execute.
+        if (apple2_debug_trap(mach->cpu)) {
             mach->paused = true;
             mach->debug = true;
         }
 
-        if (mach->debug) {
-            if (mach->selected_drive) {
-                mach->selected_drive->locked = true;
-            }
+        if (mach->gdb) {
+            apple2_gdb_tick(mach->gdb, mach);
+        }
 
+        if (mach->debug) {
             mos6502_dis_opcode(mach->cpu, stdout, mach->cpu->PC);
 
-            if (mach->selected_drive) {
-                mach->selected_drive->locked = false;
-            }
-
             char *input = apple2_debug_prompt();
 
             if (input != NULL) {
@@ -383,23 +693,27 @@ apple2_run_loop(apple2 *mach)
         }
 
         if (mach->disasm) {
-            if (mach->selected_drive) {
-                mach->selected_drive->locked = true;
-            }
-            
             mos6502_dis_opcode(mach->cpu, dlog, mach->cpu->PC);
+        }
 
-            if (mach->selected_drive) {
-                mach->selected_drive->locked = false;
-            }
+        apple2_rewind_tick(mach->rewind, mach);
+        mos6502_execute(mach->cpu);
+
+        if (mach->reflect) {
+            apple2_reflect_tick(mach->reflect, mach);
         }
 
-        if (!apple2_debug_broke(mach->cpu->PC)) {
-            mos6502_execute(mach->cpu);
+        if (mach->snap_pending) {
+            apple2_snap_idle(mach);
         }
 
         if (vm_screen_dirty(mach->screen)) {
-            apple2_draw(mach);
+            if (runahead && *runahead > 0) {
+                apple2_runahead_draw(mach, *runahead);
+            } else {
+                apple2_draw(mach);
+            }
+
             vm_screen_refresh(mach->screen);
         }
     }
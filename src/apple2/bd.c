@@ -0,0 +1,589 @@
+/*
+ * apple2.bd.c
+ *
+ * Here we emulate a block device card--something like a hard disk
+ * controller--which presents a ProDOS volume of up to 32 megabytes. The
+ * card has a ProDOS block driver and a SmartPort entry point, and it can
+ * boot from the volume in the same way the Disk II controller boots
+ * from a floppy.
+ *
+ * We don't try to emulate any particular card's hardware. Instead, the
+ * driver code in the card's ROM simply reads from one of our soft
+ * switches, and the read traps into the emulator, where we carry out
+ * the call and hand the result back in the A register.
+ */
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apple2/bd.h"
+#include "apple2/mem.h"
+#include "mos6502/enums.h"
+
+/*
+ * Offsets into the card's ROM page for the ProDOS and SmartPort entry
+ * points. By convention, the SmartPort entry is always three bytes past
+ * the ProDOS entry.
+ */
+#define BD_PRODOS_ENTRY 0x30
+#define BD_SMARTPORT_ENTRY (BD_PRODOS_ENTRY + 3)
+
+/*
+ * This is the ROM for the card, as it would be mapped into $C500. For
+ * the curious, the disassembly is given to the right of each line.
+ */
+static vm_8bit bd_rom[APPLE2_PERIPHERAL_PAGE] = {
+    // The first eight bytes are as much signature as they are code; the
+    // monitor, and ProDOS, look for $20, $00, and $03 at $Cn01, $Cn03,
+    // and $Cn05 to know that a card is bootable. The $00 at $Cn07 says
+    // that we have a SmartPort interface.
+    0xA2, 0x20,             // $C500    LDX #$20
+    0xA0, 0x00,             // $C502    LDY #$00
+    0xA2, 0x03,             // $C504    LDX #$03
+    0xA2, 0x00,             // $C506    LDX #$00
+
+    // To boot, we ask our own driver to read block 0 of the volume into
+    // $0800, and then jump into it with the slot number (times 16) in
+    // X, just as the Disk II does.
+    0xA9, 0x01,             // $C508    LDA #$01        ; READ
+    0x85, 0x42,             // $C50A    STA $42
+    0xA9, 0x50,             // $C50C    LDA #$50        ; slot 5, drive 1
+    0x85, 0x43,             // $C50E    STA $43
+    0xA9, 0x00,             // $C510    LDA #$00
+    0x85, 0x44,             // $C512    STA $44         ; buffer is $0800
+    0x85, 0x46,             // $C514    STA $46         ; block is $0000
+    0x85, 0x47,             // $C516    STA $47
+    0xA9, 0x08,             // $C518    LDA #$08
+    0x85, 0x45,             // $C51A    STA $45
+    0x20, 0x30, 0xC5,       // $C51C    JSR $C530
+    0xB0, 0x05,             // $C51F    BCS $C526
+    0xA2, 0x50,             // $C521    LDX #$50
+    0x4C, 0x01, 0x08,       // $C523    JMP $0801
+
+    // If we couldn't read the boot block, there's nothing more for us
+    // to do; we'll drop into BASIC instead.
+    0x4C, 0x00, 0xE0,       // $C526    JMP $E000
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+
+    // The ProDOS entry point jumps over the SmartPort entry point,
+    // which must immediately follow it.
+    0x4C, 0x38, 0xC5,       // $C530    JMP $C538
+    0xAD, 0xD1, 0xC0,       // $C533    LDA $C0D1       ; SmartPort trap
+    0x60,                   // $C536    RTS
+    0x00,
+    0xAD, 0xD0, 0xC0,       // $C538    LDA $C0D0       ; ProDOS trap
+    0x60,                   // $C53B    RTS
+
+    // The rest of the page is empty, until we get to the very end
+    [0xFB] = 0x00,          // SmartPort ID type byte
+    [0xFC] = 0x00,          // Block count (zero means "call STATUS")
+    [0xFD] = 0x00,
+    [0xFE] = 0x0F,          // One volume; status, read, write, format
+    [0xFF] = BD_PRODOS_ENTRY,
+};
+
+/*
+ * Read a block from our image backend.
+ */
+static int
+bd_image_read(apple2bd *bd, size_t block, vm_8bit *buf)
+{
+    off_t off = (off_t)block * APPLE2_BD_BLOCK_SIZE;
+
+    if (pread(bd->fd, buf, APPLE2_BD_BLOCK_SIZE, off) !=
+        APPLE2_BD_BLOCK_SIZE) {
+        log_crit("Could not read block %zu: %s", block, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    return OK;
+}
+
+/*
+ * Write a block into our image backend. Note that the write goes
+ * straight to the host file; there's no separate save step as there is
+ * with the Disk II drive.
+ */
+static int
+bd_image_write(apple2bd *bd, size_t block, const vm_8bit *buf)
+{
+    off_t off = (off_t)block * APPLE2_BD_BLOCK_SIZE;
+
+    if (pwrite(bd->fd, buf, APPLE2_BD_BLOCK_SIZE, off) !=
+        APPLE2_BD_BLOCK_SIZE) {
+        log_crit("Could not write block %zu: %s", block, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    return OK;
+}
+
+/*
+ * Create a new block device. Like the disk drive, it begins with
+ * nothing in it.
+ */
+apple2bd *
+apple2_bd_create()
+{
+    apple2bd *bd;
+
+    bd = malloc(sizeof(apple2bd));
+    if (bd == NULL) {
+        log_crit("Could not malloc space for apple2 block device");
+        return NULL;
+    }
+
+    bd->read_block = NULL;
+    bd->write_block = NULL;
+    bd->close = NULL;
+    bd->backend = NULL;
+    bd->stream = NULL;
+    bd->fd = -1;
+    bd->blocks = 0;
+    bd->online = false;
+    bd->write_protect = false;
+
+    return bd;
+}
+
+/*
+ * Return a fork of the given block device, for a forked machine (see
+ * apple2_fork()). The fork reads from the same backend as the parent,
+ * but it's write-protected, and it never closes the backend; so it
+ * must be freed before the parent is.
+ */
+apple2bd *
+apple2_bd_fork(apple2bd *parent)
+{
+    apple2bd *bd;
+
+    bd = apple2_bd_create();
+    if (bd == NULL) {
+        return NULL;
+    }
+
+    *bd = *parent;
+    bd->write_block = NULL;
+    bd->close = NULL;
+    bd->write_protect = true;
+
+    return bd;
+}
+
+/*
+ * Free the memory held by a block device, and eject whatever was in it.
+ */
+void
+apple2_bd_free(apple2bd *bd)
+{
+    apple2_bd_eject(bd);
+    free(bd);
+}
+
+/*
+ * Insert a disk image into the block device. The image must be some
+ * whole number of blocks in length, and no more than ProDOS can
+ * address.
+ */
+int
+apple2_bd_insert(apple2bd *bd, FILE *stream)
+{
+    struct stat finfo;
+    size_t blocks;
+
+    if (stream == NULL) {
+        log_crit("File stream is null");
+        return ERR_BADFILE;
+    }
+
+    if (fstat(fileno(stream), &finfo)) {
+        log_crit("Couldn't get file information: %s", strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    blocks = finfo.st_size / APPLE2_BD_BLOCK_SIZE;
+
+    if (finfo.st_size % APPLE2_BD_BLOCK_SIZE != 0 ||
+        blocks == 0 ||
+        blocks > APPLE2_BD_MAX_BLOCKS
+       ) {
+        log_crit("Unexpected size for a block device image: %lld",
+                 (long long)finfo.st_size);
+        return ERR_BADFILE;
+    }
+
+    apple2_bd_eject(bd);
+
+    bd->stream = stream;
+    bd->fd = fileno(stream);
+    bd->blocks = blocks;
+    bd->read_block = bd_image_read;
+    bd->write_block = bd_image_write;
+    bd->online = true;
+
+    return OK;
+}
+
+/*
+ * Eject whatever is in the block device. We don't close the stream;
+ * that belongs to whoever gave it to us.
+ */
+void
+apple2_bd_eject(apple2bd *bd)
+{
+    if (bd->close) {
+        bd->close(bd);
+    }
+
+    bd->read_block = NULL;
+    bd->write_block = NULL;
+    bd->close = NULL;
+    bd->backend = NULL;
+    bd->stream = NULL;
+    bd->fd = -1;
+    bd->blocks = 0;
+    bd->online = false;
+}
+
+/*
+ * Read a block from the device into buf, which must have room for
+ * APPLE2_BD_BLOCK_SIZE bytes.
+ */
+int
+apple2_bd_read_block(apple2bd *bd, size_t block, vm_8bit *buf)
+{
+    if (!bd->online || bd->read_block == NULL) {
+        return ERR_INVALID;
+    }
+
+    if (block >= bd->blocks) {
+        return ERR_OOB;
+    }
+
+    return bd->read_block(bd, block, buf);
+}
+
+/*
+ * Write a block from buf into the device.
+ */
+int
+apple2_bd_write_block(apple2bd *bd, size_t block, const vm_8bit *buf)
+{
+    if (!bd->online || bd->write_block == NULL || bd->write_protect) {
+        return ERR_INVALID;
+    }
+
+    if (block >= bd->blocks) {
+        return ERR_OOB;
+    }
+
+    return bd->write_block(bd, block, buf);
+}
+
+/*
+ * Copy our ROM into the slot 5 page of peripheral ROM within the given
+ * rom segment.
+ */
+int
+apple2_bd_init_rom(vm_segment *rom)
+{
+    return vm_segment_copy_buf(rom, bd_rom,
+                               APPLE2_SYSROM_SIZE +
+                               (APPLE2_BD_SLOT * APPLE2_PERIPHERAL_PAGE),
+                               0, APPLE2_PERIPHERAL_PAGE);
+}
+
+/*
+ * Map the soft switches which belong to slot 5.
+ */
+void
+apple2_bd_map(vm_segment *seg)
+{
+    size_t addr;
+
+    for (addr = 0xC0D0; addr < 0xC0E0; addr++) {
+        vm_segment_read_map(seg, addr, apple2_bd_switch_read);
+    }
+}
+
+/*
+ * Move a block between the device and the machine's memory, depending
+ * on the command given. We return one of the BD error codes.
+ */
+static int
+bd_transfer(apple2 *mach, int cmd, size_t block, vm_16bit buf)
+{
+    vm_8bit data[APPLE2_BD_BLOCK_SIZE];
+    apple2bd *bd = mach->blockdev;
+    int i, err;
+
+    if (!bd->online) {
+        return BD_NODRIVE;
+    }
+
+    if (block >= bd->blocks) {
+        return BD_BADBLOCK;
+    }
+
+    switch (cmd) {
+        case BD_READ:
+            if (apple2_bd_read_block(bd, block, data) != OK) {
+                return BD_IOERROR;
+            }
+
+            // We write through the CPU, rather than directly into main
+            // memory, so that the data ends up wherever a program
+            // would expect it to go given the memory mode it's in.
+            for (i = 0; i < APPLE2_BD_BLOCK_SIZE; i++) {
+                mos6502_set(mach->cpu, (vm_16bit)(buf + i), data[i]);
+            }
+
+            return BD_OK;
+
+        case BD_WRITE:
+            if (bd->write_protect) {
+                return BD_NOWRITE;
+            }
+
+            for (i = 0; i < APPLE2_BD_BLOCK_SIZE; i++) {
+                data[i] = mos6502_get(mach->cpu, (vm_16bit)(buf + i));
+            }
+
+            err = apple2_bd_write_block(bd, block, data);
+            return err == OK ? BD_OK : BD_IOERROR;
+    }
+
+    return BD_BADCMD;
+}
+
+/*
+ * Set the CPU state that a ProDOS or SmartPort call returns with; that
+ * is, the error code in A, and the carry set if there was an error.
+ */
+static int
+bd_return(apple2 *mach, int err)
+{
+    if (err == BD_OK) {
+        mach->cpu->P &= ~MOS_CARRY;
+    } else {
+        mach->cpu->P |= MOS_CARRY;
+    }
+
+    return err;
+}
+
+/*
+ * Carry out a ProDOS block driver call. The parameters are found in the
+ * zero page; $42 holds the command, $43 the unit number, $44-$45 the
+ * buffer address, and $46-$47 the block number.
+ */
+int
+apple2_bd_prodos(apple2 *mach)
+{
+    apple2bd *bd = mach->blockdev;
+    vm_8bit cmd, unit;
+    vm_16bit buf, block;
+
+    cmd = mos6502_get(mach->cpu, 0x42);
+    unit = mos6502_get(mach->cpu, 0x43);
+    buf = mos6502_get16(mach->cpu, 0x44);
+    block = mos6502_get16(mach->cpu, 0x46);
+
+    // We only have the one drive; the high bit of the unit number would
+    // select a second drive.
+    if (unit & 0x80 || !bd->online) {
+        return bd_return(mach, BD_NODRIVE);
+    }
+
+    switch (cmd) {
+        case BD_STATUS:
+            mach->cpu->X = bd->blocks & 0xFF;
+            mach->cpu->Y = (bd->blocks >> 8) & 0xFF;
+
+            return bd_return(mach, bd->write_protect ? BD_NOWRITE : BD_OK);
+
+        case BD_READ:
+        case BD_WRITE:
+            return bd_return(mach, bd_transfer(mach, cmd, block, buf));
+
+        // There's nothing for us to do to format a volume; any block
+        // is as good as new already.
+        case BD_FORMAT:
+            return bd_return(mach, bd->write_protect ? BD_NOWRITE : BD_OK);
+    }
+
+    return bd_return(mach, BD_IOERROR);
+}
+
+/*
+ * Write out the status of the SmartPort interface or its one unit into
+ * memory at addr, based on the given status code.
+ */
+static int
+bd_status(apple2 *mach, int unit, int code, vm_16bit addr)
+{
+    static const char name[] = "ERC BLOCK DEV   ";
+    apple2bd *bd = mach->blockdev;
+    vm_8bit status;
+    int i, len;
+
+    // Unit 0 is the SmartPort interface itself; the only status it has
+    // is the number of devices attached to it.
+    if (unit == 0) {
+        if (code != 0) {
+            return BD_BADCTL;
+        }
+
+        mos6502_set(mach->cpu, addr, 1);
+        for (i = 1; i < 8; i++) {
+            mos6502_set(mach->cpu, addr + i, 0);
+        }
+
+        len = 8;
+    } else {
+        // Block device; read, write, and format allowed
+        status = 0x80 | 0x40 | 0x20 | 0x08;
+
+        if (bd->online) {
+            status |= 0x10;
+        }
+
+        if (bd->write_protect) {
+            status |= 0x04;
+        }
+
+        if (code != 0 && code != 3) {
+            return BD_BADCTL;
+        }
+
+        mos6502_set(mach->cpu, addr, status);
+        mos6502_set(mach->cpu, addr + 1, bd->blocks & 0xFF);
+        mos6502_set(mach->cpu, addr + 2, (bd->blocks >> 8) & 0xFF);
+        mos6502_set(mach->cpu, addr + 3, (bd->blocks >> 16) & 0xFF);
+        len = 4;
+
+        // The device information block (DIB) additionally holds the
+        // name, type, and version of the device.
+        if (code == 3) {
+            mos6502_set(mach->cpu, addr + 4, sizeof(name) - 1);
+            for (i = 0; i < sizeof(name) - 1; i++) {
+                mos6502_set(mach->cpu, addr + 5 + i, name[i]);
+            }
+
+            mos6502_set(mach->cpu, addr + 21, 0x02);    // hard disk
+            mos6502_set(mach->cpu, addr + 22, 0x00);
+            mos6502_set(mach->cpu, addr + 23, 0x01);    // version 1.0
+            mos6502_set(mach->cpu, addr + 24, 0x00);
+            len = 25;
+        }
+    }
+
+    // The number of bytes we've written goes into X and Y
+    mach->cpu->X = len & 0xFF;
+    mach->cpu->Y = (len >> 8) & 0xFF;
+
+    return BD_OK;
+}
+
+/*
+ * Carry out a SmartPort call. The command and the address of the
+ * parameter list follow the JSR which got us here, so we find them
+ * through the return address on the stack--and then we must bump the
+ * return address past them.
+ */
+int
+apple2_bd_smartport(apple2 *mach)
+{
+    vm_16bit ret, params, buf;
+    vm_8bit cmd, count, unit;
+    size_t block;
+    int err;
+
+    ret = mos6502_get(mach->cpu, 0x100 + (vm_8bit)(mach->cpu->S + 1));
+    ret |= mos6502_get(mach->cpu, 0x100 + (vm_8bit)(mach->cpu->S + 2)) << 8;
+
+    cmd = mos6502_get(mach->cpu, ret + 1);
+    params = mos6502_get16(mach->cpu, ret + 2);
+
+    ret += 3;
+    mos6502_set(mach->cpu, 0x100 + (vm_8bit)(mach->cpu->S + 1), ret & 0xFF);
+    mos6502_set(mach->cpu, 0x100 + (vm_8bit)(mach->cpu->S + 2), ret >> 8);
+
+    count = mos6502_get(mach->cpu, params);
+    unit = mos6502_get(mach->cpu, params + 1);
+    buf = mos6502_get16(mach->cpu, params + 2);
+
+    // Only the status call may be made to unit 0, and we have just the
+    // one unit beyond that. (Extended calls, with their 32-bit
+    // addresses, are flagged with bit 6 of the command; we don't
+    // support those.)
+    if (unit > 1 || (unit == 0 && cmd != BD_STATUS)) {
+        return bd_return(mach, BD_BADUNIT);
+    }
+
+    switch (cmd) {
+        case BD_STATUS:
+            if (count != 3) {
+                return bd_return(mach, BD_BADPCNT);
+            }
+
+            err = bd_status(mach, unit, mos6502_get(mach->cpu, params + 4),
+                            buf);
+            return bd_return(mach, err);
+
+        case BD_READ:
+        case BD_WRITE:
+            if (count != 3) {
+                return bd_return(mach, BD_BADPCNT);
+            }
+
+            block = mos6502_get(mach->cpu, params + 4) |
+                (mos6502_get(mach->cpu, params + 5) << 8) |
+                (mos6502_get(mach->cpu, params + 6) << 16);
+
+            return bd_return(mach, bd_transfer(mach, cmd, block, buf));
+
+        case BD_FORMAT:
+            if (count != 1) {
+                return bd_return(mach, BD_BADPCNT);
+            }
+
+            if (!mach->blockdev->online) {
+                return bd_return(mach, BD_NODRIVE);
+            }
+
+            return bd_return(mach, mach->blockdev->write_protect
+                             ? BD_NOWRITE
+                             : BD_OK);
+
+        case BD_CONTROL:
+        case BD_INIT:
+            return bd_return(mach, BD_OK);
+    }
+
+    return bd_return(mach, BD_BADCMD);
+}
+
+/*
+ * Handle reads from the slot 5 soft switches. Two of these are traps
+ * for our driver; the rest do nothing.
+ */
+SEGMENT_READER(apple2_bd_switch_read)
+{
+    apple2 *mach = (apple2 *)_mach;
+
+    if (mach == NULL || mach->blockdev == NULL) {
+        return 0;
+    }
+
+    switch (addr) {
+        case APPLE2_BD_PRODOS_TRAP:
+            return apple2_bd_prodos(mach);
+
+        case APPLE2_BD_SMARTPORT_TRAP:
+            return apple2_bd_smartport(mach);
+    }
+
+    return 0;
+}
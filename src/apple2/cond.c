@@ -0,0 +1,434 @@
+/*
+ * apple2.cond.c
+ *
+ * Conditions are what make a breakpoint conditional: expressions like
+ *
+ *   A == $20 && mem[$FF] > 3
+ *
+ * which we check each time the CPU comes to the breakpoint, stopping
+ * only if they're true. Since that may be a great many times, we don't
+ * parse the expression each time; we compile it, once, into a small
+ * bytecode for a stack machine, which is quick to evaluate.
+ *
+ * Numbers are in hex, as they are everywhere else in the debugger; you
+ * may begin them with a $, and if they begin with a letter, you must
+ * (A is the accumulator, after all). The registers are A, X, Y, P, S,
+ * and PC; mem[addr] is the byte at addr. The operators are those of C,
+ * with the same precedence: ! and unary -; + and -; the comparisons;
+ * &, ^, and |; and && and ||.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "apple2/cond.h"
+#include "log.h"
+
+/*
+ * Our binary operators, from the lowest precedence level to the
+ * highest. Where one token begins another (as < does <=), the longer
+ * must come first.
+ */
+static const struct {
+    const char *token;
+    int level;
+    vm_8bit op;
+} binops[] = {
+    { "||", 0, COND_LOR },
+    { "&&", 1, COND_LAND },
+    { "|", 2, COND_OR },
+    { "^", 3, COND_XOR },
+    { "&", 4, COND_AND },
+    { "==", 5, COND_EQ },
+    { "!=", 5, COND_NE },
+    { "<=", 6, COND_LE },
+    { ">=", 6, COND_GE },
+    { "<", 6, COND_LT },
+    { ">", 6, COND_GT },
+    { "+", 7, COND_ADD },
+    { "-", 7, COND_SUB },
+};
+
+#define BINOPS_SIZE (sizeof(binops) / sizeof(binops[0]))
+#define BINOPS_LEVELS 8
+
+static const struct {
+    const char *name;
+    vm_8bit reg;
+} regs[] = {
+    { "A", COND_A },
+    { "X", COND_X },
+    { "Y", COND_Y },
+    { "P", COND_P },
+    { "S", COND_S },
+    { "PC", COND_PC },
+};
+
+#define REGS_SIZE (sizeof(regs) / sizeof(regs[0]))
+
+/*
+ * The state of our parser as it works through an expression.
+ */
+typedef struct {
+    const char *str;
+    apple2_cond *cond;
+
+    /*
+     * How deep the stack will be at this point in the code, and the
+     * deepest it will ever get.
+     */
+    int depth;
+    int max_depth;
+
+    bool err;
+} cond_parser;
+
+static void cond_expr(cond_parser *, int);
+
+/*
+ * Add a byte of code, which changes the depth of the stack by the
+ * given amount.
+ */
+static void
+cond_emit(cond_parser *p, vm_8bit byte, int depth)
+{
+    if (p->cond->len >= COND_CODE_MAX) {
+        p->err = true;
+        return;
+    }
+
+    p->cond->code[p->cond->len++] = byte;
+
+    p->depth += depth;
+    if (p->depth > p->max_depth) {
+        p->max_depth = p->depth;
+    }
+}
+
+static void
+cond_skip(cond_parser *p)
+{
+    while (isspace(*p->str)) {
+        p->str++;
+    }
+}
+
+/*
+ * Return the value of the hex digit c (which must be one)
+ */
+static int
+cond_hex(char c)
+{
+    if (isdigit(c)) {
+        return c - '0';
+    }
+
+    return tolower(c) - 'a' + 10;
+}
+
+/*
+ * Parse the operand of a unary operator, or of a binary one: that is, a
+ * number, a register, a memory reference, an expression in parentheses,
+ * or one of those with a ! or - before it.
+ */
+static void
+cond_primary(cond_parser *p)
+{
+    const char *start;
+    long num;
+    size_t len;
+
+    cond_skip(p);
+
+    if (*p->str == '!' && p->str[1] != '=') {
+        p->str++;
+        cond_primary(p);
+        cond_emit(p, COND_NOT, 0);
+        return;
+    }
+
+    if (*p->str == '-') {
+        p->str++;
+        cond_primary(p);
+        cond_emit(p, COND_NEG, 0);
+        return;
+    }
+
+    if (*p->str == '(') {
+        p->str++;
+        cond_expr(p, 0);
+        cond_skip(p);
+
+        if (*p->str != ')') {
+            p->err = true;
+            return;
+        }
+
+        p->str++;
+        return;
+    }
+
+    if (*p->str == '$' || isdigit(*p->str)) {
+        if (*p->str == '$') {
+            p->str++;
+        }
+
+        // We read the digits ourselves; strtol would also take a sign,
+        // or a 0x in front, neither of which belongs here
+        if (!isxdigit(*p->str)) {
+            p->err = true;
+            return;
+        }
+
+        for (num = 0; isxdigit(*p->str); p->str++) {
+            num = (num << 4) | cond_hex(*p->str);
+            if (num > 0xFFFF) {
+                p->err = true;
+                return;
+            }
+        }
+
+        if (isalnum(*p->str)) {
+            p->err = true;
+            return;
+        }
+
+        cond_emit(p, COND_NUM, 1);
+        cond_emit(p, num & 0xFF, 0);
+        cond_emit(p, num >> 8, 0);
+        return;
+    }
+
+    start = p->str;
+    while (isalnum(*p->str)) {
+        p->str++;
+    }
+
+    len = p->str - start;
+
+    if (len == 3 && strncasecmp(start, "mem", 3) == 0) {
+        cond_skip(p);
+        if (*p->str != '[') {
+            p->err = true;
+            return;
+        }
+
+        p->str++;
+        cond_expr(p, 0);
+        cond_skip(p);
+
+        if (*p->str != ']') {
+            p->err = true;
+            return;
+        }
+
+        p->str++;
+        cond_emit(p, COND_MEM, 0);
+        return;
+    }
+
+    for (int i = 0; i < REGS_SIZE; i++) {
+        if (len == strlen(regs[i].name) &&
+            strncasecmp(start, regs[i].name, len) == 0
+           ) {
+            cond_emit(p, COND_REG, 1);
+            cond_emit(p, regs[i].reg, 0);
+            return;
+        }
+    }
+
+    p->err = true;
+}
+
+/*
+ * If the next thing in the string is a binary operator of the given
+ * level, skip past it and return its index in binops; if not, return
+ * -1.
+ */
+static int
+cond_binop(cond_parser *p, int level)
+{
+    size_t len;
+
+    cond_skip(p);
+
+    for (int i = 0; i < BINOPS_SIZE; i++) {
+        if (binops[i].level != level) {
+            continue;
+        }
+
+        len = strlen(binops[i].token);
+        if (strncmp(p->str, binops[i].token, len) != 0) {
+            continue;
+        }
+
+        // | and & mustn't be mistaken for the first half of || and &&
+        if (len == 1 && p->str[1] == binops[i].token[0]) {
+            continue;
+        }
+
+        p->str += len;
+        return i;
+    }
+
+    return -1;
+}
+
+/*
+ * Parse an expression whose operators are all of the given precedence
+ * level or higher.
+ */
+static void
+cond_expr(cond_parser *p, int level)
+{
+    int i;
+
+    if (level == BINOPS_LEVELS) {
+        cond_primary(p);
+        return;
+    }
+
+    cond_expr(p, level + 1);
+
+    while (!p->err && (i = cond_binop(p, level)) >= 0) {
+        cond_expr(p, level + 1);
+        cond_emit(p, binops[i].op, -1);
+    }
+}
+
+/*
+ * Compile the given string into a new condition, and return it. If the
+ * string isn't an expression we understand, or it's too big for us, we
+ * return NULL.
+ */
+apple2_cond *
+apple2_cond_create(const char *str)
+{
+    apple2_cond *cond;
+    cond_parser p;
+
+    cond = calloc(1, sizeof(apple2_cond));
+    if (cond == NULL) {
+        log_crit("Could not allocate memory for condition");
+        return NULL;
+    }
+
+    p.str = str;
+    p.cond = cond;
+    p.depth = 0;
+    p.max_depth = 0;
+    p.err = false;
+
+    cond_expr(&p, 0);
+    cond_skip(&p);
+    cond_emit(&p, COND_END, 0);
+
+    if (p.err || *p.str != '\0' || p.max_depth > COND_STACK_MAX) {
+        free(cond);
+        return NULL;
+    }
+
+    cond->source = strdup(str);
+    if (cond->source == NULL) {
+        free(cond);
+        return NULL;
+    }
+
+    return cond;
+}
+
+/*
+ * Free a condition.
+ */
+void
+apple2_cond_free(apple2_cond *cond)
+{
+    if (cond == NULL) {
+        return;
+    }
+
+    free(cond->source);
+    free(cond);
+}
+
+/*
+ * Return the value of the given register in the CPU.
+ */
+static int
+cond_reg(mos6502 *cpu, int reg)
+{
+    switch (reg) {
+        case COND_A: return cpu->A;
+        case COND_X: return cpu->X;
+        case COND_Y: return cpu->Y;
+        case COND_P: return cpu->P;
+        case COND_S: return cpu->S;
+        case COND_PC: return cpu->PC;
+    }
+
+    return 0;
+}
+
+/*
+ * Return true if the condition holds for the CPU as it is now. A
+ * memory reference peeks at the byte the CPU would read (see
+ * vm_segment_peek()); some reads flip soft switches, and looking at a
+ * breakpoint's condition mustn't change anything about the machine.
+ */
+bool
+apple2_cond_eval(apple2_cond *cond, mos6502 *cpu)
+{
+    const vm_8bit *pc = cond->code;
+    int stack[COND_STACK_MAX];
+    int sp = 0;
+    int b;
+
+    for (;;) {
+        switch (*pc++) {
+            case COND_END:
+                return sp > 0 && stack[sp - 1] != 0;
+
+            case COND_NUM:
+                stack[sp++] = pc[0] | (pc[1] << 8);
+                pc += 2;
+                continue;
+
+            case COND_REG:
+                stack[sp++] = cond_reg(cpu, *pc++);
+                continue;
+
+            case COND_MEM:
+                stack[sp - 1] = mos6502_peek(cpu, stack[sp - 1] & 0xFFFF);
+                continue;
+
+            case COND_NOT:
+                stack[sp - 1] = !stack[sp - 1];
+                continue;
+
+            case COND_NEG:
+                stack[sp - 1] = -stack[sp - 1];
+                continue;
+        }
+
+        // Everything else is a binary operator
+        b = stack[--sp];
+
+        switch (pc[-1]) {
+            case COND_ADD: stack[sp - 1] += b; break;
+            case COND_SUB: stack[sp - 1] -= b; break;
+            case COND_AND: stack[sp - 1] &= b; break;
+            case COND_OR: stack[sp - 1] |= b; break;
+            case COND_XOR: stack[sp - 1] ^= b; break;
+            case COND_EQ: stack[sp - 1] = stack[sp - 1] == b; break;
+            case COND_NE: stack[sp - 1] = stack[sp - 1] != b; break;
+            case COND_LT: stack[sp - 1] = stack[sp - 1] < b; break;
+            case COND_LE: stack[sp - 1] = stack[sp - 1] <= b; break;
+            case COND_GT: stack[sp - 1] = stack[sp - 1] > b; break;
+            case COND_GE: stack[sp - 1] = stack[sp - 1] >= b; break;
+            case COND_LAND: stack[sp - 1] = stack[sp - 1] && b; break;
+            case COND_LOR: stack[sp - 1] = stack[sp - 1] || b; break;
+        }
+    }
+}
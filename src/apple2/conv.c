@@ -0,0 +1,334 @@
+/*
+ * apple2.conv.c
+ *
+ * Convert disk images between the formats we understand: DOS 3.3-order
+ * images (.dsk and .do), ProDOS-order images (.po), and nibbilized
+ * images (.nib). We don't need any special logic to do so; everything
+ * here is built from the encoder and decoder we use for the disk drive.
+ *
+ * We can also run a batch of conversions across several threads. Each
+ * thread takes one image at a time, reading it in, converting it, and
+ * writing it out before taking the next.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "apple2/conv.h"
+#include "apple2/dec.h"
+
+/*
+ * This is the state we share between the threads in a batch.
+ */
+typedef struct {
+    apple2_conv_job *jobs;
+    int njobs;
+    int next;
+    bool verify;
+    pthread_mutex_t lock;
+} conv_batch;
+
+/*
+ * Return the type of image we think the file at path holds, based on
+ * its extension. If we don't know, we return DD_NOTYPE.
+ */
+int
+apple2_conv_type(const char *path)
+{
+    const char *ext;
+
+    ext = strrchr(path, '.');
+    if (ext == NULL) {
+        return DD_NOTYPE;
+    }
+
+    ext++;
+
+    if (strcasecmp(ext, "dsk") == 0 || strcasecmp(ext, "do") == 0) {
+        return DD_DOS33;
+    }
+
+    if (strcasecmp(ext, "po") == 0) {
+        return DD_PRODOS;
+    }
+
+    if (strcasecmp(ext, "nib") == 0) {
+        return DD_NIBBLE;
+    }
+
+    return DD_NOTYPE;
+}
+
+/*
+ * Return the file extension we use for an image type.
+ */
+const char *
+apple2_conv_ext(int type)
+{
+    switch (type) {
+        case DD_DOS33:
+            return "dsk";
+        case DD_PRODOS:
+            return "po";
+        case DD_NIBBLE:
+            return "nib";
+    }
+
+    return NULL;
+}
+
+/*
+ * Convert the image in src, which is in the from format, into the to
+ * format. The segment we return is always a new one, which the caller
+ * must free.
+ *
+ * To convert between DOS 3.3 and ProDOS order, we encode the image in
+ * one order and decode it in the other. This is more work than a
+ * sector-by-sector shuffle, but it means the sector order is only ever
+ * defined in one place (see apple2_dd_sector_num()).
+ */
+vm_segment *
+apple2_conv_image(int from, int to, vm_segment *src)
+{
+    vm_segment *nib, *dest;
+
+    if (src == NULL || apple2_conv_ext(from) == NULL ||
+        apple2_conv_ext(to) == NULL
+       ) {
+        return NULL;
+    }
+
+    if (from == DD_NIBBLE) {
+        nib = apple2_enc_nib(src);
+    } else {
+        nib = apple2_enc_dos(from, src);
+    }
+
+    if (nib == NULL || to == DD_NIBBLE) {
+        return nib;
+    }
+
+    dest = vm_segment_create(_140K_);
+    if (dest == NULL) {
+        vm_segment_free(nib);
+        return NULL;
+    }
+
+    if (apple2_dec_dos(to, dest, nib) != OK) {
+        vm_segment_free(nib);
+        vm_segment_free(dest);
+        return NULL;
+    }
+
+    vm_segment_free(nib);
+    return dest;
+}
+
+/*
+ * Return the canonical form of an image: its sector data, in DOS 3.3
+ * order. Two images of any format hold the same disk if their canonical
+ * forms are the same.
+ */
+vm_segment *
+apple2_conv_canon(int type, vm_segment *src)
+{
+    return apple2_conv_image(type, DD_DOS33, src);
+}
+
+/*
+ * Read the image at path into a new segment. The file must be the right
+ * size for its type.
+ */
+static vm_segment *
+conv_read(const char *path, int type)
+{
+    struct stat finfo;
+    vm_segment *seg;
+    FILE *stream;
+    size_t want, size;
+
+    want = (type == DD_NIBBLE) ? APPLE2_CONV_NIB_SIZE : _140K_;
+    size = (type == DD_NIBBLE) ? _140K_NIB_ : _140K_;
+
+    stream = fopen(path, "r");
+    if (stream == NULL) {
+        log_crit("Could not open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fileno(stream), &finfo) || finfo.st_size != want) {
+        log_crit("Unexpected size for image %s", path);
+        fclose(stream);
+        return NULL;
+    }
+
+    seg = vm_segment_create(size);
+    if (seg && vm_segment_fread(seg, stream, 0, want) != OK) {
+        vm_segment_free(seg);
+        seg = NULL;
+    }
+
+    fclose(stream);
+    return seg;
+}
+
+/*
+ * Write an image of the given type to path.
+ */
+static int
+conv_write(const char *path, int type, vm_segment *seg)
+{
+    FILE *stream;
+    int err;
+
+    stream = fopen(path, "w");
+    if (stream == NULL) {
+        log_crit("Could not open %s: %s", path, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    err = vm_segment_fwrite(seg, stream, 0,
+                            type == DD_NIBBLE ? APPLE2_CONV_NIB_SIZE : _140K_);
+
+    if (fclose(stream) != 0) {
+        err = ERR_BADFILE;
+    }
+
+    return err;
+}
+
+/*
+ * Carry out a single conversion. If verify is true, then we read back
+ * what we wrote, and make sure it holds the same disk as the source.
+ */
+int
+apple2_conv_file(apple2_conv_job *job, bool verify)
+{
+    vm_segment *src, *dest, *check = NULL;
+    vm_segment *canon_src = NULL, *canon_dest = NULL;
+    int err = OK;
+
+    src = conv_read(job->src, job->from);
+    if (src == NULL) {
+        return job->result = ERR_BADFILE;
+    }
+
+    dest = apple2_conv_image(job->from, job->to, src);
+    if (dest == NULL) {
+        vm_segment_free(src);
+        log_crit("Could not convert %s", job->src);
+        return job->result = ERR_BADFILE;
+    }
+
+    err = conv_write(job->dest, job->to, dest);
+
+    if (err == OK && verify) {
+        check = conv_read(job->dest, job->to);
+        canon_src = apple2_conv_canon(job->from, src);
+        canon_dest = apple2_conv_canon(job->to, check);
+
+        if (canon_src == NULL || canon_dest == NULL ||
+            memcmp(canon_src->memory, canon_dest->memory, _140K_) != 0
+           ) {
+            log_crit("Round-trip verification failed for %s", job->src);
+            err = ERR_INVALID;
+        }
+    }
+
+    vm_segment_free(src);
+    vm_segment_free(dest);
+
+    if (check) {
+        vm_segment_free(check);
+    }
+
+    if (canon_src) {
+        vm_segment_free(canon_src);
+    }
+
+    if (canon_dest) {
+        vm_segment_free(canon_dest);
+    }
+
+    return job->result = err;
+}
+
+/*
+ * This is where each thread in a batch spends its life: take the next
+ * job that no one else has, and run it, until there are none left.
+ */
+static void *
+conv_worker(void *arg)
+{
+    conv_batch *batch = (conv_batch *)arg;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        i = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (i >= batch->njobs) {
+            break;
+        }
+
+        apple2_conv_file(&batch->jobs[i], batch->verify);
+    }
+
+    return NULL;
+}
+
+/*
+ * Run a batch of jobs across nthreads threads, and return the number of
+ * jobs which failed. If we can't start any threads at all, we'll just
+ * run the jobs ourselves.
+ */
+int
+apple2_conv_run(apple2_conv_job *jobs, int njobs, int nthreads, bool verify)
+{
+    pthread_t *threads;
+    conv_batch batch;
+    int i, started = 0, failed = 0;
+
+    batch.jobs = jobs;
+    batch.njobs = njobs;
+    batch.next = 0;
+    batch.verify = verify;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    if (nthreads > njobs) {
+        nthreads = njobs;
+    }
+
+    // The calling thread counts as one of our threads, so we only need
+    // to start the rest.
+    threads = malloc(sizeof(pthread_t) * (nthreads > 1 ? nthreads : 1));
+    if (threads) {
+        for (i = 0; i < nthreads - 1; i++) {
+            if (pthread_create(&threads[started], NULL,
+                               conv_worker, &batch) == 0) {
+                started++;
+            }
+        }
+    }
+
+    // If we couldn't start any threads, this will do all of the work.
+    conv_worker(&batch);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&batch.lock);
+
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].result != OK) {
+            failed++;
+        }
+    }
+
+    return failed;
+}
@@ -14,6 +14,7 @@
 #include "apple2/dd.h"
 #include "apple2/dec.h"
 #include "apple2/enc.h"
+#include "apple2/ncache.h"
 #include "apple2/apple2.h"
 #include "vm_di.h"
 
@@ -39,7 +40,6 @@ apple2_dd_create()
     drive->data = NULL;
     drive->image = NULL;
 
-    drive->locked = false;
     drive->track_pos = 0;
     drive->sector_pos = 0;
     drive->online = false;
@@ -48,6 +48,9 @@ apple2_dd_create()
     drive->phase = 0;
     drive->image_type = DD_NOTYPE;
 
+    memset(drive->dirty, false, sizeof(drive->dirty));
+    memset(&drive->stats, 0, sizeof(apple2_dd_stats));
+
     return drive;
 }
 
@@ -151,6 +154,7 @@ apple2_dd_insert(apple2dd *drive, FILE *stream, int type)
 
     drive->stream = stream;
     drive->image_type = type;
+    memset(drive->dirty, false, sizeof(drive->dirty));
 
     // Now we need to build the data segment
     apple2_dd_encode(drive);
@@ -173,7 +177,10 @@ apple2_dd_encode(apple2dd *drive)
 
         case DD_DOS33:
         case DD_PRODOS:
-            drive->data = apple2_enc_dos(drive->image_type, drive->image);
+            // This will go through our nibble cache if one has been
+            // set up; if not, it simply encodes the image.
+            drive->data = apple2_ncache_encode(drive->image_type,
+                                               drive->image);
             break;
 
         default:
@@ -184,6 +191,74 @@ apple2_dd_encode(apple2dd *drive)
     return OK;
 }
 
+/*
+ * Return every dirty track of the drive to the data it had when the
+ * disk was inserted (or last saved), except for those tracks which are
+ * true in keep. This is how we undo writes to the disk when we restore
+ * an earlier state of the machine.
+ */
+int
+apple2_dd_reset_tracks(apple2dd *drive, const bool *keep)
+{
+    vm_segment *clean;
+    size_t offset;
+    int track;
+    bool any = false;
+
+    if (drive->data == NULL) {
+        return OK;
+    }
+
+    for (track = 0; track < DD_NUM_TRACKS; track++) {
+        if (drive->dirty[track] && !keep[track]) {
+            any = true;
+        }
+    }
+
+    // This is the common case, and it saves us from encoding the whole
+    // image again
+    if (!any) {
+        return OK;
+    }
+
+    switch (drive->image_type) {
+        case DD_NIBBLE:
+            clean = apple2_enc_nib(drive->image);
+            break;
+
+        case DD_DOS33:
+        case DD_PRODOS:
+            clean = apple2_ncache_encode(drive->image_type, drive->image);
+            break;
+
+        default:
+            log_crit("Unknown image type");
+            return ERR_INVALID;
+    }
+
+    if (clean == NULL) {
+        return ERR_OOM;
+    }
+
+    for (track = 0; track < DD_NUM_TRACKS; track++) {
+        offset = track * ENC_ETRACK;
+
+        if (!drive->dirty[track] || keep[track] ||
+            offset + ENC_ETRACK > clean->size ||
+            offset + ENC_ETRACK > drive->data->size) {
+            continue;
+        }
+
+        memcpy(drive->data->memory + offset, clean->memory + offset,
+               ENC_ETRACK);
+        drive->dirty[track] = false;
+    }
+
+    vm_segment_free(clean);
+
+    return OK;
+}
+
 /*
  * Save the contents of the drive back to the file system (given as the
  * stream field in the drive struct).
@@ -199,6 +274,10 @@ apple2_dd_save(apple2dd *drive)
         rewind(drive->stream);
         vm_segment_fwrite(drive->image, drive->stream, 0, drive->image->size);
     }
+
+    // The image now has everything that the data has, so nothing is
+    // dirty anymore.
+    memset(drive->dirty, false, sizeof(drive->dirty));
 }
 
 /*
@@ -281,10 +360,6 @@ apple2_dd_phaser(apple2dd *drive, int phase)
     int step = transitions[(drive->phase * 5) + phase];
     apple2_dd_step(drive, step);
 
-    log_info("Phase %1d, step %2d, track %2d, sector pos %05x, segment position %05x",
-             phase, step, drive->track_pos / 2, drive->sector_pos,
-             apple2_dd_position(drive));
-
     // Record this new phase for the next time we make a transition
     drive->phase = phase;
 }
@@ -322,6 +397,8 @@ apple2_dd_read(apple2dd *drive)
     vm_8bit byte = vm_segment_get(drive->data, apple2_dd_position(drive));
     drive->latch = byte;
 
+    apple2_dd_count_read(drive, byte);
+
     apple2_dd_shift(drive, 1);
 
     return byte;
@@ -354,6 +431,12 @@ apple2_dd_eject(apple2dd *drive)
 void
 apple2_dd_free(apple2dd *drive)
 {
+    // Some drives are set up with one segment for both the image and
+    // the data, so take care not to free it twice
+    if (drive->image && drive->image != drive->data) {
+        vm_segment_free(drive->image);
+    }
+
     if (drive->data) {
         vm_segment_free(drive->data);
     }
@@ -361,6 +444,40 @@ apple2_dd_free(apple2dd *drive)
     free(drive);
 }
 
+/*
+ * Return a fork of the given drive (see vm_segment_fork()). The fork
+ * has the same disk in it, with the head in the same place, but what's
+ * written to it is never saved; we don't want a thousand forks of a
+ * machine all writing to the same file.
+ */
+apple2dd *
+apple2_dd_fork(apple2dd *parent)
+{
+    apple2dd *drive;
+
+    drive = apple2_dd_create();
+    if (drive == NULL) {
+        return NULL;
+    }
+
+    *drive = *parent;
+    drive->stream = NULL;
+    drive->data = NULL;
+    drive->image = NULL;
+
+    if (parent->data) {
+        drive->data = vm_segment_fork(parent->data);
+        drive->image = vm_segment_fork(parent->image);
+
+        if (drive->data == NULL || drive->image == NULL) {
+            apple2_dd_free(drive);
+            return NULL;
+        }
+    }
+
+    return drive;
+}
+
 /*
  * Set the disk drive mode, which is either read or write. (It can only
  * be one or the other at a time.)
@@ -383,12 +500,6 @@ apple2_dd_set_mode(apple2dd *drive, int mode)
 void
 apple2_dd_shift(apple2dd *drive, int pos)
 {
-    // When locked is true, we shouldn't shift our position by any
-    // number.
-    if (drive->locked) {
-        return;
-    }
-
     drive->sector_pos += pos;
 
     if (drive->sector_pos >= ENC_ETRACK) {
@@ -407,6 +518,8 @@ apple2_dd_shift(apple2dd *drive, int pos)
 void
 apple2_dd_step(apple2dd *drive, int steps)
 {
+    int from = drive->track_pos;
+
     drive->track_pos += steps;
 
     if (drive->track_pos > MAX_DRIVE_STEPS) {
@@ -415,6 +528,17 @@ apple2_dd_step(apple2dd *drive, int steps)
         drive->track_pos = 0;
     }
 
+    // If the head actually moved, count the half-tracks it moved by; if
+    // it was sitting still before, this is the start of a new seek.
+    if (drive->track_pos != from) {
+        drive->stats.half_steps += abs(drive->track_pos - from);
+
+        if (!drive->stats.seeking) {
+            drive->stats.seeking = true;
+            drive->stats.seek_from = from;
+        }
+    }
+
     drive->sector_pos = 0;
 }
 
@@ -441,11 +565,157 @@ apple2_dd_write(apple2dd *drive)
     }
 
 	if (drive->latch & 0x80) {
+		apple2_dd_seek_end(drive);
+		drive->stats.bytes_written++;
+		drive->dirty[drive->track_pos / 2] = true;
+
 		vm_segment_set(drive->data, apple2_dd_position(drive), drive->latch);
 		apple2_dd_shift(drive, 1);
 	}
 }
 
+/*
+ * Turn the drive motor on or off at the given cycle count, and keep
+ * track of how long the motor has been running. (Turning on a motor
+ * which is already on doesn't restart the clock.)
+ */
+void
+apple2_dd_motor(apple2dd *drive, bool online, uint64_t now)
+{
+    if (online && !drive->online) {
+        drive->stats.motor_since = now;
+    } else if (!online && drive->online) {
+        drive->stats.motor_cycles += now - drive->stats.motor_since;
+    }
+
+    apple2_dd_turn_on(drive, online);
+}
+
+/*
+ * Return the number of cycles the drive motor has been on, as of the
+ * cycle count given in now.
+ */
+uint64_t
+apple2_dd_motor_cycles(apple2dd *drive, uint64_t now)
+{
+    uint64_t cycles = drive->stats.motor_cycles;
+
+    if (drive->online && now > drive->stats.motor_since) {
+        cycles += now - drive->stats.motor_since;
+    }
+
+    return cycles;
+}
+
+/*
+ * Return the histogram bucket that a seek of the given distance (in
+ * half-tracks) belongs in.
+ */
+int
+apple2_dd_seek_bucket(int dist)
+{
+    int bucket = 0;
+
+    if (dist < 0) {
+        dist = -dist;
+    }
+
+    while (dist > 1 && bucket < DD_SEEK_BUCKETS - 1) {
+        dist >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/*
+ * If the head has been moving, the first read or write afterward is
+ * where we consider the seek to have ended. Record how far it went.
+ */
+void
+apple2_dd_seek_end(apple2dd *drive)
+{
+    int dist;
+
+    if (!drive->stats.seeking) {
+        return;
+    }
+
+    drive->stats.seeking = false;
+
+    // You can step out and back in again, and end up where you started;
+    // that's not much of a seek.
+    dist = abs(drive->track_pos - drive->stats.seek_from);
+    if (dist) {
+        drive->stats.seeks[apple2_dd_seek_bucket(dist)]++;
+    }
+}
+
+/*
+ * Account for a byte that the software in the machine has read from the
+ * drive.
+ */
+void
+apple2_dd_count_read(apple2dd *drive, vm_8bit byte)
+{
+    apple2_dd_stats *stats = &drive->stats;
+
+    apple2_dd_seek_end(drive);
+
+    stats->bytes_read++;
+
+    if (byte == 0xFF) {
+        stats->sync_skipped++;
+    }
+
+    stats->prologue = ((stats->prologue << 8) | byte) & 0xFFFFFF;
+    if (stats->prologue == 0xD5AAAD) {
+        stats->sector_reads[drive->track_pos / 2]++;
+    }
+}
+
+/*
+ * Print the counters we've kept for a drive to the given stream. The
+ * name is how we'll label the drive (e.g. "drive1"), and now is the
+ * cycle count as of which we should figure the motor time.
+ */
+void
+apple2_dd_stats_dump(apple2dd *drive, const char *name, FILE *stream,
+                     uint64_t now)
+{
+    apple2_dd_stats *stats = &drive->stats;
+    int i;
+
+    fprintf(stream, "%s: read %llu, written %llu, sync skipped %llu\n",
+            name,
+            (unsigned long long)stats->bytes_read,
+            (unsigned long long)stats->bytes_written,
+            (unsigned long long)stats->sync_skipped);
+
+    fprintf(stream, "%s: half-steps %llu, motor cycles %llu\n",
+            name,
+            (unsigned long long)stats->half_steps,
+            (unsigned long long)apple2_dd_motor_cycles(drive, now));
+
+    fprintf(stream, "%s: seeks", name);
+    for (i = 0; i < DD_SEEK_BUCKETS; i++) {
+        fprintf(stream, " %d+:%llu", 1 << i,
+                (unsigned long long)stats->seeks[i]);
+    }
+    fputc('\n', stream);
+
+    // There are a lot of tracks, and most of them will not have been
+    // read; so we only bother to print the ones that were.
+    fprintf(stream, "%s: sectors", name);
+    for (i = 0; i < DD_NUM_TRACKS; i++) {
+        if (stats->sector_reads[i]) {
+            fprintf(stream, " T%02d:%llu", i,
+                    (unsigned long long)stats->sector_reads[i]);
+        }
+    }
+    fputc('\n', stream);
+}
+
 /*
  * Set the write-protect status for the disk. Note that it was _disks_
  * that were write-protected in the past, sometimes by taping over a
@@ -488,14 +758,16 @@ apple2_dd_switch_drive(apple2 *mach, size_t addr)
         ? mach->selected_drive
         : mach->drive1;
 
+    uint64_t now = mach->cpu->cycles;
+
     switch (addr) {
         case 0x8:
-            apple2_dd_turn_on(mach->drive1, false);
-            apple2_dd_turn_on(mach->drive2, false);
+            apple2_dd_motor(mach->drive1, false, now);
+            apple2_dd_motor(mach->drive2, false, now);
             break;
 
         case 0x9:
-            apple2_dd_turn_on(seldrive, true);
+            apple2_dd_motor(seldrive, true, now);
             break;
 
         case 0xA:
@@ -602,7 +874,7 @@ SEGMENT_READER(apple2_dd_switch_read)
         apple2_dd_switch_latch(drive, 0);
     }
 
-    return (vm_8bit)(arc4random() & 0xff);
+    return apple2_rewind_noise(mach->rewind, mach);
 }
 
 /*
@@ -10,10 +10,16 @@
 #include <strings.h>
 
 #include "apple2/apple2.h"
+#include "apple2/cond.h"
+#include "apple2/dd.h"
 #include "apple2/debug.h"
 #include "apple2/hires.h"
+#include "apple2/state.h"
+#include "apple2/watch.h"
+#include "mos6502/calls.h"
 #include "mos6502/dis.h"
 #include "mos6502/mos6502.h"
+#include "mos6502/prof.h"
 #include "vm_di.h"
 #include "vm_event.h"
 
@@ -29,35 +35,131 @@
  */
 static bool breakpoints[BREAKPOINTS_MAX];
 
+/*
+ * The number of breakpoints set on each page of memory. The run loop
+ * looks here before it looks in the table above (see
+ * apple2_debug_trap()), so that it only pays for breakpoints on the
+ * pages that have them.
+ */
+unsigned short apple2_debug_break_pages[BREAKPOINTS_MAX >> 8];
+
+/*
+ * The most breakpoints that may have conditions at once
+ */
+#define CONDS_MAX 64
+
+/*
+ * The conditions on our conditional breakpoints. Most breakpoints have
+ * none, so rather than keep a condition for every address, we keep a
+ * short list of the ones that do.
+ */
+static struct {
+    int addr;
+    apple2_cond *cond;
+} conds[CONDS_MAX];
+
+static int nconds = 0;
+
+/*
+ * The most cycles we'll run for in one go when the debugger runs the
+ * machine for you (as until and its kin do): about a minute of the
+ * machine's time. If what you asked to run until never happens, you
+ * still get your prompt back.
+ */
+#define DEBUG_RUN_MAX (1020484ULL * 60)
+
+/*
+ * The things we can run until (see debug_run()): the PC coming to some
+ * address; the PC coming to some address with the stack where it is
+ * now, which is how we return from a JSR; an RTS or RTI that takes us
+ * out of the subroutine we're in; or some number of cycles going by.
+ */
+enum debug_until {
+    UNTIL_PC,
+    UNTIL_RETURN_TO,
+    UNTIL_RETURN,
+    UNTIL_CYCLES,
+};
+
+/*
+ * Return the index in conds of the condition for addr, or -1 if the
+ * breakpoint there (if there is one) has none.
+ */
+static int
+debug_cond(int addr)
+{
+    for (int i = 0; i < nconds; i++) {
+        if (conds[i].addr == addr) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
 /*
  * A table of commands that we support in the debugger. This list is
  * printed out (in somewhat readable form) by the help/h command.
  */
 apple2_debug_cmd cmdtable[] = {
-    { "break", "b", apple2_debug_cmd_break, 1, "<addr>",
-        "Add breakpoint at <addr>", },
+    { "break", "b", apple2_debug_cmd_break, 1, "<addr> [<cond>]",
+        "Add breakpoint at <addr>, if <cond> holds", },
+    { "calls", "cg", apple2_debug_cmd_calls, 0, "",
+        "Start following calls, or print the busiest subroutines", },
     { "dblock", "db", apple2_debug_cmd_dblock, 2, "<from> <to>",
         "Disassemble a block of code", },
+    { "dinsert", "di", apple2_debug_cmd_dinsert, 2, "<file> <drive>",
+        "Insert the disk in <file> into <drive> (1 or 2)", },
+    { "dstat", "ds", apple2_debug_cmd_dstat, 0, "",
+        "Print disk drive activity counters", },
+    { "finish", "f", apple2_debug_cmd_finish, 0, "",
+        "Run until the current subroutine returns", },
     { "hdump", "hd", apple2_debug_cmd_hdump, 2, "<from> <to>",
         "Hex dump memory in a given region", },
+    { "heatmap", "hm", apple2_debug_cmd_heatmap, 0, "[<file>]",
+        "Start counting memory accesses, or show (or save) the counts", },
     { "help", "h", apple2_debug_cmd_help, 0, "",
         "Print out this list of commands", },
     { "hidump", "hid", apple2_debug_cmd_hidump, 1, "<file>",
         "Dump hires graphics memory to file", },
     { "jump", "j", apple2_debug_cmd_jump, 1, "<addr>",
         "Jump to <addr> for next execution", },
+    { "loadstate", "ls", apple2_debug_cmd_loadstate, 1, "<file>",
+        "Load the machine state saved in <file>", },
+    { "next", "n", apple2_debug_cmd_next, 0, "",
+        "Step to the next opcode, running through any JSR", },
     { "printaddr", "pa", apple2_debug_cmd_printaddr, 1, "<addr>",
         "Print the value at memory address <addr>", },
     { "printstate", "ps", apple2_debug_cmd_printstate, 0, "",
         "Print the machine and CPU state", },
+    { "profile", "pf", apple2_debug_cmd_profile, 0, "",
+        "Start profiling, or print the profile so far", },
     { "quit", "q", apple2_debug_cmd_quit, 0, "",
         "Quit the emulator", },
+    { "rcontinue", "rc", apple2_debug_cmd_rcontinue, 0, "",
+        "Run backward to the previous breakpoint", },
     { "resume", "r", apple2_debug_cmd_resume, 0, "",
         "Resume execution", },
+    { "rstep", "rs", apple2_debug_cmd_rstep, 0, "",
+        "Step backward by one instruction", },
+    { "run", "rn", apple2_debug_cmd_run, 1, "<cycles>",
+        "Run for <cycles> (in decimal) cycles", },
+    { "savestate", "ss", apple2_debug_cmd_savestate, 1, "<file>",
+        "Save the machine state to <file>", },
     { "step", "s", apple2_debug_cmd_step, 0, "",
         "Execute the current opcode and break at the next", },
     { "unbreak", "u", apple2_debug_cmd_unbreak, 1, "<addr>",
         "Remove breakpoint at <addr>", },
+    { "until", "ut", apple2_debug_cmd_until, 1, "<addr>",
+        "Run until the PC comes to <addr>", },
+    { "until-frame", "uf", apple2_debug_cmd_until_frame, 0, "",
+        "Run until the next video frame begins", },
+    { "unwatch", "uw", apple2_debug_cmd_unwatch, 1, "<addr>",
+        "Remove the watchpoints on <addr>", },
+    { "watch", "w", apple2_debug_cmd_watch, 2, "<from> <to> [rwc]",
+        "Stop on a read, write, or change from <from> to <to>", },
+    { "watches", "wl", apple2_debug_cmd_watches, 0, "",
+        "List the watchpoints", },
     { "writeaddr", "wa", apple2_debug_cmd_writeaddr, 2, "<addr> <byte>",
         "Write <byte> at <addr>", },
     { "writestate", "ws", apple2_debug_cmd_writestate, 2, "<reg> <byte>",
@@ -124,6 +226,10 @@ apple2_debug_break(int addr)
         return;
     }
 
+    if (!breakpoints[addr]) {
+        apple2_debug_break_pages[addr >> 8]++;
+    }
+
     breakpoints[addr] = true;
 }
 
@@ -133,11 +239,61 @@ apple2_debug_break(int addr)
 void
 apple2_debug_unbreak(int addr)
 {
+    int i;
+
     if (addr < 0 || addr >= BREAKPOINTS_MAX) {
         return;
     }
 
+    if (breakpoints[addr]) {
+        apple2_debug_break_pages[addr >> 8]--;
+    }
+
     breakpoints[addr] = false;
+
+    i = debug_cond(addr);
+    if (i >= 0) {
+        apple2_cond_free(conds[i].cond);
+        conds[i] = conds[--nconds];
+    }
+}
+
+/*
+ * Add a breakpoint for addr which we only stop at if the condition in
+ * str holds (see apple2.cond.c). If there is already a breakpoint for
+ * addr, it gets the new condition. We return ERR_INVALID if we can't
+ * make sense of the condition, or have no room for another.
+ */
+int
+apple2_debug_break_if(int addr, const char *str)
+{
+    apple2_cond *cond;
+
+    if (addr < 0 || addr >= BREAKPOINTS_MAX) {
+        return ERR_INVALID;
+    }
+
+    // If addr already has a condition, the new one takes its place;
+    // otherwise we need room for another. Either way, we find out
+    // before we take away whatever breakpoint is there.
+    if (nconds == CONDS_MAX && debug_cond(addr) < 0) {
+        return ERR_INVALID;
+    }
+
+    cond = apple2_cond_create(str);
+    if (cond == NULL) {
+        return ERR_INVALID;
+    }
+
+    // Whatever breakpoint (and condition) was here goes
+    apple2_debug_unbreak(addr);
+
+    conds[nconds].addr = addr;
+    conds[nconds].cond = cond;
+    nconds++;
+
+    apple2_debug_break(addr);
+    return OK;
 }
 
 /*
@@ -153,6 +309,24 @@ apple2_debug_broke(int addr)
     return breakpoints[addr];
 }
 
+/*
+ * Return true if the CPU should stop where it is: that is, if there's a
+ * breakpoint at its PC, and the breakpoint's condition (if it has one)
+ * holds.
+ */
+bool
+apple2_debug_stop(mos6502 *cpu)
+{
+    int i;
+
+    if (!breakpoints[cpu->PC]) {
+        return false;
+    }
+
+    i = debug_cond(cpu->PC);
+    return i < 0 || apple2_cond_eval(conds[i].cond, cpu);
+}
+
 /*
  * Remove all breakpoints that have been set for any address. This
  * function doesn't have a ton of functional value--it's main use is in
@@ -163,6 +337,13 @@ void
 apple2_debug_unbreak_all()
 {
     memset(breakpoints, false, BREAKPOINTS_MAX);
+    memset(apple2_debug_break_pages, 0, sizeof(apple2_debug_break_pages));
+
+    for (int i = 0; i < nconds; i++) {
+        apple2_cond_free(conds[i].cond);
+    }
+
+    nconds = 0;
 }
 
 /*
@@ -226,6 +407,7 @@ apple2_debug_execute(const char *str)
     args.addr1 = 0;
     args.addr2 = 0;
     args.target = NULL;
+    args.rest = NULL;
 
     switch (cmd->nargs) {
         case 2:
@@ -256,13 +438,22 @@ apple2_debug_execute(const char *str)
             break;
     }
 
+    // Whatever's left, less any spaces it begins with
+    while (ebuf && *ebuf == ' ') {
+        ebuf++;
+    }
+
+    if (ebuf && *ebuf) {
+        args.rest = ebuf;
+    }
+
     cmd->handler(&args);
 
     free(orig);
 }
 
 /*
- * Compare a string key (k) with a apple2_debug_cmd (elem) name or abbrev
+ * Compare a string key (k) with a apple2_debug_cmd (elem) name
  * field. This is the function we use for bsearch() in
  * apple2_debug_find_cmd().
  */
@@ -272,10 +463,6 @@ cmd_compar(const void *k, const void *elem)
     const char *key = (const char *)k;
     const apple2_debug_cmd *cmd = (const apple2_debug_cmd *)elem;
 
-    if (strlen(key) < 3) {
-        return strcmp(key, cmd->abbrev);
-    }
-
     return strcmp(key, cmd->name);
 }
 
@@ -287,16 +474,43 @@ cmd_compar(const void *k, const void *elem)
 apple2_debug_cmd *
 apple2_debug_find_cmd(const char *str)
 {
+    // The table is sorted by name, but the abbreviations don't sort the
+    // same way ("hd" comes before "h", for instance), so we can't
+    // bsearch for those. There are few enough commands that a scan is
+    // fine.
+    if (strlen(str) < 3) {
+        for (int i = 0; i < CMDTABLE_SIZE; i++) {
+            if (strcmp(str, cmdtable[i].abbrev) == 0) {
+                return &cmdtable[i];
+            }
+        }
+
+        return NULL;
+    }
+
     return (apple2_debug_cmd *)bsearch(str, &cmdtable, CMDTABLE_SIZE,
                                    sizeof(apple2_debug_cmd), cmd_compar);
 }
 
 /*
- * Add a breakpoint at the address given in args->addr1
+ * Add a breakpoint at the address given in args->addr1. If there's
+ * anything after the address, it's a condition the breakpoint must
+ * meet.
  */
 DEBUG_CMD(break)
 {
-    apple2_debug_break(args->addr1);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    if (args->rest == NULL) {
+        // Whatever condition there was, there isn't now
+        apple2_debug_unbreak(args->addr1);
+        apple2_debug_break(args->addr1);
+        return;
+    }
+
+    if (apple2_debug_break_if(args->addr1, args->rest) != OK) {
+        fprintf(stream, "Couldn't set a breakpoint if %s\n", args->rest);
+    }
 }
 
 /*
@@ -314,6 +528,18 @@ DEBUG_CMD(help)
     }
 }
 
+/*
+ * Print the activity counters we've kept for both disk drives
+ */
+DEBUG_CMD(dstat)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    apple2_dd_stats_dump(mach->drive1, "drive1", stream, mach->cpu->cycles);
+    apple2_dd_stats_dump(mach->drive2, "drive2", stream, mach->cpu->cycles);
+}
+
 /*
  * Remove any breakpoint at the current PC and unpause execution
  */
@@ -322,8 +548,12 @@ DEBUG_CMD(resume)
     apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
 
     // If we paused because of a breakpoint, then we need to clear it
-    // before we can really keep moving.
-    apple2_debug_unbreak(mach->cpu->PC);
+    // before we can really keep moving. A conditional breakpoint we
+    // leave be; you set it to catch something that may well happen
+    // again, and the run loop won't look at it until we've moved on.
+    if (debug_cond(mach->cpu->PC) < 0) {
+        apple2_debug_unbreak(mach->cpu->PC);
+    }
 
     mach->paused = false;
     mach->debug = false;
@@ -356,7 +586,7 @@ DEBUG_CMD(printaddr)
     mos6502 *cpu = (mos6502 *)vm_di_get(VM_CPU);
     FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
 
-    fprintf(stream, "$%02X\n", mos6502_get(cpu, args->addr1));
+    fprintf(stream, "$%02X\n", mos6502_peek(cpu, args->addr1));
 }
 
 /*
@@ -397,6 +627,81 @@ DEBUG_CMD(writestate)
     }
 }
 
+/*
+ * If we aren't following the CPU's calls, start now; if we are, print
+ * the subroutines which have taken the most cycles.
+ */
+DEBUG_CMD(calls)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    if (mach->cpu->calls == NULL) {
+        if (mos6502_calls_start(mach->cpu) == OK) {
+            fprintf(stream, "Following calls\n");
+        }
+
+        return;
+    }
+
+    mos6502_calls_dump(mach->cpu->calls, stream, 0);
+}
+
+/*
+ * If we aren't counting the machine's accesses to memory, start now; if
+ * we are, draw a heatmap of what we've counted so far, or write it into
+ * the file named after the command, as CSV.
+ */
+DEBUG_CMD(heatmap)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    FILE *out;
+
+    if (mach->heat == NULL) {
+        if (apple2_heat_start(mach) == OK) {
+            fprintf(stream, "Counting memory accesses\n");
+        }
+
+        return;
+    }
+
+    if (args->rest == NULL) {
+        apple2_heat_dump(mach->heat, stream);
+        return;
+    }
+
+    out = fopen(args->rest, "w");
+    if (out == NULL) {
+        fprintf(stream, "Couldn't open %s: %s\n",
+                args->rest, strerror(errno));
+        return;
+    }
+
+    apple2_heat_csv(mach->heat, out);
+    fclose(out);
+}
+
+/*
+ * If we aren't profiling the CPU, start now; if we are, print the hot
+ * spots and the rest of the profile we've kept so far.
+ */
+DEBUG_CMD(profile)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    if (mach->cpu->prof == NULL) {
+        if (mos6502_prof_start(mach->cpu) == OK) {
+            fprintf(stream, "Profiling started\n");
+        }
+
+        return;
+    }
+
+    mos6502_prof_dump(mach->cpu, stream, 0);
+}
+
 /*
  * Quit the program entirely
  */
@@ -413,6 +718,49 @@ DEBUG_CMD(unbreak)
     apple2_debug_unbreak(args->addr1);
 }
 
+/*
+ * Watch the memory from args->addr1 through args->addr2, for the kinds
+ * of access given after them (r, w, and c, for read, write, and change;
+ * if none are, we watch for writes).
+ */
+DEBUG_CMD(watch)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    int kind = apple2_watch_kind(args->rest);
+
+    if (kind == 0 || args->addr1 < 0 || args->addr2 > 0xFFFF ||
+        apple2_watch_add(mach, args->addr1, args->addr2, kind) != OK
+       ) {
+        fprintf(stream, "Couldn't watch $%04X-$%04X\n",
+                args->addr1, args->addr2);
+    }
+}
+
+/*
+ * Remove every watchpoint that covers the address in args->addr1
+ */
+DEBUG_CMD(unwatch)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    if (apple2_watch_remove(mach, args->addr1) != OK) {
+        fprintf(stream, "Nothing is watching $%04X\n", args->addr1);
+    }
+}
+
+/*
+ * List the watchpoints we have, and how often they've been hit
+ */
+DEBUG_CMD(watches)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    apple2_watch_dump(mach->watch, stream);
+}
+
 /*
  * Execute the current opcode at PC in the CPU, then break at the
  * next opcode.
@@ -421,11 +769,165 @@ DEBUG_CMD(step)
 {
     mos6502 *cpu = (mos6502 *)vm_di_get(VM_CPU);
 
-    apple2_debug_unbreak(cpu->PC);
+    // As with resume, a conditional breakpoint stays where it is
+    if (debug_cond(cpu->PC) < 0) {
+        apple2_debug_unbreak(cpu->PC);
+    }
+
     mos6502_execute(cpu);
     apple2_debug_break(cpu->PC);
 }
 
+/*
+ * Run the machine until what we were told to run until has happened
+ * (see enum debug_until), or we come to a breakpoint, or a watchpoint
+ * catches something, or we've run for DEBUG_RUN_MAX cycles; and then
+ * stop at the prompt again. We do the least we can between
+ * instructions: there's no prompt, no disassembly, and no drawing,
+ * since no one would see it anyway. The instruction at the PC is
+ * executed whether there's a breakpoint on it or not; you're there
+ * already, after all.
+ */
+static void
+debug_run(apple2 *mach, int until, vm_16bit addr, uint64_t cycles)
+{
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    mos6502 *cpu = mach->cpu;
+    uint64_t limit = cpu->cycles + DEBUG_RUN_MAX;
+    vm_8bit S = cpu->S;
+    bool done = false;
+
+    // A watchpoint stops us the way it always stops the machine, by
+    // pausing it; so we don't want to start out paused
+    mach->paused = false;
+
+    while (!done && !mach->paused) {
+        apple2_replay_tick(mach->replay, mach);
+
+        if (mach->screen && vm_screen_last_key(mach->screen)) {
+            mach->strobe = true;
+        }
+
+        apple2_rewind_tick(mach->rewind, mach);
+        mos6502_execute(cpu);
+
+        switch (until) {
+            case UNTIL_PC:
+                done = cpu->PC == addr;
+                break;
+
+            case UNTIL_RETURN_TO:
+                done = cpu->PC == addr && cpu->S == S;
+                break;
+
+            case UNTIL_RETURN:
+                // The stack wraps around within its page, so we look at
+                // how far S has come up, rather than at S itself (see
+                // mos6502_calls_count())
+                done = (cpu->opcode == 0x60 || cpu->opcode == 0x40) &&
+                    (int8_t)(cpu->S - S) > 0;
+                break;
+
+            case UNTIL_CYCLES:
+                done = cpu->cycles >= cycles;
+                break;
+        }
+
+        if (apple2_debug_trap(cpu)) {
+            break;
+        }
+
+        if (cpu->cycles >= limit) {
+            fprintf(stream, "Gave up after %llu cycles\n",
+                    (unsigned long long)DEBUG_RUN_MAX);
+            break;
+        }
+    }
+
+    mach->paused = true;
+    mach->debug = true;
+}
+
+/*
+ * Run until the PC comes to the address given in args->addr1
+ */
+DEBUG_CMD(until)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+
+    if (args->addr1 < 0) {
+        return;
+    }
+
+    debug_run(mach, UNTIL_PC, args->addr1, 0);
+}
+
+/*
+ * Run until the next video frame begins
+ */
+DEBUG_CMD(until_frame)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    uint64_t cycles = mach->cpu->cycles;
+
+    debug_run(mach, UNTIL_CYCLES, 0,
+              cycles - (cycles % APPLE2_FRAME_CYCLES) + APPLE2_FRAME_CYCLES);
+}
+
+/*
+ * Run for the number of cycles given in args->target. Unlike most of
+ * the numbers the debugger takes, this one is in decimal; nobody counts
+ * cycles in hex.
+ */
+DEBUG_CMD(run)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    unsigned long long cycles;
+    char *end;
+
+    if (args->target == NULL) {
+        return;
+    }
+
+    cycles = strtoull(args->target, &end, 10);
+    if (end == args->target || *end != '\0' || cycles == 0) {
+        fprintf(stream, "Can't run for %s cycles\n", args->target);
+        return;
+    }
+
+    debug_run(mach, UNTIL_CYCLES, 0, mach->cpu->cycles + cycles);
+}
+
+/*
+ * Step to the next opcode; but if the current one is a JSR, run
+ * through the subroutine it calls, and stop when it returns to us.
+ */
+DEBUG_CMD(next)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    mos6502 *cpu = mach->cpu;
+
+    if (mos6502_peek(cpu, cpu->PC) == 0x20) {
+        debug_run(mach, UNTIL_RETURN_TO, cpu->PC + 3, 0);
+        return;
+    }
+
+    // Anything else takes us only as far as the next instruction, which
+    // is the first one that ends at least a cycle from now
+    debug_run(mach, UNTIL_CYCLES, 0, cpu->cycles + 1);
+}
+
+/*
+ * Run until the subroutine we're in returns to whatever called it
+ */
+DEBUG_CMD(finish)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+
+    debug_run(mach, UNTIL_RETURN, 0, 0);
+}
+
 /*
  * Disassemble a block of memory from one given address to another.
  * Useful when you want to see what memory looks like in a given region.
@@ -474,3 +976,116 @@ DEBUG_CMD(hidump)
 
     fclose(stream);
 }
+
+/*
+ * Save the state of the machine into the file given as our target.
+ * We compress the state, since a human is probably going to keep the
+ * file around for a while.
+ */
+DEBUG_CMD(savestate)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    FILE *out;
+
+    out = fopen(args->target, "w");
+    if (out == NULL) {
+        fprintf(stream, "Couldn't open %s: %s\n",
+                args->target, strerror(errno));
+        return;
+    }
+
+    if (apple2_state_save(mach, out, STATE_COMPRESS) != OK) {
+        fprintf(stream, "Couldn't save state to %s\n", args->target);
+    }
+
+    fclose(out);
+}
+
+/*
+ * Load a state which was saved to the file given as our target.
+ */
+DEBUG_CMD(loadstate)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    FILE *in;
+
+    in = fopen(args->target, "r");
+    if (in == NULL) {
+        fprintf(stream, "Couldn't open %s: %s\n",
+                args->target, strerror(errno));
+        return;
+    }
+
+    if (apple2_state_load(mach, in) != OK) {
+        fprintf(stream, "Couldn't load state from %s\n", args->target);
+    } else {
+        // Our checkpoints are from some other time now, and whatever
+        // we were recording can't be replayed from here
+        apple2_rewind_clear(mach->rewind);
+        apple2_replay_stop(mach->replay);
+    }
+
+    fclose(in);
+}
+
+/*
+ * Step backward, to the instruction we executed before the current one
+ */
+DEBUG_CMD(rstep)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    if (apple2_rewind_step(mach->rewind, mach) != OK) {
+        fprintf(stream, "Can't step back any further\n");
+    }
+}
+
+/*
+ * Run backward until we come to an instruction with a breakpoint on it
+ * (or as far back as we can go)
+ */
+DEBUG_CMD(rcontinue)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+
+    if (apple2_rewind_continue(mach->rewind, mach) != OK) {
+        fprintf(stream, "Can't run back any further\n");
+    }
+}
+
+/*
+ * Insert the disk in the file given as our target into the drive given
+ * as our second argument. If we're recording, the disk is recorded too.
+ */
+DEBUG_CMD(dinsert)
+{
+    apple2 *mach = (apple2 *)vm_di_get(VM_MACHINE);
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    FILE *in;
+
+    if (args->addr2 != 1 && args->addr2 != 2) {
+        fprintf(stream, "There is no drive %d\n", args->addr2);
+        return;
+    }
+
+    in = fopen(args->target, "r+");
+    if (in == NULL) {
+        fprintf(stream, "Couldn't open %s: %s\n",
+                args->target, strerror(errno));
+        return;
+    }
+
+    if (apple2_replay_insert(mach->replay, mach, args->addr2, in,
+                             DD_DOS33) != OK) {
+        fprintf(stream, "Couldn't insert %s\n", args->target);
+        fclose(in);
+        return;
+    }
+
+    // The rewind ring has to be able to insert it again, too
+    apple2_rewind_disk(mach->rewind, mach, args->addr2);
+}
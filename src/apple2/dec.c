@@ -83,12 +83,22 @@ apple2_dec_nib(vm_segment *dest, vm_segment *src)
 int
 apple2_dec_track(int sectype, vm_segment *dest, vm_segment *src, int doff, int track)
 {
-    int orig = doff;
-    int sect, sectlen, soff;
+    int i, sect, sectlen, soff;
 
     soff = (track * ENC_ETRACK) + ENC_ETRACK_HEADER;
 
-    for (sect = 0; sect < ENC_NUM_SECTORS; sect++) {
+    for (i = 0; i < ENC_NUM_SECTORS; i++) {
+        // Sectors are not laid out in order within the track (see
+        // apple2_enc_track), so we must read the sector number from the
+        // address field to know where the data belongs. The number is
+        // 4-and-4 encoded, following the prologue, volume, and track.
+        sect = ((vm_segment_get(src, soff + 7) << 1) | 1) &
+            vm_segment_get(src, soff + 8);
+
+        if (sect >= ENC_NUM_SECTORS) {
+            return 0;
+        }
+
         doff =
             (track * ENC_DTRACK) +
             (apple2_dd_sector_num(sectype, sect) * ENC_DSECTOR);
@@ -153,17 +153,24 @@ int
 apple2_enc_sector(vm_segment *dest, vm_segment *src,
                   int doff, int soff)
 {
-    int i, di, orig;
+    int i, di, len;
     vm_8bit lastval, curval;
 
-    orig = doff;
-    
     // The init array contains the src segment's 256 bytes converted
     // into 342 bytes, but more works needs to be done to get it into
     // proper 6-and-2 encoding. The xor array will contain the XOR'd
     // version of init, but with an extra value tagged in as a checksum.
     vm_8bit init[0x156], xor[0x157];
 
+    // We read the sector from src all at once, and build up what we
+    // write into dest in out, which we write all at once at the end:
+    // the markers, the data field, and the self-sync bytes after.
+    vm_8bit data[0x100], out[3 + 0x157 + 3 + 48];
+
+    if (vm_segment_read_range(src, data, soff, 0x100) != OK) {
+        return 0;
+    }
+
     // This loop is really complicated; I'll annotate it as best I can.
     // To begin with, we mean to write the first 86 bytes for the
     // initial array.
@@ -183,9 +190,9 @@ apple2_enc_sector(vm_segment *dest, vm_segment *src,
         // v56 is offset by 0x56, and v00 has no offset. In decimal
         // terms, vac is 172 bytes offset from 0, and v56 is 86 bytes
         // offset from 0.
-        vac = vm_segment_get(src, soff + offac);
-        v56 = vm_segment_get(src, soff + off56);
-        v00 = vm_segment_get(src, soff + i);
+        vac = data[offac];
+        v56 = data[off56];
+        v00 = data[i];
 
         // The value we ultimately want to write into the dest segment
         // is then mangled a bit. v begins life as zero, of course; it's
@@ -212,7 +219,7 @@ apple2_enc_sector(vm_segment *dest, vm_segment *src,
     // The rest of the bytes may be copied from the src buffer into dest
     // without modification. (Phew!)
     for (i = 0x00, di = 0x56; i < 0x100; i++, di++) {
-        init[di] = vm_segment_get(src, soff+i);
+        init[di] = data[i];
     }
 
     // Here we will XOR each byte with each successive byte, and store
@@ -228,28 +235,31 @@ apple2_enc_sector(vm_segment *dest, vm_segment *src,
     xor[i] = lastval;
 
     // This is the marker of the beginning of sector data
-    vm_segment_set(dest, doff++, 0xd5);
-    vm_segment_set(dest, doff++, 0xaa);
-    vm_segment_set(dest, doff++, 0xad);
+    len = 0;
+    out[len++] = 0xd5;
+    out[len++] = 0xaa;
+    out[len++] = 0xad;
 
     // Now we use the gcr table for 6-and-2 encoding to take the XOR'd
     // values and represent them as they should be in the destination
     // segment. This constitutes the data field of the sector.
     for (i = 0; i < 0x157; i++) {
-        vm_segment_set(dest, doff++, gcr62[xor[i] >> 2]);
+        out[len++] = gcr62[xor[i] >> 2];
     }
 
     // These three bytes mark the end of the data field
-    vm_segment_set(dest, doff++, 0xde);
-    vm_segment_set(dest, doff++, 0xaa);
-    vm_segment_set(dest, doff++, 0xeb);
+    out[len++] = 0xde;
+    out[len++] = 0xaa;
+    out[len++] = 0xeb;
 
     // At the conclusion of a sector, we write 48 self-sync bytes.
     for (i = 0; i < 48; i++) {
-        vm_segment_set(dest, doff++, 0xff);
+        out[len++] = 0xff;
     }
 
-    return doff - orig;
+    vm_segment_write_range(dest, out, doff, len);
+
+    return len;
 }
 
 /*
@@ -0,0 +1,943 @@
+/*
+ * apple2.gdb.c
+ *
+ * This is a debug server that speaks (enough of) the GDB remote serial
+ * protocol, over a TCP or UNIX socket. The debugger in apple2.debug.c
+ * only works from the terminal we were started in, and stops the whole
+ * machine to wait on it; this lets a debugger (gdb itself, or any tool
+ * that speaks the protocol) attach to a machine wherever it's running,
+ * erc-headless included, and leaves the machine running until the
+ * debugger asks it to stop.
+ *
+ * We never block on the socket. While the machine runs, the run loop
+ * calls apple2_gdb_tick() every so many cycles, and we deal with
+ * whatever has come in; while it's paused, we're called on every pass.
+ *
+ * The protocol is a series of packets, $<data>#<checksum>, each one
+ * acknowledged with a + (until the client asks us to stop doing that).
+ * What we understand:
+ *
+ *   ?              why we stopped
+ *   g, G           read or write all registers (see enum gdb_reg)
+ *   p, P           read or write one register
+ *   m, M           read or write memory
+ *   Z0/z0          add or remove a breakpoint
+ *   Z2/z2          add or remove a write watchpoint; Z3/z3 for reads,
+ *                  and Z4/z4 for either
+ *   s              step one instruction
+ *   c              continue until something stops us
+ *   ^C (a 0x03)    stop
+ *   D, k           detach, and let the machine run
+ *
+ * and some of the q packets gdb asks about when it attaches.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "apple2/debug.h"
+#include "apple2/gdb.h"
+#include "apple2/watch.h"
+#include "log.h"
+
+static const char hexdigits[] = "0123456789abcdef";
+
+/*
+ * Return the sum of the len bytes in data, modulo 256, which is the
+ * checksum a packet of that data carries.
+ */
+int
+apple2_gdb_checksum(const char *data, int len)
+{
+    vm_8bit sum = 0;
+
+    for (int i = 0; i < len; i++) {
+        sum += (vm_8bit)data[i];
+    }
+
+    return sum;
+}
+
+/*
+ * Send as much of what we're holding for the client as its socket will
+ * take right now. If the client is gone, we'll find out when we next
+ * read from it.
+ */
+static void
+gdb_flush(apple2_gdb *gdb)
+{
+    ssize_t n;
+    int sent = 0;
+
+    while (sent < gdb->out_len) {
+        n = send(gdb->client_fd, gdb->out + sent, gdb->out_len - sent,
+                 MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                sent = gdb->out_len;
+            }
+
+            break;
+        }
+
+        sent += n;
+    }
+
+    memmove(gdb->out, gdb->out + sent, gdb->out_len - sent);
+    gdb->out_len -= sent;
+}
+
+/*
+ * Write buf to the client. We never wait for the socket to have room;
+ * what it won't take now, we hold on to, and send from apple2_gdb_tick()
+ * when it will.
+ */
+static void
+gdb_write(apple2_gdb *gdb, const char *buf, size_t len)
+{
+    if (gdb->overflow) {
+        return;
+    }
+
+    if (gdb->out_len + len > sizeof(gdb->out)) {
+        gdb->overflow = true;
+        return;
+    }
+
+    memcpy(gdb->out + gdb->out_len, buf, len);
+    gdb->out_len += len;
+
+    gdb_flush(gdb);
+}
+
+/*
+ * Send the given data to the client as a packet.
+ */
+static void
+gdb_send(apple2_gdb *gdb, const char *data)
+{
+    char buf[GDB_PACKET_MAX + 4];
+    int len = strlen(data);
+    int sum;
+
+    if (len > GDB_PACKET_MAX) {
+        len = GDB_PACKET_MAX;
+    }
+
+    sum = apple2_gdb_checksum(data, len);
+
+    buf[0] = '$';
+    memcpy(buf + 1, data, len);
+    buf[len + 1] = '#';
+    buf[len + 2] = hexdigits[sum >> 4];
+    buf[len + 3] = hexdigits[sum & 0xF];
+
+    gdb_write(gdb, buf, len + 4);
+}
+
+/*
+ * Tell the client we've stopped, and why.
+ */
+static void
+gdb_stop_reply(apple2_gdb *gdb, int signal)
+{
+    char buf[4];
+
+    snprintf(buf, sizeof(buf), "S%02x", signal);
+    gdb_send(gdb, buf);
+}
+
+/*
+ * Return the value of the hex digit c, or -1 if it isn't one.
+ */
+static int
+gdb_hex(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/*
+ * Read the two hex digits at str as a byte, and return it; or -1 if
+ * they aren't.
+ */
+static int
+gdb_byte(const char *str)
+{
+    int hi = gdb_hex(str[0]);
+    int lo = hi < 0 ? -1 : gdb_hex(str[1]);
+
+    return lo < 0 ? -1 : (hi << 4) | lo;
+}
+
+/*
+ * Write byte into str as two hex digits.
+ */
+static void
+gdb_put_byte(char *str, vm_8bit byte)
+{
+    str[0] = hexdigits[byte >> 4];
+    str[1] = hexdigits[byte & 0xF];
+}
+
+/*
+ * Return the value of a register, or -1 if there is no such register.
+ */
+static int
+gdb_get_reg(mos6502 *cpu, int reg)
+{
+    switch (reg) {
+        case GDB_REG_A: return cpu->A;
+        case GDB_REG_X: return cpu->X;
+        case GDB_REG_Y: return cpu->Y;
+        case GDB_REG_P: return cpu->P;
+        case GDB_REG_S: return cpu->S;
+        case GDB_REG_PC: return cpu->PC;
+    }
+
+    return -1;
+}
+
+static void
+gdb_set_reg(mos6502 *cpu, int reg, int value)
+{
+    switch (reg) {
+        case GDB_REG_A: cpu->A = value; break;
+        case GDB_REG_X: cpu->X = value; break;
+        case GDB_REG_Y: cpu->Y = value; break;
+        case GDB_REG_P: cpu->P = value; break;
+        case GDB_REG_S: cpu->S = value; break;
+        case GDB_REG_PC: cpu->PC = value; break;
+    }
+}
+
+/*
+ * Write a register's value into str, in the order gdb expects (which is
+ * to say, low byte first), and return the number of characters we
+ * wrote.
+ */
+static int
+gdb_put_reg(char *str, mos6502 *cpu, int reg)
+{
+    int value = gdb_get_reg(cpu, reg);
+
+    gdb_put_byte(str, value & 0xFF);
+    if (reg != GDB_REG_PC) {
+        return 2;
+    }
+
+    gdb_put_byte(str + 2, value >> 8);
+    return 4;
+}
+
+/*
+ * Read a register's value from str, which has it as gdb_put_reg() would
+ * have written it, into the CPU; return the number of characters we
+ * read, or -1 if they weren't hex.
+ */
+static int
+gdb_read_reg(const char *str, mos6502 *cpu, int reg)
+{
+    int lo = gdb_byte(str), hi = 0;
+
+    if (lo < 0) {
+        return -1;
+    }
+
+    if (reg == GDB_REG_PC) {
+        hi = gdb_byte(str + 2);
+        if (hi < 0) {
+            return -1;
+        }
+    }
+
+    gdb_set_reg(cpu, reg, lo | (hi << 8));
+    return reg == GDB_REG_PC ? 4 : 2;
+}
+
+/*
+ * Handle a g packet: read the registers.
+ */
+static void
+gdb_cmd_regs(apple2_gdb *gdb, apple2 *mach)
+{
+    char buf[GDB_REG_COUNT * 4 + 1];
+    int len = 0;
+
+    for (int reg = 0; reg < GDB_REG_COUNT; reg++) {
+        len += gdb_put_reg(buf + len, mach->cpu, reg);
+    }
+
+    buf[len] = '\0';
+    gdb_send(gdb, buf);
+}
+
+/*
+ * Handle a G packet: write the registers.
+ */
+static void
+gdb_cmd_write_regs(apple2_gdb *gdb, apple2 *mach, const char *data)
+{
+    mos6502 saved = *mach->cpu;
+    int n;
+
+    for (int reg = 0; reg < GDB_REG_COUNT; reg++) {
+        n = gdb_read_reg(data, mach->cpu, reg);
+        if (n < 0) {
+            *mach->cpu = saved;
+            gdb_send(gdb, "E01");
+            return;
+        }
+
+        data += n;
+    }
+
+    gdb_send(gdb, "OK");
+}
+
+/*
+ * Handle a p packet (p<reg>) and a P packet (P<reg>=<value>).
+ */
+static void
+gdb_cmd_reg(apple2_gdb *gdb, apple2 *mach, const char *data, bool write)
+{
+    char buf[5];
+    char *end;
+    long reg;
+
+    reg = strtol(data, &end, 16);
+    if (end == data || reg < 0 || reg >= GDB_REG_COUNT) {
+        gdb_send(gdb, "E01");
+        return;
+    }
+
+    if (write) {
+        if (*end != '=' || gdb_read_reg(end + 1, mach->cpu, reg) < 0) {
+            gdb_send(gdb, "E01");
+            return;
+        }
+
+        gdb_send(gdb, "OK");
+        return;
+    }
+
+    buf[gdb_put_reg(buf, mach->cpu, reg)] = '\0';
+    gdb_send(gdb, buf);
+}
+
+/*
+ * Read the <addr>,<len> that m and M packets begin with. We return
+ * false if we can't, or if the range goes past the end of memory.
+ */
+static bool
+gdb_range(const char **data, unsigned long *addr, unsigned long *len)
+{
+    char *end;
+
+    *addr = strtoul(*data, &end, 16);
+    if (end == *data || *end != ',') {
+        return false;
+    }
+
+    *data = end + 1;
+    *len = strtoul(*data, &end, 16);
+    if (end == *data) {
+        return false;
+    }
+
+    *data = end;
+    return *addr <= 0xFFFF && *addr + *len <= 0x10000;
+}
+
+/*
+ * Handle an m packet: read memory.
+ */
+static void
+gdb_cmd_mem(apple2_gdb *gdb, apple2 *mach, const char *data)
+{
+    char buf[GDB_PACKET_MAX + 1];
+    unsigned long addr, len;
+
+    if (!gdb_range(&data, &addr, &len) || len * 2 > GDB_PACKET_MAX) {
+        gdb_send(gdb, "E01");
+        return;
+    }
+
+    for (unsigned long i = 0; i < len; i++) {
+        gdb_put_byte(buf + i * 2, mos6502_peek(mach->cpu, addr + i));
+    }
+
+    buf[len * 2] = '\0';
+    gdb_send(gdb, buf);
+}
+
+/*
+ * Handle an M packet: write memory. This is a write like any other the
+ * CPU might make, soft switches and all.
+ */
+static void
+gdb_cmd_write_mem(apple2_gdb *gdb, apple2 *mach, const char *data)
+{
+    unsigned long addr, len;
+    int byte;
+
+    if (!gdb_range(&data, &addr, &len) || *data++ != ':' ||
+        strlen(data) < len * 2
+       ) {
+        gdb_send(gdb, "E01");
+        return;
+    }
+
+    for (unsigned long i = 0; i < len; i++) {
+        if (gdb_byte(data + i * 2) < 0) {
+            gdb_send(gdb, "E01");
+            return;
+        }
+    }
+
+    for (unsigned long i = 0; i < len; i++) {
+        byte = gdb_byte(data + i * 2);
+        mos6502_set(mach->cpu, addr + i, byte);
+    }
+
+    gdb_send(gdb, "OK");
+}
+
+/*
+ * Handle Z and z packets (Z<type>,<addr>,<kind>), which add and remove
+ * breakpoints and watchpoints.
+ */
+static void
+gdb_cmd_point(apple2_gdb *gdb, apple2 *mach, const char *data, bool add)
+{
+    unsigned long type, addr, len;
+    int kind;
+    char *end;
+
+    type = strtoul(data, &end, 16);
+    if (end == data || *end != ',') {
+        gdb_send(gdb, "E01");
+        return;
+    }
+
+    data = end + 1;
+    if (!gdb_range(&data, &addr, &len)) {
+        gdb_send(gdb, "E01");
+        return;
+    }
+
+    switch (type) {
+        case 0:
+        case 1:
+            if (add) {
+                apple2_debug_break(addr);
+            } else {
+                apple2_debug_unbreak(addr);
+            }
+
+            gdb_send(gdb, "OK");
+            return;
+
+        case 2: kind = WATCH_WRITE; break;
+        case 3: kind = WATCH_READ; break;
+        case 4: kind = WATCH_READ | WATCH_WRITE; break;
+
+        default:
+            // We don't know that kind of point, which we say with an
+            // empty reply
+            gdb_send(gdb, "");
+            return;
+    }
+
+    if (len == 0) {
+        len = 1;
+    }
+
+    if (add) {
+        if (apple2_watch_add(mach, addr, addr + len - 1, kind) != OK) {
+            gdb_send(gdb, "E01");
+            return;
+        }
+    } else {
+        apple2_watch_remove(mach, addr);
+    }
+
+    gdb_send(gdb, "OK");
+}
+
+/*
+ * Let the machine run; we'll tell the client when it stops.
+ */
+static void
+gdb_continue(apple2_gdb *gdb, apple2 *mach)
+{
+    // If we're sitting on a breakpoint, get past it first; otherwise
+    // we'd stop again right where we are.
+    if (apple2_debug_broke(mach->cpu->PC)) {
+        mos6502_execute(mach->cpu);
+    }
+
+    mach->paused = false;
+    mach->debug = false;
+
+    gdb->running = true;
+    gdb->signal = GDB_SIGTRAP;
+}
+
+/*
+ * Let go of the client, and let the machine run on without it.
+ */
+static void
+gdb_detach(apple2_gdb *gdb, apple2 *mach)
+{
+    close(gdb->client_fd);
+
+    gdb->client_fd = -1;
+    gdb->in_len = 0;
+    gdb->out_len = 0;
+    gdb->overflow = false;
+    gdb->no_ack = false;
+    gdb->running = false;
+
+    mach->paused = false;
+    mach->debug = false;
+}
+
+/*
+ * Do what the packet with the given data asks of us.
+ */
+static void
+gdb_packet(apple2_gdb *gdb, apple2 *mach, const char *data)
+{
+    switch (data[0]) {
+        case '?':
+            mach->paused = true;
+            gdb->running = false;
+            gdb_stop_reply(gdb, GDB_SIGTRAP);
+            return;
+
+        case 'g':
+            gdb_cmd_regs(gdb, mach);
+            return;
+
+        case 'G':
+            gdb_cmd_write_regs(gdb, mach, data + 1);
+            return;
+
+        case 'p':
+            gdb_cmd_reg(gdb, mach, data + 1, false);
+            return;
+
+        case 'P':
+            gdb_cmd_reg(gdb, mach, data + 1, true);
+            return;
+
+        case 'm':
+            gdb_cmd_mem(gdb, mach, data + 1);
+            return;
+
+        case 'M':
+            gdb_cmd_write_mem(gdb, mach, data + 1);
+            return;
+
+        case 'Z':
+            gdb_cmd_point(gdb, mach, data + 1, true);
+            return;
+
+        case 'z':
+            gdb_cmd_point(gdb, mach, data + 1, false);
+            return;
+
+        case 's':
+            mos6502_execute(mach->cpu);
+            mach->paused = true;
+            gdb_stop_reply(gdb, GDB_SIGTRAP);
+            return;
+
+        case 'c':
+            gdb_continue(gdb, mach);
+            return;
+
+        case 'D':
+            gdb_send(gdb, "OK");
+            gdb_detach(gdb, mach);
+            return;
+
+        case 'k':
+            gdb_detach(gdb, mach);
+            return;
+
+        case 'H':
+            gdb_send(gdb, "OK");
+            return;
+    }
+
+    if (strncmp(data, "qSupported", 10) == 0) {
+        char buf[64];
+
+        snprintf(buf, sizeof(buf), "PacketSize=%x;QStartNoAckMode+",
+                 GDB_PACKET_MAX);
+        gdb_send(gdb, buf);
+    } else if (strcmp(data, "QStartNoAckMode") == 0) {
+        gdb_send(gdb, "OK");
+        gdb->no_ack = true;
+    } else if (strcmp(data, "qAttached") == 0) {
+        gdb_send(gdb, "1");
+    } else {
+        // Anything else, we don't support; an empty reply says so
+        gdb_send(gdb, "");
+    }
+}
+
+/*
+ * Work through what the client has sent us: acknowledgements (which we
+ * ignore), interrupts, and whole packets. Whatever is left over is the
+ * start of a packet we haven't got all of yet.
+ */
+static void
+gdb_process(apple2_gdb *gdb, apple2 *mach)
+{
+    char *in = gdb->in;
+    char *hash, *start;
+    int len, used = 0;
+
+    while (used < gdb->in_len && gdb->client_fd >= 0) {
+        start = in + used;
+
+        if (*start == '\x03') {
+            used++;
+
+            // The client may not have told us to run (we don't stop
+            // just because it attached), but it will want to hear that
+            // we've stopped all the same
+            if (!mach->paused) {
+                mach->paused = true;
+                gdb->running = true;
+                gdb->signal = GDB_SIGINT;
+            }
+
+            continue;
+        }
+
+        if (*start != '$') {
+            used++;
+            continue;
+        }
+
+        hash = memchr(start, '#', gdb->in_len - used);
+        if (hash == NULL || hash + 2 >= in + gdb->in_len) {
+            break;
+        }
+
+        len = hash - start - 1;
+        used += len + 4;
+
+        if (gdb_byte(hash + 1) != apple2_gdb_checksum(start + 1, len)) {
+            if (!gdb->no_ack) {
+                gdb_write(gdb, "-", 1);
+            }
+
+            continue;
+        }
+
+        if (!gdb->no_ack) {
+            gdb_write(gdb, "+", 1);
+        }
+
+        *hash = '\0';
+        gdb_packet(gdb, mach, start + 1);
+    }
+
+    if (gdb->client_fd < 0) {
+        return;
+    }
+
+    // A packet too big for us to hold will never be whole; throw it out
+    if (used == 0 && gdb->in_len == sizeof(gdb->in)) {
+        used = gdb->in_len;
+    }
+
+    memmove(in, in + used, gdb->in_len - used);
+    gdb->in_len -= used;
+}
+
+/*
+ * Take a new client, if one is waiting. We only talk to one at a time.
+ */
+static void
+gdb_accept(apple2_gdb *gdb)
+{
+    int fd, one = 1;
+
+    fd = accept(gdb->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    if (gdb->client_fd >= 0) {
+        close(fd);
+        return;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // Packets are small, and someone is waiting on every one of them
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    gdb->client_fd = fd;
+    gdb->in_len = 0;
+    gdb->out_len = 0;
+    gdb->overflow = false;
+    gdb->no_ack = false;
+    gdb->running = false;
+}
+
+/*
+ * This is called from the run loop: every pass while the machine is
+ * paused, and every GDB_POLL_CYCLES cycles while it runs. We tell the
+ * client if the machine has stopped, take a new client if there's one
+ * waiting, send whatever we've held on to for the client, and deal with
+ * whatever the client has sent.
+ */
+void
+apple2_gdb_tick(apple2_gdb *gdb, apple2 *mach)
+{
+    struct pollfd fds[2];
+    ssize_t n;
+
+    if (!mach->paused && mach->cpu->cycles < gdb->next) {
+        return;
+    }
+
+    gdb->next = mach->cpu->cycles + GDB_POLL_CYCLES;
+
+    // A client that has stopped taking what we send would have us hold
+    // on to more and more; we'd rather let go of it
+    if (gdb->client_fd >= 0 && gdb->overflow) {
+        log_crit("Debugger isn't reading from its socket; detaching it");
+        gdb_detach(gdb, mach);
+    }
+
+    if (gdb->client_fd >= 0) {
+        // While a client is attached, it's the debugger; we don't want
+        // the prompt on the terminal as well
+        mach->debug = false;
+
+        if (gdb->running && mach->paused) {
+            gdb->running = false;
+            gdb_stop_reply(gdb, gdb->signal);
+        }
+    }
+
+    fds[0].fd = gdb->listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = gdb->client_fd;
+    fds[1].events = POLLIN | (gdb->out_len > 0 ? POLLOUT : 0);
+
+    if (poll(fds, 2, mach->paused ? GDB_PAUSED_WAIT_MS : 0) <= 0) {
+        return;
+    }
+
+    if (fds[0].revents & POLLIN) {
+        gdb_accept(gdb);
+    }
+
+    if (fds[1].fd < 0 || fds[1].revents == 0) {
+        return;
+    }
+
+    if (fds[1].revents & POLLOUT) {
+        gdb_flush(gdb);
+    }
+
+    if (!(fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+        return;
+    }
+
+    n = recv(gdb->client_fd, gdb->in + gdb->in_len,
+             sizeof(gdb->in) - gdb->in_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        // The client is gone; the machine shouldn't wait on it
+        gdb_detach(gdb, mach);
+        return;
+    }
+
+    if (n > 0) {
+        gdb->in_len += n;
+        gdb_process(gdb, mach);
+    }
+}
+
+/*
+ * Listen on a UNIX socket at path, and return the socket; or -1 if we
+ * can't.
+ */
+static int
+gdb_listen_unix(const char *path)
+{
+    struct sockaddr_un sun;
+    int fd;
+
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+        return -1;
+    }
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // A socket left over from a run that didn't clean up after itself
+    // would keep us from binding
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Listen on a TCP port, given as PORT or HOST:PORT, and return the
+ * socket; or -1 if we can't. With no host, we listen only on the
+ * loopback interface; there's no security to speak of in the protocol,
+ * so it's best not to offer it to the world unless you mean to.
+ */
+static int
+gdb_listen_tcp(const char *spec)
+{
+    struct sockaddr_in sin;
+    const char *colon;
+    char host[64];
+    int fd, port, one = 1;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    colon = strrchr(spec, ':');
+    if (colon) {
+        if (colon - spec >= sizeof(host)) {
+            return -1;
+        }
+
+        memcpy(host, spec, colon - spec);
+        host[colon - spec] = '\0';
+
+        if (inet_pton(AF_INET, host, &sin.sin_addr) != 1) {
+            return -1;
+        }
+
+        spec = colon + 1;
+    }
+
+    port = atoi(spec);
+    if (port <= 0 || port > 0xFFFF) {
+        return -1;
+    }
+
+    sin.sin_port = htons(port);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Return a new debug server, listening at addr: a path (anything with
+ * a / in it) for a UNIX socket, or else a TCP port, as PORT or
+ * HOST:PORT. We return NULL if we can't listen there.
+ */
+apple2_gdb *
+apple2_gdb_create(const char *addr)
+{
+    apple2_gdb *gdb;
+    bool is_unix = strchr(addr, '/') != NULL;
+
+    gdb = calloc(1, sizeof(apple2_gdb));
+    if (gdb == NULL) {
+        log_crit("Could not allocate memory for debug server");
+        return NULL;
+    }
+
+    gdb->client_fd = -1;
+    gdb->listen_fd = is_unix ? gdb_listen_unix(addr) : gdb_listen_tcp(addr);
+
+    if (gdb->listen_fd < 0 || listen(gdb->listen_fd, 1) < 0) {
+        log_crit("Could not listen for a debugger at %s", addr);
+        apple2_gdb_free(gdb);
+        return NULL;
+    }
+
+    fcntl(gdb->listen_fd, F_SETFL,
+          fcntl(gdb->listen_fd, F_GETFL) | O_NONBLOCK);
+
+    if (is_unix) {
+        gdb->path = strdup(addr);
+    }
+
+    return gdb;
+}
+
+/*
+ * Stop listening, let go of any client, and free the server.
+ */
+void
+apple2_gdb_free(apple2_gdb *gdb)
+{
+    if (gdb == NULL) {
+        return;
+    }
+
+    if (gdb->client_fd >= 0) {
+        close(gdb->client_fd);
+    }
+
+    if (gdb->listen_fd >= 0) {
+        close(gdb->listen_fd);
+    }
+
+    if (gdb->path) {
+        unlink(gdb->path);
+        free(gdb->path);
+    }
+
+    free(gdb);
+}
@@ -0,0 +1,359 @@
+/*
+ * apple2.heat.c
+ *
+ * The heatmap counts where in memory the CPU reads and writes: how
+ * often in each page of main memory, aux memory, and ROM, and how often
+ * at each soft switch. When a program runs slower than it ought to,
+ * it's often because it hammers some soft switch (the speaker at $C030,
+ * say, or the bank switches at $C080..$C08F) far more than anyone
+ * thought; this is how you find out.
+ *
+ * We count the same way watchpoints catch accesses: we put our own
+ * mappers on every address in main and aux memory, which count and
+ * then call the mappers they displaced. That makes every access a
+ * little slower while we're in place, but until you ask for a heatmap,
+ * we cost nothing at all.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "apple2/bank.h"
+#include "apple2/heat.h"
+#include "apple2/mem.h"
+
+/*
+ * The characters we draw the heatmap with, from the coolest page (one
+ * we never touched) to the hottest.
+ */
+static const char heat_chars[] = " .:-=+*#%@";
+
+#define HEAT_LEVELS (sizeof(heat_chars) - 2)
+
+/*
+ * Return the bank an access to addr, through the given segment, ends up
+ * in, with the machine's memory configured as it is now. This follows
+ * the same rules the mappers do (see apple2_mem_peek()); reads of the
+ * bank-switched addresses may come from ROM, but writes never go there.
+ */
+static int
+heat_bank(apple2 *mach, vm_segment *segment, size_t addr, bool write)
+{
+    if (addr < 0x200) {
+        return (mach->bank_switch & BANK_ALTZP) ? HEAT_AUX : HEAT_MAIN;
+    }
+
+    if (addr < 0xC000) {
+        if ((mach->memory_mode & MEMORY_80STORE) &&
+            (mach->memory_mode & MEMORY_PAGE2) &&
+            ((addr >= 0x400 && addr < 0x800) ||
+             (addr >= 0x2000 && addr < 0x4000 &&
+              (mach->memory_mode & MEMORY_HIRES)))
+           ) {
+            return HEAT_AUX;
+        }
+
+        return segment == mach->aux ? HEAT_AUX : HEAT_MAIN;
+    }
+
+    if (addr < APPLE2_BANK_OFFSET) {
+        return HEAT_ROM;
+    }
+
+    if (!write && (~mach->bank_switch & BANK_RAM)) {
+        return HEAT_ROM;
+    }
+
+    return segment == mach->aux ? HEAT_AUX : HEAT_MAIN;
+}
+
+static SEGMENT_READER(heat_read)
+{
+    apple2 *mach = (apple2 *)_mach;
+    apple2_heat *heat = mach->heat;
+    vm_segment_read_fn fn;
+
+    if (heat->counting && heat->mach == mach) {
+        if ((addr >> 8) == HEAT_SWITCH_PAGE) {
+            heat->switch_reads[addr & 0xFF]++;
+        } else {
+            heat->page_reads[heat_bank(mach, segment, addr, false)]
+                [addr >> 8]++;
+        }
+    }
+
+    fn = heat->reads[segment == mach->aux ? 1 : 0][addr];
+    return fn ? fn(segment, addr, _mach) : segment->memory[addr];
+}
+
+static SEGMENT_WRITER(heat_write)
+{
+    apple2 *mach = (apple2 *)_mach;
+    apple2_heat *heat = mach->heat;
+    vm_segment_write_fn fn;
+
+    if (heat->counting && heat->mach == mach) {
+        if ((addr >> 8) == HEAT_SWITCH_PAGE) {
+            heat->switch_writes[addr & 0xFF]++;
+        } else {
+            heat->page_writes[heat_bank(mach, segment, addr, true)]
+                [addr >> 8]++;
+        }
+    }
+
+    fn = heat->writes[segment == mach->aux ? 1 : 0][addr];
+    if (fn) {
+        fn(segment, addr, value, _mach);
+    } else {
+        segment->memory[addr] = value;
+    }
+}
+
+/*
+ * Put our mappers on every address the CPU can reach in the segment,
+ * saving the ones that were there.
+ */
+static int
+heat_hook(apple2_heat *heat, vm_segment *segment, int which)
+{
+    for (size_t addr = 0; addr < MOS6502_MEMSIZE; addr++) {
+        heat->reads[which][addr] = segment->read_table[addr];
+        heat->writes[which][addr] = segment->write_table[addr];
+
+        if (vm_segment_read_map(segment, addr, heat_read) != OK ||
+            vm_segment_write_map(segment, addr, heat_write) != OK
+           ) {
+            return ERR_OOM;
+        }
+    }
+
+    return OK;
+}
+
+/*
+ * Start counting memory accesses in the machine. The first time, we put
+ * our mappers in place; after that, we just pick up counting where we
+ * left off.
+ */
+int
+apple2_heat_start(apple2 *mach)
+{
+    int err;
+
+    if (mach->heat) {
+        mach->heat->counting = true;
+        return OK;
+    }
+
+    mach->heat = calloc(1, sizeof(apple2_heat));
+    if (mach->heat == NULL) {
+        log_crit("Could not allocate memory for heatmap");
+        return ERR_OOM;
+    }
+
+    mach->heat->mach = mach;
+
+    err = heat_hook(mach->heat, mach->main, 0);
+    if (err == OK) {
+        err = heat_hook(mach->heat, mach->aux, 1);
+    }
+
+    if (err != OK) {
+        log_crit("Could not map memory for heatmap");
+        return err;
+    }
+
+    mach->heat->counting = true;
+    return OK;
+}
+
+/*
+ * Stop counting (but keep what we've counted so far).
+ */
+void
+apple2_heat_stop(apple2_heat *heat)
+{
+    if (heat) {
+        heat->counting = false;
+    }
+}
+
+/*
+ * Forget everything we've counted so far.
+ */
+void
+apple2_heat_reset(apple2_heat *heat)
+{
+    if (heat == NULL) {
+        return;
+    }
+
+    memset(heat->page_reads, 0, sizeof(heat->page_reads));
+    memset(heat->page_writes, 0, sizeof(heat->page_writes));
+    memset(heat->switch_reads, 0, sizeof(heat->switch_reads));
+    memset(heat->switch_writes, 0, sizeof(heat->switch_writes));
+}
+
+static const char *bank_names[] = { "main", "aux", "rom" };
+
+/*
+ * Write what we've counted into the stream as CSV: a row for every page
+ * of every bank, and then a row for every soft switch that was touched
+ * at all.
+ */
+void
+apple2_heat_csv(apple2_heat *heat, FILE *stream)
+{
+    fprintf(stream, "bank,address,reads,writes\n");
+
+    if (heat == NULL) {
+        return;
+    }
+
+    for (int bank = 0; bank < HEAT_BANKS; bank++) {
+        for (int page = 0; page < HEAT_PAGES; page++) {
+            if (page == HEAT_SWITCH_PAGE) {
+                continue;
+            }
+
+            fprintf(stream, "%s,%04X,%llu,%llu\n",
+                    bank_names[bank], page << 8,
+                    (unsigned long long)heat->page_reads[bank][page],
+                    (unsigned long long)heat->page_writes[bank][page]);
+        }
+    }
+
+    for (int i = 0; i < 0x100; i++) {
+        if (heat->switch_reads[i] == 0 && heat->switch_writes[i] == 0) {
+            continue;
+        }
+
+        fprintf(stream, "switch,%04X,%llu,%llu\n",
+                (HEAT_SWITCH_PAGE << 8) | i,
+                (unsigned long long)heat->switch_reads[i],
+                (unsigned long long)heat->switch_writes[i]);
+    }
+}
+
+/*
+ * Return how hot count is, next to max, as one of our levels (0 for a
+ * count of zero, and HEAT_LEVELS for max). The scale is logarithmic;
+ * the hottest pages are often hotter than the rest by several orders of
+ * magnitude, and we'd like to see the rest, too.
+ */
+static int
+heat_level(uint64_t count, uint64_t max)
+{
+    int bits = 0, max_bits = 0;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    for (; count; count >>= 1) {
+        bits++;
+    }
+
+    for (; max; max >>= 1) {
+        max_bits++;
+    }
+
+    if (max_bits == 1) {
+        return HEAT_LEVELS;
+    }
+
+    return 1 + ((bits - 1) * (HEAT_LEVELS - 1)) / (max_bits - 1);
+}
+
+/*
+ * Draw a heatmap of each bank into the stream: a grid of the 256 pages,
+ * with a character for each that shows how many reads and writes it
+ * had (see heat_chars). After that, we list the soft switches that were
+ * touched, the busiest first.
+ */
+void
+apple2_heat_dump(apple2_heat *heat, FILE *stream)
+{
+    uint64_t total, max, reads, writes;
+    int order[0x100], n = 0, tmp;
+
+    if (heat == NULL) {
+        fprintf(stream, "heatmap: not counting\n");
+        return;
+    }
+
+    for (int bank = 0; bank < HEAT_BANKS; bank++) {
+        max = reads = writes = 0;
+
+        for (int page = 0; page < HEAT_PAGES; page++) {
+            total = heat->page_reads[bank][page] +
+                heat->page_writes[bank][page];
+            if (total > max) {
+                max = total;
+            }
+
+            reads += heat->page_reads[bank][page];
+            writes += heat->page_writes[bank][page];
+        }
+
+        fprintf(stream, "heatmap: %s, %llu reads, %llu writes\n",
+                bank_names[bank], (unsigned long long)reads,
+                (unsigned long long)writes);
+        fprintf(stream, "     0123456789ABCDEF\n");
+
+        for (int hi = 0; hi < 0x10; hi++) {
+            fprintf(stream, "  %X  ", hi);
+
+            for (int lo = 0; lo < 0x10; lo++) {
+                int page = (hi << 4) | lo;
+
+                total = heat->page_reads[bank][page] +
+                    heat->page_writes[bank][page];
+                fputc(heat_chars[heat_level(total, max)], stream);
+            }
+
+            fputc('\n', stream);
+        }
+    }
+
+    for (int i = 0; i < 0x100; i++) {
+        if (heat->switch_reads[i] || heat->switch_writes[i]) {
+            order[n++] = i;
+        }
+    }
+
+    // There are few enough switches that a simple insertion sort, by
+    // total accesses, is plenty
+    for (int i = 1; i < n; i++) {
+        for (int j = i; j > 0; j--) {
+            int a = order[j - 1], b = order[j];
+
+            if (heat->switch_reads[a] + heat->switch_writes[a] >=
+                heat->switch_reads[b] + heat->switch_writes[b]) {
+                break;
+            }
+
+            tmp = order[j - 1];
+            order[j - 1] = order[j];
+            order[j] = tmp;
+        }
+    }
+
+    fprintf(stream, "heatmap: %d soft switches\n", n);
+    for (int i = 0; i < n; i++) {
+        fprintf(stream, "  $%04X %12llu reads %12llu writes\n",
+                (HEAT_SWITCH_PAGE << 8) | order[i],
+                (unsigned long long)heat->switch_reads[order[i]],
+                (unsigned long long)heat->switch_writes[order[i]]);
+    }
+}
+
+/*
+ * Free the heatmap. We don't put back the mappers we displaced; this is
+ * for when the machine itself is going away.
+ */
+void
+apple2_heat_free(apple2_heat *heat)
+{
+    free(heat);
+}
@@ -620,23 +620,22 @@ static vm_color colors[] = {
 };
 
 /*
- * Draw a single row of hires graphics.
+ * Work out the color of each of the 280 dots in the given row of hires
+ * graphics. The last dot has no neighbor to its right to decide its
+ * color, so we leave it black.
  */
 void
-apple2_hires_draw(apple2 *mach, int row)
+apple2_hires_row(apple2 *mach, int row, vm_color *pixels)
 {
-    vm_area area;
     vm_8bit dots[280];
-
-    area.width = 1;
-    area.height = 1;
-    area.width = 1;
-    area.yoff = row;
+    vm_8bit bytes[40];
 
     size_t addr = addresses[row % 192];
 
+    vm_segment_read_range(mach->cpu->rmem, bytes, addr, 40);
+
     for (int i = 0; i < 40; i++) {
-        vm_8bit byte = mos6502_get(mach->cpu, addr + i);
+        vm_8bit byte = bytes[i];
 
         for (int pos = 0; pos < 7; pos++) {
             dots[(i * 7) + pos] = 
@@ -645,8 +644,7 @@ apple2_hires_draw(apple2 *mach, int row)
         }
     }
 
-    vm_8bit prev = 0,
-            next = 0,
+    vm_8bit next = 0,
             curr = 0;
 
     for (int i = 0; i < 279; i++) {
@@ -654,11 +652,11 @@ apple2_hires_draw(apple2 *mach, int row)
         next = dots[i+1] & 1;
 
         if (curr && next) {
-            vm_screen_set_color(mach->screen, colors[HIRES_WHITE]);
+            pixels[i] = colors[HIRES_WHITE];
         } 
 
         else if (!curr && !next) {
-            vm_screen_set_color(mach->screen, colors[HIRES_BLACK]);
+            pixels[i] = colors[HIRES_BLACK];
         }
         
         // We need to emit _some_ color, but not white.
@@ -683,19 +681,63 @@ apple2_hires_draw(apple2 *mach, int row)
                 }
             }
 
-            vm_screen_set_color(mach->screen, colors[colorindex]);
+            pixels[i] = colors[colorindex];
         }
+    }
+
+    pixels[279] = colors[HIRES_BLACK];
+}
+
+/*
+ * Draw a single row of hires graphics.
+ */
+void
+apple2_hires_draw(apple2 *mach, int row)
+{
+    vm_area area;
+    vm_color pixels[280];
+
+    area.width = 1;
+    area.height = 1;
+    area.yoff = row;
+
+    apple2_hires_row(mach, row, pixels);
+
+    for (int i = 0; i < 279; i++) {
+        vm_screen_set_color(mach->screen, pixels[i]);
 
         area.xoff = i;
         vm_screen_draw_rect(mach->screen, &area);
+    }
+}
 
-        prev = curr;
+/*
+ * Write the hires graphics buffer to the given stream as a 280x192
+ * image, in the binary PPM format. It's about the simplest image format
+ * there is, and most anything can convert it into something else.
+ */
+void
+apple2_hires_frame(apple2 *mach, FILE *stream)
+{
+    vm_color pixels[280];
+
+    fprintf(stream, "P6\n280 192\n255\n");
+
+    for (int row = 0; row < 192; row++) {
+        apple2_hires_row(mach, row, pixels);
+
+        for (int i = 0; i < 280; i++) {
+            fputc(pixels[i].r, stream);
+            fputc(pixels[i].g, stream);
+            fputc(pixels[i].b, stream);
+        }
     }
 }
 
 /*
  * Print a representation of the machine's hires graphics buffer to the
- * given file stream.
+ * given file stream. We peek at the buffer, rather than read it, so
+ * that dumping it doesn't change the machine.
  */
 void
 apple2_hires_dump(apple2 *mach, FILE *stream)
@@ -712,7 +754,7 @@ apple2_hires_dump(apple2 *mach, FILE *stream)
         fprintf(stream, "%3d  [", row);
 
         for (col = 0; col < 40; col++) {
-            fprintf(stream, "%02X", mos6502_get(mach->cpu, base + col));
+            fprintf(stream, "%02X", mos6502_peek(mach->cpu, base + col));
 
             if (col < 39) {
                 fprintf(stream, " ");
@@ -730,7 +772,7 @@ apple2_hires_dump(apple2 *mach, FILE *stream)
         fprintf(stream, "%3d  [", row);
 
         for (col = 0; col < 40; col++) {
-            byte = mos6502_get(mach->cpu, base + col);
+            byte = mos6502_peek(mach->cpu, base + col);
             dotsym = (byte & 0x80) ? '#' : '%';
             for (bit = 0; bit < 7; bit++) {
                 fprintf(stream, "%c", ((byte >> bit) & 1) ? dotsym : '_');
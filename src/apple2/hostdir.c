@@ -0,0 +1,1020 @@
+/*
+ * apple2.hostdir.c
+ *
+ * This is a backend for the block device (see apple2.bd.c) which
+ * presents a directory on the host as a ProDOS volume. We never build
+ * an image of the volume; we work out where each file would go ahead of
+ * time, and then generate the directory, bitmap, index, and data blocks
+ * when they are asked for.
+ *
+ * Blocks the guest writes are kept in an overlay. Whenever the guest
+ * writes to the volume directory--which ProDOS does when it closes a
+ * file it has changed--we walk the directory and write any file which
+ * is new or changed back into the host directory.
+ *
+ * We only present the plain files at the top of the host directory;
+ * subdirectories and anything that ProDOS can't hold (files larger than
+ * 16 megabytes, or more than 51 files) are left out.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apple2/hostdir.h"
+
+/*
+ * This is the access byte we give every entry: destroy, rename, backup,
+ * write, and read are all allowed.
+ */
+#define HOSTDIR_ACCESS 0xE3
+
+/*
+ * Given a number of blocks, return how many bytes a bitmap of them
+ * would take.
+ */
+#define HOSTDIR_BITMAP_BYTES(n) (((n) + 7) / 8)
+
+/*
+ * These map file name extensions to ProDOS file types.
+ */
+static struct {
+    const char *ext;
+    vm_8bit type;
+} file_types[] = {
+    { "BAS", 0xFC },
+    { "BIN", 0x06 },
+    { "INT", 0xFA },
+    { "SYS", 0xFF },
+    { "TXT", 0x04 },
+    { "VAR", 0xFD },
+};
+
+/*
+ * Write a 16-bit value into buf, in little-endian order.
+ */
+static void
+put16(vm_8bit *buf, size_t value)
+{
+    buf[0] = value & 0xFF;
+    buf[1] = (value >> 8) & 0xFF;
+}
+
+/*
+ * Return the 16-bit value stored (in little-endian order) in buf.
+ */
+static size_t
+get16(const vm_8bit *buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+/*
+ * Write the ProDOS date and time for a given host time into buf, which
+ * must have room for four bytes.
+ */
+static void
+put_date(vm_8bit *buf, time_t when)
+{
+    struct tm tm;
+    int date;
+
+    localtime_r(&when, &tm);
+
+    date = ((tm.tm_year % 100) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+
+    put16(buf, date);
+    buf[2] = tm.tm_min;
+    buf[3] = tm.tm_hour;
+}
+
+/*
+ * Write the ProDOS form of a host file name into name, which must have
+ * room for HOSTDIR_NAME_MAX + 1 bytes. ProDOS names must begin with a
+ * letter, and may only hold letters, digits, and periods; anything else
+ * becomes a period. We return ERR_INVALID if there is nothing in the
+ * host name we can use.
+ */
+int
+apple2_hostdir_name(char *name, const char *host)
+{
+    int i, len = 0;
+
+    for (i = 0; host[i] != '\0' && len < HOSTDIR_NAME_MAX; i++) {
+        if (len == 0 && !isalpha((unsigned char)host[i])) {
+            continue;
+        }
+
+        if (isalnum((unsigned char)host[i])) {
+            name[len++] = toupper((unsigned char)host[i]);
+        } else {
+            name[len++] = '.';
+        }
+    }
+
+    name[len] = '\0';
+
+    return len > 0 ? OK : ERR_INVALID;
+}
+
+/*
+ * Return the ProDOS file type that goes with the extension of the given
+ * name. If we don't recognize the extension, we say it's binary.
+ */
+vm_8bit
+apple2_hostdir_type(const char *name)
+{
+    const char *ext;
+    int i, len;
+
+    ext = strrchr(name, '.');
+    if (ext == NULL) {
+        return 0x06;
+    }
+
+    ext++;
+    len = sizeof(file_types) / sizeof(file_types[0]);
+
+    for (i = 0; i < len; i++) {
+        if (strcasecmp(ext, file_types[i].ext) == 0) {
+            return file_types[i].type;
+        }
+    }
+
+    return 0x06;
+}
+
+/*
+ * Work out the storage type and block layout for a file of the given
+ * size, beginning at the given block.
+ */
+static void
+hostdir_layout(hostdir_file *file, size_t start)
+{
+    file->start = start;
+    file->ndata = (file->eof + APPLE2_BD_BLOCK_SIZE - 1) /
+        APPLE2_BD_BLOCK_SIZE;
+
+    // Even an empty file has one data block, as far as ProDOS is
+    // concerned.
+    if (file->ndata == 0) {
+        file->ndata = 1;
+    }
+
+    if (file->ndata == 1) {
+        file->storage = HOSTDIR_SEEDLING;
+        file->nindex = 0;
+        file->nblocks = 1;
+    } else if (file->ndata <= 256) {
+        file->storage = HOSTDIR_SAPLING;
+        file->nindex = 0;
+        file->nblocks = 1 + file->ndata;
+    } else {
+        file->storage = HOSTDIR_TREE;
+        file->nindex = (file->ndata + 255) / 256;
+        file->nblocks = 1 + file->nindex + file->ndata;
+    }
+}
+
+/*
+ * Return the file which holds the given block in our original layout,
+ * or NULL if no file does.
+ */
+static hostdir_file *
+hostdir_find(apple2_hostdir *hd, size_t block)
+{
+    int lo = 0, hi = hd->nfiles - 1, mid;
+    hostdir_file *file;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        file = &hd->files[mid];
+
+        if (block < file->start) {
+            hi = mid - 1;
+        } else if (block >= file->start + file->nblocks) {
+            lo = mid + 1;
+        } else {
+            return file;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Build one of the blocks of the volume directory.
+ */
+static void
+hostdir_dir_block(apple2_hostdir *hd, size_t n, vm_8bit *buf)
+{
+    hostdir_file *file;
+    vm_8bit *ent;
+    int i, slot, first;
+
+    put16(buf, n > 0 ? HOSTDIR_DIR_BLOCK + n - 1 : 0);
+    put16(buf + 2, n < HOSTDIR_DIR_BLOCKS - 1 ? HOSTDIR_DIR_BLOCK + n + 1 : 0);
+
+    // The first entry of the first block is the volume header
+    if (n == 0) {
+        ent = buf + 4;
+        ent[0] = 0xF0 | strlen(hd->name);
+        memcpy(ent + 1, hd->name, strlen(hd->name));
+        put_date(ent + 24, time(NULL));
+        ent[30] = HOSTDIR_ACCESS;
+        ent[31] = HOSTDIR_ENTRY_LENGTH;
+        ent[32] = HOSTDIR_ENTRIES_PER_BLOCK;
+        put16(ent + 33, hd->nfiles);
+        put16(ent + 35, HOSTDIR_BITMAP_BLOCK);
+        put16(ent + 37, APPLE2_BD_MAX_BLOCKS);
+    }
+
+    // Entries are numbered from the header, so the file in any given
+    // slot is one less than the entry number.
+    first = n * HOSTDIR_ENTRIES_PER_BLOCK;
+
+    for (slot = (n == 0) ? 1 : 0; slot < HOSTDIR_ENTRIES_PER_BLOCK; slot++) {
+        i = first + slot - 1;
+        if (i >= hd->nfiles) {
+            break;
+        }
+
+        file = &hd->files[i];
+        ent = buf + 4 + (slot * HOSTDIR_ENTRY_LENGTH);
+
+        ent[0] = (file->storage << 4) | strlen(file->name);
+        memcpy(ent + 1, file->name, strlen(file->name));
+        ent[16] = file->type;
+        put16(ent + 17, file->start);
+        put16(ent + 19, file->nblocks);
+        ent[21] = file->eof & 0xFF;
+        ent[22] = (file->eof >> 8) & 0xFF;
+        ent[23] = (file->eof >> 16) & 0xFF;
+        put_date(ent + 24, file->mtime);
+        ent[30] = HOSTDIR_ACCESS;
+        put_date(ent + 33, file->mtime);
+        put16(ent + 37, HOSTDIR_DIR_BLOCK);
+    }
+}
+
+/*
+ * Build one of the blocks of the volume bitmap. A set bit means the
+ * block is free; everything before first_free is in use.
+ */
+static void
+hostdir_bitmap_block(apple2_hostdir *hd, size_t n, vm_8bit *buf)
+{
+    size_t block, first, last;
+
+    first = n * APPLE2_BD_BLOCK_SIZE * 8;
+    last = first + APPLE2_BD_BLOCK_SIZE * 8;
+
+    for (block = first; block < last && block < APPLE2_BD_MAX_BLOCKS;
+         block++) {
+        if (block >= hd->first_free) {
+            buf[(block - first) / 8] |= 0x80 >> (block % 8);
+        }
+    }
+}
+
+/*
+ * Build a block of a file from our layout. This could be an index
+ * block, a master index block, or data from the host file.
+ */
+static int
+hostdir_file_block(hostdir_file *file, size_t block, vm_8bit *buf)
+{
+    size_t off = block - file->start;
+    size_t data, ptr, i;
+    ssize_t len;
+    int fd;
+
+    if (file->storage == HOSTDIR_SEEDLING) {
+        data = 0;
+    } else if (off == 0) {
+        // This is the key block. For a sapling, it indexes the data
+        // blocks; for a tree, it indexes the index blocks.
+        for (i = 0; i < 256; i++) {
+            if (file->storage == HOSTDIR_SAPLING && i < file->ndata) {
+                ptr = file->start + 1 + i;
+            } else if (file->storage == HOSTDIR_TREE && i < file->nindex) {
+                ptr = file->start + 1 + i;
+            } else {
+                continue;
+            }
+
+            buf[i] = ptr & 0xFF;
+            buf[i + 256] = ptr >> 8;
+        }
+
+        return OK;
+    } else if (file->storage == HOSTDIR_SAPLING) {
+        data = off - 1;
+    } else if (off <= file->nindex) {
+        // One of the index blocks of a tree
+        for (i = 0; i < 256; i++) {
+            data = ((off - 1) * 256) + i;
+            if (data >= file->ndata) {
+                break;
+            }
+
+            ptr = file->start + 1 + file->nindex + data;
+            buf[i] = ptr & 0xFF;
+            buf[i + 256] = ptr >> 8;
+        }
+
+        return OK;
+    } else {
+        data = off - 1 - file->nindex;
+    }
+
+    fd = open(file->path, O_RDONLY);
+    if (fd < 0) {
+        log_crit("Could not open %s: %s", file->path, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    len = pread(fd, buf, APPLE2_BD_BLOCK_SIZE, data * APPLE2_BD_BLOCK_SIZE);
+    close(fd);
+
+    return len < 0 ? ERR_BADFILE : OK;
+}
+
+/*
+ * Read a block of the volume, either from the overlay or by generating
+ * it from our layout.
+ */
+static int
+hostdir_read(apple2bd *bd, size_t block, vm_8bit *buf)
+{
+    apple2_hostdir *hd = (apple2_hostdir *)bd->backend;
+    hostdir_file *file;
+
+    if (hd->overlay[block]) {
+        memcpy(buf, hd->overlay[block], APPLE2_BD_BLOCK_SIZE);
+        return OK;
+    }
+
+    memset(buf, 0, APPLE2_BD_BLOCK_SIZE);
+
+    if (block >= HOSTDIR_DIR_BLOCK &&
+        block < HOSTDIR_DIR_BLOCK + HOSTDIR_DIR_BLOCKS) {
+        hostdir_dir_block(hd, block - HOSTDIR_DIR_BLOCK, buf);
+        return OK;
+    }
+
+    if (block >= HOSTDIR_BITMAP_BLOCK &&
+        block < HOSTDIR_BITMAP_BLOCK + HOSTDIR_BITMAP_BLOCKS) {
+        hostdir_bitmap_block(hd, block - HOSTDIR_BITMAP_BLOCK, buf);
+        return OK;
+    }
+
+    file = hostdir_find(hd, block);
+    if (file) {
+        return hostdir_file_block(file, block, buf);
+    }
+
+    // Boot blocks and free blocks are all zeroes
+    return OK;
+}
+
+/*
+ * Write a block of the volume into the overlay. If it's a block of the
+ * volume directory, we take the opportunity to commit what's changed
+ * back to the host.
+ */
+static int
+hostdir_write(apple2bd *bd, size_t block, const vm_8bit *buf)
+{
+    apple2_hostdir *hd = (apple2_hostdir *)bd->backend;
+
+    if (hd->overlay[block] == NULL) {
+        hd->overlay[block] = malloc(APPLE2_BD_BLOCK_SIZE);
+        if (hd->overlay[block] == NULL) {
+            log_crit("Could not allocate space for block %zu", block);
+            return ERR_OOM;
+        }
+    }
+
+    memcpy(hd->overlay[block], buf, APPLE2_BD_BLOCK_SIZE);
+    hd->dirty[block / 8] |= 1 << (block % 8);
+
+    if (block >= HOSTDIR_DIR_BLOCK &&
+        block < HOSTDIR_DIR_BLOCK + HOSTDIR_DIR_BLOCKS) {
+        apple2_hostdir_commit(bd);
+    }
+
+    return OK;
+}
+
+/*
+ * Copy every block of a file in our original layout into the overlay.
+ * We need to do this before we overwrite the host file, since the
+ * blocks we would generate for it would otherwise change underneath
+ * us.
+ */
+static int
+hostdir_pin(apple2bd *bd, hostdir_file *file)
+{
+    apple2_hostdir *hd = (apple2_hostdir *)bd->backend;
+    size_t block;
+    int err;
+
+    if (file->pinned) {
+        return OK;
+    }
+
+    for (block = file->start; block < file->start + file->nblocks; block++) {
+        if (hd->overlay[block]) {
+            continue;
+        }
+
+        hd->overlay[block] = malloc(APPLE2_BD_BLOCK_SIZE);
+        if (hd->overlay[block] == NULL) {
+            return ERR_OOM;
+        }
+
+        memset(hd->overlay[block], 0, APPLE2_BD_BLOCK_SIZE);
+        err = hostdir_file_block(file, block, hd->overlay[block]);
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    file->pinned = true;
+    return OK;
+}
+
+/*
+ * Gather the block numbers of the data blocks for a file, given its
+ * storage type, key block, and number of data blocks, into blocks. If
+ * dirty is not NULL, we'll set it to true if any block we look at
+ * (including index blocks) has been written since our last commit.
+ */
+static int
+hostdir_blocks(apple2bd *bd, int storage, size_t key, size_t ndata,
+               size_t *blocks, bool *dirty)
+{
+    apple2_hostdir *hd = (apple2_hostdir *)bd->backend;
+    vm_8bit master[APPLE2_BD_BLOCK_SIZE], index[APPLE2_BD_BLOCK_SIZE];
+    size_t i, ptr;
+    int err;
+
+#define CHECK_DIRTY(b) \
+    if (dirty && (b) < APPLE2_BD_MAX_BLOCKS && \
+        hd->dirty[(b) / 8] & (1 << ((b) % 8))) *dirty = true
+
+    CHECK_DIRTY(key);
+
+    // Anything past the first data block of a seedling, or the 256th
+    // of a sapling, is not something the file can hold; we'll leave
+    // those as sparse.
+    if (storage == HOSTDIR_SEEDLING) {
+        blocks[0] = key;
+        return OK;
+    }
+
+    if (storage == HOSTDIR_SAPLING && ndata > 256) {
+        ndata = 256;
+    }
+
+    err = apple2_bd_read_block(bd, key, master);
+    if (err != OK) {
+        return err;
+    }
+
+    if (storage == HOSTDIR_SAPLING) {
+        memcpy(index, master, sizeof(index));
+    }
+
+    for (i = 0; i < ndata; i++) {
+        if (storage == HOSTDIR_TREE && i % 256 == 0) {
+            ptr = master[i / 256] | (master[(i / 256) + 256] << 8);
+            memset(index, 0, sizeof(index));
+
+            // A pointer of zero is a sparse part of the file
+            if (ptr) {
+                CHECK_DIRTY(ptr);
+                err = apple2_bd_read_block(bd, ptr, index);
+                if (err != OK) {
+                    return err;
+                }
+            }
+        }
+
+        blocks[i] = index[i % 256] | (index[(i % 256) + 256] << 8);
+        if (blocks[i]) {
+            CHECK_DIRTY(blocks[i]);
+        }
+    }
+
+#undef CHECK_DIRTY
+
+    return OK;
+}
+
+/*
+ * Write the contents of a file in the volume to the given host path. We
+ * write into a temporary file, and then rename it into place.
+ */
+static int
+hostdir_save(apple2bd *bd, const char *path, const size_t *blocks,
+             size_t ndata, size_t eof)
+{
+    vm_8bit buf[APPLE2_BD_BLOCK_SIZE];
+    char *tmp;
+    size_t i, len;
+    FILE *stream;
+    int err = OK;
+
+    tmp = malloc(strlen(path) + 5);
+    if (tmp == NULL) {
+        return ERR_OOM;
+    }
+
+    sprintf(tmp, "%s.tmp", path);
+
+    stream = fopen(tmp, "w");
+    if (stream == NULL) {
+        log_crit("Could not open %s: %s", tmp, strerror(errno));
+        free(tmp);
+        return ERR_BADFILE;
+    }
+
+    for (i = 0; i < ndata && err == OK; i++) {
+        memset(buf, 0, sizeof(buf));
+
+        if (blocks[i]) {
+            err = apple2_bd_read_block(bd, blocks[i], buf);
+        }
+
+        len = eof - (i * APPLE2_BD_BLOCK_SIZE);
+        if (len > APPLE2_BD_BLOCK_SIZE) {
+            len = APPLE2_BD_BLOCK_SIZE;
+        }
+
+        if (err == OK && fwrite(buf, len, 1, stream) != 1 && len > 0) {
+            err = ERR_BADFILE;
+        }
+    }
+
+    fclose(stream);
+
+    if (err != OK || rename(tmp, path) != 0) {
+        log_crit("Could not save %s", path);
+        unlink(tmp);
+        err = ERR_BADFILE;
+    }
+
+    free(tmp);
+    return err;
+}
+
+/*
+ * Commit a single directory entry back to the host, if it's new, or if
+ * it or any of its blocks have changed.
+ */
+static int
+hostdir_commit_entry(apple2bd *bd, hostdir_entry *ent)
+{
+    apple2_hostdir *hd = (apple2_hostdir *)bd->backend;
+    hostdir_entry *last = NULL;
+    hostdir_file *orig = NULL;
+    size_t *blocks, ndata;
+    bool dirty = false;
+    char *path;
+    int i, err;
+
+    for (i = 0; i < hd->nentries; i++) {
+        if (strcmp(hd->entries[i].name, ent->name) == 0) {
+            last = &hd->entries[i];
+            break;
+        }
+    }
+
+    ndata = (ent->eof + APPLE2_BD_BLOCK_SIZE - 1) / APPLE2_BD_BLOCK_SIZE;
+    if (ndata == 0) {
+        ndata = 1;
+    }
+
+    blocks = calloc(ndata, sizeof(size_t));
+    if (blocks == NULL) {
+        return ERR_OOM;
+    }
+
+    err = hostdir_blocks(bd, ent->storage, ent->key, ndata, blocks, &dirty);
+    if (err != OK) {
+        free(blocks);
+        return err;
+    }
+
+    if (last && !dirty &&
+        last->storage == ent->storage &&
+        last->key == ent->key &&
+        last->eof == ent->eof
+       ) {
+        free(blocks);
+        return OK;
+    }
+
+    // If the file is one we found in the host directory, then we write
+    // back to the same path; otherwise, we make a new file from its
+    // ProDOS name.
+    for (i = 0; i < hd->nfiles; i++) {
+        if (strcmp(hd->files[i].name, ent->name) == 0) {
+            orig = &hd->files[i];
+            break;
+        }
+    }
+
+    if (orig) {
+        path = strdup(orig->path);
+
+        err = hostdir_pin(bd, orig);
+        if (err != OK) {
+            free(path);
+            free(blocks);
+            return err;
+        }
+    } else {
+        path = malloc(strlen(hd->dir) + HOSTDIR_NAME_MAX + 2);
+        if (path) {
+            sprintf(path, "%s/%s", hd->dir, ent->name);
+            for (i = strlen(hd->dir) + 1; path[i]; i++) {
+                path[i] = tolower((unsigned char)path[i]);
+            }
+        }
+    }
+
+    if (path == NULL) {
+        free(blocks);
+        return ERR_OOM;
+    }
+
+    err = hostdir_save(bd, path, blocks, ndata, ent->eof);
+
+    free(path);
+    free(blocks);
+
+    return err;
+}
+
+/*
+ * Walk the volume directory as the guest has left it, and write back
+ * to the host any file which is new or has changed since the last time
+ * we did this.
+ *
+ * We never remove files from the host directory, even if the guest has
+ * deleted them from the volume.
+ */
+int
+apple2_hostdir_commit(apple2bd *bd)
+{
+    apple2_hostdir *hd = (apple2_hostdir *)bd->backend;
+    vm_8bit buf[APPLE2_BD_BLOCK_SIZE];
+    char check[HOSTDIR_NAME_MAX + 1];
+    hostdir_entry *entries;
+    size_t block;
+    vm_8bit *ent;
+    int n, nentries = 0, slot, len, err, result = OK;
+
+    entries = calloc(HOSTDIR_MAX_FILES, sizeof(hostdir_entry));
+    if (entries == NULL) {
+        return ERR_OOM;
+    }
+
+    block = HOSTDIR_DIR_BLOCK;
+
+    // We follow the next pointers of the directory blocks, but we won't
+    // go further than the four blocks a volume directory may have.
+    for (n = 0; n < HOSTDIR_DIR_BLOCKS && block != 0; n++) {
+        err = apple2_bd_read_block(bd, block, buf);
+        if (err != OK) {
+            free(entries);
+            return err;
+        }
+
+        for (slot = (n == 0) ? 1 : 0; slot < HOSTDIR_ENTRIES_PER_BLOCK;
+             slot++) {
+            ent = buf + 4 + (slot * HOSTDIR_ENTRY_LENGTH);
+            len = ent[0] & 0x0F;
+
+            if ((ent[0] >> 4) < HOSTDIR_SEEDLING ||
+                (ent[0] >> 4) > HOSTDIR_TREE ||
+                len == 0 ||
+                nentries >= HOSTDIR_MAX_FILES
+               ) {
+                continue;
+            }
+
+            memcpy(entries[nentries].name, ent + 1, len);
+            entries[nentries].name[len] = '\0';
+            entries[nentries].storage = ent[0] >> 4;
+            entries[nentries].key = get16(ent + 17);
+            entries[nentries].eof =
+                ent[21] | (ent[22] << 8) | (ent[23] << 16);
+
+            // We only want names we can safely make a path from
+            if (apple2_hostdir_name(check, entries[nentries].name) != OK ||
+                strcmp(check, entries[nentries].name) != 0
+               ) {
+                continue;
+            }
+
+            err = hostdir_commit_entry(bd, &entries[nentries]);
+            if (err != OK) {
+                result = err;
+            }
+
+            nentries++;
+        }
+
+        block = get16(buf + 2);
+    }
+
+    free(hd->entries);
+    hd->entries = entries;
+    hd->nentries = nentries;
+
+    memset(hd->dirty, 0, HOSTDIR_BITMAP_BYTES(APPLE2_BD_MAX_BLOCKS));
+
+    return result;
+}
+
+/*
+ * Free everything the backend holds when the volume is ejected, after
+ * committing whatever may be left.
+ */
+static void
+hostdir_close(apple2bd *bd)
+{
+    apple2_hostdir *hd = (apple2_hostdir *)bd->backend;
+    int i;
+
+    if (hd == NULL) {
+        return;
+    }
+
+    apple2_hostdir_commit(bd);
+
+    for (i = 0; i < APPLE2_BD_MAX_BLOCKS; i++) {
+        free(hd->overlay[i]);
+    }
+
+    for (i = 0; i < hd->nfiles; i++) {
+        free(hd->files[i].path);
+    }
+
+    free(hd->overlay);
+    free(hd->dirty);
+    free(hd->files);
+    free(hd->entries);
+    free(hd->dir);
+    free(hd);
+
+    bd->backend = NULL;
+}
+
+/*
+ * Compare two files by name, for qsort; and, for two host files with
+ * the same ProDOS name, by the path on the host, so that the order is
+ * the same every time.
+ */
+static int
+hostdir_compare(const void *a, const void *b)
+{
+    const hostdir_file *fa = (const hostdir_file *)a;
+    const hostdir_file *fb = (const hostdir_file *)b;
+    int diff;
+
+    diff = strcmp(fa->name, fb->name);
+    if (diff == 0) {
+        diff = strcmp(fa->path, fb->path);
+    }
+
+    return diff;
+}
+
+/*
+ * Build the list of files from the host directory, and lay them out in
+ * the volume.
+ */
+static int
+hostdir_scan(apple2_hostdir *hd)
+{
+    struct dirent *dent;
+    struct stat finfo;
+    hostdir_file *files = NULL, *more, *file;
+    size_t block;
+    char *path;
+    DIR *dir;
+    int i, keep, nfiles = 0, cap = 0;
+
+    dir = opendir(hd->dir);
+    if (dir == NULL) {
+        log_crit("Could not open directory %s: %s", hd->dir, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    // We take every file we can make a ProDOS file of, at first; which
+    // of them we keep can't depend on the order the directory gives
+    // them to us in.
+    while ((dent = readdir(dir)) != NULL) {
+        if (dent->d_name[0] == '.') {
+            continue;
+        }
+
+        path = malloc(strlen(hd->dir) + strlen(dent->d_name) + 2);
+        if (path == NULL) {
+            goto oom;
+        }
+
+        sprintf(path, "%s/%s", hd->dir, dent->d_name);
+
+        if (stat(path, &finfo) || !S_ISREG(finfo.st_mode) ||
+            finfo.st_size > HOSTDIR_EOF_MAX
+           ) {
+            free(path);
+            continue;
+        }
+
+        if (nfiles == cap) {
+            cap = cap ? cap * 2 : HOSTDIR_MAX_FILES;
+            more = realloc(files, cap * sizeof(hostdir_file));
+            if (more == NULL) {
+                free(path);
+                goto oom;
+            }
+
+            files = more;
+        }
+
+        file = &files[nfiles];
+        memset(file, 0, sizeof(hostdir_file));
+
+        if (apple2_hostdir_name(file->name, dent->d_name) != OK) {
+            free(path);
+            continue;
+        }
+
+        file->path = path;
+        file->type = apple2_hostdir_type(dent->d_name);
+        file->eof = finfo.st_size;
+        file->mtime = finfo.st_mtime;
+
+        nfiles++;
+    }
+
+    closedir(dir);
+
+    // Sort by name so that the volume looks the same every time, no
+    // matter what order the directory gave us. Two host files can map
+    // to the same ProDOS name; only the first of those (by host path)
+    // is kept. Past that, we keep as many as the volume has room for.
+    if (nfiles > 0) {
+        qsort(files, nfiles, sizeof(hostdir_file), hostdir_compare);
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        if (hd->nfiles > 0 &&
+            strcmp(files[i].name, hd->files[hd->nfiles - 1].name) == 0
+           ) {
+            log_crit("Skipping %s; its name is already in use",
+                     files[i].path);
+            free(files[i].path);
+            continue;
+        }
+
+        if (hd->nfiles >= HOSTDIR_MAX_FILES) {
+            log_crit("Too many files in %s; skipping %s",
+                     hd->dir, files[i].path);
+            free(files[i].path);
+            continue;
+        }
+
+        hd->files[hd->nfiles++] = files[i];
+    }
+
+    free(files);
+
+    block = HOSTDIR_FIRST_FILE_BLOCK;
+
+    for (i = 0; i < hd->nfiles; i++) {
+        file = &hd->files[i];
+        hostdir_layout(file, block);
+
+        if (block + file->nblocks > APPLE2_BD_MAX_BLOCKS) {
+            log_crit("Volume is full; skipping %s and what follows",
+                     file->path);
+
+            keep = i;
+            for (; i < hd->nfiles; i++) {
+                free(hd->files[i].path);
+            }
+
+            hd->nfiles = keep;
+            break;
+        }
+
+        block += file->nblocks;
+    }
+
+    hd->first_free = block;
+
+    return OK;
+
+oom:
+    closedir(dir);
+
+    for (i = 0; i < nfiles; i++) {
+        free(files[i].path);
+    }
+
+    free(files);
+    return ERR_OOM;
+}
+
+/*
+ * Insert a host directory into the block device, as though it were a
+ * ProDOS volume.
+ */
+int
+apple2_hostdir_insert(apple2bd *bd, const char *dir)
+{
+    apple2_hostdir *hd;
+    const char *base;
+    int err, i;
+
+    hd = calloc(1, sizeof(apple2_hostdir));
+    if (hd == NULL) {
+        log_crit("Could not allocate space for host directory");
+        return ERR_OOM;
+    }
+
+    hd->dir = strdup(dir);
+    hd->files = calloc(HOSTDIR_MAX_FILES, sizeof(hostdir_file));
+    hd->overlay = calloc(APPLE2_BD_MAX_BLOCKS, sizeof(vm_8bit *));
+    hd->dirty = calloc(HOSTDIR_BITMAP_BYTES(APPLE2_BD_MAX_BLOCKS), 1);
+
+    if (hd->dir == NULL || hd->files == NULL ||
+        hd->overlay == NULL || hd->dirty == NULL
+       ) {
+        log_crit("Could not allocate space for host directory");
+        free(hd->dir);
+        free(hd->files);
+        free(hd->overlay);
+        free(hd->dirty);
+        free(hd);
+        return ERR_OOM;
+    }
+
+    // The volume takes its name from the last part of the directory
+    // path, if we can make something of it.
+    base = strrchr(dir, '/');
+    base = (base && base[1] != '\0') ? base + 1 : dir;
+    if (apple2_hostdir_name(hd->name, base) != OK) {
+        strcpy(hd->name, "HOST");
+    }
+
+    err = hostdir_scan(hd);
+    if (err != OK) {
+        for (i = 0; i < hd->nfiles; i++) {
+            free(hd->files[i].path);
+        }
+
+        free(hd->dir);
+        free(hd->files);
+        free(hd->overlay);
+        free(hd->dirty);
+        free(hd);
+        return err;
+    }
+
+    // What we committed last is, to begin with, just what we found
+    hd->entries = calloc(HOSTDIR_MAX_FILES, sizeof(hostdir_entry));
+    if (hd->entries) {
+        for (i = 0; i < hd->nfiles; i++) {
+            strcpy(hd->entries[i].name, hd->files[i].name);
+            hd->entries[i].storage = hd->files[i].storage;
+            hd->entries[i].key = hd->files[i].start;
+            hd->entries[i].eof = hd->files[i].eof;
+        }
+
+        hd->nentries = hd->nfiles;
+    }
+
+    apple2_bd_eject(bd);
+
+    bd->backend = hd;
+    bd->read_block = hostdir_read;
+    bd->write_block = hostdir_write;
+    bd->close = hostdir_close;
+    bd->blocks = APPLE2_BD_MAX_BLOCKS;
+    bd->online = true;
+
+    return OK;
+}
@@ -8,6 +8,7 @@
  */
 
 #include "apple2/kb.h"
+#include "apple2/snap.h"
 
 /*
  * This mapper is considerably simpler than most, because it handles
@@ -36,6 +37,12 @@ SEGMENT_READER(apple2_kb_switch_read)
             // This _also_ returns the 7 bit high if the strobe is still
             // set. Once you read from $C010, this bit will be cleared
             // in future reads--until another key is pressed.
+            apple2_snap_poll(mach, mach->strobe);
+
+            if (!mach->strobe) {
+                mach->kb_empty_polls++;
+            }
+
             if (mach->screen) {
                 ch = vm_screen_last_key(mach->screen);
 
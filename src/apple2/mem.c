@@ -8,6 +8,7 @@
  */
 
 #include "apple2/bank.h"
+#include "apple2/bd.h"
 #include "apple2/dbuf.h"
 #include "apple2/dd.h"
 #include "apple2/apple2.h"
@@ -52,6 +53,10 @@ apple2_mem_map(apple2 *mach, vm_segment *segment)
     size_t addr;
     int i, rlen, wlen;
 
+    // Our mappers will be given this machine, rather than whatever
+    // machine is in the DI container
+    segment->mach = mach;
+
     // Set up all of the bank-switch-related mapping. Well--almost all
     // of it.
     apple2_bank_map(segment);
@@ -69,6 +74,9 @@ apple2_mem_map(apple2 *mach, vm_segment *segment)
     // Map our disk drive switches
     apple2_dd_map(segment);
 
+    // And the switches for the block device
+    apple2_bd_map(segment);
+
     // We will do the mapping for the zero page and stack addresses.
     // Accessing those addresses can be affected by bank-switching, but
     // those addresses do not actually exist in the capital
@@ -88,6 +96,9 @@ apple2_mem_map(apple2 *mach, vm_segment *segment)
     for (i = 0; i < wlen; i++) {
         vm_segment_write_map(segment, switch_writes[i], apple2_mem_switch_write);
     }
+
+    segment->peek = apple2_mem_peek;
+    segment->poke = apple2_mem_poke;
 }
 
 /*
@@ -120,6 +131,14 @@ apple2_mem_init_sys_rom(apple2 *mach)
         return ERR_BADFILE;
     }
 
+    // The block device ROM isn't part of the peripheral ROM we store,
+    // so we install it on top of the (empty) slot it goes into.
+    err = apple2_bd_init_rom(mach->rom);
+    if (err != OK) {
+        log_crit("Could not copy block device rom");
+        return ERR_BADFILE;
+    }
+
     return OK;
 }
 
@@ -296,3 +315,59 @@ SEGMENT_WRITER(apple2_mem_switch_write)
 
     }
 }
+
+/*
+ * Return the byte the CPU would read at addr, with the machine's memory
+ * configured the way it is now, but without anything else that reading
+ * it would do (see vm_segment_peek()). Most of the read mappers do
+ * nothing else, so we let them find the byte for us; it's only the soft
+ * switches in $C000..$C0FF that change the machine when read, and those
+ * peek as zero. We call the mappers ourselves rather than look in the
+ * read table, since a watchpoint may have put its own mapper there, and
+ * a peek isn't a read it should catch.
+ */
+SEGMENT_READER(apple2_mem_peek)
+{
+    if (addr < 0x200) {
+        return apple2_mem_zp_read(segment, addr, _mach);
+    }
+
+    if (addr < 0xC000) {
+        return apple2_dbuf_read(segment, addr, _mach);
+    }
+
+    if (addr < 0xC100) {
+        return 0;
+    }
+
+    if (addr < APPLE2_BANK_OFFSET) {
+        return apple2_pc_read(segment, addr, _mach);
+    }
+
+    if (addr < MOS6502_MEMSIZE) {
+        return apple2_bank_read(segment, addr, _mach);
+    }
+
+    return segment->memory[addr];
+}
+
+/*
+ * Put value at addr where the CPU would write it, but without anything
+ * else that writing it would do (beyond letting the screen know, if it's
+ * display memory, that it has something new to draw). A poke into the
+ * soft switches (or the peripheral ROM) goes nowhere.
+ */
+SEGMENT_WRITER(apple2_mem_poke)
+{
+    if (addr < 0x200) {
+        apple2_mem_zp_write(segment, addr, value, _mach);
+    } else if (addr < 0xC000) {
+        apple2_dbuf_write(segment, addr, value, _mach);
+    } else if (addr < APPLE2_BANK_OFFSET) {
+        return;
+    } else if (addr < MOS6502_MEMSIZE) {
+        apple2_bank_write(segment, addr, value, _mach);
+    } else {
+        segment->memory[addr] = value;
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ * apple2.ncache.c
+ *
+ * A persistent cache of nibbilized disk images. Encoding a DOS 3.3 or
+ * ProDOS image with 6-and-2 encoding (see apple2.enc.c) is something we
+ * must do every time a disk is inserted, and it's the same work every
+ * time for the same image. So, if you've given us a cache directory,
+ * we'll save the encoded data there, named by a hash of the image
+ * contents and its sector order. The next time we see the same image,
+ * we can map the encoded data right back in and skip the encoder
+ * entirely.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apple2/dd.h"
+#include "apple2/enc.h"
+#include "apple2/ncache.h"
+#include "vm_di.h"
+#include "vm_hash.h"
+
+/*
+ * Return the key for a given image and image type. The type is part of
+ * the key because a DOS 3.3 image and a ProDOS image with the same
+ * bytes will encode to different tracks (their sectors are ordered
+ * differently; see apple2_dd_sector_num()).
+ */
+uint64_t
+apple2_ncache_key(int type, vm_segment *image)
+{
+    uint64_t hash = VM_HASH_INIT;
+
+    hash = vm_hash_int(hash, NCACHE_VERSION);
+    hash = vm_hash_int(hash, type);
+
+    return vm_hash_segment(hash, image);
+}
+
+/*
+ * Write the path of the cache entry for a given key and image type into
+ * buf. If the path would not fit, we return ERR_OOB.
+ */
+int
+apple2_ncache_path(char *buf, size_t len, const char *dir,
+                   uint64_t key, int type)
+{
+    int n;
+
+    n = snprintf(buf, len, "%s/%016" PRIx64 "-%d.nib", dir, key, type);
+    if (n < 0 || n >= len) {
+        return ERR_OOB;
+    }
+
+    return OK;
+}
+
+/*
+ * Load the cache entry at path, if one exists, and return a segment
+ * that maps its contents. If there's no such entry--or if it's the
+ * wrong size to be one of ours--we return NULL.
+ */
+vm_segment *
+apple2_ncache_load(const char *path)
+{
+    struct stat finfo;
+    vm_segment *seg;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &finfo) || finfo.st_size != _140K_NIB_) {
+        close(fd);
+        return NULL;
+    }
+
+    seg = vm_segment_map(fd, finfo.st_size);
+
+    // The mapping holds its own reference to the file, so we don't need
+    // the descriptor any longer.
+    close(fd);
+
+    return seg;
+}
+
+/*
+ * Save the contents of seg to the cache entry at path. We write into a
+ * temporary file first and then rename it into place, so that someone
+ * else reading the cache will never see a partly-written entry.
+ */
+int
+apple2_ncache_store(const char *path, vm_segment *seg)
+{
+    char tmp[NCACHE_PATH_MAX];
+    FILE *stream;
+    int err;
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    stream = fopen(tmp, "w");
+    if (stream == NULL) {
+        log_crit("Could not open nibble cache entry %s: %s",
+                 tmp, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    err = vm_segment_fwrite(seg, stream, 0, seg->size);
+    fclose(stream);
+
+    if (err != OK || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return ERR_BADFILE;
+    }
+
+    return OK;
+}
+
+/*
+ * Return a segment containing the 6-and-2 encoded form of the given
+ * image. If we have no cache directory, this is no different from
+ * calling apple2_enc_dos(); otherwise, we'll try the cache first, and
+ * save what we encode to the cache if we missed.
+ */
+vm_segment *
+apple2_ncache_encode(int type, vm_segment *image)
+{
+    char path[NCACHE_PATH_MAX];
+    const char *dir;
+    vm_segment *seg;
+
+    dir = (const char *)vm_di_get(VM_NIBCACHE);
+    if (dir == NULL || image == NULL) {
+        return apple2_enc_dos(type, image);
+    }
+
+    if (apple2_ncache_path(path, sizeof(path), dir,
+                           apple2_ncache_key(type, image), type) != OK) {
+        return apple2_enc_dos(type, image);
+    }
+
+    seg = apple2_ncache_load(path);
+    if (seg) {
+        return seg;
+    }
+
+    seg = apple2_enc_dos(type, image);
+    if (seg == NULL) {
+        return NULL;
+    }
+
+    // We don't really care if the cache directory doesn't exist yet;
+    // if it does, then mkdir will fail, and that's fine. If something
+    // else is wrong, then the store will fail, and that's ALSO fine.
+    // We still have an encoded disk to return.
+    mkdir(dir, 0755);
+    apple2_ncache_store(path, seg);
+
+    return seg;
+}
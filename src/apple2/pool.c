@@ -0,0 +1,626 @@
+/*
+ * apple2.pool.c
+ *
+ * A pool runs any number of machines--thousands, if you like--on a
+ * fixed number of worker threads. Each worker has its own queue of
+ * machines; it takes one from the front, runs it for a quantum of
+ * cycles, and puts it back at the end. A worker whose queue runs dry
+ * steals a machine from the end of someone else's, so no thread sits
+ * around while there is work to do.
+ *
+ * A machine which spends its slice doing nothing but polling the
+ * keyboard is parked: it leaves the queues entirely, and costs us
+ * nothing, until someone gives it a key with apple2_pool_key().
+ *
+ * The locks we use are, in the order they must be taken: the lock on
+ * the list of instances, then an instance's lock, then a worker's lock,
+ * then the pool's lock.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "apple2/pool.h"
+
+/*
+ * Return the time in nanoseconds since some point in the past.
+ */
+static uint64_t
+pool_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Put an instance at the end of a worker's queue, and let any waiting
+ * worker know there's something to do. We return ERR_OOM if the queue
+ * needed to grow and couldn't.
+ */
+static int
+pool_push(apple2_pool *pool, apple2_pool_worker *worker,
+          apple2_pool_inst *inst)
+{
+    apple2_pool_inst **queue;
+    int i;
+
+    inst->home = worker->id;
+    inst->queued_at = pool_now();
+
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->count == worker->cap) {
+        int cap = worker->cap ? worker->cap * 2 : 16;
+
+        queue = malloc(sizeof(apple2_pool_inst *) * cap);
+        if (queue == NULL) {
+            pthread_mutex_unlock(&worker->lock);
+            return ERR_OOM;
+        }
+
+        // The queue is a ring, so we straighten it out as we copy it
+        for (i = 0; i < worker->count; i++) {
+            queue[i] = worker->queue[(worker->head + i) % worker->cap];
+        }
+
+        free(worker->queue);
+        worker->queue = queue;
+        worker->head = 0;
+        worker->cap = cap;
+    }
+
+    worker->queue[(worker->head + worker->count) % worker->cap] = inst;
+    worker->count++;
+
+    pthread_mutex_unlock(&worker->lock);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    return OK;
+}
+
+/*
+ * Find the next instance for a worker to run: the one at the front of
+ * its own queue, or failing that, the one at the end of somebody
+ * else's. We return NULL if there's nothing to be had.
+ */
+static apple2_pool_inst *
+pool_take(apple2_pool *pool, apple2_pool_worker *worker)
+{
+    apple2_pool_worker *victim;
+    apple2_pool_inst *inst = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->count) {
+        inst = worker->queue[worker->head];
+        worker->head = (worker->head + 1) % worker->cap;
+        worker->count--;
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    for (int i = 1; inst == NULL && i < pool->nworkers; i++) {
+        victim = &pool->workers[(worker->id + i) % pool->nworkers];
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->count) {
+            victim->count--;
+            inst = victim->queue[(victim->head + victim->count) %
+                                 victim->cap];
+            worker->steals++;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    if (inst) {
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        pool->running++;
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return inst;
+}
+
+/*
+ * Run an instance for one slice, and then figure out what should become
+ * of it.
+ */
+static void
+pool_slice(apple2_pool *pool, apple2_pool_worker *worker,
+           apple2_pool_inst *inst)
+{
+    apple2 *mach = inst->mach;
+    uint64_t t0, t1, start, ran, wait, limit = pool->quantum;
+    bool requeue = false;
+
+    t0 = pool_now();
+
+    pthread_mutex_lock(&inst->lock);
+
+    wait = t0 - inst->queued_at;
+    inst->wait_ns += wait;
+    if (wait > inst->max_wait_ns) {
+        inst->max_wait_ns = wait;
+    }
+
+    inst->state = POOL_RUNNING;
+
+    // Once the machine has read the last key we gave it, we can give it
+    // the next one.
+    if (!mach->strobe && mach->screen) {
+        if (inst->nkeys) {
+            mach->screen->last_key = inst->keys[inst->key_head];
+            mach->screen->key_pressed = true;
+            mach->strobe = true;
+
+            inst->key_head = (inst->key_head + 1) % POOL_KEYS;
+            inst->nkeys--;
+        } else {
+            mach->screen->key_pressed = false;
+        }
+    }
+
+    pthread_mutex_unlock(&inst->lock);
+
+    if (inst->budget && inst->budget - inst->cycles < limit) {
+        limit = inst->budget - inst->cycles;
+    }
+
+    mach->kb_empty_polls = 0;
+    start = mach->cpu->cycles;
+
+    while (mach->cpu->cycles - start < limit) {
+        mos6502_execute(mach->cpu);
+    }
+
+    ran = mach->cpu->cycles - start;
+    t1 = pool_now();
+
+    pthread_mutex_lock(&inst->lock);
+
+    inst->slices++;
+    inst->cycles += ran;
+    inst->run_ns += t1 - t0;
+
+    if (inst->budget && inst->cycles >= inst->budget) {
+        inst->state = POOL_DONE;
+    } else if (mach->kb_empty_polls > 0 &&
+               mach->kb_empty_polls >= ran / POOL_IDLE_CYCLES &&
+               inst->nkeys == 0 && !mach->strobe
+              ) {
+        inst->state = POOL_PARKED;
+        inst->parks++;
+    } else {
+        inst->state = POOL_READY;
+        requeue = true;
+    }
+
+    // If the queue can't grow to take us back, we have to park; a key
+    // will give us another try.
+    if (requeue && pool_push(pool, worker, inst) != OK) {
+        log_crit("Couldn't requeue a machine; parking it");
+        inst->state = POOL_PARKED;
+        inst->parks++;
+    }
+
+    pthread_mutex_unlock(&inst->lock);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running--;
+    worker->slices++;
+
+    if (pool->pending == 0 && pool->running == 0) {
+        pthread_cond_broadcast(&pool->quiet);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * This is where a worker thread spends its life, until the pool is
+ * stopped.
+ */
+static void *
+pool_worker(void *arg)
+{
+    apple2_pool_worker *worker = (apple2_pool_worker *)arg;
+    apple2_pool *pool = worker->pool;
+    apple2_pool_inst *inst;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+
+        while (pool->pending == 0 && !pool->stop) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+
+        inst = pool_take(pool, worker);
+        if (inst) {
+            pool_slice(pool, worker, inst);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Create a pool with the given number of workers, which will run
+ * machines for quantum cycles at a time. A quantum of zero gives you
+ * the default, which is one frame's worth of cycles. The workers don't
+ * start until you call apple2_pool_start().
+ */
+apple2_pool *
+apple2_pool_create(int nworkers, uint64_t quantum)
+{
+    apple2_pool *pool;
+
+    if (nworkers < 1) {
+        log_crit("A pool needs at least one worker");
+        return NULL;
+    }
+
+    pool = malloc(sizeof(apple2_pool));
+    if (pool == NULL) {
+        log_crit("Couldn't allocate memory for a pool");
+        return NULL;
+    }
+
+    pool->workers = calloc(nworkers, sizeof(apple2_pool_worker));
+    if (pool->workers == NULL) {
+        log_crit("Couldn't allocate memory for pool workers");
+        free(pool);
+        return NULL;
+    }
+
+    pool->nworkers = nworkers;
+    pool->quantum = quantum ? quantum : APPLE2_FRAME_CYCLES;
+    pool->insts = NULL;
+    pool->ninsts = 0;
+    pool->cap = 0;
+    pool->pending = 0;
+    pool->running = 0;
+    pool->started = false;
+    pool->stop = false;
+    pool->start_ns = 0;
+    pool->elapsed_ns = 0;
+
+    pthread_mutex_init(&pool->insts_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->quiet, NULL);
+
+    for (int i = 0; i < nworkers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pthread_mutex_init(&pool->workers[i].lock, NULL);
+    }
+
+    return pool;
+}
+
+/*
+ * Add a machine to the pool, and return the instance we keep for it. If
+ * budget is not zero, we'll stop running the machine after that many
+ * cycles. You can add machines whether or not the pool has started.
+ */
+apple2_pool_inst *
+apple2_pool_add(apple2_pool *pool, apple2 *mach, uint64_t budget)
+{
+    apple2_pool_inst *inst, **insts;
+    int home;
+
+    inst = calloc(1, sizeof(apple2_pool_inst));
+    if (inst == NULL) {
+        log_crit("Couldn't allocate memory for a pool instance");
+        return NULL;
+    }
+
+    inst->mach = mach;
+    inst->budget = budget;
+    inst->state = POOL_READY;
+    pthread_mutex_init(&inst->lock, NULL);
+
+    pthread_mutex_lock(&pool->insts_lock);
+
+    if (pool->ninsts == pool->cap) {
+        int cap = pool->cap ? pool->cap * 2 : 64;
+
+        insts = realloc(pool->insts, sizeof(apple2_pool_inst *) * cap);
+        if (insts == NULL) {
+            pthread_mutex_unlock(&pool->insts_lock);
+            log_crit("Couldn't grow the list of pool instances");
+            pthread_mutex_destroy(&inst->lock);
+            free(inst);
+            return NULL;
+        }
+
+        pool->insts = insts;
+        pool->cap = cap;
+    }
+
+    // We deal new machines out to the workers in turn; stealing will
+    // even things out from there.
+    home = pool->ninsts % pool->nworkers;
+    pool->insts[pool->ninsts++] = inst;
+
+    pthread_mutex_unlock(&pool->insts_lock);
+
+    pthread_mutex_lock(&inst->lock);
+    if (pool_push(pool, &pool->workers[home], inst) != OK) {
+        inst->state = POOL_PARKED;
+    }
+    pthread_mutex_unlock(&inst->lock);
+
+    return inst;
+}
+
+/*
+ * Give a key to a machine in the pool. It will be typed once the
+ * machine has read every key we gave it before. If the machine was
+ * parked, this wakes it up. We return ERR_OOB if we're already holding
+ * as many keys for it as we can.
+ */
+int
+apple2_pool_key(apple2_pool *pool, apple2_pool_inst *inst, vm_8bit key)
+{
+    pthread_mutex_lock(&inst->lock);
+
+    if (inst->nkeys == POOL_KEYS) {
+        pthread_mutex_unlock(&inst->lock);
+        return ERR_OOB;
+    }
+
+    inst->keys[(inst->key_head + inst->nkeys) % POOL_KEYS] = key;
+    inst->nkeys++;
+
+    if (inst->state == POOL_PARKED &&
+        pool_push(pool, &pool->workers[inst->home], inst) == OK
+       ) {
+        inst->state = POOL_READY;
+    }
+
+    pthread_mutex_unlock(&inst->lock);
+
+    return OK;
+}
+
+/*
+ * Start the workers. We return ERR_INVALID if we couldn't start all of
+ * them (in which case, none are left running).
+ */
+int
+apple2_pool_start(apple2_pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->started) {
+        pthread_mutex_unlock(&pool->lock);
+        return OK;
+    }
+
+    pool->stop = false;
+    pool->started = true;
+    pool->start_ns = pool_now();
+
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nworkers; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL,
+                           pool_worker, &pool->workers[i]) != 0) {
+            break;
+        }
+    }
+
+    if (i < pool->nworkers) {
+        log_crit("Couldn't start pool worker %d", i);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = true;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+
+        while (i-- > 0) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->started = false;
+        pthread_mutex_unlock(&pool->lock);
+
+        return ERR_INVALID;
+    }
+
+    return OK;
+}
+
+/*
+ * Stop the workers, once they've finished the slices they're running.
+ * Instances which were waiting to run stay in their queues, and will
+ * run again if you start the pool again.
+ */
+void
+apple2_pool_stop(apple2_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    if (!pool->started) {
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nworkers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->started = false;
+    pool->elapsed_ns += pool_now() - pool->start_ns;
+    pthread_cond_broadcast(&pool->quiet);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Wait until there's nothing left for the pool to run: every instance
+ * is either parked or done. If the pool hasn't been started, we don't
+ * wait at all.
+ */
+void
+apple2_pool_wait(apple2_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->started && (pool->pending || pool->running)) {
+        pthread_cond_wait(&pool->quiet, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Stop the pool if it's running, and free it, along with every instance
+ * in it. The machines are left alone.
+ */
+void
+apple2_pool_free(apple2_pool *pool)
+{
+    apple2_pool_stop(pool);
+
+    for (int i = 0; i < pool->ninsts; i++) {
+        pthread_mutex_destroy(&pool->insts[i]->lock);
+        free(pool->insts[i]);
+    }
+
+    for (int i = 0; i < pool->nworkers; i++) {
+        pthread_mutex_destroy(&pool->workers[i].lock);
+        free(pool->workers[i].queue);
+    }
+
+    pthread_mutex_destroy(&pool->insts_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->quiet);
+
+    free(pool->insts);
+    free(pool->workers);
+    free(pool);
+}
+
+/*
+ * Return how fairly the pool has shared its workers, as Jain's fairness
+ * index: 1.0 if every instance has run just as fast as every other,
+ * down toward 1/n if one instance got everything. We compare the rate
+ * at which each instance ran over the time it wanted to run (that is,
+ * the time it spent running or waiting in a queue), so that an instance
+ * which was parked or done for a while doesn't look hard done by.
+ */
+double
+apple2_pool_fairness(apple2_pool *pool)
+{
+    double rate, sum = 0, sumsq = 0;
+    apple2_pool_inst *inst;
+    int n = 0;
+
+    pthread_mutex_lock(&pool->insts_lock);
+
+    for (int i = 0; i < pool->ninsts; i++) {
+        inst = pool->insts[i];
+
+        pthread_mutex_lock(&inst->lock);
+        if (inst->run_ns + inst->wait_ns > 0) {
+            rate = (double)inst->cycles / (inst->run_ns + inst->wait_ns);
+            sum += rate;
+            sumsq += rate * rate;
+            n++;
+        }
+        pthread_mutex_unlock(&inst->lock);
+    }
+
+    pthread_mutex_unlock(&pool->insts_lock);
+
+    if (n == 0 || sumsq == 0) {
+        return 1.0;
+    }
+
+    return (sum * sum) / (n * sumsq);
+}
+
+/*
+ * Write what we know about how the pool has been running--as a whole,
+ * for each worker, and for each instance--into the given stream.
+ */
+void
+apple2_pool_stats_dump(apple2_pool *pool, FILE *stream)
+{
+    static const char *states[] = { "ready", "running", "parked", "done" };
+    uint64_t cycles = 0, elapsed;
+    apple2_pool_inst *inst;
+    double fairness;
+
+    fairness = apple2_pool_fairness(pool);
+
+    pthread_mutex_lock(&pool->insts_lock);
+
+    for (int i = 0; i < pool->ninsts; i++) {
+        pthread_mutex_lock(&pool->insts[i]->lock);
+        cycles += pool->insts[i]->cycles;
+        pthread_mutex_unlock(&pool->insts[i]->lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    elapsed = pool->elapsed_ns;
+    if (pool->started) {
+        elapsed += pool_now() - pool->start_ns;
+    }
+
+    fprintf(stream, "pool: %d workers, %d instances, quantum %llu\n",
+            pool->nworkers, pool->ninsts,
+            (unsigned long long)pool->quantum);
+    fprintf(stream, "pool: %llu cycles in %.3fs (%.0f cycles/s), "
+            "fairness %.3f\n",
+            (unsigned long long)cycles, elapsed / 1e9,
+            elapsed ? cycles / (elapsed / 1e9) : 0.0, fairness);
+
+    for (int i = 0; i < pool->nworkers; i++) {
+        fprintf(stream, "worker%d: slices %llu, steals %llu\n", i,
+                (unsigned long long)pool->workers[i].slices,
+                (unsigned long long)pool->workers[i].steals);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->ninsts; i++) {
+        inst = pool->insts[i];
+
+        pthread_mutex_lock(&inst->lock);
+        fprintf(stream, "inst%d: %s, slices %llu, cycles %llu, "
+                "run %.3fms, wait %.3fms, max wait %.3fms, parks %llu\n",
+                i, states[inst->state],
+                (unsigned long long)inst->slices,
+                (unsigned long long)inst->cycles,
+                inst->run_ns / 1e6, inst->wait_ns / 1e6,
+                inst->max_wait_ns / 1e6,
+                (unsigned long long)inst->parks);
+        pthread_mutex_unlock(&inst->lock);
+    }
+
+    pthread_mutex_unlock(&pool->insts_lock);
+}
@@ -0,0 +1,217 @@
+/*
+ * apple2.reflect.c
+ *
+ * Reflection lets other programs watch a machine while it runs. We
+ * create a named shared memory object and, once a frame, copy into it
+ * the registers, the soft switches, some counters, and all of main and
+ * aux memory (see apple2_reflect_state). A dashboard or an analysis
+ * tool can then map the object and look at the machine as often as it
+ * likes, without our having to stop for it--or even know it's there.
+ *
+ * The object is readable by anyone, but writable only by us; and it's
+ * unlinked when we're done with it.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apple2/mem.h"
+#include "apple2/reflect.h"
+
+_Static_assert(REFLECT_MEMORY_SIZE == APPLE2_MEMORY_SIZE,
+               "the reflected memory must be the size of main and aux");
+
+/*
+ * Return the time in nanoseconds since some point in the past.
+ */
+static uint64_t
+reflect_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Create the shared memory object with the given name, and return a
+ * reflection which will publish to it. Names of shared memory objects
+ * begin with a slash; if the name doesn't, we'll add one. (Keep it
+ * short; some systems allow no more than 31 characters.) If there's
+ * already an object by that name--say, left over from a run that
+ * crashed--we take it over.
+ */
+apple2_reflect *
+apple2_reflect_create(const char *name)
+{
+    apple2_reflect *rf;
+    size_t len;
+
+    rf = malloc(sizeof(apple2_reflect));
+    if (rf == NULL) {
+        log_crit("Could not allocate memory for reflection");
+        return NULL;
+    }
+
+    len = strlen(name);
+    rf->name = malloc(len + 2);
+    if (rf->name == NULL) {
+        log_crit("Could not allocate memory for reflection name");
+        free(rf);
+        return NULL;
+    }
+
+    if (name[0] == '/') {
+        memcpy(rf->name, name, len + 1);
+    } else {
+        rf->name[0] = '/';
+        memcpy(rf->name + 1, name, len + 1);
+    }
+
+    rf->state = NULL;
+    rf->next = 0;
+    rf->last_cycles = 0;
+    rf->last_ns = reflect_now();
+    rf->instructions = 0;
+
+    rf->fd = shm_open(rf->name, O_RDWR | O_CREAT, 0644);
+    if (rf->fd < 0) {
+        log_crit("Could not open shared memory %s: %s",
+                 rf->name, strerror(errno));
+        free(rf->name);
+        free(rf);
+        return NULL;
+    }
+
+    if (ftruncate(rf->fd, sizeof(apple2_reflect_state)) < 0) {
+        log_crit("Could not size shared memory %s: %s",
+                 rf->name, strerror(errno));
+        apple2_reflect_free(rf);
+        return NULL;
+    }
+
+    rf->state = mmap(NULL, sizeof(apple2_reflect_state),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, rf->fd, 0);
+    if (rf->state == MAP_FAILED) {
+        log_crit("Could not map shared memory %s: %s",
+                 rf->name, strerror(errno));
+        rf->state = NULL;
+        apple2_reflect_free(rf);
+        return NULL;
+    }
+
+    memset(rf->state, 0, sizeof(apple2_reflect_state));
+    rf->state->magic = REFLECT_MAGIC;
+    rf->state->version = REFLECT_VERSION;
+    rf->state->size = sizeof(apple2_reflect_state);
+
+    return rf;
+}
+
+/*
+ * Unmap and unlink the shared memory, and free the reflection. Anyone
+ * who still has the object mapped keeps what was last published.
+ */
+void
+apple2_reflect_free(apple2_reflect *rf)
+{
+    if (rf->state) {
+        munmap(rf->state, sizeof(apple2_reflect_state));
+    }
+
+    close(rf->fd);
+    shm_unlink(rf->name);
+
+    free(rf->name);
+    free(rf);
+}
+
+/*
+ * This should be called after every instruction the machine executes.
+ * We count the instruction, and publish the machine's state if a frame
+ * has gone by since we last did. (If the machine has gone back in time,
+ * as it does when it's rewound, we publish right away.)
+ */
+void
+apple2_reflect_tick(apple2_reflect *rf, apple2 *mach)
+{
+    uint64_t cycles = mach->cpu->cycles;
+
+    rf->instructions++;
+
+    if (cycles >= rf->next || cycles < rf->last_cycles) {
+        apple2_reflect_update(rf, mach);
+    }
+}
+
+/*
+ * Copy the memory of a segment into the shared memory.
+ */
+static void
+reflect_copy(vm_8bit *dest, vm_segment *seg)
+{
+    size_t len = seg->size;
+
+    if (len > REFLECT_MEMORY_SIZE) {
+        len = REFLECT_MEMORY_SIZE;
+    }
+
+    memcpy(dest, seg->memory, len);
+}
+
+/*
+ * Publish the state of the machine right now.
+ */
+void
+apple2_reflect_update(apple2_reflect *rf, apple2 *mach)
+{
+    apple2_reflect_state *st = rf->state;
+    mos6502 *cpu = mach->cpu;
+    uint64_t now = reflect_now();
+
+    // Let readers know we're in the middle of an update
+    atomic_fetch_add_explicit(&st->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    st->PC = cpu->PC;
+    st->A = cpu->A;
+    st->X = cpu->X;
+    st->Y = cpu->Y;
+    st->P = cpu->P;
+    st->S = cpu->S;
+
+    st->display_mode = mach->display_mode;
+    st->memory_mode = mach->memory_mode;
+    st->bank_switch = mach->bank_switch;
+    st->strobe = mach->strobe;
+
+    st->selected_drive = mach->selected_drive == mach->drive2 ? 2 : 1;
+    st->track_pos[0] = mach->drive1 ? mach->drive1->track_pos : 0;
+    st->track_pos[1] = mach->drive2 ? mach->drive2->track_pos : 0;
+
+    st->cycles = cpu->cycles;
+    st->instructions = rf->instructions;
+    st->frames++;
+
+    if (cpu->cycles > rf->last_cycles && now > rf->last_ns) {
+        st->cycles_per_sec = (cpu->cycles - rf->last_cycles) *
+            1000000000 / (now - rf->last_ns);
+    }
+
+    st->kb_empty_polls = mach->kb_empty_polls;
+    st->host_ns = now;
+
+    reflect_copy(st->main, mach->main);
+    reflect_copy(st->aux, mach->aux);
+
+    atomic_thread_fence(memory_order_release);
+    atomic_fetch_add_explicit(&st->seq, 1, memory_order_relaxed);
+
+    rf->last_cycles = cpu->cycles;
+    rf->last_ns = now;
+    rf->next = cpu->cycles + APPLE2_FRAME_CYCLES;
+}
@@ -0,0 +1,527 @@
+/*
+ * apple2.replay.c
+ *
+ * Nearly everything the machine does follows from the state it's in;
+ * start two machines in the same state, and they'll do the same thing.
+ * The exceptions are the things that come from outside the machine:
+ * the keys you press (and when you press them), the noise we return
+ * from the disk controller's soft switches, and any disk you put into a
+ * drive while the machine is running.
+ *
+ * When we record, we write the state of the machine to a stream, and
+ * then each of those inputs as it happens, along with the cycle count
+ * at which the machine saw it. When we replay, we load the state and
+ * feed the inputs back in at the same cycles, so the machine does
+ * exactly what it did the first time--on this host or on another one,
+ * so long as it has the same disk images to start with.
+ *
+ * The stream is a state (see apple2.state.c), then REPLAY_MAGIC and a
+ * version byte, and then the events. Each event is a tag byte,
+ * followed by:
+ *
+ *   REPLAY_KEY    cycles since the last timed event (varint), the last
+ *                 key, and whether a key is pressed
+ *   REPLAY_NOISE  the byte we returned
+ *   REPLAY_DISK   cycles since the last timed event (varint), the drive
+ *                 (1 or 2), the image type, the image length (varint),
+ *                 the deflated length (varint), and the deflated image
+ *
+ * Noise isn't timed. It's asked for by the instructions the machine
+ * executes, so on replay it's asked for in exactly the order it was
+ * when we recorded it. A varint is the usual seven bits per byte, low
+ * bits first, with the high bit set on every byte but the last.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "apple2/dd.h"
+#include "apple2/replay.h"
+#include "apple2/state.h"
+
+/*
+ * Create a new replay, which is neither recording nor replaying.
+ */
+apple2_replay *
+apple2_replay_create()
+{
+    apple2_replay *rp;
+
+    rp = malloc(sizeof(apple2_replay));
+    if (rp == NULL) {
+        log_crit("Could not allocate memory for replay");
+        return NULL;
+    }
+
+    memset(rp, 0, sizeof(apple2_replay));
+    rp->mode = REPLAY_OFF;
+    rp->next = EOF;
+
+    return rp;
+}
+
+/*
+ * Stop recording (or replaying), and free the replay.
+ */
+void
+apple2_replay_free(apple2_replay *rp)
+{
+    apple2_replay_stop(rp);
+    free(rp);
+}
+
+/*
+ * Stop whatever we're doing. If we were recording, we make sure
+ * everything we've written has made it to the stream.
+ */
+void
+apple2_replay_stop(apple2_replay *rp)
+{
+    if (rp == NULL || rp->mode == REPLAY_OFF) {
+        return;
+    }
+
+    if (rp->mode == REPLAY_RECORD &&
+        (fflush(rp->stream) != 0 || ferror(rp->stream))) {
+        log_crit("Couldn't write the recording: %s", strerror(errno));
+    }
+
+    if (!rp->quiet) {
+        log_info("Stopped %s after %llu events",
+                 rp->mode == REPLAY_RECORD ? "recording" : "replaying",
+                 (unsigned long long)rp->events);
+    }
+
+    rp->mode = REPLAY_OFF;
+    rp->stream = NULL;
+    rp->next = EOF;
+}
+
+static void
+replay_put_varint(FILE *stream, uint64_t num)
+{
+    while (num >= 0x80) {
+        fputc((num & 0x7F) | 0x80, stream);
+        num >>= 7;
+    }
+
+    fputc(num, stream);
+}
+
+static bool
+replay_get_varint(FILE *stream, uint64_t *num)
+{
+    int ch, shift = 0;
+
+    *num = 0;
+
+    do {
+        ch = fgetc(stream);
+        if (ch == EOF || shift > 63) {
+            return false;
+        }
+
+        *num |= (uint64_t)(ch & 0x7F) << shift;
+        shift += 7;
+    } while (ch & 0x80);
+
+    return true;
+}
+
+/*
+ * Begin writing an event which happened at the given cycle count.
+ */
+static void
+replay_put_timed(apple2_replay *rp, int tag, uint64_t cycles)
+{
+    fputc(tag, rp->stream);
+    replay_put_varint(rp->stream, cycles - rp->stamp);
+
+    rp->stamp = cycles;
+    rp->events++;
+}
+
+/*
+ * Read the tag (and the time, if it has one) of the next event in the
+ * stream. If there are no more events, the replay is over.
+ */
+static void
+replay_next(apple2_replay *rp)
+{
+    uint64_t delta;
+
+    // There's no stream at all if there were no events to replay
+    if (rp->stream == NULL) {
+        rp->mark = 0;
+        apple2_replay_stop(rp);
+        return;
+    }
+
+    rp->mark = ftell(rp->stream);
+    rp->next = fgetc(rp->stream);
+
+    switch (rp->next) {
+        case EOF:
+            apple2_replay_stop(rp);
+            return;
+
+        case REPLAY_NOISE:
+            break;
+
+        case REPLAY_KEY:
+        case REPLAY_DISK:
+            if (!replay_get_varint(rp->stream, &delta)) {
+                log_crit("Recording is truncated");
+                apple2_replay_stop(rp);
+                return;
+            }
+
+            rp->next_cycles = rp->stamp + delta;
+            break;
+
+        default:
+            log_crit("Recording has an unknown event (%x)", rp->next);
+            apple2_replay_stop(rp);
+            return;
+    }
+
+    rp->events++;
+}
+
+/*
+ * Write a disk which was just inserted into the given drive.
+ */
+static int
+replay_put_disk(apple2_replay *rp, uint64_t cycles, int which,
+                apple2dd *drive)
+{
+    vm_8bit *zbuf;
+    uLongf zlen;
+
+    zlen = compressBound(drive->image->size);
+    zbuf = malloc(zlen);
+    if (zbuf == NULL) {
+        log_crit("Couldn't allocate memory to record a disk");
+        return ERR_OOM;
+    }
+
+    if (compress2(zbuf, &zlen, drive->image->memory, drive->image->size,
+                  Z_BEST_SPEED) != Z_OK) {
+        log_crit("Couldn't compress a disk to record it");
+        free(zbuf);
+        return ERR_INVALID;
+    }
+
+    replay_put_timed(rp, REPLAY_DISK, cycles);
+    fputc(which, rp->stream);
+    fputc(drive->image_type, rp->stream);
+    replay_put_varint(rp->stream, drive->image->size);
+    replay_put_varint(rp->stream, zlen);
+    fwrite(zbuf, zlen, 1, rp->stream);
+
+    free(zbuf);
+    return OK;
+}
+
+/*
+ * Read a disk out of the stream and insert it into the drive it was
+ * recorded in. The drive has to have a file to write back to, so we
+ * give it a temporary one; the disk we replay never touches the disk
+ * we recorded.
+ */
+static int
+replay_get_disk(apple2_replay *rp, apple2 *mach)
+{
+    apple2dd *drive;
+    vm_8bit *zbuf = NULL, *image = NULL;
+    uint64_t size, zlen;
+    uLongf len;
+    FILE *tmp;
+    int which, type, err = ERR_BADFILE;
+
+    which = fgetc(rp->stream);
+    type = fgetc(rp->stream);
+
+    if (which != 1 && which != 2) {
+        log_crit("Recording has a disk for a drive we don't have");
+        return ERR_BADFILE;
+    }
+
+    if (type == EOF ||
+        !replay_get_varint(rp->stream, &size) ||
+        !replay_get_varint(rp->stream, &zlen)) {
+        log_crit("Recording is truncated");
+        return ERR_BADFILE;
+    }
+
+    drive = which == 1 ? mach->drive1 : mach->drive2;
+
+    zbuf = malloc(zlen);
+    image = malloc(size);
+    if (zbuf == NULL || image == NULL) {
+        log_crit("Couldn't allocate memory to replay a disk");
+        err = ERR_OOM;
+        goto done;
+    }
+
+    len = size;
+    if (fread(zbuf, zlen, 1, rp->stream) != 1 ||
+        uncompress(image, &len, zbuf, zlen) != Z_OK ||
+        len != size) {
+        log_crit("Couldn't read a disk from the recording");
+        goto done;
+    }
+
+    tmp = tmpfile();
+    if (tmp == NULL ||
+        fwrite(image, size, 1, tmp) != 1 ||
+        fflush(tmp) != 0) {
+        log_crit("Couldn't make a file for a replayed disk");
+        goto done;
+    }
+
+    rewind(tmp);
+    err = apple2_dd_insert(drive, tmp, type);
+
+done:
+    free(zbuf);
+    free(image);
+    return err;
+}
+
+/*
+ * Begin recording the machine into the given stream.
+ */
+int
+apple2_replay_record(apple2_replay *rp, apple2 *mach, FILE *stream)
+{
+    int err;
+
+    apple2_replay_stop(rp);
+
+    err = apple2_state_save(mach, stream, STATE_COMPRESS);
+    if (err != OK) {
+        return err;
+    }
+
+    fputs(REPLAY_MAGIC, stream);
+    fputc(REPLAY_VERSION, stream);
+
+    return apple2_replay_events(rp, mach, stream, REPLAY_RECORD);
+}
+
+/*
+ * Begin replaying the recording in the given stream. This puts the
+ * machine in the state in which the recording began.
+ */
+int
+apple2_replay_play(apple2_replay *rp, apple2 *mach, FILE *stream)
+{
+    char magic[4];
+    int err;
+
+    apple2_replay_stop(rp);
+
+    err = apple2_state_load(mach, stream);
+    if (err != OK) {
+        return err;
+    }
+
+    if (fread(magic, 4, 1, stream) != 1 ||
+        memcmp(magic, REPLAY_MAGIC, 4) != 0) {
+        log_crit("Recording has a bad header");
+        return ERR_BADFILE;
+    }
+
+    if (fgetc(stream) != REPLAY_VERSION) {
+        log_crit("Recording is from a version we don't know");
+        return ERR_BADFILE;
+    }
+
+    return apple2_replay_events(rp, mach, stream, REPLAY_PLAY);
+}
+
+/*
+ * Begin recording (or replaying) just the events in the stream, with no
+ * state or header in front of them; the machine must already be in the
+ * state the events begin from. This is how the rewind ring keeps the
+ * inputs between its checkpoints (see apple2.rewind.c). When replaying,
+ * the stream may be NULL, which is taken to have no events in it.
+ */
+int
+apple2_replay_events(apple2_replay *rp, apple2 *mach, FILE *stream,
+                     int mode)
+{
+    apple2_replay_stop(rp);
+
+    rp->mode = mode;
+    rp->stream = stream;
+    rp->stamp = mach->cpu->cycles;
+    rp->events = 0;
+
+    if (mach->screen) {
+        rp->key = mach->screen->last_key;
+        rp->pressed = mach->screen->key_pressed;
+    }
+
+    if (mode == REPLAY_PLAY) {
+        replay_next(rp);
+    }
+
+    return OK;
+}
+
+/*
+ * This is called before each instruction the machine executes. When
+ * recording, we write down any change in the keyboard; when replaying,
+ * we hand the machine whatever events are due by now.
+ */
+void
+apple2_replay_tick(apple2_replay *rp, apple2 *mach)
+{
+    vm_screen *screen = mach->screen;
+    uint64_t cycles = mach->cpu->cycles;
+
+    if (rp == NULL || rp->mode == REPLAY_OFF) {
+        return;
+    }
+
+    if (rp->mode == REPLAY_RECORD) {
+        if (screen &&
+            (screen->last_key != rp->key ||
+             screen->key_pressed != rp->pressed)) {
+            rp->key = screen->last_key;
+            rp->pressed = screen->key_pressed;
+
+            replay_put_timed(rp, REPLAY_KEY, cycles);
+            fputc(rp->key, rp->stream);
+            fputc(rp->pressed, rp->stream);
+        }
+
+        return;
+    }
+
+    while (rp->mode == REPLAY_PLAY &&
+           rp->next != REPLAY_NOISE &&
+           rp->next_cycles <= cycles) {
+        if (rp->next == REPLAY_KEY) {
+            int key = fgetc(rp->stream);
+            int pressed = fgetc(rp->stream);
+
+            if (pressed == EOF) {
+                log_crit("Recording is truncated");
+                apple2_replay_stop(rp);
+                break;
+            }
+
+            rp->key = key;
+            rp->pressed = pressed;
+        } else if (replay_get_disk(rp, mach) != OK) {
+            apple2_replay_stop(rp);
+            break;
+        }
+
+        rp->stamp = rp->next_cycles;
+        replay_next(rp);
+    }
+
+    // Whatever the host keyboard may be doing, the machine should only
+    // see the keys we recorded. (Even if the replay just ended; after
+    // this, the host keyboard takes over.)
+    if (screen) {
+        screen->last_key = rp->key;
+        screen->key_pressed = rp->pressed;
+    }
+}
+
+/*
+ * Return a byte of noise, for reads of soft switches which don't have
+ * anything meaningful to say. We record the noise we make, and replay
+ * the noise we recorded.
+ */
+vm_8bit
+apple2_replay_noise(apple2_replay *rp)
+{
+    vm_8bit byte;
+    int ch;
+
+    if (rp && rp->mode == REPLAY_PLAY) {
+        if (rp->next == REPLAY_NOISE && (ch = fgetc(rp->stream)) != EOF) {
+            replay_next(rp);
+            return ch;
+        }
+
+        // If the machine wants noise when the recording says it
+        // shouldn't, it's not doing what it did when we recorded it,
+        // and nothing we replay from here will make sense.
+        log_crit("Replay has fallen out of step with the recording");
+        apple2_replay_stop(rp);
+    }
+
+    byte = (vm_8bit)(arc4random() & 0xff);
+    apple2_replay_put_noise(rp, byte);
+
+    return byte;
+}
+
+/*
+ * If we're recording, write down a byte of noise which the machine was
+ * given (by us, or by some other replay).
+ */
+void
+apple2_replay_put_noise(apple2_replay *rp, vm_8bit byte)
+{
+    if (rp && rp->mode == REPLAY_RECORD) {
+        fputc(REPLAY_NOISE, rp->stream);
+        fputc(byte, rp->stream);
+        rp->events++;
+    }
+}
+
+/*
+ * Insert a disk into drive 1 or 2 of the machine while it's running.
+ * If we're recording, the disk goes into the recording too, so the
+ * replay can insert the very same disk at the very same time.
+ */
+int
+apple2_replay_insert(apple2_replay *rp, apple2 *mach, int which,
+                     FILE *stream, int type)
+{
+    apple2dd *drive;
+    int err;
+
+    if (which != 1 && which != 2) {
+        return ERR_INVALID;
+    }
+
+    if (rp->mode == REPLAY_PLAY) {
+        log_crit("Can't insert a disk while replaying");
+        return ERR_INVALID;
+    }
+
+    drive = which == 1 ? mach->drive1 : mach->drive2;
+
+    err = apple2_dd_insert(drive, stream, type);
+    if (err != OK) {
+        return err;
+    }
+
+    return apple2_replay_disk(rp, mach, which);
+}
+
+/*
+ * If we're recording, write down the disk which was just inserted into
+ * drive 1 or 2 of the machine.
+ */
+int
+apple2_replay_disk(apple2_replay *rp, apple2 *mach, int which)
+{
+    if (rp->mode != REPLAY_RECORD) {
+        return OK;
+    }
+
+    return replay_put_disk(rp, mach->cpu->cycles, which,
+                           which == 1 ? mach->drive1 : mach->drive2);
+}
@@ -0,0 +1,733 @@
+/*
+ * apple2.rewind.c
+ *
+ * Here we keep a ring of checkpoints of the machine, taken every so
+ * many cycles as it runs, which lets the debugger step backwards. We
+ * can't really run a 6502 in reverse; what we do instead is go back to
+ * the nearest checkpoint before the point we want, and then run forward
+ * again until we get there. Since the machine will do exactly what it
+ * did the first time, we end up exactly where we would have been.
+ *
+ * It will only do that if it's given what it was given the first time,
+ * though. So we also keep, for each checkpoint, the inputs that came
+ * after it--in the same form a recording keeps them (see replay.c)--and
+ * when we run forward from that checkpoint, we replay them.
+ *
+ * A checkpoint is a machine state (see apple2.state.c). Only the newest
+ * checkpoint is kept in full; the others are kept as deltas against the
+ * checkpoint that came after them. A delta is a list of runs: the
+ * number of bytes which are the same in both states, followed by the
+ * number of bytes which are different, followed by those different
+ * bytes (xor'd with the bytes they differ from).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apple2/debug.h"
+#include "apple2/rewind.h"
+#include "apple2/state.h"
+#include "mos6502/mos6502.h"
+
+/*
+ * When we are building a delta, we won't end a run of different bytes
+ * unless we see at least this many bytes which are the same; it's not
+ * worth the cost of the run lengths otherwise.
+ */
+#define REWIND_MIN_SKIP 8
+
+/*
+ * Create a new, empty rewind ring, which takes a checkpoint every
+ * interval cycles.
+ */
+apple2_rewind *
+apple2_rewind_create(uint64_t interval)
+{
+    apple2_rewind *rw;
+
+    rw = malloc(sizeof(apple2_rewind));
+    if (rw == NULL) {
+        log_crit("Could not allocate memory for rewind ring");
+        return NULL;
+    }
+
+    memset(rw, 0, sizeof(apple2_rewind));
+    rw->interval = interval;
+
+    rw->log = apple2_replay_create();
+    rw->play = apple2_replay_create();
+    if (rw->log == NULL || rw->play == NULL) {
+        apple2_rewind_free(rw);
+        return NULL;
+    }
+
+    rw->log->quiet = true;
+    rw->play->quiet = true;
+
+    return rw;
+}
+
+/*
+ * Stop writing and replaying events, and close the streams we did that
+ * with. Closing the stream we write with leaves its events in the
+ * checkpoint it was writing them for.
+ */
+static void
+rewind_close(apple2_rewind *rw)
+{
+    apple2_replay_stop(rw->log);
+    apple2_replay_stop(rw->play);
+
+    if (rw->out) {
+        fclose(rw->out);
+        rw->out = NULL;
+    }
+
+    if (rw->in) {
+        fclose(rw->in);
+        rw->in = NULL;
+    }
+
+    rw->rewound = false;
+}
+
+/*
+ * Begin writing the events which follow the given checkpoint, after the
+ * first len bytes of events it has already.
+ */
+static void
+rewind_log(apple2_rewind *rw, apple2 *mach, apple2_rewind_point *point,
+           size_t len)
+{
+    char *events = point->events;
+
+    point->events = NULL;
+    point->events_len = 0;
+
+    rw->out = open_memstream(&point->events, &point->events_len);
+    if (rw->out == NULL) {
+        // The checkpoint is still good, but we won't be able to replay
+        // what came after it
+        log_crit("Could not allocate memory for rewind events");
+        point->events = NULL;
+        point->events_len = 0;
+        free(events);
+        return;
+    }
+
+    if (len > 0) {
+        fwrite(events, len, 1, rw->out);
+    }
+
+    free(events);
+    apple2_replay_events(rw->log, mach, rw->out, REPLAY_RECORD);
+}
+
+/*
+ * If we're rewound, then the machine is about to go somewhere it hasn't
+ * been; the events we haven't replayed yet are no longer its future. We
+ * throw those away, and go back to writing events as they happen.
+ */
+static void
+rewind_settle(apple2_rewind *rw, apple2 *mach)
+{
+    apple2_rewind_point *point;
+    uint64_t stamp;
+    vm_8bit key;
+    bool pressed;
+    long mark;
+
+    if (!rw->rewound || rw->count == 0) {
+        return;
+    }
+
+    mark = rw->play->mark;
+    stamp = rw->play->stamp;
+    key = rw->play->key;
+    pressed = rw->play->pressed;
+
+    rewind_close(rw);
+
+    point = &rw->points[(rw->first + rw->count - 1) % REWIND_POINTS];
+    rewind_log(rw, mach, point, mark > 0 ? (size_t)mark : 0);
+
+    // We pick up where the replay left off, so that the next event we
+    // write follows the last one we kept
+    rw->log->stamp = stamp;
+    rw->log->key = key;
+    rw->log->pressed = pressed;
+}
+
+/*
+ * Throw away every checkpoint we have. You would do this if the machine
+ * has jumped to some other point in time (say, by loading a state), so
+ * that the checkpoints have nothing to do with where it is now.
+ */
+void
+apple2_rewind_clear(apple2_rewind *rw)
+{
+    rewind_close(rw);
+
+    for (int i = 0; i < rw->count; i++) {
+        free(rw->points[(rw->first + i) % REWIND_POINTS].delta);
+        free(rw->points[(rw->first + i) % REWIND_POINTS].events);
+    }
+
+    free(rw->last);
+
+    rw->last = NULL;
+    rw->last_len = 0;
+    rw->first = 0;
+    rw->count = 0;
+    rw->next = 0;
+}
+
+/*
+ * Free the rewind ring and all of its checkpoints.
+ */
+void
+apple2_rewind_free(apple2_rewind *rw)
+{
+    apple2_rewind_clear(rw);
+
+    if (rw->log) {
+        apple2_replay_free(rw->log);
+    }
+
+    if (rw->play) {
+        apple2_replay_free(rw->play);
+    }
+
+    free(rw);
+}
+
+/*
+ * Return the byte at index i of a state of length len, xor'd against
+ * the byte at the same index in base. Bytes beyond the end of base are
+ * taken to be zero.
+ */
+static inline vm_8bit
+rewind_xor(const vm_8bit *target, const vm_8bit *base, size_t blen,
+           size_t i)
+{
+    return target[i] ^ (i < blen ? base[i] : 0);
+}
+
+/*
+ * Write a 32-bit run length into buf.
+ */
+static inline void
+rewind_put_len(vm_8bit *buf, uint32_t len)
+{
+    memcpy(buf, &len, sizeof(len));
+}
+
+/*
+ * Build a delta which, applied to base, gives us target. We allocate
+ * the delta and return it through the delta pointer; the return value
+ * is its length (or zero, if we could not allocate it).
+ */
+size_t
+apple2_rewind_delta(vm_8bit **delta, const vm_8bit *target, size_t tlen,
+                    const vm_8bit *base, size_t blen)
+{
+    vm_8bit *buf, *shrunk;
+    size_t i, pos, skip, lit, run, bound;
+
+    // Every run of different bytes is followed by at least
+    // REWIND_MIN_SKIP bytes that aren't (except the last), so this is
+    // as long as a delta can possibly get.
+    bound = tlen + (tlen / REWIND_MIN_SKIP + 2) * 8;
+
+    buf = malloc(bound);
+    if (buf == NULL) {
+        log_crit("Could not allocate memory for rewind delta");
+        *delta = NULL;
+        return 0;
+    }
+
+    i = pos = 0;
+
+    while (i < tlen) {
+        skip = 0;
+        while (i < tlen && rewind_xor(target, base, blen, i) == 0) {
+            skip++;
+            i++;
+        }
+
+        lit = 0;
+        while (i + lit < tlen) {
+            if (rewind_xor(target, base, blen, i + lit) == 0) {
+                run = 0;
+                while (run < REWIND_MIN_SKIP && i + lit + run < tlen &&
+                       rewind_xor(target, base, blen, i + lit + run) == 0) {
+                    run++;
+                }
+
+                if (run == REWIND_MIN_SKIP || i + lit + run == tlen) {
+                    break;
+                }
+
+                lit += run;
+                continue;
+            }
+
+            lit++;
+        }
+
+        rewind_put_len(buf + pos, skip);
+        rewind_put_len(buf + pos + 4, lit);
+        pos += 8;
+
+        for (size_t j = 0; j < lit; j++) {
+            buf[pos++] = rewind_xor(target, base, blen, i + j);
+        }
+
+        i += lit;
+    }
+
+    // Most deltas are much smaller than the bound, so give back what we
+    // didn't use.
+    shrunk = realloc(buf, pos ? pos : 1);
+    if (shrunk) {
+        buf = shrunk;
+    }
+
+    *delta = buf;
+    return pos ? pos : 1;
+}
+
+/*
+ * Apply a delta to base, and return a newly-allocated state of length
+ * tlen. If the delta is malformed, or we can't allocate memory, we
+ * return NULL.
+ */
+vm_8bit *
+apple2_rewind_patch(const vm_8bit *delta, size_t dlen, const vm_8bit *base,
+                    size_t blen, size_t tlen)
+{
+    vm_8bit *target;
+    uint32_t skip, lit;
+    size_t i, pos;
+
+    target = malloc(tlen ? tlen : 1);
+    if (target == NULL) {
+        log_crit("Could not allocate memory for rewind state");
+        return NULL;
+    }
+
+    // We begin with a copy of base (as much as fits), and zeroes after
+    // that; then we only need to xor in the bytes that are different.
+    memset(target, 0, tlen);
+    memcpy(target, base, blen < tlen ? blen : tlen);
+
+    i = pos = 0;
+
+    while (pos + 8 <= dlen) {
+        memcpy(&skip, delta + pos, 4);
+        memcpy(&lit, delta + pos + 4, 4);
+        pos += 8;
+
+        if (i + skip + lit > tlen || pos + lit > dlen) {
+            log_crit("Rewind delta is malformed");
+            free(target);
+            return NULL;
+        }
+
+        i += skip;
+
+        for (uint32_t j = 0; j < lit; j++) {
+            target[i++] ^= delta[pos++];
+        }
+    }
+
+    return target;
+}
+
+/*
+ * Take a checkpoint of the machine as it is now.
+ */
+int
+apple2_rewind_checkpoint(apple2_rewind *rw, apple2 *mach)
+{
+    apple2_state_buf buf = { NULL, 0, 0, OK };
+    apple2_rewind_point *point;
+    int err;
+
+    err = apple2_state_encode(mach, &buf);
+    if (err != OK) {
+        free(buf.data);
+        return err;
+    }
+
+    // The events we've been writing belong to the checkpoint that was
+    // the newest; the ones we write from here on belong to this one.
+    rewind_settle(rw, mach);
+    rewind_close(rw);
+
+    // If the ring is full, then the oldest checkpoint has to go.
+    if (rw->count == REWIND_POINTS) {
+        free(rw->points[rw->first].delta);
+        free(rw->points[rw->first].events);
+        rw->points[rw->first].delta = NULL;
+        rw->points[rw->first].events = NULL;
+        rw->points[rw->first].events_len = 0;
+        rw->first = (rw->first + 1) % REWIND_POINTS;
+        rw->count--;
+    }
+
+    // The checkpoint that was the newest now becomes a delta against
+    // the one we're adding.
+    if (rw->count > 0) {
+        point = &rw->points[(rw->first + rw->count - 1) % REWIND_POINTS];
+        point->delta_len = apple2_rewind_delta(&point->delta,
+                                               rw->last, rw->last_len,
+                                               buf.data, buf.pos);
+
+        // If we couldn't build the delta, we've lost the way back to
+        // every checkpoint before this one.
+        if (point->delta == NULL) {
+            apple2_rewind_clear(rw);
+        }
+    }
+
+    free(rw->last);
+    rw->last = buf.data;
+    rw->last_len = buf.pos;
+
+    point = &rw->points[(rw->first + rw->count) % REWIND_POINTS];
+    point->cycles = mach->cpu->cycles;
+    point->delta = NULL;
+    point->delta_len = 0;
+    point->len = buf.pos;
+    point->events = NULL;
+    point->events_len = 0;
+
+    rw->count++;
+    rw->next = mach->cpu->cycles + rw->interval;
+
+    rewind_log(rw, mach, point, 0);
+
+    return OK;
+}
+
+/*
+ * This is called by the run loop before each instruction it executes.
+ * If it's time, we take a checkpoint; and we write down any change in
+ * the keyboard since the last instruction, just as a recording would.
+ */
+void
+apple2_rewind_tick(apple2_rewind *rw, apple2 *mach)
+{
+    rewind_settle(rw, mach);
+
+    if (mach->cpu->cycles >= rw->next) {
+        apple2_rewind_checkpoint(rw, mach);
+    }
+
+    apple2_replay_tick(rw->log, mach);
+}
+
+/*
+ * Return a byte of noise for the disk controller (see
+ * apple2_replay_noise()). While we run forward from a checkpoint, it's
+ * the noise the machine was given the first time; otherwise, we write
+ * down whatever noise it's given now.
+ */
+vm_8bit
+apple2_rewind_noise(apple2_rewind *rw, apple2 *mach)
+{
+    vm_8bit byte;
+
+    if (rw == NULL) {
+        return apple2_replay_noise(mach->replay);
+    }
+
+    if (rw->running && rw->rewound) {
+        return apple2_replay_noise(rw->play);
+    }
+
+    rewind_settle(rw, mach);
+
+    byte = apple2_replay_noise(mach->replay);
+    apple2_replay_put_noise(rw->log, byte);
+
+    return byte;
+}
+
+/*
+ * Write down that a disk was just inserted into drive 1 or 2.
+ */
+int
+apple2_rewind_disk(apple2_rewind *rw, apple2 *mach, int which)
+{
+    rewind_settle(rw, mach);
+
+    return apple2_replay_disk(rw->log, mach, which);
+}
+
+/*
+ * Restore the machine to the checkpoint at the given index (where zero
+ * is the oldest checkpoint we have). Any checkpoints newer than that
+ * one are discarded; we're going back in time, and they are now in the
+ * future.
+ */
+int
+apple2_rewind_restore(apple2_rewind *rw, apple2 *mach, int index)
+{
+    apple2_rewind_point *point;
+    vm_8bit *state, *prev;
+    size_t len;
+    int i, err;
+
+    if (index < 0 || index >= rw->count) {
+        return ERR_OOB;
+    }
+
+    state = malloc(rw->last_len ? rw->last_len : 1);
+    if (state == NULL) {
+        log_crit("Could not allocate memory for rewind state");
+        return ERR_OOM;
+    }
+
+    memcpy(state, rw->last, rw->last_len);
+    len = rw->last_len;
+
+    // Walk back from the newest checkpoint, applying deltas, until we
+    // get to the one we want.
+    for (i = rw->count - 2; i >= index; i--) {
+        point = &rw->points[(rw->first + i) % REWIND_POINTS];
+
+        prev = state;
+        state = apple2_rewind_patch(point->delta, point->delta_len,
+                                    prev, len, point->len);
+        free(prev);
+
+        if (state == NULL) {
+            return ERR_INVALID;
+        }
+
+        len = point->len;
+    }
+
+    err = apple2_state_decode(mach, state, len);
+    if (err != OK) {
+        free(state);
+        return err;
+    }
+
+    // A recording can't follow us back in time
+    apple2_replay_stop(mach->replay);
+    rewind_close(rw);
+
+    // Now drop everything after the checkpoint, and make it the newest.
+    for (i = index; i < rw->count; i++) {
+        point = &rw->points[(rw->first + i) % REWIND_POINTS];
+        free(point->delta);
+        point->delta = NULL;
+        point->delta_len = 0;
+
+        if (i > index) {
+            free(point->events);
+            point->events = NULL;
+            point->events_len = 0;
+        }
+    }
+
+    free(rw->last);
+    rw->last = state;
+    rw->last_len = len;
+    rw->count = index + 1;
+    rw->next = mach->cpu->cycles + rw->interval;
+
+    // When we run forward from here, we'll replay what came after the
+    // checkpoint the first time.
+    point = &rw->points[(rw->first + index) % REWIND_POINTS];
+    if (point->events_len > 0) {
+        rw->in = fmemopen(point->events, point->events_len, "r");
+    }
+
+    apple2_replay_events(rw->play, mach, rw->in, REPLAY_PLAY);
+    rw->rewound = true;
+
+    return OK;
+}
+
+/*
+ * Run the machine forward until its cycle count reaches target. If
+ * we've just restored a checkpoint, we replay the events that followed
+ * it, so the machine does what it did the first time. We don't look for
+ * breakpoints--if there are any, we're going to where they'd stop us,
+ * not stopping at them--and we don't count the instructions we execute
+ * in the profiles, the trace, or the heatmap; those have been counted
+ * already.
+ */
+int
+apple2_rewind_run_to(apple2 *mach, uint64_t target)
+{
+    apple2_rewind *rw = mach->rewind;
+    mos6502 *cpu = mach->cpu;
+    mos6502_prof *prof = cpu->prof;
+    mos6502_calls *calls = cpu->calls;
+    mos6502_trace *trace = cpu->trace;
+    bool counting = false;
+
+    // We've been here before, and any watchpoint we come across has
+    // had its say already
+    if (mach->watch) {
+        mach->watch->quiet = true;
+    }
+
+    // A fork shares its heatmap with the machine it was forked from,
+    // and doesn't count in it anyway
+    if (mach->heat && mach->heat->mach == mach) {
+        counting = mach->heat->counting;
+        mach->heat->counting = false;
+    }
+
+    cpu->prof = NULL;
+    cpu->calls = NULL;
+    cpu->trace = NULL;
+
+    if (rw) {
+        rw->running = true;
+    }
+
+    while (cpu->cycles < target) {
+        if (rw && rw->rewound) {
+            apple2_replay_tick(rw->play, mach);
+        }
+
+        if (mach->screen && vm_screen_last_key(mach->screen)) {
+            mach->strobe = true;
+        }
+
+        mos6502_execute(cpu);
+    }
+
+    if (rw) {
+        rw->running = false;
+    }
+
+    cpu->prof = prof;
+    cpu->calls = calls;
+    cpu->trace = trace;
+
+    if (mach->heat && mach->heat->mach == mach) {
+        mach->heat->counting = counting;
+    }
+
+    if (mach->watch) {
+        mach->watch->quiet = false;
+    }
+
+    return OK;
+}
+
+/*
+ * Return the index of the newest checkpoint taken before the given
+ * cycle count, or -1 if there isn't one.
+ */
+static int
+rewind_find(apple2_rewind *rw, uint64_t cycles)
+{
+    for (int i = rw->count - 1; i >= 0; i--) {
+        if (rw->points[(rw->first + i) % REWIND_POINTS].cycles < cycles) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Step the machine back by one instruction. We go back to the nearest
+ * checkpoint and run forward to find where the previous instruction
+ * began; then we go back again and run forward to just that point.
+ */
+int
+apple2_rewind_step(apple2_rewind *rw, apple2 *mach)
+{
+    uint64_t now, target;
+    int index, err;
+
+    now = mach->cpu->cycles;
+
+    index = rewind_find(rw, now);
+    if (index < 0) {
+        return ERR_OOB;
+    }
+
+    err = apple2_rewind_restore(rw, mach, index);
+    if (err != OK) {
+        return err;
+    }
+
+    target = mach->cpu->cycles;
+    while (mach->cpu->cycles < now) {
+        target = mach->cpu->cycles;
+        apple2_rewind_run_to(mach, target + 1);
+    }
+
+    err = apple2_rewind_restore(rw, mach, index);
+    if (err != OK) {
+        return err;
+    }
+
+    return apple2_rewind_run_to(mach, target);
+}
+
+/*
+ * Run the machine backwards until we come to a breakpoint; that is, go
+ * back to the last time, before now, that we were about to execute an
+ * instruction with a breakpoint on it. If there's no such time within
+ * the checkpoints we have, we end up at the oldest checkpoint.
+ */
+int
+apple2_rewind_continue(apple2_rewind *rw, apple2 *mach)
+{
+    uint64_t end, target;
+    bool found;
+    int index, err;
+
+    end = mach->cpu->cycles;
+
+    for (index = rewind_find(rw, end); index >= 0; index--) {
+        err = apple2_rewind_restore(rw, mach, index);
+        if (err != OK) {
+            return err;
+        }
+
+        // Run forward through this span between checkpoints, and look
+        // for the last breakpoint we'd have stopped at.
+        found = false;
+        while (mach->cpu->cycles < end) {
+            if (apple2_debug_stop(mach->cpu)) {
+                found = true;
+                target = mach->cpu->cycles;
+            }
+
+            apple2_rewind_run_to(mach, mach->cpu->cycles + 1);
+        }
+
+        if (found) {
+            err = apple2_rewind_restore(rw, mach, index);
+            if (err != OK) {
+                return err;
+            }
+
+            return apple2_rewind_run_to(mach, target);
+        }
+
+        end = rw->points[(rw->first + index) % REWIND_POINTS].cycles;
+    }
+
+    // We didn't find a breakpoint, so we'll settle for the oldest point
+    // we can get to.
+    if (rw->count == 0) {
+        return ERR_OOB;
+    }
+
+    return apple2_rewind_restore(rw, mach, 0);
+}
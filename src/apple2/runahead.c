@@ -0,0 +1,71 @@
+/*
+ * apple2.runahead.c
+ *
+ * Software on the Apple II reads the keyboard when it gets around to
+ * it--maybe once a frame, maybe less often--and then may take another
+ * frame or two to put something on the screen about it. Add that to
+ * the time it takes us to get the screen to you, and typing can feel
+ * sluggish.
+ *
+ * Run-ahead hides the machine's part of that. When it's time to draw,
+ * we fork the machine (see apple2_fork()), run the fork a few frames
+ * into the future, and draw what's on the fork's screen; then we throw
+ * the fork away. Throwing it away is our rollback. The machine itself
+ * never runs ahead, so nothing it does has to be undone; but what you
+ * see is a few frames fresher than where the machine really is.
+ */
+
+#include "apple2/draw.h"
+#include "apple2/rewind.h"
+#include "apple2/runahead.h"
+
+/*
+ * Return a fork of the machine which has run the given number of
+ * frames further than the machine has, or NULL if we couldn't fork it.
+ */
+apple2 *
+apple2_runahead(apple2 *mach, int frames)
+{
+    apple2 *fork;
+
+    fork = apple2_fork(mach);
+    if (fork == NULL) {
+        return NULL;
+    }
+
+    apple2_rewind_run_to(fork, mach->cpu->cycles +
+                         (uint64_t)frames * APPLE2_FRAME_CYCLES);
+
+    return fork;
+}
+
+/*
+ * Draw the screen of the machine as it will be in the given number of
+ * frames. If we can't run ahead, we'll just draw it as it is now.
+ */
+void
+apple2_runahead_draw(apple2 *mach, int frames)
+{
+    apple2 *fork;
+    vm_screen *screen;
+
+    fork = apple2_runahead(mach, frames);
+    if (fork == NULL) {
+        apple2_draw(mach);
+        return;
+    }
+
+    // A fork has no screen or fonts to draw with, so it borrows ours
+    screen = fork->screen;
+    fork->screen = mach->screen;
+    fork->sysfont = mach->sysfont;
+    fork->invfont = mach->invfont;
+
+    apple2_draw(fork);
+
+    fork->screen = screen;
+    fork->sysfont = NULL;
+    fork->invfont = NULL;
+
+    apple2_free(fork);
+}
@@ -0,0 +1,205 @@
+/*
+ * apple2.snap.c
+ *
+ * A cache of machine snapshots taken just after boot. Almost every time
+ * we run, we boot the same ROM with the same disks, and spend millions
+ * of cycles doing so only to end up at the same prompt. If you've given
+ * us a snapshot directory, then the first time we boot with some set of
+ * inputs, we'll wait until the machine has settled down at a prompt and
+ * save its state there; every time after that, we load the state and
+ * skip the boot entirely.
+ *
+ * Snapshots are named by a hash of everything that could change the
+ * result of a boot: the contents of the ROM, and the disk images in
+ * the drives (and their types).
+ */
+
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apple2/dd.h"
+#include "apple2/snap.h"
+#include "apple2/state.h"
+#include "vm_di.h"
+#include "vm_hash.h"
+
+/*
+ * Return the snapshot key for the machine as it is now.
+ */
+uint64_t
+apple2_snap_key(apple2 *mach)
+{
+    apple2dd *drives[] = { mach->drive1, mach->drive2 };
+    uint64_t hash = VM_HASH_INIT;
+
+    hash = vm_hash_int(hash, SNAP_VERSION);
+    hash = vm_hash_int(hash, STATE_VERSION);
+    hash = vm_hash_segment(hash, mach->rom);
+
+    for (int i = 0; i < 2; i++) {
+        hash = vm_hash_int(hash, drives[i]->image != NULL);
+
+        if (drives[i]->image) {
+            hash = vm_hash_int(hash, drives[i]->image_type);
+            hash = vm_hash_segment(hash, drives[i]->image);
+        }
+    }
+
+    return hash;
+}
+
+/*
+ * Write the path of the snapshot for a given key into buf. If the path
+ * would not fit, we return ERR_OOB.
+ */
+int
+apple2_snap_path(char *buf, size_t len, const char *dir, uint64_t key)
+{
+    int n;
+
+    n = snprintf(buf, len, "%s/%016" PRIx64 ".state", dir, key);
+    if (n < 0 || n >= len) {
+        return ERR_OOB;
+    }
+
+    return OK;
+}
+
+/*
+ * Try to restore the machine from a snapshot. We return OK if we did;
+ * if we couldn't, because there is no snapshot yet, we set ourselves up
+ * to record one once the machine goes idle, and return ERR_BADFILE.
+ */
+int
+apple2_snap_restore(apple2 *mach)
+{
+    char path[SNAP_PATH_MAX];
+    const char *dir;
+    FILE *stream;
+    int err;
+
+    mach->snap_pending = false;
+    mach->kb_polls = 0;
+
+    dir = (const char *)vm_di_get(VM_SNAPCACHE);
+    if (dir == NULL) {
+        return ERR_INVALID;
+    }
+
+    // We don't save the state of the block device, and the volume in it
+    // could change underneath us from one run to the next; so we can't
+    // say that a snapshot would be the same.
+    if (mach->blockdev && mach->blockdev->online) {
+        log_info("Not using snapshots with a volume in the block device");
+        return ERR_INVALID;
+    }
+
+    if (apple2_snap_path(path, sizeof(path), dir,
+                         apple2_snap_key(mach)) != OK) {
+        return ERR_OOB;
+    }
+
+    stream = fopen(path, "r");
+    if (stream == NULL) {
+        mach->snap_pending = true;
+        return ERR_BADFILE;
+    }
+
+    err = apple2_state_load(mach, stream);
+    fclose(stream);
+
+    // If the snapshot is no good, we'll just record a new one over it.
+    if (err != OK) {
+        log_crit("Could not load snapshot %s", path);
+        mach->snap_pending = true;
+        return err;
+    }
+
+    log_info("Restored boot snapshot %s", path);
+    return OK;
+}
+
+/*
+ * Save a snapshot of the machine as it is now. As with the nibble
+ * cache, we write to a temporary file and rename it into place. We
+ * don't compress the snapshot; it's a little larger that way, but it
+ * loads straight out of a mapping of the file.
+ */
+int
+apple2_snap_store(apple2 *mach)
+{
+    char path[SNAP_PATH_MAX], tmp[SNAP_PATH_MAX];
+    const char *dir;
+    FILE *stream;
+    int err;
+
+    dir = (const char *)vm_di_get(VM_SNAPCACHE);
+    if (dir == NULL) {
+        return ERR_INVALID;
+    }
+
+    if (apple2_snap_path(path, sizeof(path), dir,
+                         apple2_snap_key(mach)) != OK) {
+        return ERR_OOB;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    // If the directory already exists, this fails, which is fine.
+    mkdir(dir, 0755);
+
+    stream = fopen(tmp, "w");
+    if (stream == NULL) {
+        log_crit("Could not open snapshot %s: %s", tmp, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    err = apple2_state_save(mach, stream, STATE_DEFAULT);
+    fclose(stream);
+
+    if (err != OK || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return ERR_BADFILE;
+    }
+
+    log_info("Recorded boot snapshot %s", path);
+    return OK;
+}
+
+/*
+ * Note that the machine has polled the keyboard. If a key was waiting,
+ * then someone has already begun to interact with the machine, and
+ * whatever state it ends up in is not a pristine boot; we give up on
+ * the snapshot.
+ */
+void
+apple2_snap_poll(apple2 *mach, bool key)
+{
+    if (!mach->snap_pending) {
+        return;
+    }
+
+    if (key) {
+        mach->snap_pending = false;
+        return;
+    }
+
+    mach->kb_polls++;
+}
+
+/*
+ * This is called by the run loop between instructions, while we are
+ * waiting to record a snapshot. Once the machine has gone idle, we
+ * record it.
+ */
+void
+apple2_snap_idle(apple2 *mach)
+{
+    if (!mach->snap_pending || mach->kb_polls < SNAP_IDLE_POLLS) {
+        return;
+    }
+
+    mach->snap_pending = false;
+    apple2_snap_store(mach);
+}
@@ -0,0 +1,719 @@
+/*
+ * apple2.state.c
+ *
+ * Here we save the complete state of a machine to a file, and restore a
+ * machine from one. That state is everything the software in the
+ * machine could notice: the CPU registers, all of memory, the soft
+ * switch modes, the keyboard, and the disk drives.
+ *
+ * A state file is a fixed-length header followed by the state data. The
+ * header is laid out like so (all numbers are little-endian):
+ *
+ *   0  magic ("ERCS")
+ *   4  format version (16 bits)
+ *   6  flags (16 bits; see apple2_state_flags)
+ *   8  length of the state data (32 bits)
+ *  12  length of the state data as it's stored (32 bits)
+ *  16  hash of the state data (64 bits)
+ *  24  reserved (64 bits of zero)
+ *
+ * If the state isn't compressed, the stored length and the length are
+ * the same, and the state data can be decoded directly out of a mapping
+ * of the file--which is what we do. The largest part of a state is the
+ * memory of the machine, and those bytes are copied straight out of the
+ * mapping into our memory segments; a load takes about as long as it
+ * takes to copy a few hundred kilobytes.
+ *
+ * We don't save the contents of the disks themselves. We save a hash of
+ * each disk image, and then only the tracks that have been written to
+ * since the disk was inserted; to load a state, the same disks must be
+ * in the drives.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "apple2/dd.h"
+#include "apple2/enc.h"
+#include "apple2/state.h"
+#include "vm_hash.h"
+
+/*
+ * When we encode a state, this is how much room we begin with in our
+ * buffer. It's enough to hold the memory segments, which are most of
+ * what we write, so we rarely need to grow it.
+ */
+#define STATE_BUF_SIZE 0x30000
+
+/*
+ * Make sure the buffer has room for another len bytes, growing it if it
+ * doesn't.
+ */
+static bool
+state_reserve(apple2_state_buf *buf, size_t len)
+{
+    vm_8bit *data;
+    size_t size;
+
+    if (buf->err != OK) {
+        return false;
+    }
+
+    if (buf->pos + len <= buf->size) {
+        return true;
+    }
+
+    size = buf->size ? buf->size : STATE_BUF_SIZE;
+    while (size < buf->pos + len) {
+        size *= 2;
+    }
+
+    data = realloc(buf->data, size);
+    if (data == NULL) {
+        log_crit("Couldn't allocate memory for machine state");
+        buf->err = ERR_OOM;
+        return false;
+    }
+
+    buf->data = data;
+    buf->size = size;
+    return true;
+}
+
+/*
+ * Write len bytes from src into the buffer.
+ */
+static void
+state_put(apple2_state_buf *buf, const vm_8bit *src, size_t len)
+{
+    if (!state_reserve(buf, len)) {
+        return;
+    }
+
+    memcpy(buf->data + buf->pos, src, len);
+    buf->pos += len;
+}
+
+/*
+ * Write an unsigned number of the given width (in bytes) into the
+ * buffer, least significant byte first.
+ */
+static void
+state_put_num(apple2_state_buf *buf, uint64_t num, int width)
+{
+    vm_8bit bytes[8];
+
+    for (int i = 0; i < width; i++) {
+        bytes[i] = (num >> (i * 8)) & 0xff;
+    }
+
+    state_put(buf, bytes, width);
+}
+
+/*
+ * Return a pointer to the next len bytes in the buffer, and move past
+ * them. If there aren't that many bytes left, we return NULL and note
+ * the error in the buffer.
+ */
+static const vm_8bit *
+state_get(apple2_state_buf *buf, size_t len)
+{
+    const vm_8bit *ptr;
+
+    if (buf->err != OK) {
+        return NULL;
+    }
+
+    if (len > buf->size - buf->pos) {
+        log_crit("Machine state is truncated");
+        buf->err = ERR_BADFILE;
+        return NULL;
+    }
+
+    ptr = buf->data + buf->pos;
+    buf->pos += len;
+
+    return ptr;
+}
+
+/*
+ * Read an unsigned number of the given width (in bytes) from the
+ * buffer. If the buffer is exhausted, we return zero.
+ */
+static uint64_t
+state_get_num(apple2_state_buf *buf, int width)
+{
+    const vm_8bit *bytes;
+    uint64_t num = 0;
+
+    bytes = state_get(buf, width);
+    if (bytes == NULL) {
+        return 0;
+    }
+
+    for (int i = width - 1; i >= 0; i--) {
+        num = (num << 8) | bytes[i];
+    }
+
+    return num;
+}
+
+/*
+ * Write a memory segment into the buffer, prefixed by its size.
+ */
+static void
+state_put_segment(apple2_state_buf *buf, vm_segment *seg)
+{
+    state_put_num(buf, seg->size, 4);
+    state_put(buf, seg->memory, seg->size);
+}
+
+/*
+ * Read the contents of a memory segment out of the buffer. The segment
+ * we saved must be the same size as the one we're reading into. We
+ * only copy the memory if apply is true.
+ */
+static void
+state_get_segment(apple2_state_buf *buf, vm_segment *seg, bool apply)
+{
+    const vm_8bit *mem;
+    size_t size;
+
+    size = state_get_num(buf, 4);
+    if (buf->err == OK && size != seg->size) {
+        log_crit("Saved segment size (%zu) does not match machine (%zu)",
+                 size, seg->size);
+        buf->err = ERR_BADFILE;
+        return;
+    }
+
+    mem = state_get(buf, size);
+    if (mem && apply) {
+        memcpy(seg->memory, mem, size);
+    }
+}
+
+/*
+ * Return true if the given track of the drive has been written to, and
+ * is one we can save. (The head can step a half-track beyond the last
+ * track of the disk, but there's no data there.)
+ */
+static bool
+state_dirty(apple2dd *drive, int track)
+{
+    return drive->dirty[track] &&
+        (track + 1) * ENC_ETRACK <= drive->data->size;
+}
+
+/*
+ * Write the state of a disk drive into the buffer.
+ */
+static void
+state_put_drive(apple2_state_buf *buf, apple2dd *drive)
+{
+    int track, ndirty = 0;
+
+    state_put_num(buf, drive->data != NULL, 1);
+
+    if (drive->data) {
+        state_put_num(buf, vm_hash_segment(VM_HASH_INIT, drive->image), 8);
+        state_put_num(buf, drive->data->size, 4);
+    }
+
+    state_put_num(buf, drive->track_pos, 1);
+    state_put_num(buf, drive->sector_pos, 2);
+    state_put_num(buf, drive->phase, 1);
+    state_put_num(buf, drive->latch, 1);
+    state_put_num(buf, drive->mode, 1);
+    state_put_num(buf, drive->online, 1);
+    state_put_num(buf, drive->write_protect, 1);
+
+    if (drive->data == NULL) {
+        return;
+    }
+
+    for (track = 0; track < DD_NUM_TRACKS; track++) {
+        if (state_dirty(drive, track)) {
+            ndirty++;
+        }
+    }
+
+    state_put_num(buf, ndirty, 1);
+
+    for (track = 0; track < DD_NUM_TRACKS; track++) {
+        if (state_dirty(drive, track)) {
+            state_put_num(buf, track, 1);
+            state_put(buf, drive->data->memory + (track * ENC_ETRACK),
+                      ENC_ETRACK);
+        }
+    }
+}
+
+/*
+ * Read the state of a disk drive from the buffer. If the drive had a
+ * disk in it, then our drive must have the very same disk, or we can't
+ * go on.
+ */
+static void
+state_get_drive(apple2_state_buf *buf, apple2dd *drive, bool apply)
+{
+    const vm_8bit *data;
+    uint64_t hash;
+    size_t size;
+    int track_pos, sector_pos, phase, latch, mode, online, protect;
+    int present, ndirty, track;
+    bool saved[DD_NUM_TRACKS];
+
+    present = state_get_num(buf, 1);
+
+    if (present) {
+        hash = state_get_num(buf, 8);
+        size = state_get_num(buf, 4);
+    }
+
+    if (buf->err != OK) {
+        return;
+    }
+
+    if (present != (drive->data != NULL)) {
+        log_crit("Saved drive state %s a disk, but our drive %s",
+                 present ? "has" : "does not have",
+                 drive->data ? "does" : "does not");
+        buf->err = ERR_BADFILE;
+        return;
+    }
+
+    if (present && (size != drive->data->size ||
+                    hash != vm_hash_segment(VM_HASH_INIT, drive->image))) {
+        log_crit("The disk in the drive is not the one in the saved state");
+        buf->err = ERR_BADFILE;
+        return;
+    }
+
+    track_pos = state_get_num(buf, 1);
+    sector_pos = state_get_num(buf, 2);
+    phase = state_get_num(buf, 1);
+    latch = state_get_num(buf, 1);
+    mode = state_get_num(buf, 1);
+    online = state_get_num(buf, 1);
+    protect = state_get_num(buf, 1);
+
+    if (track_pos > MAX_DRIVE_STEPS || sector_pos >= ENC_ETRACK) {
+        log_crit("Saved drive head position is out of bounds");
+        buf->err = ERR_BADFILE;
+        return;
+    }
+
+    if (apply) {
+        drive->track_pos = track_pos;
+        drive->sector_pos = sector_pos;
+        drive->phase = phase;
+        drive->latch = latch;
+        drive->mode = mode;
+        drive->online = online;
+        drive->write_protect = protect;
+    }
+
+    if (!present) {
+        return;
+    }
+
+    ndirty = state_get_num(buf, 1);
+    memset(saved, false, sizeof(saved));
+
+    // We make two passes over the saved tracks: one to see which they
+    // are, and the second to copy them in. In between, any track we've
+    // written to since the state was saved--that isn't one of the saved
+    // tracks--has to go back to the way it was.
+    size_t start = buf->pos;
+
+    for (int i = 0; i < ndirty; i++) {
+        track = state_get_num(buf, 1);
+        data = state_get(buf, ENC_ETRACK);
+
+        if (data == NULL) {
+            return;
+        }
+
+        if (track >= DD_NUM_TRACKS ||
+            (track + 1) * ENC_ETRACK > drive->data->size) {
+            log_crit("Saved track %d is beyond the end of the disk", track);
+            buf->err = ERR_BADFILE;
+            return;
+        }
+
+        saved[track] = true;
+    }
+
+    if (!apply) {
+        return;
+    }
+
+    if (apple2_dd_reset_tracks(drive, saved) != OK) {
+        buf->err = ERR_INVALID;
+        return;
+    }
+
+    buf->pos = start;
+
+    for (int i = 0; i < ndirty; i++) {
+        track = state_get_num(buf, 1);
+        data = state_get(buf, ENC_ETRACK);
+
+        memcpy(drive->data->memory + (track * ENC_ETRACK), data,
+               ENC_ETRACK);
+        drive->dirty[track] = true;
+    }
+}
+
+/*
+ * Serialize the state of the machine into buf, appending to whatever
+ * is already there. The caller is responsible for freeing buf->data
+ * when they are done with it.
+ */
+int
+apple2_state_encode(apple2 *mach, apple2_state_buf *buf)
+{
+    mos6502 *cpu = mach->cpu;
+    int selected = 0;
+
+    state_put_num(buf, cpu->PC, 2);
+    state_put_num(buf, cpu->A, 1);
+    state_put_num(buf, cpu->X, 1);
+    state_put_num(buf, cpu->Y, 1);
+    state_put_num(buf, cpu->P, 1);
+    state_put_num(buf, cpu->S, 1);
+    state_put_num(buf, cpu->opcode, 1);
+    state_put_num(buf, cpu->operand, 1);
+    state_put_num(buf, cpu->eff_addr, 2);
+    state_put_num(buf, cpu->addr_mode, 1);
+    state_put_num(buf, cpu->cycles, 8);
+
+    state_put_num(buf, mach->bank_switch, 1);
+    state_put_num(buf, mach->memory_mode, 1);
+    state_put_num(buf, mach->display_mode, 1);
+    state_put_num(buf, mach->color_mode, 1);
+    state_put_num(buf, mach->strobe, 1);
+
+    // The keyboard state is kept by the screen, since that's where we
+    // get our input events from.
+    state_put_num(buf, mach->screen ? mach->screen->last_key : 0, 1);
+    state_put_num(buf, mach->screen ? mach->screen->key_pressed : 0, 1);
+
+    state_put_segment(buf, mach->main);
+    state_put_segment(buf, mach->aux);
+    state_put_segment(buf, mach->rom);
+
+    if (mach->selected_drive == mach->drive1) {
+        selected = 1;
+    } else if (mach->selected_drive == mach->drive2) {
+        selected = 2;
+    }
+
+    state_put_num(buf, selected, 1);
+    state_put_drive(buf, mach->drive1);
+    state_put_drive(buf, mach->drive2);
+
+    return buf->err;
+}
+
+/*
+ * Read the state of a machine out of buf. If apply is false, we only
+ * check that the state is something we could load into the machine,
+ * and leave the machine alone.
+ */
+static int
+state_read(apple2 *mach, apple2_state_buf *buf, bool apply)
+{
+    mos6502 saved;
+    vm_8bit bank_switch, memory_mode, display_mode, color_mode, strobe;
+    vm_8bit last_key, key_pressed;
+    int selected;
+
+    // We read the registers into a scratch CPU, so that we don't touch
+    // the real one until we know the whole state is good.
+    saved.PC = state_get_num(buf, 2);
+    saved.A = state_get_num(buf, 1);
+    saved.X = state_get_num(buf, 1);
+    saved.Y = state_get_num(buf, 1);
+    saved.P = state_get_num(buf, 1);
+    saved.S = state_get_num(buf, 1);
+    saved.opcode = state_get_num(buf, 1);
+    saved.operand = state_get_num(buf, 1);
+    saved.eff_addr = state_get_num(buf, 2);
+    saved.addr_mode = state_get_num(buf, 1);
+    saved.cycles = state_get_num(buf, 8);
+
+    bank_switch = state_get_num(buf, 1);
+    memory_mode = state_get_num(buf, 1);
+    display_mode = state_get_num(buf, 1);
+    color_mode = state_get_num(buf, 1);
+    strobe = state_get_num(buf, 1);
+
+    last_key = state_get_num(buf, 1);
+    key_pressed = state_get_num(buf, 1);
+
+    state_get_segment(buf, mach->main, apply);
+    state_get_segment(buf, mach->aux, apply);
+    state_get_segment(buf, mach->rom, apply);
+
+    selected = state_get_num(buf, 1);
+    state_get_drive(buf, mach->drive1, apply);
+    state_get_drive(buf, mach->drive2, apply);
+
+    if (buf->err != OK || !apply) {
+        return buf->err;
+    }
+
+    // Keep the memory segments the CPU is using; the memory mode will
+    // decide those for us in a moment.
+    saved.rmem = mach->cpu->rmem;
+    saved.wmem = mach->cpu->wmem;
+
+    // Profiles and traces aren't part of the state, so we keep those
+    // too
+    saved.prof = mach->cpu->prof;
+    saved.calls = mach->cpu->calls;
+    saved.trace = mach->cpu->trace;
+    *mach->cpu = saved;
+
+    // We set the bank switch directly, rather than through
+    // apple2_set_bank_switch(); that function would copy the zero page
+    // between main and aux memory, but we've already restored both
+    // exactly as they were.
+    mach->bank_switch = bank_switch;
+    apple2_set_memory_mode(mach, memory_mode);
+
+    mach->color_mode = color_mode;
+    mach->strobe = strobe;
+
+    if (mach->screen) {
+        apple2_set_display(mach, display_mode);
+        mach->screen->last_key = last_key;
+        mach->screen->key_pressed = key_pressed;
+    } else {
+        mach->display_mode = display_mode;
+    }
+
+    switch (selected) {
+        case 1: mach->selected_drive = mach->drive1; break;
+        case 2: mach->selected_drive = mach->drive2; break;
+        default: mach->selected_drive = NULL; break;
+    }
+
+    apple2_notify_refresh(mach);
+
+    return OK;
+}
+
+/*
+ * Restore the state of a machine from the given data, which must have
+ * been produced by apple2_state_encode(). If the data can't be loaded
+ * into this machine, we return an error and leave the machine as it
+ * was.
+ */
+int
+apple2_state_decode(apple2 *mach, const vm_8bit *data, size_t size)
+{
+    apple2_state_buf buf;
+    int err;
+
+    buf.data = (vm_8bit *)data;
+    buf.size = size;
+    buf.pos = 0;
+    buf.err = OK;
+
+    // Do this once without changing anything, so we'll know before we
+    // begin if it's going to work.
+    err = state_read(mach, &buf, false);
+    if (err != OK) {
+        return err;
+    }
+
+    buf.pos = 0;
+    return state_read(mach, &buf, true);
+}
+
+/*
+ * Save the state of the machine to the given stream, with the given
+ * flags (see apple2_state_flags).
+ */
+int
+apple2_state_save(apple2 *mach, FILE *stream, int flags)
+{
+    apple2_state_buf state, header;
+    vm_8bit *stored = NULL;
+    uLongf stored_len;
+    int err;
+
+    memset(&state, 0, sizeof(state));
+    memset(&header, 0, sizeof(header));
+    state.err = header.err = OK;
+
+    err = apple2_state_encode(mach, &state);
+    if (err != OK) {
+        free(state.data);
+        return err;
+    }
+
+    stored = state.data;
+    stored_len = state.pos;
+
+    if (flags & STATE_COMPRESS) {
+        stored_len = compressBound(state.pos);
+        stored = malloc(stored_len);
+        if (stored == NULL) {
+            log_crit("Couldn't allocate memory to compress machine state");
+            free(state.data);
+            return ERR_OOM;
+        }
+
+        if (compress2(stored, &stored_len, state.data, state.pos,
+                      Z_BEST_SPEED) != Z_OK) {
+            log_crit("Couldn't compress machine state");
+            free(stored);
+            free(state.data);
+            return ERR_INVALID;
+        }
+    }
+
+    state_put(&header, (const vm_8bit *)STATE_MAGIC, 4);
+    state_put_num(&header, STATE_VERSION, 2);
+    state_put_num(&header, flags & STATE_COMPRESS, 2);
+    state_put_num(&header, state.pos, 4);
+    state_put_num(&header, stored_len, 4);
+    state_put_num(&header, vm_hash_buf(VM_HASH_INIT, state.data, state.pos), 8);
+    state_put_num(&header, 0, 8);
+
+    err = header.err;
+
+    if (err == OK &&
+        (fwrite(header.data, header.pos, 1, stream) != 1 ||
+         fwrite(stored, stored_len, 1, stream) != 1 ||
+         fflush(stream) != 0)) {
+        log_crit("Couldn't write machine state: %s", strerror(errno));
+        err = ERR_BADFILE;
+    }
+
+    if (stored != state.data) {
+        free(stored);
+    }
+
+    free(state.data);
+    free(header.data);
+
+    return err;
+}
+
+/*
+ * Load the state of the machine from the given stream, which must have
+ * been written by apple2_state_save(). We map the stream's file into
+ * memory rather than reading it; if it isn't compressed, we decode the
+ * state directly from the mapping. The state doesn't have to be all
+ * that's in the file, but it does have to be at the beginning of it.
+ */
+int
+apple2_state_load(apple2 *mach, FILE *stream)
+{
+    apple2_state_buf header;
+    struct stat finfo;
+    vm_8bit *map, *inflated = NULL;
+    const vm_8bit *data;
+    uint64_t hash;
+    size_t len, stored_len;
+    uLongf inflated_len;
+    int fd, version, flags, err;
+
+    fd = fileno(stream);
+    if (fstat(fd, &finfo)) {
+        log_crit("Couldn't inspect state file: %s", strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    if (finfo.st_size < STATE_HEADER_SIZE) {
+        log_crit("State file is too small to be a state file");
+        return ERR_BADFILE;
+    }
+
+    map = mmap(NULL, finfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        log_crit("Couldn't map state file: %s", strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    header.data = map;
+    header.size = STATE_HEADER_SIZE;
+    header.pos = 4;
+    header.err = OK;
+
+    version = state_get_num(&header, 2);
+    flags = state_get_num(&header, 2);
+    len = state_get_num(&header, 4);
+    stored_len = state_get_num(&header, 4);
+    hash = state_get_num(&header, 8);
+
+    err = ERR_BADFILE;
+
+    if (memcmp(map, STATE_MAGIC, 4) != 0) {
+        log_crit("State file has a bad header");
+        goto done;
+    }
+
+    if (version != STATE_VERSION) {
+        log_crit("State file has version %d; we can only load %d",
+                 version, STATE_VERSION);
+        goto done;
+    }
+
+    if (stored_len > finfo.st_size - STATE_HEADER_SIZE) {
+        log_crit("State file is truncated");
+        goto done;
+    }
+
+    data = map + STATE_HEADER_SIZE;
+
+    if (flags & STATE_COMPRESS) {
+        inflated_len = len;
+        inflated = malloc(len);
+        if (inflated == NULL) {
+            log_crit("Couldn't allocate memory to inflate machine state");
+            err = ERR_OOM;
+            goto done;
+        }
+
+        if (uncompress(inflated, &inflated_len, data, stored_len) != Z_OK ||
+            inflated_len != len) {
+            log_crit("Couldn't inflate machine state");
+            goto done;
+        }
+
+        data = inflated;
+    } else if (stored_len != len) {
+        log_crit("State file lengths do not agree");
+        goto done;
+    }
+
+    if (vm_hash_buf(VM_HASH_INIT, data, len) != hash) {
+        log_crit("State file is corrupt");
+        goto done;
+    }
+
+    err = apple2_state_decode(mach, data, len);
+
+    // Leave the stream just past the state, so that whoever gave it to
+    // us can read anything they may have written after it.
+    if (err == OK &&
+        fseek(stream, STATE_HEADER_SIZE + stored_len, SEEK_SET) != 0) {
+        log_crit("Couldn't seek past state: %s", strerror(errno));
+        err = ERR_BADFILE;
+    }
+
+done:
+    free(inflated);
+    munmap(map, finfo.st_size);
+
+    return err;
+}
@@ -11,6 +11,8 @@
  */
 
 #include <ctype.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "apple2/text.h"
 
@@ -362,3 +364,48 @@ apple2_text_area(vm_area *area, vm_bitfont *font, size_t addr)
 
     return OK;
 }
+
+/*
+ * Write the 40-column text screen to the given stream as plain text,
+ * one line per row. This is meant for places where nobody can look at
+ * the screen, like a batch run; inverse and flashing characters come
+ * out the same as normal ones.
+ */
+void
+apple2_text_dump(apple2 *mach, FILE *stream)
+{
+    char grid[24][41];
+    char *charset = primary_display;
+    size_t addr, base = 0x400;
+    int row, col;
+
+    // Outside of 80STORE, the PAGE2 switch tells us which of the two
+    // text pages is being shown.
+    if ((mach->memory_mode & MEMORY_PAGE2) &&
+        !(mach->memory_mode & MEMORY_80STORE)
+       ) {
+        base = 0x800;
+    }
+
+    if (mach->display_mode & DISPLAY_ALTCHAR) {
+        charset = alternate_display;
+    }
+
+    memset(grid, ' ', sizeof(grid));
+
+    for (addr = 0x400; addr < 0x800; addr++) {
+        row = buffer_rows[addr - 0x400];
+        col = buffer_cols[addr - 0x400];
+
+        if (row == -1 || col == -1) {
+            continue;
+        }
+
+        grid[row][col] = charset[mos6502_peek(mach->cpu, base + addr - 0x400)];
+    }
+
+    for (row = 0; row < 24; row++) {
+        grid[row][40] = '\0';
+        fprintf(stream, "%s\n", grid[row]);
+    }
+}
@@ -0,0 +1,402 @@
+/*
+ * apple2.watch.c
+ *
+ * Watchpoints stop the machine when the CPU reads from, or writes to,
+ * (or changes) some range of memory; which is how you find out who it
+ * is that keeps scribbling over your data.
+ *
+ * We catch accesses the way the soft switches do: by putting our own
+ * read and write mappers on the addresses we watch, in both main and
+ * aux memory. Our mappers call the ones they displaced (or go straight
+ * to memory, if there weren't any), so the machine works just as it
+ * did; and every address we don't watch costs nothing more than it
+ * ever did.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "apple2/bank.h"
+#include "apple2/mem.h"
+#include "apple2/watch.h"
+#include "vm_di.h"
+
+/*
+ * Tell whoever is at the debugger what we caught, and stop the machine
+ * so they can look around.
+ */
+static void
+watch_report(apple2_watch *watch, int kind, vm_16bit addr, vm_8bit old,
+             vm_8bit value)
+{
+    FILE *stream = (FILE *)vm_di_get(VM_OUTPUT);
+    apple2 *mach = watch->mach;
+
+    if (watch->quiet) {
+        return;
+    }
+
+    if (stream) {
+        if (kind == WATCH_READ) {
+            fprintf(stream, "watch: $%04X read $%02X from $%04X\n",
+                    mach->cpu->PC, value, addr);
+        } else {
+            fprintf(stream, "watch: $%04X wrote $%02X to $%04X "
+                    "(was $%02X)\n",
+                    mach->cpu->PC, value, addr, old);
+        }
+    }
+
+    mach->paused = true;
+    mach->debug = true;
+}
+
+/*
+ * Look for the watchpoints that catch the given access to addr, and
+ * report it if any do. For a write, old is what was in memory before
+ * it; for a read, it's just the value read.
+ */
+static void
+watch_hit(apple2_watch *watch, int kind, vm_16bit addr, vm_8bit old,
+          vm_8bit value)
+{
+    apple2_watch_point *point;
+    bool caught = false;
+
+    for (int i = 0; i < watch->npoints; i++) {
+        point = &watch->points[i];
+
+        if (addr < point->from || addr > point->to) {
+            continue;
+        }
+
+        if (kind == WATCH_WRITE) {
+            if ((point->kind & WATCH_WRITE) ||
+                ((point->kind & WATCH_CHANGE) && old != value)
+               ) {
+                point->hits++;
+                caught = true;
+            }
+        } else if (point->kind & WATCH_READ) {
+            point->hits++;
+            caught = true;
+        }
+    }
+
+    if (caught) {
+        watch_report(watch, kind, addr, old, value);
+    }
+}
+
+/*
+ * Return 1 if the segment is the aux memory of the machine, and 0 if
+ * it's main memory; which is to say, which set of displaced mappers in
+ * the watch belongs to it.
+ */
+static int
+watch_which(apple2 *mach, vm_segment *segment)
+{
+    return segment == mach->aux ? 1 : 0;
+}
+
+/*
+ * Return what's in memory at addr where a write through the segment
+ * would put it; that's where we peek, except in the bank-switched
+ * memory when it reads from ROM, since writes never go there (see
+ * apple2_bank_write()).
+ */
+static vm_8bit
+watch_old(apple2 *mach, vm_segment *segment, vm_16bit addr)
+{
+    if (addr >= APPLE2_BANK_OFFSET && (~mach->bank_switch & BANK_RAM)) {
+        if (addr < 0xE000 && (mach->bank_switch & BANK_RAM2)) {
+            return segment->memory[addr + 0x3000];
+        }
+
+        return segment->memory[addr];
+    }
+
+    return vm_segment_peek(segment, addr);
+}
+
+static SEGMENT_READER(watch_read)
+{
+    apple2 *mach = (apple2 *)_mach;
+    apple2_watch *watch = mach->watch;
+    vm_segment_read_fn fn;
+    vm_8bit value;
+
+    fn = watch->reads[watch_which(mach, segment)][addr >> 8][addr & 0xFF];
+    value = fn ? fn(segment, addr, _mach) : segment->memory[addr];
+
+    if (watch->mach == mach) {
+        watch_hit(watch, WATCH_READ, addr, value, value);
+    }
+
+    return value;
+}
+
+static SEGMENT_WRITER(watch_write)
+{
+    apple2 *mach = (apple2 *)_mach;
+    apple2_watch *watch = mach->watch;
+    vm_segment_write_fn fn;
+    vm_8bit old;
+
+    // What's there now, in the memory this write goes to. We look
+    // rather than read, so that we don't set off anything a read would.
+    old = watch_old(mach, segment, addr);
+
+    fn = watch->writes[watch_which(mach, segment)][addr >> 8][addr & 0xFF];
+    if (fn) {
+        fn(segment, addr, value, _mach);
+    } else {
+        segment->memory[addr] = value;
+    }
+
+    if (watch->mach == mach) {
+        watch_hit(watch, WATCH_WRITE, addr, old, value);
+    }
+}
+
+/*
+ * Return true if any of our watchpoints covers addr.
+ */
+static bool
+watch_covers(apple2_watch *watch, vm_16bit addr)
+{
+    for (int i = 0; i < watch->npoints; i++) {
+        if (addr >= watch->points[i].from && addr <= watch->points[i].to) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Put our mappers on addr in the segment, saving the ones that were
+ * there.
+ */
+static int
+watch_hook(apple2_watch *watch, vm_segment *segment, int which,
+           vm_16bit addr)
+{
+    int page = addr >> 8;
+
+    if (watch->hooked[which][addr >> 3] & (1 << (addr & 7))) {
+        return OK;
+    }
+
+    if (watch->reads[which][page] == NULL) {
+        watch->reads[which][page] = calloc(0x100, sizeof(vm_segment_read_fn));
+        watch->writes[which][page] =
+            calloc(0x100, sizeof(vm_segment_write_fn));
+
+        if (watch->reads[which][page] == NULL ||
+            watch->writes[which][page] == NULL
+           ) {
+            log_crit("Could not allocate memory for watchpoint");
+            return ERR_OOM;
+        }
+    }
+
+    watch->reads[which][page][addr & 0xFF] = segment->read_table[addr];
+    watch->writes[which][page][addr & 0xFF] = segment->write_table[addr];
+
+    if (vm_segment_read_map(segment, addr, watch_read) != OK ||
+        vm_segment_write_map(segment, addr, watch_write) != OK
+       ) {
+        return ERR_OOM;
+    }
+
+    watch->hooked[which][addr >> 3] |= 1 << (addr & 7);
+    return OK;
+}
+
+/*
+ * Put back the mappers we displaced from addr in the segment. If
+ * someone else has put their mappers on top of ours since, we can't
+ * take ours out of the chain without breaking theirs; so we leave them
+ * there, where they just pass accesses along.
+ */
+static void
+watch_unhook(apple2_watch *watch, vm_segment *segment, int which,
+             vm_16bit addr)
+{
+    int page = addr >> 8;
+
+    if (segment->read_table[addr] != watch_read) {
+        return;
+    }
+
+    vm_segment_read_map(segment, addr,
+                        watch->reads[which][page][addr & 0xFF]);
+    vm_segment_write_map(segment, addr,
+                         watch->writes[which][page][addr & 0xFF]);
+
+    watch->hooked[which][addr >> 3] &= ~(1 << (addr & 7));
+}
+
+/*
+ * Return the kinds of access (see enum watch_kind) named in the string,
+ * which is made up of the letters r (read), w (write), and c (change).
+ * If the string is NULL or empty, we watch writes. If there's anything
+ * else in the string, we return 0.
+ */
+int
+apple2_watch_kind(const char *str)
+{
+    int kind = 0;
+
+    if (str == NULL || *str == '\0') {
+        return WATCH_WRITE;
+    }
+
+    for (; *str; str++) {
+        switch (*str) {
+            case 'r': kind |= WATCH_READ; break;
+            case 'w': kind |= WATCH_WRITE; break;
+            case 'c': kind |= WATCH_CHANGE; break;
+            default: return 0;
+        }
+    }
+
+    return kind;
+}
+
+/*
+ * Watch the addresses from, through to, for the given kinds of access.
+ * We return ERR_INVALID if the range or kind make no sense, or if we
+ * have as many watchpoints as we can keep.
+ */
+int
+apple2_watch_add(apple2 *mach, vm_16bit from, vm_16bit to, int kind)
+{
+    apple2_watch_point *point;
+    apple2_watch *watch;
+    int err;
+
+    if (from > to || kind == 0) {
+        return ERR_INVALID;
+    }
+
+    if (mach->watch == NULL) {
+        mach->watch = calloc(1, sizeof(apple2_watch));
+        if (mach->watch == NULL) {
+            log_crit("Could not allocate memory for watchpoints");
+            return ERR_OOM;
+        }
+
+        mach->watch->mach = mach;
+    }
+
+    watch = mach->watch;
+    if (watch->npoints == WATCH_MAX) {
+        return ERR_INVALID;
+    }
+
+    point = &watch->points[watch->npoints];
+    point->from = from;
+    point->to = to;
+    point->kind = kind;
+    point->hits = 0;
+
+    watch->npoints++;
+
+    for (int addr = from; addr <= to; addr++) {
+        err = watch_hook(watch, mach->main, 0, addr);
+        if (err == OK) {
+            err = watch_hook(watch, mach->aux, 1, addr);
+        }
+
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    return OK;
+}
+
+/*
+ * Stop watching with every watchpoint that covers addr. If none do, we
+ * return ERR_INVALID.
+ */
+int
+apple2_watch_remove(apple2 *mach, vm_16bit addr)
+{
+    apple2_watch *watch = mach->watch;
+    apple2_watch_point point;
+    bool found = false;
+    int i = 0;
+
+    if (watch == NULL) {
+        return ERR_INVALID;
+    }
+
+    while (i < watch->npoints) {
+        if (addr < watch->points[i].from || addr > watch->points[i].to) {
+            i++;
+            continue;
+        }
+
+        point = watch->points[i];
+        watch->points[i] = watch->points[--watch->npoints];
+        found = true;
+
+        for (int a = point.from; a <= point.to; a++) {
+            if (!watch_covers(watch, a)) {
+                watch_unhook(watch, mach->main, 0, a);
+                watch_unhook(watch, mach->aux, 1, a);
+            }
+        }
+    }
+
+    return found ? OK : ERR_INVALID;
+}
+
+/*
+ * Write a list of our watchpoints into the stream.
+ */
+void
+apple2_watch_dump(apple2_watch *watch, FILE *stream)
+{
+    apple2_watch_point *point;
+
+    if (watch == NULL || watch->npoints == 0) {
+        fprintf(stream, "watch: no watchpoints\n");
+        return;
+    }
+
+    for (int i = 0; i < watch->npoints; i++) {
+        point = &watch->points[i];
+
+        fprintf(stream, "watch: $%04X-$%04X %s%s%s %llu hits\n",
+                point->from, point->to,
+                point->kind & WATCH_READ ? "r" : "",
+                point->kind & WATCH_WRITE ? "w" : "",
+                point->kind & WATCH_CHANGE ? "c" : "",
+                (unsigned long long)point->hits);
+    }
+}
+
+/*
+ * Free the watchpoints. We don't put back the mappers we displaced;
+ * this is for when the machine itself is going away.
+ */
+void
+apple2_watch_free(apple2_watch *watch)
+{
+    if (watch == NULL) {
+        return;
+    }
+
+    for (int which = 0; which < 2; which++) {
+        for (int page = 0; page < WATCH_PAGES; page++) {
+            free(watch->reads[which][page]);
+            free(watch->writes[which][page]);
+        }
+    }
+
+    free(watch);
+}
@@ -0,0 +1,202 @@
+/*
+ * convert.c
+ *
+ * This is the entry point for erc-convert, a tool which converts every
+ * disk image in a directory into another format, without needing to
+ * boot up the emulator to do it. For example:
+ *
+ *   erc-convert --to=nib --verify images/ nibs/
+ *
+ * Work is spread across all of the processors we have, one image at a
+ * time per thread.
+ */
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apple2/conv.h"
+#include "log.h"
+
+/*
+ * These are the options erc-convert understands.
+ */
+enum options {
+    HELP,
+    JOBS,
+    TO,
+    VERIFY,
+};
+
+static struct option long_options[] = {
+    { "help", 0, NULL, HELP },
+    { "jobs", 1, NULL, JOBS },
+    { "to", 1, NULL, TO },
+    { "verify", 0, NULL, VERIFY },
+    { NULL, 0, NULL, 0 },
+};
+
+/*
+ * Print out how to use the tool.
+ */
+static void
+print_help()
+{
+    fprintf(stderr, "Usage: erc-convert [options...] SRCDIR DESTDIR\n\
+Convert every .dsk, .do, .po, and .nib image in SRCDIR, writing the\n\
+results into DESTDIR.\n\
+\n\
+OPTIONS\n\
+  --help                      Print this help message\n\
+  --jobs=N                    Use N threads (default: one per processor)\n\
+  --to=TYPE                   Convert to TYPE (dsk, po, or nib; default nib)\n\
+  --verify                    Check that each output holds the same disk\n\
+                              as its input\n");
+}
+
+/*
+ * Build the list of jobs for every image we find in srcdir. We return
+ * the number of jobs, or -1 if we couldn't read the directory.
+ */
+static int
+build_jobs(apple2_conv_job **jobs, const char *srcdir,
+           const char *destdir, int to)
+{
+    struct dirent *dent;
+    apple2_conv_job *job;
+    int njobs = 0, cap = 0, from;
+    char *base, *dot;
+    DIR *dir;
+
+    *jobs = NULL;
+
+    dir = opendir(srcdir);
+    if (dir == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", srcdir, strerror(errno));
+        return -1;
+    }
+
+    while ((dent = readdir(dir)) != NULL) {
+        from = apple2_conv_type(dent->d_name);
+        if (from == DD_NOTYPE) {
+            continue;
+        }
+
+        if (njobs == cap) {
+            cap = cap ? cap * 2 : 64;
+            job = realloc(*jobs, sizeof(apple2_conv_job) * cap);
+            if (job == NULL) {
+                closedir(dir);
+                return -1;
+            }
+
+            *jobs = job;
+        }
+
+        job = &(*jobs)[njobs++];
+        job->from = from;
+        job->to = to;
+        job->result = OK;
+
+        job->src = malloc(strlen(srcdir) + strlen(dent->d_name) + 2);
+        sprintf(job->src, "%s/%s", srcdir, dent->d_name);
+
+        // The destination keeps the name of the source, but swaps in
+        // the extension for the type we're converting to.
+        base = strdup(dent->d_name);
+        dot = strrchr(base, '.');
+        *dot = '\0';
+
+        job->dest = malloc(strlen(destdir) + strlen(base) + 6);
+        sprintf(job->dest, "%s/%s.%s", destdir, base, apple2_conv_ext(to));
+
+        free(base);
+    }
+
+    closedir(dir);
+    return njobs;
+}
+
+int
+main(int argc, char **argv)
+{
+    apple2_conv_job *jobs;
+    int opt, index, i, njobs, failed;
+    int nthreads = 0, to = DD_NIBBLE;
+    bool verify = false;
+    char ext[16];
+
+    do {
+        opt = getopt_long_only(argc, argv, "", long_options, &index);
+
+        switch (opt) {
+            case JOBS:
+                nthreads = atoi(optarg);
+                break;
+
+            case TO:
+                // The type is just an extension, so we can figure it
+                // out the same way we would for a file name.
+                snprintf(ext, sizeof(ext), ".%s", optarg);
+                to = apple2_conv_type(ext);
+
+                if (to == DD_NOTYPE) {
+                    fprintf(stderr, "Unknown image type: %s\n", optarg);
+                    return 1;
+                }
+                break;
+
+            case VERIFY:
+                verify = true;
+                break;
+
+            case HELP:
+                print_help();
+                return 0;
+
+            case '?':
+                print_help();
+                return 1;
+        }
+    } while (opt != -1);
+
+    if (argc - optind != 2) {
+        print_help();
+        return 1;
+    }
+
+    log_open(stderr);
+
+    if (nthreads <= 0) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads <= 0) {
+            nthreads = 1;
+        }
+    }
+
+    njobs = build_jobs(&jobs, argv[optind], argv[optind + 1], to);
+    if (njobs < 0) {
+        return 1;
+    }
+
+    failed = apple2_conv_run(jobs, njobs, nthreads, verify);
+
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].result != OK) {
+            fprintf(stderr, "FAILED %s\n", jobs[i].src);
+        }
+
+        free(jobs[i].src);
+        free(jobs[i].dest);
+    }
+
+    free(jobs);
+
+    printf("%d converted, %d failed\n", njobs - failed, failed);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,368 @@
+/*
+ * erc.c
+ *
+ * These are the functions of liberc (see erc.h). For the most part,
+ * they are thin wrappers around the apple2 code; what they add is that
+ * they ask nothing of the DI container, and so don't get in the way of
+ * each other when there's more than one machine.
+ */
+
+#include <stdlib.h>
+
+#include "apple2/apple2.h"
+#include "apple2/conv.h"
+#include "apple2/dd.h"
+#include "apple2/hires.h"
+#include "apple2/state.h"
+#include "apple2/text.h"
+#include "erc.h"
+#include "log.h"
+
+/*
+ * We pass our own error codes straight through, so ours had better be
+ * the same.
+ */
+_Static_assert((int) ERC_OK == OK &&
+               (int) ERC_ERR_OOM == ERR_OOM &&
+               (int) ERC_ERR_OOB == ERR_OOB &&
+               (int) ERC_ERR_BADFILE == ERR_BADFILE &&
+               (int) ERC_ERR_BADOPT == ERR_BADOPT &&
+               (int) ERC_ERR_INVALID == ERR_INVALID,
+               "erc_status must match log_errcode");
+
+struct erc_machine {
+    apple2 *mach;
+
+    /*
+     * The files we opened for disks which are to be written back to;
+     * we need to close them when the disks are ejected.
+     */
+    FILE *disks[2];
+};
+
+/*
+ * Return the drive with the given number (1 or 2), or NULL if there's
+ * no such drive.
+ */
+static apple2dd *
+erc_drive(erc_machine *m, int drive)
+{
+    switch (drive) {
+        case 1:
+            return m->mach->drive1;
+        case 2:
+            return m->mach->drive2;
+    }
+
+    return NULL;
+}
+
+/*
+ * Send our log messages to the given stream. Until this is called, they
+ * go to standard output.
+ */
+void
+erc_log(FILE *stream)
+{
+    log_open(stream);
+}
+
+/*
+ * Create a new machine, with nothing in its drives. It won't run until
+ * you call erc_reset().
+ */
+erc_machine *
+erc_create()
+{
+    erc_machine *m;
+
+    m = malloc(sizeof(erc_machine));
+    if (m == NULL) {
+        return NULL;
+    }
+
+    // liberc is built with HEADLESS, so this won't look for a window
+    m->mach = apple2_create(ERC_FRAME_WIDTH, ERC_FRAME_HEIGHT);
+    if (m->mach == NULL) {
+        free(m);
+        return NULL;
+    }
+
+    m->disks[0] = NULL;
+    m->disks[1] = NULL;
+
+    return m;
+}
+
+/*
+ * Free a machine, ejecting its disks first.
+ */
+void
+erc_free(erc_machine *m)
+{
+    erc_eject(m, 1);
+    erc_eject(m, 2);
+
+    apple2_free(m->mach);
+    free(m);
+}
+
+/*
+ * Put the disk image at path into the given drive (1 or 2), replacing
+ * whatever was there. The format of the image comes from its extension;
+ * if we don't know that, we'll assume a DOS 3.3-order image.
+ */
+int
+erc_insert(erc_machine *m, int drive, const char *path, int flags)
+{
+    apple2dd *dd;
+    FILE *stream;
+    int type, err;
+
+    dd = erc_drive(m, drive);
+    if (dd == NULL) {
+        return ERR_BADOPT;
+    }
+
+    type = apple2_conv_type(path);
+    if (type == DD_NOTYPE) {
+        type = DD_DOS33;
+    }
+
+    stream = fopen(path, (flags & ERC_DISK_WRITE) ? "r+" : "r");
+    if (stream == NULL) {
+        log_crit("Couldn't open disk image %s: %s", path, strerror(errno));
+        return ERR_BADFILE;
+    }
+
+    erc_eject(m, drive);
+
+    err = apple2_dd_insert(dd, stream, type);
+    if (err != OK) {
+        fclose(stream);
+        return err;
+    }
+
+    // The whole image is in memory now, so unless we have to write it
+    // back, we don't need the file anymore.
+    if (flags & ERC_DISK_WRITE) {
+        m->disks[drive - 1] = stream;
+    } else {
+        dd->stream = NULL;
+        fclose(stream);
+    }
+
+    return OK;
+}
+
+/*
+ * Take the disk out of the given drive, writing it back to its file if
+ * we were asked to when it was inserted.
+ */
+void
+erc_eject(erc_machine *m, int drive)
+{
+    apple2dd *dd;
+
+    dd = erc_drive(m, drive);
+    if (dd == NULL) {
+        return;
+    }
+
+    apple2_dd_eject(dd);
+    dd->stream = NULL;
+
+    if (m->disks[drive - 1]) {
+        fclose(m->disks[drive - 1]);
+        m->disks[drive - 1] = NULL;
+    }
+}
+
+/*
+ * Reset the machine as though it had just been switched on. It will
+ * boot from the disk in drive 1, if there is one.
+ */
+void
+erc_reset(erc_machine *m)
+{
+    apple2_power_on(m->mach);
+}
+
+/*
+ * Run the machine for at least the given number of cycles, and return
+ * how many it actually ran. (The last instruction may take us a few
+ * cycles past where you asked us to stop.)
+ */
+uint64_t
+erc_run(erc_machine *m, uint64_t cycles)
+{
+    mos6502 *cpu = m->mach->cpu;
+    uint64_t start = cpu->cycles;
+
+    while (cpu->cycles - start < cycles) {
+        mos6502_execute(cpu);
+    }
+
+    return cpu->cycles - start;
+}
+
+/*
+ * Return the number of cycles the machine has run since it was created.
+ */
+uint64_t
+erc_cycles(erc_machine *m)
+{
+    return m->mach->cpu->cycles;
+}
+
+/*
+ * Return true if the machine has read the last key we gave it, and so
+ * is ready for another.
+ */
+bool
+erc_key_ready(erc_machine *m)
+{
+    return !m->mach->strobe;
+}
+
+/*
+ * Type a key on the machine's keyboard. If the machine hasn't read the
+ * last key we gave it, we return ERR_INVALID; run it for a while and
+ * try again.
+ */
+int
+erc_key(erc_machine *m, uint8_t key)
+{
+    apple2 *mach = m->mach;
+
+    if (mach->strobe) {
+        return ERR_INVALID;
+    }
+
+    mach->screen->last_key = key & 0x7F;
+    mach->screen->key_pressed = true;
+    mach->strobe = true;
+
+    return OK;
+}
+
+/*
+ * Copy the hires screen into buf, as ERC_FRAME_HEIGHT rows of
+ * ERC_FRAME_WIDTH dots, each with a red, green and blue byte. The buffer
+ * must have room for ERC_FRAME_SIZE bytes.
+ */
+int
+erc_frame(erc_machine *m, uint8_t *buf, size_t size)
+{
+    vm_color pixels[ERC_FRAME_WIDTH];
+
+    if (size < ERC_FRAME_SIZE) {
+        return ERR_OOB;
+    }
+
+    for (int row = 0; row < ERC_FRAME_HEIGHT; row++) {
+        apple2_hires_row(m->mach, row, pixels);
+
+        for (int i = 0; i < ERC_FRAME_WIDTH; i++) {
+            *buf++ = pixels[i].r;
+            *buf++ = pixels[i].g;
+            *buf++ = pixels[i].b;
+        }
+    }
+
+    return OK;
+}
+
+/*
+ * Copy the text screen into buf, which must have room for ERC_TEXT_SIZE
+ * bytes.
+ */
+int
+erc_text(erc_machine *m, char *buf, size_t size)
+{
+    FILE *stream;
+
+    if (size < ERC_TEXT_SIZE) {
+        return ERR_OOB;
+    }
+
+    stream = fmemopen(buf, size, "w");
+    if (stream == NULL) {
+        return ERR_OOM;
+    }
+
+    apple2_text_dump(m->mach, stream);
+    fclose(stream);
+
+    buf[ERC_TEXT_SIZE - 1] = '\0';
+
+    return OK;
+}
+
+/*
+ * Copy len bytes of memory, starting at addr, into buf. We read memory
+ * as the CPU would see it right now, with whatever banks are switched
+ * in; but we only peek at it (see vm_segment_peek()), so the page of
+ * soft switches at $C000, which would change the state of the machine
+ * if we read it, reads as zero.
+ */
+int
+erc_read(erc_machine *m, uint16_t addr, uint8_t *buf, size_t len)
+{
+    if (addr + len > 0x10000) {
+        return ERR_OOB;
+    }
+
+    return vm_segment_peek_range(m->mach->cpu->rmem, buf, addr, len);
+}
+
+/*
+ * Copy len bytes from buf into memory, starting at addr, just as the
+ * CPU would write them (soft switches and all).
+ */
+int
+erc_write(erc_machine *m, uint16_t addr, const uint8_t *buf, size_t len)
+{
+    if (addr + len > 0x10000) {
+        return ERR_OOB;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        mos6502_set(m->mach->cpu, addr + i, buf[i]);
+    }
+
+    return OK;
+}
+
+/*
+ * Take a snapshot of the machine. The snapshot is returned in *data,
+ * which you must free(), and its length in *len.
+ */
+int
+erc_save(erc_machine *m, uint8_t **data, size_t *len)
+{
+    apple2_state_buf buf = { NULL, 0, 0, OK };
+    int err;
+
+    err = apple2_state_encode(m->mach, &buf);
+    if (err != OK) {
+        free(buf.data);
+        return err;
+    }
+
+    *data = buf.data;
+    *len = buf.pos;
+
+    return OK;
+}
+
+/*
+ * Restore a snapshot taken with erc_save(). The machine must have the
+ * same disks in its drives as the one the snapshot was taken from; if
+ * it doesn't, we return ERR_BADFILE and leave the machine alone.
+ */
+int
+erc_load(erc_machine *m, const uint8_t *data, size_t len)
+{
+    return apple2_state_decode(m->mach, data, len);
+}
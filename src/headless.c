@@ -0,0 +1,484 @@
+/*
+ * headless.c
+ *
+ * This is the entry point for erc-headless, which runs the emulator
+ * without a display, for as long as you tell it to, and then tells you
+ * what the machine was up to. For example:
+ *
+ *   erc-headless --disk1=test.dsk --cycles=20000000 \
+ *       --keys='RUN TEST\n' --text=- --dump=300-3FF
+ *
+ * It's meant for places like a CI job, where there's nobody to look at
+ * a window. The machine runs as fast as we can make it go, and the exit
+ * status tells you whether the run went the way you expected.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apple2/apple2.h"
+#include "apple2/dd.h"
+#include "apple2/debug.h"
+#include "apple2/gdb.h"
+#include "apple2/hires.h"
+#include "apple2/text.h"
+#include "log.h"
+#include "vm_di.h"
+
+/*
+ * These are the options erc-headless understands.
+ */
+enum options {
+    CYCLES,
+    DISK1,
+    DISK2,
+    DUMP,
+    EXPECT,
+    FRAME,
+    GDB,
+    HELP,
+    KEYS,
+    KEYS_AT,
+    SECONDS,
+    STATE,
+    TEXT,
+};
+
+static struct option long_options[] = {
+    { "cycles", 1, NULL, CYCLES },
+    { "disk1", 1, NULL, DISK1 },
+    { "disk2", 1, NULL, DISK2 },
+    { "dump", 1, NULL, DUMP },
+    { "expect", 1, NULL, EXPECT },
+    { "frame", 1, NULL, FRAME },
+    { "gdb", 1, NULL, GDB },
+    { "help", 0, NULL, HELP },
+    { "keys", 1, NULL, KEYS },
+    { "keys-at", 1, NULL, KEYS_AT },
+    { "seconds", 1, NULL, SECONDS },
+    { "state", 1, NULL, STATE },
+    { "text", 1, NULL, TEXT },
+    { NULL, 0, NULL, 0 },
+};
+
+/*
+ * The exit statuses we can end with, besides zero for a run that went
+ * fine.
+ */
+enum headless_status {
+    HEADLESS_ERROR = 1,
+    HEADLESS_UNEXPECTED = 2,
+};
+
+/*
+ * We can be asked for any number of memory dumps; this is as many as
+ * we'll bother to keep track of.
+ */
+#define HEADLESS_MAX_DUMPS 16
+
+/*
+ * How many instructions we run between looks at the wall clock. Asking
+ * for the time is slow compared to running an instruction, and we
+ * don't need to stop at precisely the right microsecond.
+ */
+#define HEADLESS_CLOCK_EVERY 4096
+
+/*
+ * After the machine has taken a key we've typed, we wait this many
+ * cycles before typing the next one. That gives whatever read the key
+ * time to do something with it before the next one comes along.
+ */
+#define HEADLESS_KEY_GAP 10000
+
+struct headless_dump {
+    size_t from;
+    size_t to;
+};
+
+/*
+ * Print out how to use the tool.
+ */
+static void
+print_help()
+{
+    fprintf(stderr, "Usage: erc-headless [options...]\n\
+Run the emulator without a display until a cycle or time budget runs\n\
+out, then report on the state of the machine.\n\
+\n\
+OPTIONS\n\
+  --cycles=N                  Stop after N emulated cycles\n\
+  --disk1=FILE                Load FILE into disk drive 1\n\
+  --disk2=FILE                Load FILE into disk drive 2\n\
+  --dump=FROM-TO              Print a hexdump of memory from FROM through\n\
+                              TO (in hex); may be given more than once\n\
+  --expect=TEXT               Exit with status 2 unless TEXT is on the\n\
+                              text screen at the end of the run\n\
+  --frame=FILE                Write the hires screen to FILE as a PPM\n\
+  --gdb=ADDR                  Listen for a remote debugger at ADDR: a\n\
+                              port (or host:port), or a socket path\n\
+  --help                      Print this help message\n\
+  --keys=STRING               Type STRING on the keyboard; \\n is return\n\
+  --keys-at=N                 Start typing after N cycles (default 0)\n\
+  --seconds=N                 Stop after N seconds of wall-clock time\n\
+  --state=FILE                Start from the machine state in FILE\n\
+  --text=FILE                 Write the text screen to FILE (- for\n\
+                              standard output)\n\
+\n\
+Disk images are never written back to. At least one of --cycles or\n\
+--seconds must be given.\n");
+}
+
+/*
+ * Turn the escapes we support in a --keys string into the keys they
+ * stand for. We do this in place, since the result can only be as long
+ * as the string or shorter.
+ */
+static void
+unescape_keys(char *keys)
+{
+    char *src = keys, *dest = keys;
+
+    for (; *src != '\0'; src++, dest++) {
+        if (*src != '\\' || src[1] == '\0') {
+            *dest = *src;
+            continue;
+        }
+
+        switch (*++src) {
+            case 'n':
+            case 'r':
+                *dest = '\r';
+                break;
+
+            case 'e':
+                *dest = 0x1B;
+                break;
+
+            default:
+                *dest = *src;
+                break;
+        }
+    }
+
+    *dest = '\0';
+}
+
+/*
+ * Type the next of our keys into the machine, if it's ready for one.
+ * The machine is ready once it has cleared the strobe of the last key
+ * we typed, and a little while has passed since then. We return the
+ * position in keys that we've gotten up to.
+ */
+static const char *
+type_key(apple2 *mach, const char *keys, uint64_t *ready)
+{
+    if (*keys == '\0' || mach->strobe) {
+        return keys;
+    }
+
+    // The strobe just cleared, so now we can start counting
+    if (mach->screen->key_pressed) {
+        mach->screen->key_pressed = false;
+        *ready = mach->cpu->cycles + HEADLESS_KEY_GAP;
+    }
+
+    if (mach->cpu->cycles < *ready) {
+        return keys;
+    }
+
+    // The keyboard only deals in 7-bit ASCII
+    mach->screen->last_key = *keys & 0x7F;
+    mach->screen->key_pressed = true;
+    mach->strobe = true;
+
+    return keys + 1;
+}
+
+/*
+ * Return the number of seconds since some point in the past, as
+ * precisely as we can.
+ */
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/*
+ * Open the file at path, with the given mode, or complain and return
+ * NULL. A path of "-" means standard output, if we're writing.
+ */
+static FILE *
+open_file(const char *path, const char *mode)
+{
+    FILE *stream;
+
+    if (strcmp(path, "-") == 0 && *mode == 'w') {
+        return stdout;
+    }
+
+    stream = fopen(path, mode);
+    if (stream == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+    }
+
+    return stream;
+}
+
+/*
+ * Close a stream we opened with open_file().
+ */
+static void
+close_file(FILE *stream)
+{
+    if (stream != NULL && stream != stdout) {
+        fclose(stream);
+    }
+}
+
+/*
+ * Return true if the text screen has the given text anywhere in it.
+ * Text won't match across the end of a line.
+ */
+static bool
+screen_has(apple2 *mach, const char *text)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    bool found;
+    FILE *stream;
+
+    stream = open_memstream(&buf, &len);
+    if (stream == NULL) {
+        return false;
+    }
+
+    apple2_text_dump(mach, stream);
+    fclose(stream);
+
+    found = strstr(buf, text) != NULL;
+    free(buf);
+
+    return found;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct headless_dump dumps[HEADLESS_MAX_DUMPS];
+    FILE *disk1 = NULL, *disk2 = NULL, *state = NULL, *stream;
+    const char *text = NULL, *frame = NULL, *expect = NULL;
+    const char *next_key;
+    char *keys = NULL;
+    uint64_t cycles = 0, keys_at = 0, key_ready = 0;
+    double seconds = 0, start;
+    int opt, index, ndumps = 0, status = 0;
+    unsigned long n = 0;
+    apple2 *mach;
+
+    do {
+        opt = getopt_long_only(argc, argv, "", long_options, &index);
+
+        switch (opt) {
+            case CYCLES:
+                cycles = strtoull(optarg, NULL, 10);
+                break;
+
+            case DISK1:
+            case DISK2:
+                // We only ever read from the images we're given, so
+                // that the same run can be made over and over.
+                stream = open_file(optarg, "r");
+                if (stream == NULL) {
+                    return HEADLESS_ERROR;
+                }
+
+                if (opt == DISK1) {
+                    disk1 = stream;
+                } else {
+                    disk2 = stream;
+                }
+                break;
+
+            case DUMP:
+                if (ndumps == HEADLESS_MAX_DUMPS) {
+                    fprintf(stderr, "Too many dumps (no more than %d)\n",
+                            HEADLESS_MAX_DUMPS);
+                    return HEADLESS_ERROR;
+                }
+
+                if (sscanf(optarg, "%zx-%zx", &dumps[ndumps].from,
+                           &dumps[ndumps].to) != 2 ||
+                    dumps[ndumps].from > dumps[ndumps].to ||
+                    dumps[ndumps].to > 0xFFFF
+                   ) {
+                    fprintf(stderr, "Bad memory range: %s\n", optarg);
+                    return HEADLESS_ERROR;
+                }
+
+                ndumps++;
+                break;
+
+            case EXPECT:
+                expect = optarg;
+                break;
+
+            case FRAME:
+                frame = optarg;
+                break;
+
+            case GDB:
+                vm_di_set(VM_GDB, optarg);
+                break;
+
+            case HELP:
+                print_help();
+                return 0;
+
+            case KEYS:
+                keys = optarg;
+                unescape_keys(keys);
+                break;
+
+            case KEYS_AT:
+                keys_at = strtoull(optarg, NULL, 10);
+                break;
+
+            case SECONDS:
+                seconds = atof(optarg);
+                break;
+
+            case STATE:
+                state = open_file(optarg, "r");
+                if (state == NULL) {
+                    return HEADLESS_ERROR;
+                }
+                break;
+
+            case TEXT:
+                text = optarg;
+                break;
+
+            case '?':
+                print_help();
+                return HEADLESS_ERROR;
+        }
+    } while (opt != -1);
+
+    if (cycles == 0 && seconds <= 0) {
+        print_help();
+        return HEADLESS_ERROR;
+    }
+
+    log_open(stderr);
+
+    vm_di_set(VM_OUTPUT, stdout);
+    vm_di_set(VM_DISK1, disk1);
+    vm_di_set(VM_DISK2, disk2);
+    vm_di_set(VM_STATE, state);
+
+    // We never call vm_screen_init(), and since we're built with
+    // HEADLESS, the machine's screen won't ask SDL for a window. It
+    // still tracks the keyboard, though, which is how we type keys.
+    mach = apple2_create(280, 192);
+    if (mach == NULL) {
+        fprintf(stderr, "Couldn't create the machine\n");
+        return HEADLESS_ERROR;
+    }
+
+    vm_di_set(VM_MACHINE, mach);
+    vm_di_set(VM_CPU, mach->cpu);
+
+    if (apple2_boot(mach) != OK) {
+        fprintf(stderr, "Bootup failed!\n");
+        return HEADLESS_ERROR;
+    }
+
+    next_key = keys ? keys : "";
+    key_ready = keys_at;
+    cycles += mach->cpu->cycles;
+    start = now();
+
+    // Here's the run loop. Unlike apple2_run_loop(), there's no
+    // throttling, no debugger (unless one attaches remotely), and
+    // nothing to draw.
+    for (;;) {
+        if (cycles && mach->cpu->cycles >= cycles) {
+            break;
+        }
+
+        if (seconds > 0 && ++n % HEADLESS_CLOCK_EVERY == 0 &&
+            now() - start >= seconds
+           ) {
+            break;
+        }
+
+        if (mach->cpu->cycles >= keys_at) {
+            next_key = type_key(mach, next_key, &key_ready);
+        }
+
+        if (mach->gdb) {
+            if (apple2_debug_trap(mach->cpu)) {
+                mach->paused = true;
+            }
+
+            apple2_gdb_tick(mach->gdb, mach);
+
+            if (mach->paused) {
+                continue;
+            }
+        }
+
+        mos6502_execute(mach->cpu);
+    }
+
+    if (text) {
+        stream = open_file(text, "w");
+        if (stream == NULL) {
+            status = HEADLESS_ERROR;
+        } else {
+            apple2_text_dump(mach, stream);
+            close_file(stream);
+        }
+    }
+
+    if (frame) {
+        stream = open_file(frame, "w");
+        if (stream == NULL) {
+            status = HEADLESS_ERROR;
+        } else {
+            apple2_hires_frame(mach, stream);
+            close_file(stream);
+        }
+    }
+
+    for (int i = 0; i < ndumps; i++) {
+        vm_segment_hexdump(mach->cpu->rmem, stdout,
+                           dumps[i].from, dumps[i].to + 1);
+    }
+
+    if (status == 0 && expect && !screen_has(mach, expect)) {
+        fprintf(stderr, "Expected text not found: %s\n", expect);
+        status = HEADLESS_UNEXPECTED;
+    }
+
+    // The disks were opened read-only, so there's nothing to write back
+    // to them.
+    mach->drive1->stream = NULL;
+    mach->drive2->stream = NULL;
+    apple2_free(mach);
+
+    close_file(disk1);
+    close_file(disk2);
+    close_file(state);
+
+    return status;
+}
@@ -12,9 +12,13 @@
 #include <unistd.h>
 
 #include "apple2/apple2.h"
+#include "apple2/dd.h"
 #include "apple2/draw.h"
 #include "apple2/event.h"
 #include "log.h"
+#include "mos6502/calls.h"
+#include "mos6502/prof.h"
+#include "mos6502/trace.h"
 #include "option.h"
 #include "vm_di.h"
 #include "vm_screen.h"
@@ -60,19 +64,79 @@ init(int argc, char **argv)
     }
 }
 
+/*
+ * The machine we're running, for as long as it exists. We need to keep
+ * this around for finish(), which may be called from exit() anywhere
+ * in the program.
+ */
+static apple2 *mach = NULL;
+
+/*
+ * Write the activity counters of our disk drives into the log, so you
+ * can see what the disks were up to after the fact; and, if we were
+ * asked to profile the CPU (or count its accesses to memory), write the
+ * profiles out.
+ */
+static void
+dump_stats()
+{
+    FILE *log = log_stream();
+    FILE *profile = (FILE *)vm_di_get(VM_PROFILE);
+    FILE *callgraph = (FILE *)vm_di_get(VM_CALLGRAPH);
+    FILE *heatmap = (FILE *)vm_di_get(VM_HEATMAP);
+
+    if (mach == NULL) {
+        return;
+    }
+
+    if (profile) {
+        mos6502_prof_dump(mach->cpu, profile, 0);
+    }
+
+    if (callgraph && mach->cpu->calls) {
+        mos6502_calls_folded(mach->cpu->calls, callgraph);
+    }
+
+    if (heatmap) {
+        apple2_heat_csv(mach->heat, heatmap);
+    }
+
+    if (log == NULL) {
+        return;
+    }
+
+    apple2_dd_stats_dump(mach->drive1, "drive1", log, mach->cpu->cycles);
+    apple2_dd_stats_dump(mach->drive2, "drive2", log, mach->cpu->cycles);
+}
+
 /*
  * And this is the teardown function.
  */
 static void
 finish()
 {
-    FILE *stream[3];
+    FILE *stream[10];
+
+    dump_stats();
+
+    // The trace has a thread writing into one of the streams we're
+    // about to close, so it must finish first
+    if (mach) {
+        mos6502_trace_stop(mach->cpu);
+    }
 
     stream[0] = (FILE *)vm_di_get(VM_DISK1);
     stream[1] = (FILE *)vm_di_get(VM_DISK2);
     stream[2] = (FILE *)vm_di_get(VM_DISASM_LOG);
-
-    for (int i = 0; i < 3; i++) {
+    stream[3] = (FILE *)vm_di_get(VM_STATE);
+    stream[4] = (FILE *)vm_di_get(VM_RECORD);
+    stream[5] = (FILE *)vm_di_get(VM_REPLAY);
+    stream[6] = (FILE *)vm_di_get(VM_PROFILE);
+    stream[7] = (FILE *)vm_di_get(VM_CALLGRAPH);
+    stream[8] = (FILE *)vm_di_get(VM_TRACE);
+    stream[9] = (FILE *)vm_di_get(VM_HEATMAP);
+
+    for (int i = 0; i < 10; i++) {
         if (stream[i]) {
             fclose(stream[i]);
         }
@@ -90,7 +154,6 @@ finish()
 int
 main(int argc, char **argv)
 {
-    apple2 *mach;
     vm_screen *screen;
     int err;
 
@@ -130,8 +193,12 @@ main(int argc, char **argv)
     // machine.
     apple2_run_loop(mach);
 
-    // We're all done, so let's tear everything down.
+    // We're all done, so let's tear everything down. Since finish()
+    // won't have a machine to look at after this, we dump our stats
+    // now.
+    dump_stats();
     apple2_free(mach);
+    mach = NULL;
 
     // ha ha ha ha #nervous #laughter
     printf("Hello, world\n");
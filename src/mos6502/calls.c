@@ -0,0 +1,332 @@
+/*
+ * mos6502.calls.c
+ *
+ * The call profiler keeps a shadow of the call stack: when the CPU
+ * executes a JSR, we push a frame for the subroutine it calls, and
+ * every cycle the CPU spends until that call is over is charged to it.
+ * That tells us not just where the time goes, as the flat profile in
+ * mos6502.prof.c does, but on whose behalf.
+ *
+ * We don't pop frames on RTS, exactly. A 6502 program can return with
+ * RTI, or pull its return address off the stack and jump somewhere
+ * else, or reset the stack pointer outright; and it can use RTS to jump
+ * to an address it pushed itself, without returning from anything. So
+ * after every instruction we look at the S register instead: once it's
+ * back to where it was before a call, that call's return address has
+ * left the stack, and the call is over however it happened.
+ *
+ * Each chain of callers we see becomes a path in a call tree, and the
+ * cycles we charge go to the node at the end of the path; from that, we
+ * can write the folded stacks that flame graph tools read.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "mos6502/calls.h"
+
+/*
+ * The opcode for JSR, which is the only instruction that makes a call.
+ * (BRK would be another, if it went by way of the interrupt vector; in
+ * our implementation, it doesn't.)
+ */
+#define CALLS_JSR 0x20
+
+/*
+ * Return a new, empty call profile, or NULL if we couldn't allocate
+ * one.
+ */
+static mos6502_calls *
+calls_create()
+{
+    mos6502_calls *calls;
+
+    calls = calloc(1, sizeof(mos6502_calls));
+    if (calls == NULL) {
+        log_crit("Could not allocate memory for call profile");
+        return NULL;
+    }
+
+    calls->cap = 1024;
+    calls->nodes = malloc(sizeof(mos6502_calls_node) * calls->cap);
+    if (calls->nodes == NULL) {
+        log_crit("Could not allocate memory for call tree");
+        free(calls);
+        return NULL;
+    }
+
+    // The root node is everything outside of any call
+    calls->nodes[0].addr = 0;
+    calls->nodes[0].parent = -1;
+    calls->nodes[0].child = -1;
+    calls->nodes[0].sibling = -1;
+    calls->nodes[0].cycles = 0;
+    calls->nnodes = 1;
+
+    return calls;
+}
+
+/*
+ * Give the CPU a call profile, and so begin following its calls. If it
+ * already has one, we leave it be.
+ */
+int
+mos6502_calls_start(mos6502 *cpu)
+{
+    if (cpu->calls) {
+        return OK;
+    }
+
+    cpu->calls = calls_create();
+    if (cpu->calls == NULL) {
+        return ERR_OOM;
+    }
+
+    return OK;
+}
+
+/*
+ * Free a call profile.
+ */
+void
+mos6502_calls_free(mos6502_calls *calls)
+{
+    if (calls == NULL) {
+        return;
+    }
+
+    free(calls->nodes);
+    free(calls);
+}
+
+/*
+ * Stop following calls, and throw away the profile we've kept.
+ */
+void
+mos6502_calls_stop(mos6502 *cpu)
+{
+    mos6502_calls_free(cpu->calls);
+    cpu->calls = NULL;
+}
+
+/*
+ * Return the child of the given node for a call to addr, making one if
+ * there isn't one yet. If we can't, we return the node itself, so the
+ * call is counted with its caller.
+ */
+static int
+calls_child(mos6502_calls *calls, int node, vm_16bit addr)
+{
+    mos6502_calls_node *n;
+    int child;
+
+    for (child = calls->nodes[node].child; child >= 0;
+         child = calls->nodes[child].sibling) {
+        if (calls->nodes[child].addr == addr) {
+            return child;
+        }
+    }
+
+    if (calls->nnodes == calls->cap) {
+        mos6502_calls_node *nodes;
+        int cap = calls->cap * 2;
+
+        if (cap > CALLS_MAX_NODES) {
+            return node;
+        }
+
+        nodes = realloc(calls->nodes, sizeof(mos6502_calls_node) * cap);
+        if (nodes == NULL) {
+            return node;
+        }
+
+        calls->nodes = nodes;
+        calls->cap = cap;
+    }
+
+    child = calls->nnodes++;
+    n = &calls->nodes[child];
+
+    n->addr = addr;
+    n->parent = node;
+    n->child = -1;
+    n->cycles = 0;
+    n->sibling = calls->nodes[node].child;
+    calls->nodes[node].child = child;
+
+    return child;
+}
+
+/*
+ * Pop the frame at the top of the stack, and charge the subroutine for
+ * everything that happened while it was there. If the same subroutine
+ * is further down the stack (it called itself, one way or another),
+ * that call will be charged when it's over, and already includes this
+ * one.
+ */
+static void
+calls_pop(mos6502_calls *calls, uint64_t now)
+{
+    mos6502_calls_frame *frame = &calls->stack[--calls->depth];
+
+    for (int i = 0; i < calls->depth; i++) {
+        if (calls->stack[i].addr == frame->addr) {
+            return;
+        }
+    }
+
+    calls->inclusive[frame->addr] += now - frame->start;
+}
+
+/*
+ * Count the instruction the CPU has just executed. We're given its
+ * opcode, and the number of cycles it took; the CPU is as the
+ * instruction left it.
+ */
+void
+mos6502_calls_count(mos6502_calls *calls, mos6502 *cpu, vm_8bit opcode,
+                    int cycles)
+{
+    int node = calls->depth ? calls->stack[calls->depth - 1].node : 0;
+
+    // The instruction is charged to whoever executed it: so a JSR is
+    // the caller's, and an RTS is the callee's.
+    calls->nodes[node].cycles += cycles;
+    calls->cycles += cycles;
+
+    if (calls->depth) {
+        calls->exclusive[calls->stack[calls->depth - 1].addr] += cycles;
+    } else {
+        calls->top_cycles += cycles;
+    }
+
+    if (opcode == CALLS_JSR && calls->depth < CALLS_MAX_DEPTH) {
+        mos6502_calls_frame *frame = &calls->stack[calls->depth++];
+
+        frame->node = calls_child(calls, node, cpu->PC);
+        frame->addr = cpu->PC;
+        frame->S = (vm_8bit)(cpu->S + 2);
+        frame->start = cpu->cycles - cycles;
+
+        calls->calls[cpu->PC]++;
+        return;
+    }
+
+    // Any call whose return address has left the stack is over. The
+    // stack wraps around within its page, so we look at how far S has
+    // come back up since the call, rather than at S itself; otherwise a
+    // call made with S at $00 or $01 would look over as soon as it
+    // began.
+    while (calls->depth &&
+           (int8_t)(cpu->S - calls->stack[calls->depth - 1].S) >= 0
+          ) {
+        calls_pop(calls, cpu->cycles);
+    }
+}
+
+/*
+ * Fill top with the addresses of (at most) n of the subroutines with
+ * the most inclusive cycles, most first; and return how many we found.
+ */
+static int
+calls_top(mos6502_calls *calls, int *top, int n)
+{
+    const uint64_t *keys = calls->inclusive;
+    int found = 0;
+
+    for (int i = 0; i < MOS6502_MEMSIZE; i++) {
+        int j;
+
+        if (calls->calls[i] == 0) {
+            continue;
+        }
+
+        if (found == n && keys[i] <= keys[top[n - 1]]) {
+            continue;
+        }
+
+        j = found < n ? found++ : n - 1;
+        while (j > 0 && keys[top[j - 1]] < keys[i]) {
+            top[j] = top[j - 1];
+            j--;
+        }
+
+        top[j] = i;
+    }
+
+    return found;
+}
+
+/*
+ * Write a table of the n subroutines which took the most cycles,
+ * counting what they called, into the stream. Calls which haven't
+ * returned yet aren't in the inclusive cycles; their subroutines'
+ * exclusive cycles are up to date, though.
+ */
+void
+mos6502_calls_dump(mos6502_calls *calls, FILE *stream, int n)
+{
+    int top[256];
+    int found;
+
+    if (n <= 0 || n > 256) {
+        n = 20;
+    }
+
+    fprintf(stream, "calls: %llu cycles, %llu outside of any call, "
+            "%d frames deep\n",
+            (unsigned long long)calls->cycles,
+            (unsigned long long)calls->top_cycles,
+            calls->depth);
+
+    fprintf(stream, "%-6s %10s %14s %14s\n",
+            "sub", "calls", "inclusive", "exclusive");
+
+    found = calls_top(calls, top, n);
+    for (int i = 0; i < found; i++) {
+        fprintf(stream, "$%04X  %10llu %14llu %14llu\n", top[i],
+                (unsigned long long)calls->calls[top[i]],
+                (unsigned long long)calls->inclusive[top[i]],
+                (unsigned long long)calls->exclusive[top[i]]);
+    }
+}
+
+/*
+ * Write the path from the root to the given node, as the names of the
+ * subroutines on it separated by semicolons.
+ */
+static void
+calls_path(mos6502_calls *calls, int node, FILE *stream)
+{
+    if (node == 0) {
+        fputs("top", stream);
+        return;
+    }
+
+    calls_path(calls, calls->nodes[node].parent, stream);
+    fprintf(stream, ";%04X", calls->nodes[node].addr);
+}
+
+/*
+ * Write the call tree into the stream as folded stacks: one line for
+ * each chain of calls we saw which took any cycles of its own, giving
+ * the chain and the number of cycles, like so:
+ *
+ *   top;D566;DD7B;DE10 1234
+ *
+ * This is the format that flame graph tools expect.
+ */
+void
+mos6502_calls_folded(mos6502_calls *calls, FILE *stream)
+{
+    for (int i = 0; i < calls->nnodes; i++) {
+        if (calls->nodes[i].cycles == 0) {
+            continue;
+        }
+
+        calls_path(calls, i, stream);
+        fprintf(stream, " %llu\n",
+                (unsigned long long)calls->nodes[i].cycles);
+    }
+}
@@ -237,11 +237,70 @@ mos6502_dis_expected_bytes(int addr_mode)
     return 0;
 }
 
+/*
+ * Write a line of disassembly into the stream for the given opcode and
+ * operand, which were found at the CPU's PC; address is where the
+ * instruction ends. The registers we show are the CPU's. This is the
+ * part of mos6502_dis_opcode() that doesn't need to read memory, so a
+ * trace can be shown exactly as the disassembler would have shown it
+ * (see mos6502.trace.c).
+ */
+void
+mos6502_dis_print(mos6502 *cpu, FILE *stream, int address, vm_8bit opcode,
+                  vm_16bit operand)
+{
+    int addr_mode, expected;
+    char status[9];
+
+    memset(s_bytes, 0, sizeof(s_bytes));
+    memset(s_inst, 0, sizeof(s_inst));
+    memset(s_operand, 0, sizeof(s_operand));
+
+    addr_mode = mos6502_addr_mode(opcode);
+    expected = mos6502_dis_expected_bytes(addr_mode);
+
+    // Print out the instruction code that our opcode represents.
+    mos6502_dis_instruction(s_inst, sizeof(s_inst),
+                            mos6502_instruction(opcode));
+
+    if (expected) {
+        // Print out the operand given the proper address mode.
+        mos6502_dis_operand(cpu, s_operand, sizeof(s_operand), 
+                            address, addr_mode, operand);
+    }
+
+    // And three, the operand, if any. Remembering that the operand
+    // should be shown in little-endian order.
+    if (expected == 2) {
+        snprintf(s_bytes, sizeof(s_bytes) - 1, "%02X %02X %02X", 
+                 opcode, operand & 0xff, operand >> 8);
+    } else if (expected == 1) {
+        snprintf(s_bytes, sizeof(s_bytes) - 1, "%02X %02X", 
+                 opcode, operand & 0xff);
+    } else {
+        snprintf(s_bytes, sizeof(s_bytes) - 1, "%02X", opcode);
+    }
+
+    snprintf(status, sizeof(status), "%c%c_%c%c%c%c%c",
+             cpu->P & MOS_NEGATIVE ? 'N' : '_',
+             cpu->P & MOS_OVERFLOW ? 'V' : '_',
+             cpu->P & MOS_BREAK ? 'B' : '_',
+             cpu->P & MOS_DECIMAL ? 'D' : '_',
+             cpu->P & MOS_INTERRUPT ? 'I' : '_',
+             cpu->P & MOS_ZERO ? 'Z' : '_',
+             cpu->P & MOS_CARRY ? 'C' : '_');
+
+    fprintf(stream, "%04X:%-9s%20s   %-20s; A:%02X X:%02X Y:%02X P:%02X<%s> S:%02X\n",
+            cpu->PC, s_bytes, s_inst, s_operand,
+            cpu->A, cpu->X, cpu->Y, cpu->P, status, cpu->S);
+}
+
 /*
  * Scan memory (with a given address) and write the opcode at that
  * point to the given file stream. This function will also write an
  * operand to the file stream if one is warranted. We return the number
- * of bytes consumed by scanning past the opcode and/or operand.
+ * of bytes consumed by scanning past the opcode and/or operand. We only
+ * peek at memory, so disassembling code never changes the machine.
  */
 int
 mos6502_dis_opcode(mos6502 *cpu, FILE *stream, int address)
@@ -249,25 +308,16 @@ mos6502_dis_opcode(mos6502 *cpu, FILE *stream, int address)
     vm_8bit opcode;
     vm_16bit operand;
     int addr_mode;
-    int inst_code;
     int expected;
-    char status[9];
-
-    memset(s_bytes, 0, sizeof(s_bytes));
-    memset(s_inst, 0, sizeof(s_inst));
-    memset(s_operand, 0, sizeof(s_operand));
 
     // The next byte is assumed to be the opcode we work with.
-    opcode = mos6502_get(cpu, address);
+    opcode = mos6502_peek(cpu, address);
 
     // And given that opcode, we need to see how many bytes large our
     // operand will be.
     addr_mode = mos6502_addr_mode(opcode);
     expected = mos6502_dis_expected_bytes(addr_mode);
 
-    // The specific instruction we mean to execute
-    inst_code = mos6502_instruction(opcode);
-
     // The operand itself defaults to zero... in cases where this
     // doesn't change, the instruction related to the opcode will
     // probably not even use it.
@@ -281,12 +331,12 @@ mos6502_dis_opcode(mos6502 *cpu, FILE *stream, int address)
             // Remember that the 6502 is little-endian, so the operand
             // needs to be retrieved with the LSB first and the MSB
             // second.
-            operand |= mos6502_get(cpu, address++);
-            operand |= mos6502_get(cpu, address++) << 8;
+            operand |= mos6502_peek(cpu, address++);
+            operand |= mos6502_peek(cpu, address++) << 8;
             break;
 
         case 1:
-            operand |= mos6502_get(cpu, address++);
+            operand |= mos6502_peek(cpu, address++);
             break;
 
             // And, in any other case (e.g. 0), we are done; we don't
@@ -299,39 +349,7 @@ mos6502_dis_opcode(mos6502 *cpu, FILE *stream, int address)
     // contents of our inspection of the opcode. (For example, we may
     // just want to set the jump table in a lookahead operation.)
     if (stream) {
-        // Print out the instruction code that our opcode represents.
-        mos6502_dis_instruction(s_inst, sizeof(s_inst), inst_code);
-
-        if (expected) {
-            // Print out the operand given the proper address mode.
-            mos6502_dis_operand(cpu, s_operand, sizeof(s_operand), 
-                                address, addr_mode, operand);
-        }
-
-        // And three, the operand, if any. Remembering that the operand
-        // should be shown in little-endian order.
-        if (expected == 2) {
-            snprintf(s_bytes, sizeof(s_bytes) - 1, "%02X %02X %02X", 
-                     opcode, operand & 0xff, operand >> 8);
-        } else if (expected == 1) {
-            snprintf(s_bytes, sizeof(s_bytes) - 1, "%02X %02X", 
-                     opcode, operand & 0xff);
-        } else {
-            snprintf(s_bytes, sizeof(s_bytes) - 1, "%02X", opcode);
-        }
-
-        snprintf(status, sizeof(status), "%c%c_%c%c%c%c%c",
-                 cpu->P & MOS_NEGATIVE ? 'N' : '_',
-                 cpu->P & MOS_OVERFLOW ? 'V' : '_',
-                 cpu->P & MOS_BREAK ? 'B' : '_',
-                 cpu->P & MOS_DECIMAL ? 'D' : '_',
-                 cpu->P & MOS_INTERRUPT ? 'I' : '_',
-                 cpu->P & MOS_ZERO ? 'Z' : '_',
-                 cpu->P & MOS_CARRY ? 'C' : '_');
-
-        fprintf(stream, "%04X:%-9s%20s   %-20s; A:%02X X:%02X Y:%02X P:%02X<%s> S:%02X\n",
-                cpu->PC, s_bytes, s_inst, s_operand,
-                cpu->A, cpu->X, cpu->Y, cpu->P, status, cpu->S);
+        mos6502_dis_print(cpu, stream, address, opcode, operand);
     }
 
     // The expected number of bytes here is for the operand, but we need
@@ -13,7 +13,10 @@
 
 #include "log.h"
 #include "mos6502/mos6502.h"
+#include "mos6502/calls.h"
 #include "mos6502/dis.h"
+#include "mos6502/prof.h"
+#include "mos6502/trace.h"
 
 // All of our address modes, instructions, etc. are defined here.
 #include "mos6502/enums.h"
@@ -172,11 +175,15 @@ mos6502_create(vm_segment *rmem, vm_segment *wmem)
     cpu->eff_addr = 0;
     cpu->addr_mode = 0;
     cpu->PC = 0;
+    cpu->cycles = 0;
     cpu->A = 0;
     cpu->X = 0;
     cpu->Y = 0;
     cpu->P = MOS_STATUS_DEFAULT;
     cpu->S = 0xff;
+    cpu->prof = NULL;
+    cpu->calls = NULL;
+    cpu->trace = NULL;
 
     return cpu;
 }
@@ -189,6 +196,9 @@ mos6502_free(mos6502 *cpu)
 {
     // Note we do not free rmem or wmem; we consider this to be the
     // responsibility of the caller that passed us those values.
+    free(cpu->prof);
+    mos6502_calls_free(cpu->calls);
+    mos6502_trace_free(cpu->trace);
     free(cpu);
 }
 
@@ -299,13 +309,19 @@ void
 mos6502_execute(mos6502 *cpu)
 {
     vm_8bit opcode, operand = 0;
-    int /*cycles,*/ bytes;
+    vm_16bit pc = cpu->PC;
+    int cycles, bytes;
+    mos6502_trace_rec *rec = NULL;
     mos6502_address_resolver resolver;
     mos6502_instruction_handler handler;
 
     cpu->opcode = opcode = mos6502_get(cpu, cpu->PC);
     cpu->addr_mode = mos6502_addr_mode(opcode);
 
+    if (cpu->trace) {
+        rec = mos6502_trace_next(cpu->trace, cpu);
+    }
+
     // The disassembler knows how many bytes each operand requires
     // (maybe this code doesn't belong in the disassembler); let's use
     // that to figure out the total number of bytes to skip. We add 1
@@ -343,7 +359,12 @@ mos6502_execute(mos6502 *cpu)
     // with the idea that certain instructions -- in certain address
     // modes -- were more expensive than others, and you want those
     // programs to feel faster or slower in relation to that.
-    //cycles = mos6502_cycles(cpu, opcode);
+    cycles = mos6502_cycles(cpu, opcode);
+    cpu->cycles += cycles;
+
+    if (cpu->prof) {
+        mos6502_prof_count(cpu->prof, pc, opcode, cpu->addr_mode, cycles);
+    }
 
     // If we need to jump, then the handler has to take care of updating
     // PC. If not, then we need to do it. 
@@ -357,6 +378,14 @@ mos6502_execute(mos6502 *cpu)
 
     cpu->P |= MOS_UNUSED | MOS_BREAK;
 
+    if (cpu->calls) {
+        mos6502_calls_count(cpu->calls, cpu, opcode, cycles);
+    }
+
+    if (rec) {
+        mos6502_trace_commit(cpu->trace, cpu);
+    }
+
     // Ok -- we're done! This wasn't so hard, was it?
     return;
 }
@@ -459,6 +488,18 @@ mos6502_get(mos6502 *cpu, size_t addr)
     return vm_segment_get(cpu->rmem, addr);
 }
 
+/*
+ * Return the byte at a given address as mos6502_get() would, but
+ * without any of the side effects that reading it might have (see
+ * vm_segment_peek()). This is for anything that only wants to look,
+ * like the disassembler.
+ */
+vm_8bit
+mos6502_peek(mos6502 *cpu, size_t addr)
+{
+    return vm_segment_peek(cpu->rmem, addr);
+}
+
 /*
  * Return the 16-bit value from a given address using the read memory
  * segment.
@@ -0,0 +1,245 @@
+/*
+ * mos6502.prof.c
+ *
+ * The profiler counts, as the CPU executes, how many times it has run
+ * the instruction at each address and how many cycles those took; and
+ * likewise for each opcode and each address mode. From that we can
+ * tell which routines in the guest are where its time goes, and
+ * whether it's worth our while to make some instruction faster.
+ *
+ * Everything is kept in flat arrays, indexed directly by address or
+ * opcode, so counting costs only a few additions. When the CPU has no
+ * profile, it doesn't count at all.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "mos6502/dis.h"
+#include "mos6502/enums.h"
+#include "mos6502/prof.h"
+
+_Static_assert(ZPY < PROF_MODES, "PROF_MODES must cover every address mode");
+
+/*
+ * The names of the address modes, in the order of enum addr_mode.
+ */
+static const char *mode_names[PROF_MODES] = {
+    "NOA", "ACC", "ABS", "ABX", "ABY", "BY2", "BY3", "IMM",
+    "IMP", "IND", "IDX", "IDY", "REL", "ZPG", "ZPX", "ZPY",
+};
+
+/*
+ * Give the CPU a profile, and so begin counting what it executes. If it
+ * already has one, we leave it be. We return ERR_OOM if we couldn't
+ * allocate the profile.
+ */
+int
+mos6502_prof_start(mos6502 *cpu)
+{
+    if (cpu->prof) {
+        return OK;
+    }
+
+    cpu->prof = calloc(1, sizeof(mos6502_prof));
+    if (cpu->prof == NULL) {
+        log_crit("Could not allocate memory for profile");
+        return ERR_OOM;
+    }
+
+    return OK;
+}
+
+/*
+ * Stop counting, and throw away the profile we've kept.
+ */
+void
+mos6502_prof_stop(mos6502 *cpu)
+{
+    free(cpu->prof);
+    cpu->prof = NULL;
+}
+
+/*
+ * Forget everything we've counted so far.
+ */
+void
+mos6502_prof_clear(mos6502_prof *prof)
+{
+    memset(prof, 0, sizeof(mos6502_prof));
+}
+
+/*
+ * Count one execution of the given opcode, in the given address mode,
+ * at the given address, which took the given number of cycles.
+ */
+void
+mos6502_prof_count(mos6502_prof *prof, vm_16bit pc, vm_8bit opcode,
+                   int mode, int cycles)
+{
+    prof->pc_execs[pc]++;
+    prof->pc_cycles[pc] += cycles;
+
+    prof->op_execs[opcode]++;
+    prof->op_cycles[opcode] += cycles;
+
+    prof->mode_execs[mode]++;
+    prof->mode_cycles[mode] += cycles;
+
+    prof->execs++;
+    prof->cycles += cycles;
+}
+
+/*
+ * Fill top with the indexes of (at most) n of the largest nonzero
+ * keys, largest first, and return how many we found. This is a simple
+ * insertion into a short sorted list, which is all we need when n is
+ * small.
+ */
+static int
+prof_top(const uint64_t *keys, int nkeys, int *top, int n)
+{
+    int found = 0;
+
+    for (int i = 0; i < nkeys; i++) {
+        int j;
+
+        if (keys[i] == 0) {
+            continue;
+        }
+
+        if (found == n && keys[i] <= keys[top[n - 1]]) {
+            continue;
+        }
+
+        j = found < n ? found++ : n - 1;
+        while (j > 0 && keys[top[j - 1]] < keys[i]) {
+            top[j] = top[j - 1];
+            j--;
+        }
+
+        top[j] = i;
+    }
+
+    return found;
+}
+
+/*
+ * Return the percentage that part is of whole.
+ */
+static double
+prof_pct(uint64_t part, uint64_t whole)
+{
+    return whole ? (double)part * 100.0 / whole : 0.0;
+}
+
+/*
+ * Write the disassembly of the instruction at pc into str. We use the
+ * disassembler's own notation, but leave off the registers it would
+ * show after the semicolon; those are what they are now, and have
+ * nothing to do with the profile.
+ */
+static void
+prof_dis(mos6502 *cpu, vm_16bit pc, char *str, size_t len)
+{
+    vm_16bit orig = cpu->PC;
+    FILE *stream;
+    char *semi;
+    size_t end;
+
+    str[0] = '\0';
+
+    stream = fmemopen(str, len, "w");
+    if (stream == NULL) {
+        return;
+    }
+
+    cpu->PC = pc;
+    mos6502_dis_opcode(cpu, stream, pc);
+    cpu->PC = orig;
+
+    fclose(stream);
+    str[len - 1] = '\0';
+
+    semi = strchr(str, ';');
+    if (semi) {
+        *semi = '\0';
+    }
+
+    end = strlen(str);
+    while (end > 0 && (str[end - 1] == ' ' || str[end - 1] == '\n')) {
+        str[--end] = '\0';
+    }
+}
+
+/*
+ * Write the CPU's profile into the stream: first the hot spots, the n
+ * addresses where the most cycles were spent, with the instruction we
+ * find there now; then the opcodes and the address modes, also by the
+ * cycles they took. If n is zero, we show PROF_HOT_SPOTS hot spots.
+ */
+void
+mos6502_prof_dump(mos6502 *cpu, FILE *stream, int n)
+{
+    mos6502_prof *prof = cpu->prof;
+    char dis[128];
+    int top[256];
+    int found;
+
+    if (prof == NULL) {
+        fprintf(stream, "profile: not profiling\n");
+        return;
+    }
+
+    if (n <= 0) {
+        n = PROF_HOT_SPOTS;
+    }
+
+    if (n > 256) {
+        n = 256;
+    }
+
+    fprintf(stream, "profile: %llu instructions, %llu cycles\n",
+            (unsigned long long)prof->execs,
+            (unsigned long long)prof->cycles);
+
+    fprintf(stream, "\nhot spots:\n%12s %7s %12s  %s\n",
+            "cycles", "%", "execs", "instruction");
+
+    found = prof_top(prof->pc_cycles, MOS6502_MEMSIZE, top, n);
+    for (int i = 0; i < found; i++) {
+        prof_dis(cpu, top[i], dis, sizeof(dis));
+        fprintf(stream, "%12llu %6.2f%% %12llu  %s\n",
+                (unsigned long long)prof->pc_cycles[top[i]],
+                prof_pct(prof->pc_cycles[top[i]], prof->cycles),
+                (unsigned long long)prof->pc_execs[top[i]],
+                dis);
+    }
+
+    fprintf(stream, "\nopcodes:\n%12s %7s %12s  %s\n",
+            "cycles", "%", "execs", "opcode");
+
+    found = prof_top(prof->op_cycles, 256, top, 256);
+    for (int i = 0; i < found; i++) {
+        mos6502_dis_instruction(dis, sizeof(dis),
+                                mos6502_instruction(top[i]));
+        fprintf(stream, "%12llu %6.2f%% %12llu  $%02X %s %s\n",
+                (unsigned long long)prof->op_cycles[top[i]],
+                prof_pct(prof->op_cycles[top[i]], prof->cycles),
+                (unsigned long long)prof->op_execs[top[i]],
+                top[i], dis, mode_names[mos6502_addr_mode(top[i])]);
+    }
+
+    fprintf(stream, "\naddress modes:\n%12s %7s %12s  %s\n",
+            "cycles", "%", "execs", "mode");
+
+    found = prof_top(prof->mode_cycles, PROF_MODES, top, PROF_MODES);
+    for (int i = 0; i < found; i++) {
+        fprintf(stream, "%12llu %6.2f%% %12llu  %s\n",
+                (unsigned long long)prof->mode_cycles[top[i]],
+                prof_pct(prof->mode_cycles[top[i]], prof->cycles),
+                (unsigned long long)prof->mode_execs[top[i]],
+                mode_names[top[i]]);
+    }
+}
@@ -0,0 +1,276 @@
+/*
+ * mos6502.trace.c
+ *
+ * A trace is a record of every instruction the CPU executes, kept in a
+ * binary form that costs us very little to make. Disassembling as we
+ * go (as --disassemble does) means formatting a line of text for every
+ * instruction, which slows the machine to a crawl; here we just fill in
+ * a small, fixed-size record and put it in a ring buffer. A thread of
+ * our own writes the ring out to a file as it fills, and later on,
+ * mos6502_trace_decode() turns the file into just what the
+ * disassembler would have shown.
+ *
+ * If the ring fills faster than the flusher can empty it, the CPU waits
+ * for it; we would rather run slowly than lose records. You can record
+ * fewer of them by giving a range of addresses to record, or by
+ * sampling only one instruction in so many.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "mos6502/dis.h"
+#include "mos6502/trace.h"
+
+/*
+ * This is the flusher thread. It writes whatever is in the ring to the
+ * stream, until we're told to stop and there's nothing left to write.
+ */
+static void *
+trace_flush(void *arg)
+{
+    mos6502_trace *tr = (mos6502_trace *)arg;
+    uint64_t head, tail;
+    size_t from, len;
+
+    for (;;) {
+        head = atomic_load_explicit(&tr->head, memory_order_acquire);
+        tail = atomic_load_explicit(&tr->tail, memory_order_relaxed);
+
+        if (head == tail) {
+            if (atomic_load(&tr->stop)) {
+                break;
+            }
+
+            usleep(TRACE_FLUSH_USEC);
+            continue;
+        }
+
+        // Write as much as we can in one go, which is up to the head or
+        // the end of the ring, whichever comes first
+        from = tail & (TRACE_RING - 1);
+        len = head - tail;
+        if (from + len > TRACE_RING) {
+            len = TRACE_RING - from;
+        }
+
+        if (fwrite(&tr->ring[from], sizeof(mos6502_trace_rec), len,
+                   tr->stream) != len) {
+            atomic_store(&tr->err, ERR_BADFILE);
+        }
+
+        atomic_store_explicit(&tr->tail, tail + len, memory_order_release);
+    }
+
+    fflush(tr->stream);
+    return NULL;
+}
+
+/*
+ * Begin tracing the CPU into the given stream. We only record
+ * instructions at addresses from lo to hi, inclusive, and of those,
+ * only one in every sample (or every one, if sample is zero). If the
+ * CPU is already being traced, we return ERR_INVALID.
+ */
+int
+mos6502_trace_start(mos6502 *cpu, FILE *stream, vm_16bit lo, vm_16bit hi,
+                    unsigned int sample)
+{
+    mos6502_trace_header header;
+    mos6502_trace *tr;
+
+    if (cpu->trace) {
+        return ERR_INVALID;
+    }
+
+    tr = calloc(1, sizeof(mos6502_trace));
+    if (tr == NULL) {
+        log_crit("Could not allocate memory for trace");
+        return ERR_OOM;
+    }
+
+    tr->ring = malloc(sizeof(mos6502_trace_rec) * TRACE_RING);
+    if (tr->ring == NULL) {
+        log_crit("Could not allocate memory for trace ring");
+        free(tr);
+        return ERR_OOM;
+    }
+
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.rec_size = sizeof(mos6502_trace_rec);
+    header.reserved = 0;
+
+    if (fwrite(&header, sizeof(header), 1, stream) != 1) {
+        log_crit("Could not write trace header");
+        free(tr->ring);
+        free(tr);
+        return ERR_BADFILE;
+    }
+
+    tr->stream = stream;
+    tr->lo = lo;
+    tr->hi = hi;
+    tr->sample = sample ? sample : 1;
+    tr->skipped = 0;
+    atomic_init(&tr->head, 0);
+    atomic_init(&tr->tail, 0);
+    atomic_init(&tr->stop, false);
+    atomic_init(&tr->err, OK);
+
+    if (pthread_create(&tr->flusher, NULL, trace_flush, tr) != 0) {
+        log_crit("Could not start trace flusher");
+        free(tr->ring);
+        free(tr);
+        return ERR_INVALID;
+    }
+
+    cpu->trace = tr;
+    return OK;
+}
+
+/*
+ * Stop the flusher, once it has written out everything we've recorded,
+ * and free the trace. We don't close the stream; that's yours.
+ */
+void
+mos6502_trace_free(mos6502_trace *tr)
+{
+    if (tr == NULL) {
+        return;
+    }
+
+    atomic_store(&tr->stop, true);
+    pthread_join(tr->flusher, NULL);
+
+    if (tr->err != OK) {
+        log_crit("Could not write the whole trace");
+    }
+
+    free(tr->ring);
+    free(tr);
+}
+
+/*
+ * Stop tracing the CPU.
+ */
+void
+mos6502_trace_stop(mos6502 *cpu)
+{
+    mos6502_trace_free(cpu->trace);
+    cpu->trace = NULL;
+}
+
+/*
+ * This is called by mos6502_execute() when it has read the opcode of
+ * the next instruction, but not yet executed it. If we are to record
+ * the instruction, we fill in what we can of a record for it and
+ * return that; the record is made once mos6502_trace_commit() is
+ * called. If not, we return NULL.
+ */
+mos6502_trace_rec *
+mos6502_trace_next(mos6502_trace *tr, mos6502 *cpu)
+{
+    mos6502_trace_rec *rec;
+    uint64_t head;
+    int expected;
+
+    if (cpu->PC < tr->lo || cpu->PC > tr->hi) {
+        return NULL;
+    }
+
+    if (tr->skipped) {
+        tr->skipped--;
+        return NULL;
+    }
+
+    if (tr->err != OK) {
+        return NULL;
+    }
+
+    tr->skipped = tr->sample - 1;
+
+    head = atomic_load_explicit(&tr->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&tr->tail, memory_order_acquire)
+           >= TRACE_RING) {
+        tr->stalls++;
+        sched_yield();
+    }
+
+    rec = &tr->ring[head & (TRACE_RING - 1)];
+
+    rec->cycles = cpu->cycles;
+    rec->PC = cpu->PC;
+    rec->eff_addr = 0;
+    rec->opcode = cpu->opcode;
+    rec->A = cpu->A;
+    rec->X = cpu->X;
+    rec->Y = cpu->Y;
+    rec->P = cpu->P;
+    rec->S = cpu->S;
+
+    expected = mos6502_dis_expected_bytes(cpu->addr_mode);
+    rec->oper[0] = expected > 0 ? mos6502_peek(cpu, cpu->PC + 1) : 0;
+    rec->oper[1] = expected > 1 ? mos6502_peek(cpu, cpu->PC + 2) : 0;
+
+    return rec;
+}
+
+/*
+ * Finish the record we began in mos6502_trace_next(), now that the
+ * instruction has executed, and hand it to the flusher.
+ */
+void
+mos6502_trace_commit(mos6502_trace *tr, mos6502 *cpu)
+{
+    uint64_t head = atomic_load_explicit(&tr->head, memory_order_relaxed);
+
+    tr->ring[head & (TRACE_RING - 1)].eff_addr = cpu->eff_addr;
+    tr->records++;
+
+    atomic_store_explicit(&tr->head, head + 1, memory_order_release);
+}
+
+/*
+ * Read the trace in the stream in, and write it to out as the
+ * disassembler would have written it as the instructions executed. We
+ * return ERR_BADFILE if the stream doesn't hold a trace we understand.
+ */
+int
+mos6502_trace_decode(FILE *stream, FILE *out)
+{
+    mos6502_trace_header header;
+    mos6502_trace_rec rec;
+    mos6502 cpu;
+    int expected;
+
+    if (fread(&header, sizeof(header), 1, stream) != 1 ||
+        header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION ||
+        header.rec_size != sizeof(mos6502_trace_rec)
+       ) {
+        log_crit("Not a trace we can read");
+        return ERR_BADFILE;
+    }
+
+    memset(&cpu, 0, sizeof(cpu));
+
+    while (fread(&rec, sizeof(rec), 1, stream) == 1) {
+        cpu.PC = rec.PC;
+        cpu.A = rec.A;
+        cpu.X = rec.X;
+        cpu.Y = rec.Y;
+        cpu.P = rec.P;
+        cpu.S = rec.S;
+
+        expected = mos6502_dis_expected_bytes(mos6502_addr_mode(rec.opcode));
+
+        mos6502_dis_print(&cpu, out, rec.PC + 1 + expected, rec.opcode,
+                          rec.oper[0] | (rec.oper[1] << 8));
+    }
+
+    return OK;
+}
@@ -7,6 +7,7 @@
  * data are bitmap fonts, ROM data, etc.
  */
 
+#include <pthread.h>
 #include <zlib.h>
 
 #include "objstore.h"
@@ -23,6 +24,14 @@
  */
 static objstore store;
 
+/*
+ * Machines may be created on any thread (see erc.h), and the first of
+ * them to be created fills in the store; this keeps two threads from
+ * doing so at once, or one from looking at the store while another is
+ * halfway through filling it in.
+ */
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * This function will set up the store variable so that it contains
  * useful information rather than garbage data from the stack. It does
@@ -32,9 +41,14 @@ static objstore store;
 int
 objstore_init()
 {
+    int err = OK;
+
+    pthread_mutex_lock(&store_lock);
+
     // Oh, you're calling this again? Cool, but let's bail before we do
     // anything else.
     if (objstore_ready()) {
+        pthread_mutex_unlock(&store_lock);
         return OK;
     }
 
@@ -50,10 +64,11 @@ objstore_init()
     // If the copy didn't work out somehow...
     if (!objstore_ready()) {
         log_crit("Object store initialization failed with bad data");
-        return ERR_BADFILE;
+        err = ERR_BADFILE;
     }
 
-    return OK;
+    pthread_mutex_unlock(&store_lock);
+    return err;
 }
 
 /*
@@ -63,7 +78,9 @@ objstore_init()
 void
 objstore_clear()
 {
+    pthread_mutex_lock(&store_lock);
     memset(&store, 0, sizeof(store));
+    pthread_mutex_unlock(&store_lock);
 }
 
 /*
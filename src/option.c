@@ -8,9 +8,11 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "apple2/runahead.h"
 #include "option.h"
 #include "log.h"
 #include "vm_di.h"
@@ -22,6 +24,14 @@
  */
 static FILE *input1 = NULL;
 static FILE *input2 = NULL;
+static FILE *volume = NULL;
+static FILE *state = NULL;
+static FILE *record = NULL;
+static FILE *replay = NULL;
+static FILE *profile = NULL;
+static FILE *callgraph = NULL;
+static FILE *trace = NULL;
+static FILE *heatmap = NULL;
 
 static FILE *disasm_log = NULL;
 
@@ -44,6 +54,19 @@ static char error_buffer[ERRBUF_SIZE] = "";
 static int width = 840;
 static int height = 576;
 
+/*
+ * How many frames we run ahead when we draw (see apple2.runahead.c);
+ * zero if we don't.
+ */
+static int runahead = 0;
+
+/*
+ * The range of addresses we trace, and how many instructions we sample
+ * one of (see mos6502.trace.c).
+ */
+static int trace_range[2] = { 0, 0xFFFF };
+static int trace_sample = 1;
+
 /*
  * These are all of the options we allow in our long-form options. It's
  * a bit faster to identify them by integer symbols than to do string
@@ -54,16 +77,48 @@ enum options {
     DISK2,
     HELP,
     DISASSEMBLE,
+    NIBCACHE,
+    VOLUME,
+    HOSTDIR,
+    STATE,
+    SNAPCACHE,
+    RECORD,
+    REPLAY,
+    RUNAHEAD,
+    REFLECT,
+    PROFILE,
+    CALLGRAPH,
+    TRACE,
+    TRACE_RANGE,
+    TRACE_SAMPLE,
+    GDB,
+    HEATMAP,
 };
 
 /*
  * Here are the options we support for program execution.
  */
 static struct option long_options[] = {
+    { "callgraph", 1, NULL, CALLGRAPH },
     { "disassemble", 1, NULL, DISASSEMBLE },
     { "disk1", 1, NULL, DISK1 },
     { "disk2", 1, NULL, DISK2 },
+    { "gdb", 1, NULL, GDB },
+    { "heatmap", 1, NULL, HEATMAP },
     { "help", 0, NULL, HELP },
+    { "hostdir", 1, NULL, HOSTDIR },
+    { "nibcache", 1, NULL, NIBCACHE },
+    { "profile", 1, NULL, PROFILE },
+    { "record", 1, NULL, RECORD },
+    { "reflect", 1, NULL, REFLECT },
+    { "replay", 1, NULL, REPLAY },
+    { "runahead", 1, NULL, RUNAHEAD },
+    { "snapcache", 1, NULL, SNAPCACHE },
+    { "state", 1, NULL, STATE },
+    { "trace", 1, NULL, TRACE },
+    { "trace-range", 1, NULL, TRACE_RANGE },
+    { "trace-sample", 1, NULL, TRACE_SAMPLE },
+    { "volume", 1, NULL, VOLUME },
 };
 
 /*
@@ -139,6 +194,130 @@ option_parse(int argc, char **argv)
                 vm_di_set(VM_DISK2, input2);
                 break;
 
+            case NIBCACHE:
+                vm_di_set(VM_NIBCACHE, optarg);
+                break;
+
+            case VOLUME:
+                if (!option_open_file(&volume, optarg, "r+")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_VOLUME, volume);
+                break;
+
+            case HOSTDIR:
+                vm_di_set(VM_HOSTDIR, optarg);
+                break;
+
+            case SNAPCACHE:
+                vm_di_set(VM_SNAPCACHE, optarg);
+                break;
+
+            case STATE:
+                if (!option_open_file(&state, optarg, "r")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_STATE, state);
+                break;
+
+            case RECORD:
+                if (!option_open_file(&record, optarg, "w")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_RECORD, record);
+                break;
+
+            case REPLAY:
+                if (!option_open_file(&replay, optarg, "r")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_REPLAY, replay);
+                break;
+
+            case CALLGRAPH:
+                if (!option_open_file(&callgraph, optarg, "w")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_CALLGRAPH, callgraph);
+                break;
+
+            case TRACE:
+                if (!option_open_file(&trace, optarg, "w")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_TRACE, trace);
+                break;
+
+            case TRACE_RANGE:
+                if (sscanf(optarg, "%x-%x",
+                           &trace_range[0], &trace_range[1]) != 2 ||
+                    trace_range[0] > trace_range[1] ||
+                    trace_range[1] > 0xFFFF
+                   ) {
+                    snprintf(error_buffer,
+                             ERRBUF_SIZE,
+                             "bad trace range: %s", optarg);
+                    return 0;
+                }
+
+                vm_di_set(VM_TRACE_RANGE, trace_range);
+                break;
+
+            case TRACE_SAMPLE:
+                trace_sample = atoi(optarg);
+                if (trace_sample < 1) {
+                    snprintf(error_buffer,
+                             ERRBUF_SIZE,
+                             "trace sample must be at least 1");
+                    return 0;
+                }
+
+                vm_di_set(VM_TRACE_SAMPLE, &trace_sample);
+                break;
+
+            case PROFILE:
+                if (!option_open_file(&profile, optarg, "w")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_PROFILE, profile);
+                break;
+
+            case GDB:
+                vm_di_set(VM_GDB, optarg);
+                break;
+
+            case HEATMAP:
+                if (!option_open_file(&heatmap, optarg, "w")) {
+                    return 0;
+                }
+
+                vm_di_set(VM_HEATMAP, heatmap);
+                break;
+
+            case REFLECT:
+                vm_di_set(VM_REFLECT, optarg);
+                break;
+
+            case RUNAHEAD:
+                runahead = atoi(optarg);
+                if (runahead < 0 || runahead > RUNAHEAD_MAX_FRAMES) {
+                    snprintf(error_buffer,
+                             ERRBUF_SIZE,
+                             "runahead must be between 0 and %d frames",
+                             RUNAHEAD_MAX_FRAMES);
+                    return 0;
+                }
+
+                vm_di_set(VM_RUNAHEAD, &runahead);
+                break;
+
             case HELP:
                 option_print_help();
                 
@@ -188,10 +367,44 @@ option_print_help()
     fprintf(stderr, "Usage: erc [options...]\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "\
+  --callgraph=FILE            Follow the calls the CPU makes, and write\n\
+                              them into FILE as folded stacks (for a\n\
+                              flame graph) when we exit\n\
   --disassemble=FILE          Write assembly notation into FILE\n\
   --disk1=FILE                Load FILE into disk drive 1\n\
   --disk2=FILE                Load FILE into disk drive 2\n\
+  --gdb=ADDR                  Listen for a remote debugger at ADDR: a\n\
+                              port (or host:port), or a socket path\n\
+  --heatmap=FILE              Count the machine's reads and writes in\n\
+                              each page of memory, and at each soft\n\
+                              switch, and write them into FILE as CSV\n\
+                              when we exit\n\
   --help                      Print this help message\n\
+  --hostdir=DIR               Present DIR as a ProDOS volume in the\n\
+                              block device in slot 5\n\
+  --nibcache=DIR              Cache encoded disk images in DIR\n\
+  --profile=FILE              Count what the CPU executes, and write\n\
+                              the hot spots into FILE when we exit\n\
+  --record=FILE               Record everything the machine is given\n\
+                              from outside into FILE, once we have\n\
+                              booted\n\
+  --reflect=NAME              Publish the machine's state, once a\n\
+                              frame, in the shared memory object NAME\n\
+  --replay=FILE               Replay a recording made with --record\n\
+  --runahead=FRAMES           Show the screen as it will be FRAMES\n\
+                              frames from now, to hide input lag\n\
   --size=WIDTHxHEIGHT         Use WIDTH and HEIGHT for window size\n\
-                              (only 700x480 and 875x600 are supported)\n");
+                              (only 700x480 and 875x600 are supported)\n\
+  --snapcache=DIR             Save a snapshot of the machine in DIR\n\
+                              once it has booted, and start from it\n\
+                              when booting the same way again\n\
+  --state=FILE                Load the machine state saved in FILE\n\
+                              once we have booted\n\
+  --trace=FILE                Record a binary trace of everything the\n\
+                              CPU executes into FILE (see erc-trace)\n\
+  --trace-range=FROM-TO       Only trace instructions at addresses from\n\
+                              FROM through TO (in hex)\n\
+  --trace-sample=N            Only trace one instruction in every N\n\
+  --volume=FILE               Load FILE (a ProDOS volume) into the\n\
+                              block device in slot 5\n");
 }
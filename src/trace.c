@@ -0,0 +1,42 @@
+/*
+ * trace.c
+ *
+ * This is the entry point for erc-trace, which reads a trace made with
+ * erc --trace and writes it out as the disassembler would have, had we
+ * run erc with --disassemble instead. For example:
+ *
+ *   erc --trace=boot.trace --disk1=dos33.dsk
+ *   erc-trace boot.trace > boot.log
+ */
+
+#include <stdio.h>
+
+#include "log.h"
+#include "mos6502/trace.h"
+
+int
+main(int argc, char **argv)
+{
+    FILE *stream;
+    int err;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: erc-trace FILE\n\
+Write the trace in FILE, as made by erc --trace, to standard output as\n\
+a disassembly.\n");
+        return 1;
+    }
+
+    log_open(stderr);
+
+    stream = fopen(argv[1], "r");
+    if (stream == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    err = mos6502_trace_decode(stream, stdout);
+    fclose(stream);
+
+    return err == OK ? 0 : 1;
+}
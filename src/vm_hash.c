@@ -0,0 +1,66 @@
+/*
+ * vm_hash.c
+ *
+ * Here we can compute a content hash of some data, such as a disk image
+ * or a block of ROM. These hashes are used to name things we save to
+ * disk (like caches) so that we can tell if we've seen the same data
+ * before.
+ *
+ * The algorithm is 64-bit FNV-1a, which is not cryptographic in any
+ * sense; it's just fast, simple, and spreads its bits around well
+ * enough that we don't expect collisions among the images any one
+ * person is likely to own.
+ */
+
+#include "vm_hash.h"
+
+/*
+ * The FNV prime we multiply by for every byte we hash.
+ */
+#define FNV_PRIME 0x100000001b3ULL
+
+/*
+ * Continue the hash given in `hash` with `len` bytes from `buf`, and
+ * return the new hash. If you're starting fresh, pass in VM_HASH_INIT.
+ */
+uint64_t
+vm_hash_buf(uint64_t hash, const vm_8bit *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= buf[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Fold an integer value into the hash. We do this byte-by-byte, in
+ * little-endian order, so that the result is the same regardless of the
+ * byte order of the host.
+ */
+uint64_t
+vm_hash_int(uint64_t hash, uint64_t value)
+{
+    vm_8bit bytes[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        bytes[i] = (value >> (i * 8)) & 0xff;
+    }
+
+    return vm_hash_buf(hash, bytes, sizeof(bytes));
+}
+
+/*
+ * Hash the entire memory of a segment. Note that we hash the memory
+ * directly, and don't consult any of the segment's mapper functions.
+ */
+uint64_t
+vm_hash_segment(uint64_t hash, vm_segment *seg)
+{
+    hash = vm_hash_int(hash, seg->size);
+    return vm_hash_buf(hash, seg->memory, seg->size);
+}
@@ -8,9 +8,12 @@
  */
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "log.h"
 #include "vm_di.h"
@@ -45,6 +48,17 @@ vm_segment_create(size_t size)
     // begins life in that state.
     memset(seg->memory, 0, sizeof(vm_8bit) * size);
 
+    // If we fail to build the tables below, vm_segment_free() will
+    // need to know what we have and haven't got.
+    seg->read_table = NULL;
+    seg->write_table = NULL;
+    seg->mapped = false;
+    seg->mach = NULL;
+    seg->base = NULL;
+    seg->table_refs = NULL;
+    seg->peek = NULL;
+    seg->poke = NULL;
+
     seg->read_table = malloc(sizeof(vm_segment_read_fn) * size);
     if (seg->read_table == NULL) {
         log_crit("Couldn't allocate enough space for segment read_table");
@@ -72,16 +86,288 @@ vm_segment_create(size_t size)
     return seg;
 }
 
+/*
+ * Create a segment whose memory is a private mapping of `size` bytes
+ * from the file descriptor `fd`. Pages are only read in from the file
+ * when they are touched, and any writes to the segment stay in our
+ * memory; they are never carried back to the file.
+ */
+vm_segment *
+vm_segment_map(int fd, size_t size)
+{
+    vm_segment *seg;
+    void *mem;
+
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mem == MAP_FAILED) {
+        log_crit("Couldn't map file into vm_segment: %s", strerror(errno));
+        return NULL;
+    }
+
+    // The simplest way to get the tables (and everything else) set up
+    // is to build a normal segment, and then swap in our mapping for
+    // the memory it allocated.
+    seg = vm_segment_create(size);
+    if (seg == NULL) {
+        munmap(mem, size);
+        return NULL;
+    }
+
+    free(seg->memory);
+    seg->memory = mem;
+    seg->mapped = true;
+
+    return seg;
+}
+
+/*
+ * Let go of our reference to a frozen base, and if no one else is
+ * holding it, get rid of it.
+ */
+static void
+segment_release(vm_segment_base *base)
+{
+    if (--base->refs > 0) {
+        return;
+    }
+
+    munmap((void *)base->view, base->len);
+    close(base->fd);
+    free(base);
+}
+
 /*
  * Free the memory consumed by a given segment.
  */
 void
 vm_segment_free(vm_segment *seg)
 {
-    free(seg->memory);
+    if (seg->base) {
+        munmap(seg->memory, seg->base->len);
+        segment_release(seg->base);
+    } else if (seg->mapped) {
+        munmap(seg->memory, seg->size);
+    } else {
+        free(seg->memory);
+    }
+
+    // We only free the tables if no fork is still using them
+    if (seg->table_refs == NULL || --*seg->table_refs == 0) {
+        free(seg->read_table);
+        free(seg->write_table);
+        free(seg->table_refs);
+    }
+
     free(seg);
 }
 
+/*
+ * Return a descriptor for a new shared memory object of len bytes. The
+ * object has no name; we unlink it as soon as we've opened it, so it
+ * goes away when the last descriptor and mapping of it do.
+ */
+static int
+segment_shm(size_t len)
+{
+    static unsigned long serial = 0;
+    char name[64];
+    int fd;
+
+    do {
+        snprintf(name, sizeof(name), "/erc.%d.%lu",
+                 (int)getpid(), serial++);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } while (fd < 0 && errno == EEXIST);
+
+    if (fd < 0) {
+        log_crit("Couldn't create shared memory: %s", strerror(errno));
+        return -1;
+    }
+
+    shm_unlink(name);
+
+    if (ftruncate(fd, len) != 0) {
+        log_crit("Couldn't size shared memory: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Freeze the memory of a segment: copy it into a new shared object,
+ * and replace our memory with a private mapping of that object. Our
+ * memory has the same contents as before, but now any number of forks
+ * can map the same object, and the kernel will give each its own copy
+ * of a page only when it writes to that page.
+ */
+static int
+segment_freeze(vm_segment *seg)
+{
+    vm_segment_base *base;
+    vm_8bit *view, *mem;
+    long page = sysconf(_SC_PAGESIZE);
+
+    base = malloc(sizeof(vm_segment_base));
+    if (base == NULL) {
+        log_crit("Couldn't allocate space for a segment base");
+        return ERR_OOM;
+    }
+
+    base->refs = 1;
+    base->len = (seg->size + page - 1) / page * page;
+    base->fd = segment_shm(base->len);
+    if (base->fd < 0) {
+        free(base);
+        return ERR_OOM;
+    }
+
+    // Not every system lets you write() into a shared memory object,
+    // so we copy into it through a mapping; and then we keep that
+    // mapping around, read-only, to see what's in the object later.
+    view = mmap(NULL, base->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                base->fd, 0);
+    mem = mmap(NULL, base->len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+               base->fd, 0);
+    if (view == MAP_FAILED || mem == MAP_FAILED) {
+        log_crit("Couldn't map shared memory: %s", strerror(errno));
+
+        if (view != MAP_FAILED) {
+            munmap(view, base->len);
+        }
+
+        if (mem != MAP_FAILED) {
+            munmap(mem, base->len);
+        }
+
+        close(base->fd);
+        free(base);
+        return ERR_OOM;
+    }
+
+    memcpy(view, seg->memory, seg->size);
+    mprotect(view, base->len, PROT_READ);
+    base->view = view;
+
+    // Now we can let go of the memory we had before
+    if (seg->base) {
+        munmap(seg->memory, seg->base->len);
+        segment_release(seg->base);
+    } else if (seg->mapped) {
+        munmap(seg->memory, seg->size);
+    } else {
+        free(seg->memory);
+    }
+
+    seg->memory = mem;
+    seg->mapped = false;
+    seg->base = base;
+
+    return OK;
+}
+
+/*
+ * Return a fork of the given segment. The fork begins with the same
+ * memory and mappers as the segment, but from then on, what happens in
+ * one doesn't happen in the other.
+ *
+ * Forking doesn't copy memory. The first time we fork a segment, we
+ * freeze its memory (see segment_freeze()), and the fork maps the same
+ * frozen memory; a page is only copied when the segment or its fork
+ * first writes to it. If the segment's memory is still what it was
+ * when we last froze it, we don't need to freeze it again, so forking
+ * over and over from the same state is very cheap. The fork shares our
+ * read and write tables, too.
+ */
+vm_segment *
+vm_segment_fork(vm_segment *seg)
+{
+    vm_segment *fork;
+
+    if (seg->base == NULL ||
+        memcmp(seg->memory, seg->base->view, seg->size) != 0) {
+        if (segment_freeze(seg) != OK) {
+            return NULL;
+        }
+    }
+
+    fork = malloc(sizeof(vm_segment));
+    if (fork == NULL) {
+        log_crit("Couldn't allocate enough space for vm_segment");
+        return NULL;
+    }
+
+    fork->memory = mmap(NULL, seg->base->len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, seg->base->fd, 0);
+    if (fork->memory == MAP_FAILED) {
+        log_crit("Couldn't map shared memory: %s", strerror(errno));
+        free(fork);
+        return NULL;
+    }
+
+    if (seg->table_refs == NULL) {
+        seg->table_refs = malloc(sizeof(int));
+        if (seg->table_refs == NULL) {
+            log_crit("Couldn't allocate space for segment table refs");
+            munmap(fork->memory, seg->base->len);
+            free(fork);
+            return NULL;
+        }
+
+        *seg->table_refs = 1;
+    }
+
+    fork->size = seg->size;
+    fork->mapped = false;
+    fork->mach = seg->mach;
+    fork->base = seg->base;
+    fork->base->refs++;
+    fork->read_table = seg->read_table;
+    fork->write_table = seg->write_table;
+    fork->table_refs = seg->table_refs;
+    fork->peek = seg->peek;
+    fork->poke = seg->poke;
+    (*fork->table_refs)++;
+
+    return fork;
+}
+
+/*
+ * If we share our read and write tables with some other segment, make
+ * copies of them that are ours alone. We do this before we change a
+ * mapper, so the change doesn't happen to every fork.
+ */
+static int
+segment_own_tables(vm_segment *seg)
+{
+    vm_segment_read_fn *rtab;
+    vm_segment_write_fn *wtab;
+
+    if (seg->table_refs == NULL || *seg->table_refs == 1) {
+        return OK;
+    }
+
+    rtab = malloc(sizeof(vm_segment_read_fn) * seg->size);
+    wtab = malloc(sizeof(vm_segment_write_fn) * seg->size);
+    if (rtab == NULL || wtab == NULL) {
+        log_crit("Couldn't allocate space for segment tables");
+        free(rtab);
+        free(wtab);
+        return ERR_OOM;
+    }
+
+    memcpy(rtab, seg->read_table, sizeof(vm_segment_read_fn) * seg->size);
+    memcpy(wtab, seg->write_table, sizeof(vm_segment_write_fn) * seg->size);
+
+    (*seg->table_refs)--;
+    seg->table_refs = NULL;
+    seg->read_table = rtab;
+    seg->write_table = wtab;
+
+    return OK;
+}
+
 /*
  * Set the byte in `segment`, at `addr`, to the given `value`. Our
  * bounds-checking here will _crash_ the program if we are
@@ -100,10 +386,10 @@ vm_segment_set(vm_segment *seg, size_t addr, vm_8bit value)
         return ERR_OOB;
     }
 
-    void *map_mach = vm_di_get(VM_MACHINE);
-
     // Check if we have a write mapper
     if (seg->write_table[addr]) {
+        void *map_mach = seg->mach ? seg->mach : vm_di_get(VM_MACHINE);
+
         seg->write_table[addr](seg, addr, value, map_mach);
         return OK;
     }
@@ -130,16 +416,192 @@ vm_segment_get(vm_segment *seg, size_t addr)
         exit(1);
     }
 
-    void *map_mach = vm_di_get(VM_MACHINE);
-
     // We may have a read mapper for this address
     if (seg->read_table[addr]) {
+        void *map_mach = seg->mach ? seg->mach : vm_di_get(VM_MACHINE);
+
         return seg->read_table[addr](seg, addr, map_mach);
     }
 
     return seg->memory[addr];
 }
 
+/*
+ * Read the len bytes from addr on into buf, just as len calls to
+ * vm_segment_get() would, in the same order. But where there's a run
+ * of addresses with no read mapper, we copy the whole run with one
+ * memcpy(); so reading plain memory in bulk costs about what memcpy()
+ * does, and we only pay a call apiece for the addresses that are
+ * mapped.
+ */
+int
+vm_segment_read_range(vm_segment *seg, vm_8bit *buf, size_t addr,
+                      size_t len)
+{
+    void *map_mach = NULL;
+    size_t i = 0, end;
+
+    if (addr + len > seg->size) {
+        log_crit(
+            "Attempt to read beyond bounds of vm_segment (%d + %d > %d)",
+            addr,
+            len,
+            seg->size);
+
+        return ERR_OOB;
+    }
+
+    while (i < len) {
+        // A mapper we call may map or unmap other addresses, so we look
+        // for the end of each run only when we get to it
+        for (end = i; end < len && !seg->read_table[addr + end]; end++) {
+        }
+
+        if (end > i) {
+            memcpy(buf + i, seg->memory + addr + i, end - i);
+            i = end;
+            continue;
+        }
+
+        if (map_mach == NULL) {
+            map_mach = seg->mach ? seg->mach : vm_di_get(VM_MACHINE);
+        }
+
+        buf[i] = seg->read_table[addr + i](seg, addr + i, map_mach);
+        i++;
+    }
+
+    return OK;
+}
+
+/*
+ * Write the len bytes in buf into the segment from addr on, just as len
+ * calls to vm_segment_set() would. Like vm_segment_read_range(), we
+ * copy runs of unmapped addresses with memcpy(), and call the write
+ * mapper for each address that has one.
+ */
+int
+vm_segment_write_range(vm_segment *seg, const vm_8bit *buf, size_t addr,
+                       size_t len)
+{
+    void *map_mach = NULL;
+    size_t i = 0, end;
+
+    if (addr + len > seg->size) {
+        log_crit(
+            "Attempt to write beyond bounds of vm_segment (%d + %d > %d)",
+            addr,
+            len,
+            seg->size);
+
+        return ERR_OOB;
+    }
+
+    while (i < len) {
+        for (end = i; end < len && !seg->write_table[addr + end]; end++) {
+        }
+
+        if (end > i) {
+            memcpy(seg->memory + addr + i, buf + i, end - i);
+            i = end;
+            continue;
+        }
+
+        if (map_mach == NULL) {
+            map_mach = seg->mach ? seg->mach : vm_di_get(VM_MACHINE);
+        }
+
+        seg->write_table[addr + i](seg, addr + i, buf[i], map_mach);
+        i++;
+    }
+
+    return OK;
+}
+
+/*
+ * Return the byte at addr, as a read would, but without doing anything
+ * else a read would do. A read mapper may do all sorts of things (flip
+ * a soft switch, move a disk head), which is fine for the machine; but
+ * a debugger or a hex dump looking at memory mustn't change what it
+ * looks at. If the segment has a peek function, it knows how to find
+ * the byte a read would return without any of that; if not, the byte
+ * is simply what's in memory.
+ *
+ * Unlike vm_segment_get(), we don't exit if addr is out of bounds;
+ * someone who only wants a look at memory gets a zero.
+ */
+vm_8bit
+vm_segment_peek(vm_segment *seg, size_t addr)
+{
+    if (!vm_segment_bounds_check(seg, addr)) {
+        return 0;
+    }
+
+    if (seg->peek) {
+        void *map_mach = seg->mach ? seg->mach : vm_di_get(VM_MACHINE);
+
+        return seg->peek(seg, addr, map_mach);
+    }
+
+    return seg->memory[addr];
+}
+
+/*
+ * Copy the len bytes from addr on into buf, as vm_segment_peek() would
+ * see them. Without a peek function, that's a single memcpy().
+ */
+int
+vm_segment_peek_range(vm_segment *seg, vm_8bit *buf, size_t addr,
+                      size_t len)
+{
+    void *map_mach;
+
+    if (addr + len > seg->size) {
+        log_crit(
+            "Attempt to peek beyond bounds of vm_segment (%d + %d > %d)",
+            addr,
+            len,
+            seg->size);
+
+        return ERR_OOB;
+    }
+
+    if (seg->peek == NULL) {
+        memcpy(buf, seg->memory + addr, len);
+        return OK;
+    }
+
+    map_mach = seg->mach ? seg->mach : vm_di_get(VM_MACHINE);
+
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = seg->peek(seg, addr + i, map_mach);
+    }
+
+    return OK;
+}
+
+/*
+ * Put value at addr, where a write would put it, but without doing
+ * anything else a write would do (see vm_segment_peek()).
+ */
+int
+vm_segment_poke(vm_segment *seg, size_t addr, vm_8bit value)
+{
+    if (!vm_segment_bounds_check(seg, addr)) {
+        return ERR_OOB;
+    }
+
+    if (seg->poke) {
+        void *map_mach = seg->mach ? seg->mach : vm_di_get(VM_MACHINE);
+
+        seg->poke(seg, addr, value, map_mach);
+        return OK;
+    }
+
+    seg->memory[addr] = value;
+    return OK;
+}
+
 /*
  * Return a 16-bit value from a given address. This will read the byte
  * at addr and the byte at addr+1, then fit those into a two-byte
@@ -237,6 +699,10 @@ vm_segment_read_map(vm_segment *seg,
         return ERR_OOB;
     }
 
+    if (segment_own_tables(seg) != OK) {
+        return ERR_OOM;
+    }
+
     seg->read_table[addr] = fn;
     return OK;
 }
@@ -254,6 +720,10 @@ vm_segment_write_map(vm_segment *seg,
         return ERR_OOB;
     }
 
+    if (segment_own_tables(seg) != OK) {
+        return ERR_OOM;
+    }
+
     seg->write_table[addr] = fn;
     return OK;
 }
@@ -334,34 +804,37 @@ vm_segment_set16(vm_segment *seg, size_t addr, vm_16bit value)
  * given file stream. This looks vaguely like the output of the hexdump
  * Unix command, except that the hex values are upper-case, and we use
  * brackets instead of vertical bars to delimit the ASCII output because
- * WHY NOT.
+ * WHY NOT. We only peek at memory (see vm_segment_peek()), so dumping
+ * it doesn't change it.
  */
 void
 vm_segment_hexdump(vm_segment *seg, FILE *stream, size_t from, size_t to)
 {
     char nbuf[51], sbuf[17];
-    int ni = 0, si = 0;
-    int bytes = 0;
-    vm_8bit byte;
+    int ni, si;
+    vm_8bit line[16];
+    size_t len;
 
+    // We take each line's worth of memory in one go
     while (from < to) {
-        byte = vm_segment_get(seg, from);
+        len = to - from < 16 ? to - from : 16;
+        if (vm_segment_peek_range(seg, line, from, len) != OK) {
+            return;
+        }
 
-        ni += sprintf(nbuf + ni, "%02X ", byte);
-        si += sprintf(sbuf + si, "%c", isprint(byte) ? byte : '.');
+        ni = 0;
+        si = 0;
 
-        from++;
-        bytes++;
+        for (size_t i = 0; i < len; i++) {
+            ni += sprintf(nbuf + ni, "%02X ", line[i]);
+            si += sprintf(sbuf + si, "%c", isprint(line[i]) ? line[i] : '.');
 
-        if (bytes == 8) {
-            ni += sprintf(nbuf + ni, " ");
+            if (i == 7) {
+                ni += sprintf(nbuf + ni, " ");
+            }
         }
 
-        if (bytes >= 16 || from >= to) {
-            fprintf(stream, "%08zX    %s  [%s]\n", from - bytes, nbuf, sbuf);
-            bytes = 0;
-            ni = 0; 
-            si = 0;
-        }
+        fprintf(stream, "%08zX    %s  [%s]\n", from, nbuf, sbuf);
+        from += len;
     }
 }
@@ -35,6 +35,42 @@ Test(apple2, create)
     cr_assert_neq(mach->drive2, NULL);
 }
 
+Test(apple2, fork)
+{
+    apple2 *fork;
+
+    mach->cpu->PC = 0x1234;
+    mach->cpu->A = 0x56;
+    mos6502_set(mach->cpu, 0x10, 0x11);
+    mos6502_set(mach->cpu, 0x300, 0x22);
+    apple2_set_memory_mode(mach, MEMORY_READ_AUX);
+    mach->selected_drive = mach->drive2;
+
+    fork = apple2_fork(mach);
+    cr_assert_neq(fork, NULL);
+    cr_assert_eq(fork->cpu->PC, 0x1234);
+    cr_assert_eq(fork->cpu->A, 0x56);
+    cr_assert_eq(fork->cpu->rmem, fork->aux);
+    cr_assert_eq(fork->cpu->wmem, fork->main);
+    cr_assert_eq(fork->selected_drive, fork->drive2);
+    cr_assert_eq(fork->main->mach, fork);
+
+    // The zero page goes through a mapper, which must be looking at
+    // the fork, and not at the machine in the DI container
+    apple2_set_memory_mode(fork, MEMORY_DEFAULT);
+    cr_assert_eq(mos6502_get(fork->cpu, 0x10), 0x11);
+    cr_assert_eq(mos6502_get(fork->cpu, 0x300), 0x22);
+
+    mos6502_set(fork->cpu, 0x10, 0x33);
+    mos6502_set(fork->cpu, 0x300, 0x44);
+    cr_assert_eq(mach->main->memory[0x10], 0x11);
+    cr_assert_eq(mach->main->memory[0x300], 0x22);
+    cr_assert_eq(fork->main->memory[0x10], 0x33);
+
+    apple2_free(fork);
+    cr_assert_eq(mach->main->memory[0x300], 0x22);
+}
+
 Test(apple2, is_double_video)
 {
     mach->display_mode = DISPLAY_DEFAULT;
@@ -0,0 +1,190 @@
+#include <criterion/criterion.h>
+#include <unistd.h>
+
+#include "apple2/bd.h"
+#include "apple2/mem.h"
+#include "apple2/tests.h"
+#include "mos6502/enums.h"
+
+static FILE *stream;
+
+/*
+ * Our fixture is a small image of 16 blocks, where every byte of a
+ * block is that block's number.
+ */
+static void
+bd_setup()
+{
+    vm_8bit block[APPLE2_BD_BLOCK_SIZE];
+    int i;
+
+    setup();
+
+    stream = tmpfile();
+    for (i = 0; i < 16; i++) {
+        memset(block, i, sizeof(block));
+        fwrite(block, sizeof(block), 1, stream);
+    }
+
+    fflush(stream);
+}
+
+static void
+bd_teardown()
+{
+    teardown();
+    fclose(stream);
+}
+
+TestSuite(apple2_bd, .init = bd_setup, .fini = bd_teardown);
+
+Test(apple2_bd, create)
+{
+    cr_assert_neq(mach->blockdev, NULL);
+    cr_assert_eq(mach->blockdev->online, false);
+    cr_assert_eq(mach->blockdev->blocks, 0);
+}
+
+Test(apple2_bd, insert)
+{
+    FILE *bad;
+
+    cr_assert_eq(apple2_bd_insert(mach->blockdev, NULL), ERR_BADFILE);
+
+    // Not a whole number of blocks
+    bad = tmpfile();
+    fwrite("abc", 3, 1, bad);
+    fflush(bad);
+    cr_assert_eq(apple2_bd_insert(mach->blockdev, bad), ERR_BADFILE);
+    fclose(bad);
+
+    cr_assert_eq(apple2_bd_insert(mach->blockdev, stream), OK);
+    cr_assert_eq(mach->blockdev->online, true);
+    cr_assert_eq(mach->blockdev->blocks, 16);
+}
+
+Test(apple2_bd, eject)
+{
+    apple2_bd_insert(mach->blockdev, stream);
+    apple2_bd_eject(mach->blockdev);
+
+    cr_assert_eq(mach->blockdev->online, false);
+    cr_assert_eq(mach->blockdev->stream, NULL);
+}
+
+/*
+ * Test(apple2_bd, write_block)
+ */
+Test(apple2_bd, read_block)
+{
+    vm_8bit buf[APPLE2_BD_BLOCK_SIZE];
+
+    cr_assert_eq(apple2_bd_read_block(mach->blockdev, 0, buf), ERR_INVALID);
+
+    apple2_bd_insert(mach->blockdev, stream);
+    cr_assert_eq(apple2_bd_read_block(mach->blockdev, 3, buf), OK);
+    cr_assert_eq(buf[0], 3);
+    cr_assert_eq(buf[511], 3);
+
+    cr_assert_eq(apple2_bd_read_block(mach->blockdev, 16, buf), ERR_OOB);
+
+    memset(buf, 0xAB, sizeof(buf));
+    cr_assert_eq(apple2_bd_write_block(mach->blockdev, 5, buf), OK);
+
+    memset(buf, 0, sizeof(buf));
+    apple2_bd_read_block(mach->blockdev, 5, buf);
+    cr_assert_eq(buf[100], 0xAB);
+
+    mach->blockdev->write_protect = true;
+    cr_assert_eq(apple2_bd_write_block(mach->blockdev, 5, buf), ERR_INVALID);
+}
+
+Test(apple2_bd, init_rom)
+{
+    // These are the bytes that tell ProDOS we're a SmartPort device
+    cr_assert_eq(vm_segment_get(mach->main, 0xC501), 0x20);
+    cr_assert_eq(vm_segment_get(mach->main, 0xC503), 0x00);
+    cr_assert_eq(vm_segment_get(mach->main, 0xC505), 0x03);
+    cr_assert_eq(vm_segment_get(mach->main, 0xC507), 0x00);
+    cr_assert_eq(vm_segment_get(mach->main, 0xC5FF), 0x30);
+}
+
+Test(apple2_bd, map)
+{
+    size_t addr;
+
+    for (addr = 0xC0D0; addr < 0xC0E0; addr++) {
+        cr_assert_eq(mach->main->read_table[addr], apple2_bd_switch_read);
+    }
+}
+
+/*
+ * Test(apple2_bd, switch_read)
+ */
+Test(apple2_bd, prodos)
+{
+    apple2_bd_insert(mach->blockdev, stream);
+
+    // Read block 2 into $2000
+    mos6502_set(mach->cpu, 0x42, BD_READ);
+    mos6502_set(mach->cpu, 0x43, 0x50);
+    mos6502_set16(mach->cpu, 0x44, 0x2000);
+    mos6502_set16(mach->cpu, 0x46, 2);
+
+    cr_assert_eq(vm_segment_get(mach->main, APPLE2_BD_PRODOS_TRAP), BD_OK);
+    cr_assert_eq(mach->cpu->P & MOS_CARRY, 0);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x2000), 2);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x21FF), 2);
+
+    // Status should give us the number of blocks
+    mos6502_set(mach->cpu, 0x42, BD_STATUS);
+    cr_assert_eq(apple2_bd_prodos(mach), BD_OK);
+    cr_assert_eq(mach->cpu->X, 16);
+    cr_assert_eq(mach->cpu->Y, 0);
+
+    // A block that's out of bounds
+    mos6502_set(mach->cpu, 0x42, BD_READ);
+    mos6502_set16(mach->cpu, 0x46, 16);
+    cr_assert_eq(apple2_bd_prodos(mach), BD_BADBLOCK);
+    cr_assert_eq(mach->cpu->P & MOS_CARRY, MOS_CARRY);
+
+    // A drive we don't have
+    mos6502_set(mach->cpu, 0x43, 0xD0);
+    cr_assert_eq(apple2_bd_prodos(mach), BD_NODRIVE);
+}
+
+Test(apple2_bd, smartport)
+{
+    apple2_bd_insert(mach->blockdev, stream);
+
+    // Pretend we've done a JSR from $3000, followed by a READ command
+    // and the address of a parameter list at $3100.
+    mach->cpu->S = 0xFD;
+    mos6502_set16(mach->cpu, 0x1FE, 0x3002);
+    mos6502_set(mach->cpu, 0x3003, BD_READ);
+    mos6502_set16(mach->cpu, 0x3004, 0x3100);
+
+    mos6502_set(mach->cpu, 0x3100, 3);
+    mos6502_set(mach->cpu, 0x3101, 1);
+    mos6502_set16(mach->cpu, 0x3102, 0x2000);
+    mos6502_set(mach->cpu, 0x3104, 7);
+    mos6502_set(mach->cpu, 0x3105, 0);
+    mos6502_set(mach->cpu, 0x3106, 0);
+
+    cr_assert_eq(apple2_bd_smartport(mach), BD_OK);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x2000), 7);
+
+    // The return address should have been moved past the inline
+    // parameters
+    cr_assert_eq(mos6502_get16(mach->cpu, 0x1FE), 0x3005);
+
+    // Now ask for the status of the interface itself
+    mos6502_set16(mach->cpu, 0x1FE, 0x3002);
+    mos6502_set(mach->cpu, 0x3003, BD_STATUS);
+    mos6502_set(mach->cpu, 0x3101, 0);
+    mos6502_set(mach->cpu, 0x3104, 0);
+
+    cr_assert_eq(apple2_bd_smartport(mach), BD_OK);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x2000), 1);
+    cr_assert_eq(mach->cpu->X, 8);
+}
@@ -0,0 +1,83 @@
+#include <criterion/criterion.h>
+
+#include "apple2/cond.h"
+#include "apple2/tests.h"
+
+TestSuite(apple2_cond, .init = setup, .fini = teardown);
+
+/*
+ * Compile and evaluate str against the machine's CPU, and return the
+ * answer.
+ */
+static bool
+cond_holds(const char *str)
+{
+    apple2_cond *cond = apple2_cond_create(str);
+    bool holds;
+
+    cr_assert_neq(cond, NULL);
+    holds = apple2_cond_eval(cond, mach->cpu);
+    apple2_cond_free(cond);
+
+    return holds;
+}
+
+Test(apple2_cond, create)
+{
+    apple2_cond *cond;
+
+    cond = apple2_cond_create("A == $20 && mem[$FF] > 3");
+    cr_assert_neq(cond, NULL);
+    cr_assert_str_eq(cond->source, "A == $20 && mem[$FF] > 3");
+    cr_assert_eq(cond->code[cond->len - 1], COND_END);
+    apple2_cond_free(cond);
+
+    // Things that aren't expressions
+    cr_assert_eq(apple2_cond_create(""), NULL);
+    cr_assert_eq(apple2_cond_create("A =="), NULL);
+    cr_assert_eq(apple2_cond_create("(A == 1"), NULL);
+    cr_assert_eq(apple2_cond_create("mem[1"), NULL);
+    cr_assert_eq(apple2_cond_create("FF"), NULL);
+    cr_assert_eq(apple2_cond_create("A == 1 junk"), NULL);
+    cr_assert_eq(apple2_cond_create("$10000"), NULL);
+
+    // Numbers are hex digits, and only hex digits
+    cr_assert_eq(apple2_cond_create("A == $"), NULL);
+    cr_assert_eq(apple2_cond_create("A == $-1"), NULL);
+    cr_assert_eq(apple2_cond_create("A == $+1"), NULL);
+    cr_assert_eq(apple2_cond_create("A == $0x10"), NULL);
+    cr_assert_eq(apple2_cond_create("A == 0x10"), NULL);
+    cr_assert_eq(apple2_cond_create("A == $ 10"), NULL);
+}
+
+Test(apple2_cond, eval)
+{
+    mach->cpu->A = 0x20;
+    mach->cpu->X = 0x05;
+    mach->cpu->PC = 0x0803;
+    mos6502_set(mach->cpu, 0xFF, 0x04);
+
+    cr_assert(cond_holds("A == $20 && mem[$FF] > 3"));
+    cr_assert(!cond_holds("A == $20 && mem[$FF] > 4"));
+    cr_assert(cond_holds("a == 20 || x == 0"));
+    cr_assert(cond_holds("PC == $803"));
+    cr_assert(cond_holds("X + 1 == 6"));
+    cr_assert(cond_holds("X - 6 == -1"));
+    cr_assert(cond_holds("(A | X) == $25 && (A & X) == 0"));
+    cr_assert(cond_holds("(A ^ $FF) == $DF"));
+    cr_assert(cond_holds("(A ^ $ff) == $0000df"));
+    cr_assert(cond_holds("!(A != $20)"));
+    cr_assert(cond_holds("X >= 5 && X <= 5 && X < 6 && !(X > 5)"));
+
+    // Precedence is as it is in C
+    cr_assert(cond_holds("1 + 1 == 2 && 0 || 1"));
+    cr_assert(cond_holds("mem[$F0 + $0F] == 4"));
+}
+
+Test(apple2_cond, too_deep)
+{
+    // This needs more stack than we have
+    cr_assert_eq(apple2_cond_create(
+        "1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+(1+1))))))))))))))))"),
+        NULL);
+}
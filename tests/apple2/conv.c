@@ -0,0 +1,136 @@
+#include <criterion/criterion.h>
+#include <unistd.h>
+
+#include "apple2/conv.h"
+
+static vm_segment *image;
+static char dir[64];
+
+static void
+setup()
+{
+    int i;
+
+    image = vm_segment_create(_140K_);
+    for (i = 0; i < _140K_; i++) {
+        image->memory[i] = (i * 7) ^ (i >> 8);
+    }
+
+    strcpy(dir, "/tmp/erc-conv.XXXXXX");
+    mkdtemp(dir);
+}
+
+static void
+teardown()
+{
+    char cmd[128];
+
+    vm_segment_free(image);
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+}
+
+TestSuite(apple2_conv, .init = setup, .fini = teardown);
+
+Test(apple2_conv, type)
+{
+    cr_assert_eq(apple2_conv_type("a/b/game.dsk"), DD_DOS33);
+    cr_assert_eq(apple2_conv_type("GAME.DO"), DD_DOS33);
+    cr_assert_eq(apple2_conv_type("game.po"), DD_PRODOS);
+    cr_assert_eq(apple2_conv_type("game.nib"), DD_NIBBLE);
+    cr_assert_eq(apple2_conv_type("game.txt"), DD_NOTYPE);
+    cr_assert_eq(apple2_conv_type("game"), DD_NOTYPE);
+}
+
+Test(apple2_conv, ext)
+{
+    cr_assert_str_eq(apple2_conv_ext(DD_DOS33), "dsk");
+    cr_assert_str_eq(apple2_conv_ext(DD_PRODOS), "po");
+    cr_assert_str_eq(apple2_conv_ext(DD_NIBBLE), "nib");
+    cr_assert_eq(apple2_conv_ext(DD_NOTYPE), NULL);
+}
+
+/*
+ * Test(apple2_conv, canon)
+ */
+Test(apple2_conv, image)
+{
+    vm_segment *po, *dsk;
+
+    cr_assert_eq(apple2_conv_image(DD_NOTYPE, DD_DOS33, image), NULL);
+
+    // Sector 1 of a DOS 3.3 image is sector 14 of a ProDOS one; going
+    // there and back should give us what we started with.
+    po = apple2_conv_image(DD_DOS33, DD_PRODOS, image);
+    cr_assert_neq(po, NULL);
+    cr_assert_eq(memcmp(po->memory, image->memory, ENC_DSECTOR), 0);
+    cr_assert_eq(memcmp(po->memory + (14 * ENC_DSECTOR),
+                        image->memory + ENC_DSECTOR, ENC_DSECTOR), 0);
+
+    dsk = apple2_conv_image(DD_PRODOS, DD_DOS33, po);
+    cr_assert_eq(memcmp(dsk->memory, image->memory, _140K_), 0);
+
+    vm_segment_free(po);
+    vm_segment_free(dsk);
+}
+
+Test(apple2_conv, file)
+{
+    apple2_conv_job job;
+    char src[128], dest[128];
+    FILE *stream;
+
+    snprintf(src, sizeof(src), "%s/game.dsk", dir);
+    snprintf(dest, sizeof(dest), "%s/game.nib", dir);
+
+    stream = fopen(src, "w");
+    vm_segment_fwrite(image, stream, 0, _140K_);
+    fclose(stream);
+
+    job.src = src;
+    job.dest = dest;
+    job.from = DD_DOS33;
+    job.to = DD_NIBBLE;
+
+    cr_assert_eq(apple2_conv_file(&job, true), OK);
+    cr_assert_eq(job.result, OK);
+
+    stream = fopen(dest, "r");
+    fseek(stream, 0, SEEK_END);
+    cr_assert_eq(ftell(stream), APPLE2_CONV_NIB_SIZE);
+    fclose(stream);
+
+    // A source that isn't there
+    job.src = dest;
+    job.from = DD_DOS33;
+    cr_assert_eq(apple2_conv_file(&job, true), ERR_BADFILE);
+}
+
+Test(apple2_conv, run)
+{
+    apple2_conv_job jobs[8];
+    char src[8][128], dest[8][128];
+    FILE *stream;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        snprintf(src[i], sizeof(src[i]), "%s/%d.po", dir, i);
+        snprintf(dest[i], sizeof(dest[i]), "%s/%d.dsk", dir, i);
+
+        // The last one is too short to be an image
+        stream = fopen(src[i], "w");
+        vm_segment_fwrite(image, stream, 0, i == 7 ? 1000 : _140K_);
+        fclose(stream);
+
+        jobs[i].src = src[i];
+        jobs[i].dest = dest[i];
+        jobs[i].from = DD_PRODOS;
+        jobs[i].to = DD_DOS33;
+        jobs[i].result = OK;
+    }
+
+    cr_assert_eq(apple2_conv_run(jobs, 8, 4, true), 1);
+    cr_assert_eq(jobs[0].result, OK);
+    cr_assert_eq(jobs[7].result, ERR_BADFILE);
+}
@@ -342,3 +342,108 @@ Test(apple2_dd, sector_num)
         cr_assert_eq(apple2_dd_sector_num(DD_DOS33, i), dos33[i]);
     }
 }
+
+Test(apple2_dd, count_read)
+{
+    drive->data = vm_segment_create(_140K_);
+    drive->image = drive->data;
+    drive->track_pos = 4;
+
+    apple2_dd_count_read(drive, 0xFF);
+    apple2_dd_count_read(drive, 0xD5);
+    apple2_dd_count_read(drive, 0xAA);
+    cr_assert_eq(drive->stats.sector_reads[2], 0);
+    apple2_dd_count_read(drive, 0xAD);
+
+    cr_assert_eq(drive->stats.bytes_read, 4);
+    cr_assert_eq(drive->stats.sync_skipped, 1);
+    cr_assert_eq(drive->stats.sector_reads[2], 1);
+
+    apple2_dd_read(drive);
+    cr_assert_eq(drive->stats.bytes_read, 5);
+}
+
+Test(apple2_dd, seek_bucket)
+{
+    cr_assert_eq(apple2_dd_seek_bucket(1), 0);
+    cr_assert_eq(apple2_dd_seek_bucket(-1), 0);
+    cr_assert_eq(apple2_dd_seek_bucket(2), 1);
+    cr_assert_eq(apple2_dd_seek_bucket(3), 1);
+    cr_assert_eq(apple2_dd_seek_bucket(4), 2);
+    cr_assert_eq(apple2_dd_seek_bucket(70), 6);
+    cr_assert_eq(apple2_dd_seek_bucket(100000), DD_SEEK_BUCKETS - 1);
+}
+
+Test(apple2_dd, seek_end)
+{
+    apple2_dd_step(drive, 1);
+    apple2_dd_step(drive, 1);
+    apple2_dd_step(drive, 1);
+    cr_assert_eq(drive->stats.half_steps, 3);
+    cr_assert(drive->stats.seeking);
+
+    apple2_dd_seek_end(drive);
+    cr_assert(!drive->stats.seeking);
+    cr_assert_eq(drive->stats.seeks[1], 1);
+
+    // Stepping against the stop doesn't move the head, so it's not a
+    // step at all
+    apple2_dd_step(drive, -100);
+    apple2_dd_step(drive, -1);
+    cr_assert_eq(drive->stats.half_steps, 6);
+
+    // And if we ended up where we started, there's no seek to record
+    apple2_dd_step(drive, 3);
+    apple2_dd_seek_end(drive);
+    cr_assert_eq(drive->stats.seeks[1], 1);
+}
+
+Test(apple2_dd, count_write)
+{
+    drive->data = vm_segment_create(_140K_);
+    drive->image = drive->data;
+
+    drive->latch = 0x12;
+    apple2_dd_write(drive);
+    cr_assert_eq(drive->stats.bytes_written, 0);
+
+    drive->latch = 0x96;
+    apple2_dd_write(drive);
+    cr_assert_eq(drive->stats.bytes_written, 1);
+
+    // We should remember which track we wrote to
+    cr_assert(drive->dirty[0]);
+    cr_assert(!drive->dirty[1]);
+}
+
+Test(apple2_dd, motor)
+{
+    apple2_dd_motor(drive, true, 100);
+    cr_assert(drive->online);
+    cr_assert_eq(apple2_dd_motor_cycles(drive, 150), 50);
+
+    // Turning it on again doesn't restart the clock
+    apple2_dd_motor(drive, true, 120);
+    apple2_dd_motor(drive, false, 200);
+    cr_assert(!drive->online);
+    cr_assert_eq(apple2_dd_motor_cycles(drive, 500), 100);
+
+    apple2_dd_motor(drive, true, 1000);
+    cr_assert_eq(apple2_dd_motor_cycles(drive, 1010), 110);
+}
+
+Test(apple2_dd, stats_dump)
+{
+    char buf[1024];
+    FILE *stream;
+
+    memset(buf, 0, sizeof(buf));
+    stream = fmemopen(buf, sizeof(buf), "w");
+
+    drive->stats.sector_reads[17] = 3;
+    apple2_dd_stats_dump(drive, "drive1", stream, 0);
+    fclose(stream);
+
+    cr_assert_neq(strstr(buf, "drive1: read 0"), NULL);
+    cr_assert_neq(strstr(buf, "T17:3"), NULL);
+}
@@ -124,6 +124,38 @@ Test(apple2_dec, track)
     }
 }
 
+/*
+ * Sectors are interleaved within an encoded track, so we need data that
+ * differs from sector to sector to see they come back where they should.
+ */
+Test(apple2_dec, track_order)
+{
+    vm_segment *orig;
+    vm_segment *enc;
+    vm_segment *dec;
+    int i;
+
+    orig = vm_segment_create(ENC_DTRACK);
+    enc = vm_segment_create(ENC_ETRACK + 0x30);
+    dec = vm_segment_create(ENC_DTRACK);
+
+    for (i = 0; i < ENC_DTRACK; i++) {
+        vm_segment_set(orig, i, i / ENC_DSECTOR);
+    }
+
+    apple2_enc_track(DD_DOS33, enc, orig, 0, 0);
+    cr_assert_eq(apple2_dec_track(DD_DOS33, dec, enc, 0, 0), ENC_DTRACK);
+
+    for (i = 0; i < ENC_DTRACK; i++) {
+        cr_assert_eq(vm_segment_get(dec, i),
+                     vm_segment_get(orig, i));
+    }
+
+    vm_segment_free(orig);
+    vm_segment_free(enc);
+    vm_segment_free(dec);
+}
+
 Test(apple2_dec, dos)
 {
     vm_segment *enc;
@@ -0,0 +1,268 @@
+#include <criterion/criterion.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "apple2/debug.h"
+#include "apple2/gdb.h"
+#include "apple2/tests.h"
+
+#define GDB_TEST_PATH "/tmp/erc-test-gdb.sock"
+
+static apple2_gdb *gdb;
+static int client;
+static char reply[GDB_PACKET_MAX + 8];
+
+static void
+gdb_setup()
+{
+    struct sockaddr_un sun;
+
+    setup();
+
+    gdb = apple2_gdb_create(GDB_TEST_PATH);
+    cr_assert_neq(gdb, NULL);
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, GDB_TEST_PATH);
+
+    client = socket(AF_UNIX, SOCK_STREAM, 0);
+    cr_assert_eq(connect(client, (struct sockaddr *)&sun, sizeof(sun)), 0);
+
+    // We'll be attached once the server sees us
+    mach->paused = true;
+    apple2_gdb_tick(gdb, mach);
+    cr_assert_neq(gdb->client_fd, -1);
+}
+
+static void
+gdb_teardown()
+{
+    close(client);
+    apple2_gdb_free(gdb);
+    apple2_debug_unbreak_all();
+    teardown();
+}
+
+TestSuite(apple2_gdb, .init = gdb_setup, .fini = gdb_teardown);
+
+/*
+ * Send data as a packet, with its checksum.
+ */
+static void
+send_packet(const char *data)
+{
+    char buf[GDB_PACKET_MAX + 8];
+
+    snprintf(buf, sizeof(buf), "$%s#%02x", data,
+             apple2_gdb_checksum(data, strlen(data)));
+    cr_assert_eq(write(client, buf, strlen(buf)), strlen(buf));
+}
+
+/*
+ * Let the server work until it has something for us, and return the
+ * data of the packet it sent (skipping any acknowledgement); or NULL if
+ * it sent nothing.
+ */
+static char *
+recv_packet()
+{
+    struct pollfd pfd = { client, POLLIN, 0 };
+    char *start, *hash;
+    int len = 0;
+    ssize_t n;
+
+    for (int i = 0; i < 20; i++) {
+        apple2_gdb_tick(gdb, mach);
+
+        while (poll(&pfd, 1, 0) > 0) {
+            n = read(client, reply + len, sizeof(reply) - len - 1);
+            if (n <= 0) {
+                break;
+            }
+
+            len += n;
+        }
+
+        reply[len] = '\0';
+        start = strchr(reply, '$');
+        hash = start ? strchr(start, '#') : NULL;
+        if (hash && strlen(hash) >= 3) {
+            *hash = '\0';
+            return start + 1;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Send a packet, and return the reply to it.
+ */
+static char *
+ask(const char *data)
+{
+    send_packet(data);
+    return recv_packet();
+}
+
+Test(apple2_gdb, checksum)
+{
+    cr_assert_eq(apple2_gdb_checksum("OK", 2), 0x9a);
+    cr_assert_eq(apple2_gdb_checksum("", 0), 0);
+}
+
+Test(apple2_gdb, create_bad)
+{
+    cr_assert_eq(apple2_gdb_create("not-a-port"), NULL);
+    cr_assert_eq(apple2_gdb_create("/no/such/dir/sock"), NULL);
+}
+
+Test(apple2_gdb, query)
+{
+    char *r;
+
+    cr_assert_str_eq(ask("?"), "S05");
+    cr_assert_str_eq(ask("qAttached"), "1");
+
+    r = ask("qSupported:multiprocess+");
+    cr_assert_neq(strstr(r, "PacketSize="), NULL);
+
+    // We say nothing about what we don't know
+    cr_assert_str_empty(ask("vMustReplyEmpty"));
+}
+
+Test(apple2_gdb, bad_checksum)
+{
+    char c = 0;
+
+    cr_assert_eq(write(client, "$g#00", 5), 5);
+    apple2_gdb_tick(gdb, mach);
+    cr_assert_eq(read(client, &c, 1), 1);
+    cr_assert_eq(c, '-');
+}
+
+Test(apple2_gdb, regs)
+{
+    mach->cpu->A = 0x12;
+    mach->cpu->X = 0x34;
+    mach->cpu->Y = 0x56;
+    mach->cpu->P = 0x24;
+    mach->cpu->S = 0xfd;
+    mach->cpu->PC = 0x0803;
+
+    cr_assert_str_eq(ask("g"), "12345624fd0308");
+    cr_assert_str_eq(ask("p5"), "0308");
+    cr_assert_str_eq(ask("p0"), "12");
+    cr_assert_str_eq(ask("p9"), "E01");
+
+    cr_assert_str_eq(ask("G0102030405000c"), "OK");
+    cr_assert_eq(mach->cpu->A, 1);
+    cr_assert_eq(mach->cpu->S, 5);
+    cr_assert_eq(mach->cpu->PC, 0x0c00);
+
+    cr_assert_str_eq(ask("P1=99"), "OK");
+    cr_assert_eq(mach->cpu->X, 0x99);
+
+    cr_assert_str_eq(ask("Gzz"), "E01");
+    cr_assert_eq(mach->cpu->A, 1);
+}
+
+Test(apple2_gdb, mem)
+{
+    cr_assert_str_eq(ask("M300,3:a9ff60"), "OK");
+    cr_assert_eq(mos6502_get(mach->cpu, 0x301), 0xff);
+
+    cr_assert_str_eq(ask("m300,3"), "a9ff60");
+    cr_assert_str_eq(ask("mffff,2"), "E01");
+    cr_assert_str_eq(ask("M300,2:zz00"), "E01");
+}
+
+Test(apple2_gdb, break_continue)
+{
+    // LDA #$01; LDA #$02; JMP $0802
+    mos6502_set(mach->cpu, 0x800, 0xA9);
+    mos6502_set(mach->cpu, 0x801, 0x01);
+    mos6502_set(mach->cpu, 0x802, 0xA9);
+    mos6502_set(mach->cpu, 0x803, 0x02);
+    mos6502_set(mach->cpu, 0x804, 0x4C);
+    mos6502_set16(mach->cpu, 0x805, 0x0802);
+    mach->cpu->PC = 0x800;
+
+    cr_assert_str_eq(ask("Z0,804,1"), "OK");
+    cr_assert_eq(apple2_debug_broke(0x804), true);
+
+    cr_assert_str_eq(ask("s"), "S05");
+    cr_assert_eq(mach->cpu->PC, 0x802);
+
+    send_packet("c");
+    recv_packet();
+    cr_assert_eq(mach->paused, false);
+    cr_assert_eq(gdb->running, true);
+
+    // This is what the run loop would do
+    mos6502_execute(mach->cpu);
+    if (apple2_debug_trap(mach->cpu)) {
+        mach->paused = true;
+    }
+
+    cr_assert_str_eq(recv_packet(), "S05");
+    cr_assert_eq(mach->cpu->PC, 0x804);
+    cr_assert_eq(gdb->running, false);
+
+    cr_assert_str_eq(ask("z0,804,1"), "OK");
+    cr_assert_eq(apple2_debug_broke(0x804), false);
+}
+
+Test(apple2_gdb, interrupt)
+{
+    send_packet("c");
+    recv_packet();
+    cr_assert_eq(gdb->running, true);
+    cr_assert_eq(mach->paused, false);
+
+    // While the machine runs, we're only looked at now and then
+    cr_assert_eq(write(client, "\x03", 1), 1);
+    mach->cpu->cycles += GDB_POLL_CYCLES;
+    cr_assert_str_eq(recv_packet(), "S02");
+    cr_assert_eq(mach->paused, true);
+}
+
+Test(apple2_gdb, watch)
+{
+    cr_assert_str_eq(ask("Z2,300,4"), "OK");
+    cr_assert_neq(mach->watch, NULL);
+    cr_assert_eq(mach->watch->points[0].to, 0x303);
+
+    cr_assert_str_eq(ask("z2,300,4"), "OK");
+    cr_assert_eq(mach->watch->npoints, 0);
+}
+
+Test(apple2_gdb, detach)
+{
+    cr_assert_str_eq(ask("D"), "OK");
+    cr_assert_eq(gdb->client_fd, -1);
+    cr_assert_eq(mach->paused, false);
+}
+
+Test(apple2_gdb, stalled)
+{
+    int i;
+
+    // Ask for memory over and over without ever reading the replies.
+    // Once the socket is full, we shouldn't wait on it; we should hold
+    // on to what we can, and then let go of the client.
+    send_packet("QStartNoAckMode");
+    for (i = 0; i < 10000 && gdb->client_fd >= 0; i++) {
+        send_packet("m300,200");
+        apple2_gdb_tick(gdb, mach);
+    }
+
+    cr_assert_eq(gdb->client_fd, -1);
+    cr_assert_eq(gdb->out_len, 0);
+    cr_assert_eq(mach->paused, false);
+}
@@ -0,0 +1,166 @@
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "apple2/bank.h"
+#include "apple2/heat.h"
+#include "apple2/tests.h"
+#include "apple2/watch.h"
+
+TestSuite(apple2_heat, .init = setup, .fini = teardown);
+
+Test(apple2_heat, start)
+{
+    cr_assert_eq(mach->heat, NULL);
+    cr_assert_eq(apple2_heat_start(mach), OK);
+    cr_assert_neq(mach->heat, NULL);
+    cr_assert_eq(mach->heat->mach, mach);
+    cr_assert_eq(mach->heat->counting, true);
+
+    // Every address is ours, in both main and aux memory
+    cr_assert_neq(mach->main->read_table[0x300], NULL);
+    cr_assert_neq(mach->aux->write_table[0x300], NULL);
+
+    // Starting again doesn't make a new heatmap
+    apple2_heat_stop(mach->heat);
+    cr_assert_eq(mach->heat->counting, false);
+    cr_assert_eq(apple2_heat_start(mach), OK);
+    cr_assert_eq(mach->heat->counting, true);
+}
+
+Test(apple2_heat, pages)
+{
+    apple2_heat_start(mach);
+
+    mos6502_set(mach->cpu, 0x300, 0x12);
+    mos6502_set(mach->cpu, 0x3FF, 0x34);
+    cr_assert_eq(mach->heat->page_writes[HEAT_MAIN][0x03], 2);
+
+    // The accesses themselves went through
+    cr_assert_eq(mos6502_get(mach->cpu, 0x300), 0x12);
+    cr_assert_eq(mach->heat->page_reads[HEAT_MAIN][0x03], 1);
+    cr_assert_eq(mach->heat->page_reads[HEAT_AUX][0x03], 0);
+}
+
+Test(apple2_heat, banks)
+{
+    apple2_heat_start(mach);
+
+    // With the default bank switch, reads at $D000 and up come from ROM
+    mos6502_get(mach->cpu, 0xFFFC);
+    cr_assert_eq(mach->heat->page_reads[HEAT_ROM][0xFF], 1);
+
+    mos6502_get(mach->cpu, 0xC600);
+    cr_assert_eq(mach->heat->page_reads[HEAT_ROM][0xC6], 1);
+
+    // The zero page follows ALTZP
+    apple2_set_bank_switch(mach, BANK_ALTZP);
+    mos6502_get(mach->cpu, 0x10);
+    cr_assert_eq(mach->heat->page_reads[HEAT_AUX][0x00], 1);
+    cr_assert_eq(mach->heat->page_reads[HEAT_MAIN][0x00], 0);
+}
+
+Test(apple2_heat, switches)
+{
+    apple2_heat_start(mach);
+
+    mos6502_get(mach->cpu, 0xC030);
+    mos6502_get(mach->cpu, 0xC030);
+    mos6502_set(mach->cpu, 0xC000, 0);
+    cr_assert_eq(mach->heat->switch_reads[0x30], 2);
+    cr_assert_eq(mach->heat->switch_writes[0x00], 1);
+
+    // Soft switches aren't counted in any page
+    cr_assert_eq(mach->heat->page_reads[HEAT_ROM][0xC0], 0);
+    cr_assert_eq(mach->heat->page_reads[HEAT_MAIN][0xC0], 0);
+}
+
+Test(apple2_heat, stop_reset)
+{
+    apple2_heat_start(mach);
+
+    mos6502_get(mach->cpu, 0x300);
+    apple2_heat_stop(mach->heat);
+    mos6502_get(mach->cpu, 0x300);
+    cr_assert_eq(mach->heat->page_reads[HEAT_MAIN][0x03], 1);
+
+    apple2_heat_reset(mach->heat);
+    cr_assert_eq(mach->heat->page_reads[HEAT_MAIN][0x03], 0);
+
+    // Neither is a problem without a heatmap
+    apple2_heat_stop(NULL);
+    apple2_heat_reset(NULL);
+}
+
+Test(apple2_heat, csv)
+{
+    char buf[64];
+    FILE *stream;
+
+    apple2_heat_start(mach);
+    mos6502_get(mach->cpu, 0x300);
+    mos6502_get(mach->cpu, 0xC030);
+
+    stream = tmpfile();
+    apple2_heat_csv(mach->heat, stream);
+    rewind(stream);
+
+    cr_assert_neq(fgets(buf, sizeof(buf), stream), NULL);
+    cr_assert_str_eq(buf, "bank,address,reads,writes\n");
+    cr_assert_neq(fgets(buf, sizeof(buf), stream), NULL);
+    cr_assert_str_eq(buf, "main,0000,0,0\n");
+
+    // The last row is the one soft switch we touched
+    while (fgets(buf, sizeof(buf), stream)) {
+        if (strncmp(buf, "switch", 6) == 0) {
+            break;
+        }
+    }
+
+    cr_assert_str_eq(buf, "switch,C030,1,0\n");
+    fclose(stream);
+}
+
+Test(apple2_heat, dump)
+{
+    char buf[64];
+    FILE *stream;
+
+    stream = tmpfile();
+    apple2_heat_dump(NULL, stream);
+    rewind(stream);
+    cr_assert_neq(fgets(buf, sizeof(buf), stream), NULL);
+    cr_assert_str_eq(buf, "heatmap: not counting\n");
+    fclose(stream);
+
+    apple2_heat_start(mach);
+    mos6502_get(mach->cpu, 0x300);
+
+    stream = tmpfile();
+    apple2_heat_dump(mach->heat, stream);
+    rewind(stream);
+    cr_assert_neq(fgets(buf, sizeof(buf), stream), NULL);
+    cr_assert_str_eq(buf, "heatmap: main, 1 reads, 0 writes\n");
+    fclose(stream);
+}
+
+Test(apple2_heat, watch)
+{
+    // A watchpoint under the heatmap can't be taken out of the chain of
+    // mappers; watching it again must not put it in a second time.
+    apple2_watch_add(mach, 0x300, 0x300, WATCH_WRITE);
+    apple2_heat_start(mach);
+    apple2_watch_remove(mach, 0x300);
+    apple2_watch_add(mach, 0x300, 0x300, WATCH_WRITE);
+
+    mos6502_set(mach->cpu, 0x300, 0x12);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x300), 0x12);
+    cr_assert_eq(mach->heat->page_writes[HEAT_MAIN][0x03], 1);
+    cr_assert_eq(mach->watch->points[0].hits, 1);
+
+    // And with the heatmap under the watchpoint, taking the watchpoint
+    // away leaves the heatmap in place
+    apple2_watch_add(mach, 0x400, 0x400, WATCH_WRITE);
+    apple2_watch_remove(mach, 0x400);
+    mos6502_set(mach->cpu, 0x400, 0x34);
+    cr_assert_eq(mach->heat->page_writes[HEAT_MAIN][0x04], 1);
+}
@@ -8,3 +8,35 @@ TestSuite(apple2_hires, .init = setup, .fini = teardown);
 Test(apple2_hires, draw)
 {
 }
+
+Test(apple2_hires, frame)
+{
+    char header[16];
+    vm_8bit rgb[3];
+    FILE *stream;
+
+    // Two dots next to each other in the first row should come out
+    // white
+    mos6502_set(mach->cpu, 0x2000, 0x03);
+
+    stream = tmpfile();
+    apple2_hires_frame(mach, stream);
+    cr_assert_eq(ftell(stream), 15 + (280 * 192 * 3));
+
+    rewind(stream);
+    fread(header, 1, 15, stream);
+    header[15] = '\0';
+    cr_assert_str_eq(header, "P6\n280 192\n255\n");
+
+    fread(rgb, 1, 3, stream);
+    cr_assert_eq(rgb[0], 0xff);
+    cr_assert_eq(rgb[1], 0xff);
+    cr_assert_eq(rgb[2], 0xff);
+
+    // And the next row should be all black
+    fseek(stream, 15 + (280 * 3), SEEK_SET);
+    fread(rgb, 1, 3, stream);
+    cr_assert_eq(rgb[0], 0);
+
+    fclose(stream);
+}
@@ -0,0 +1,237 @@
+#include <criterion/criterion.h>
+#include <unistd.h>
+
+#include "apple2/bd.h"
+#include "apple2/hostdir.h"
+
+static apple2bd *bd;
+static char dir[64];
+static char path[128];
+
+/*
+ * Write a file of the given length into our fixture directory, where
+ * each byte is the low byte of its offset.
+ */
+static void
+make_file(const char *name, size_t len)
+{
+    FILE *stream;
+    size_t i;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    stream = fopen(path, "w");
+
+    for (i = 0; i < len; i++) {
+        fputc(i & 0xFF, stream);
+    }
+
+    fclose(stream);
+}
+
+static void
+setup()
+{
+    strcpy(dir, "/tmp/erc-hostdir.XXXXXX");
+    mkdtemp(dir);
+
+    make_file("hello.txt", 100);
+    make_file("prog.bin", 2000);
+    make_file("big", 200000);
+
+    bd = apple2_bd_create();
+}
+
+static void
+teardown()
+{
+    char cmd[128];
+
+    apple2_bd_free(bd);
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+}
+
+TestSuite(apple2_hostdir, .init = setup, .fini = teardown);
+
+Test(apple2_hostdir, name)
+{
+    char name[HOSTDIR_NAME_MAX + 1];
+
+    cr_assert_eq(apple2_hostdir_name(name, "hello.txt"), OK);
+    cr_assert_str_eq(name, "HELLO.TXT");
+
+    cr_assert_eq(apple2_hostdir_name(name, "1st-file_name.is.long"), OK);
+    cr_assert_str_eq(name, "ST.FILE.NAME.IS");
+
+    cr_assert_eq(apple2_hostdir_name(name, "123"), ERR_INVALID);
+}
+
+Test(apple2_hostdir, type)
+{
+    cr_assert_eq(apple2_hostdir_type("HELLO.TXT"), 0x04);
+    cr_assert_eq(apple2_hostdir_type("STARTUP.bas"), 0xFC);
+    cr_assert_eq(apple2_hostdir_type("PRODOS.SYS"), 0xFF);
+    cr_assert_eq(apple2_hostdir_type("WHATEVER"), 0x06);
+}
+
+Test(apple2_hostdir, insert)
+{
+    cr_assert_eq(apple2_hostdir_insert(bd, "/tmp/erc-no-such-dir"),
+                 ERR_BADFILE);
+
+    cr_assert_eq(apple2_hostdir_insert(bd, dir), OK);
+    cr_assert_eq(bd->online, true);
+    cr_assert_eq(bd->blocks, APPLE2_BD_MAX_BLOCKS);
+}
+
+Test(apple2_hostdir, full)
+{
+    apple2_hostdir *hd;
+
+    // Three files of 12 megabytes, of which only two fit on the volume.
+    // They needn't take up any space on the host.
+    make_file("huge1", 0);
+    truncate(path, 12000000);
+    make_file("huge2", 0);
+    truncate(path, 12000000);
+    make_file("huge3", 0);
+    truncate(path, 12000000);
+
+    cr_assert_eq(apple2_hostdir_insert(bd, dir), OK);
+
+    // BIG, HELLO.TXT, HUGE1, and HUGE2 fit; HUGE3 and PROG.BIN (which
+    // follow it) are left out.
+    hd = (apple2_hostdir *)bd->backend;
+    cr_assert_eq(hd->nfiles, 4);
+    cr_assert_str_eq(hd->files[3].name, "HUGE2");
+}
+
+Test(apple2_hostdir, same_name)
+{
+    apple2_hostdir *hd;
+
+    // Both hello-txt and hello.txt come out as HELLO.TXT; the one we
+    // keep is the first by host name, whatever order the directory is
+    // in.
+    make_file("hello-txt", 7);
+
+    apple2_hostdir_insert(bd, dir);
+    hd = (apple2_hostdir *)bd->backend;
+
+    cr_assert_eq(hd->nfiles, 3);
+    cr_assert_str_eq(hd->files[1].name, "HELLO.TXT");
+    cr_assert_eq(hd->files[1].eof, 7);
+}
+
+Test(apple2_hostdir, too_many)
+{
+    apple2_hostdir *hd;
+    char name[8];
+
+    // With more files than the volume directory holds, we keep those
+    // that come first by name: BIG, and F00 through F49.
+    for (int i = 0; i < 60; i++) {
+        snprintf(name, sizeof(name), "f%02d", i);
+        make_file(name, 1);
+    }
+
+    apple2_hostdir_insert(bd, dir);
+    hd = (apple2_hostdir *)bd->backend;
+
+    cr_assert_eq(hd->nfiles, HOSTDIR_MAX_FILES);
+    cr_assert_str_eq(hd->files[0].name, "BIG");
+    cr_assert_str_eq(hd->files[HOSTDIR_MAX_FILES - 1].name, "F49");
+}
+
+Test(apple2_hostdir, read)
+{
+    vm_8bit buf[APPLE2_BD_BLOCK_SIZE];
+    vm_8bit *ent;
+    size_t key, index;
+
+    apple2_hostdir_insert(bd, dir);
+
+    cr_assert_eq(apple2_bd_read_block(bd, HOSTDIR_DIR_BLOCK, buf), OK);
+
+    // The volume header, and then files sorted by name: BIG, HELLO.TXT,
+    // and PROG.BIN.
+    cr_assert_eq(buf[4] & 0xF0, 0xF0);
+    cr_assert_eq(buf[4 + 33], 3);
+
+    ent = buf + 4 + HOSTDIR_ENTRY_LENGTH;
+    cr_assert_eq(ent[0], (HOSTDIR_TREE << 4) | 3);
+    cr_assert_eq(memcmp(ent + 1, "BIG", 3), 0);
+
+    ent += HOSTDIR_ENTRY_LENGTH;
+    cr_assert_eq(ent[0], (HOSTDIR_SEEDLING << 4) | 9);
+    cr_assert_eq(ent[16], 0x04);
+    cr_assert_eq(ent[21], 100);
+
+    ent += HOSTDIR_ENTRY_LENGTH;
+    cr_assert_eq(ent[0], (HOSTDIR_SAPLING << 4) | 8);
+    key = ent[17] | (ent[18] << 8);
+
+    // The key block of a sapling is its index; the fourth data block of
+    // the file should hold the bytes from offset 1536 on.
+    apple2_bd_read_block(bd, key, buf);
+    index = buf[3] | (buf[256 + 3] << 8);
+
+    apple2_bd_read_block(bd, index, buf);
+    cr_assert_eq(buf[0], 1536 & 0xFF);
+    cr_assert_eq(buf[463], (1536 + 463) & 0xFF);
+    cr_assert_eq(buf[464], 0);
+
+    // Nothing should be free before the end of the last file, and
+    // everything should be free after it.
+    apple2_bd_read_block(bd, HOSTDIR_BITMAP_BLOCK, buf);
+    cr_assert_eq(buf[0], 0);
+    cr_assert_eq(buf[200], 0xFF);
+}
+
+Test(apple2_hostdir, commit)
+{
+    vm_8bit buf[APPLE2_BD_BLOCK_SIZE];
+    vm_8bit *ent;
+    size_t key;
+    FILE *stream;
+
+    apple2_hostdir_insert(bd, dir);
+
+    // Change the first byte of HELLO.TXT
+    apple2_bd_read_block(bd, HOSTDIR_DIR_BLOCK, buf);
+    ent = buf + 4 + (2 * HOSTDIR_ENTRY_LENGTH);
+    key = ent[17] | (ent[18] << 8);
+
+    apple2_bd_read_block(bd, key, buf);
+    buf[0] = 'X';
+    apple2_bd_write_block(bd, key, buf);
+
+    // Nothing should have been written until the directory is
+    snprintf(path, sizeof(path), "%s/hello.txt", dir);
+    stream = fopen(path, "r");
+    cr_assert_eq(fgetc(stream), 0);
+    fclose(stream);
+
+    // Now add a new file in the last slot of the first block, which
+    // reuses HELLO.TXT's data block, but is only 10 bytes long.
+    apple2_bd_read_block(bd, HOSTDIR_DIR_BLOCK, buf);
+    ent = buf + 4 + (12 * HOSTDIR_ENTRY_LENGTH);
+    ent[0] = (HOSTDIR_SEEDLING << 4) | 3;
+    memcpy(ent + 1, "NEW", 3);
+    ent[17] = key & 0xFF;
+    ent[18] = key >> 8;
+    ent[21] = 10;
+    apple2_bd_write_block(bd, HOSTDIR_DIR_BLOCK, buf);
+
+    stream = fopen(path, "r");
+    cr_assert_eq(fgetc(stream), 'X');
+    fclose(stream);
+
+    snprintf(path, sizeof(path), "%s/new", dir);
+    stream = fopen(path, "r");
+    cr_assert_neq(stream, NULL);
+    fseek(stream, 0, SEEK_END);
+    cr_assert_eq(ftell(stream), 10);
+    fclose(stream);
+}
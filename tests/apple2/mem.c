@@ -62,3 +62,42 @@ Test(apple2_mem, zp_read)
     cr_assert_neq(mach->main->memory[0], 234);
     cr_assert_eq(mach->aux->memory[0], 234);
 }
+
+Test(apple2_mem, peek)
+{
+    vm_8bit buf[4];
+
+    // The zero page follows BANK_ALTZP, as a read would (and switching
+    // it on copies the zero page over, so we write aux after)
+    apple2_set_bank_switch(mach, BANK_DEFAULT);
+    mach->main->memory[0x10] = 0x11;
+    cr_assert_eq(mos6502_peek(mach->cpu, 0x10), 0x11);
+    apple2_set_bank_switch(mach, BANK_ALTZP);
+    mach->aux->memory[0x10] = 0x22;
+    cr_assert_eq(mos6502_peek(mach->cpu, 0x10), 0x22);
+
+    // ROM is where a read would find it
+    apple2_set_bank_switch(mach, BANK_DEFAULT);
+    cr_assert_eq(mos6502_peek(mach->cpu, 0xFFFC),
+                 mos6502_get(mach->cpu, 0xFFFC));
+
+    // And the soft switches are zero, and stay as they were
+    mach->strobe = true;
+    cr_assert_eq(mos6502_peek(mach->cpu, 0xC010), 0);
+    cr_assert_eq(mach->strobe, true);
+
+    cr_assert_eq(vm_segment_peek_range(mach->cpu->rmem, buf, 0xC054, 4), OK);
+    cr_assert_eq(mach->memory_mode & MEMORY_PAGE2, 0);
+}
+
+Test(apple2_mem, poke)
+{
+    apple2_set_bank_switch(mach, BANK_ALTZP);
+    vm_segment_poke(mach->cpu->wmem, 0x10, 0x33);
+    cr_assert_eq(mach->aux->memory[0x10], 0x33);
+    cr_assert_neq(mach->main->memory[0x10], 0x33);
+
+    // A poke into a soft switch doesn't flip it
+    vm_segment_poke(mach->cpu->wmem, 0xC055, 0);
+    cr_assert_eq(mach->memory_mode & MEMORY_PAGE2, 0);
+}
@@ -0,0 +1,107 @@
+#include <criterion/criterion.h>
+#include <unistd.h>
+
+#include "apple2/dd.h"
+#include "apple2/enc.h"
+#include "apple2/ncache.h"
+#include "vm_di.h"
+
+static vm_segment *image;
+static char dir[] = "/tmp/erc-ncache.XXXXXX";
+
+static void
+setup()
+{
+    int i;
+
+    image = vm_segment_create(_140K_);
+    for (i = 0; i < _140K_; i++) {
+        image->memory[i] = i & 0xff;
+    }
+
+    strcpy(dir, "/tmp/erc-ncache.XXXXXX");
+    mkdtemp(dir);
+    vm_di_set(VM_NIBCACHE, dir);
+}
+
+static void
+teardown()
+{
+    char path[NCACHE_PATH_MAX];
+
+    apple2_ncache_path(path, sizeof(path), dir,
+                       apple2_ncache_key(DD_DOS33, image), DD_DOS33);
+    unlink(path);
+    rmdir(dir);
+
+    vm_di_set(VM_NIBCACHE, NULL);
+    vm_segment_free(image);
+}
+
+TestSuite(apple2_ncache, .init = setup, .fini = teardown);
+
+Test(apple2_ncache, key)
+{
+    uint64_t key = apple2_ncache_key(DD_DOS33, image);
+
+    cr_assert_eq(key, apple2_ncache_key(DD_DOS33, image));
+    cr_assert_neq(key, apple2_ncache_key(DD_PRODOS, image));
+
+    image->memory[1000] ^= 0xff;
+    cr_assert_neq(key, apple2_ncache_key(DD_DOS33, image));
+}
+
+Test(apple2_ncache, path)
+{
+    char buf[64];
+
+    cr_assert_eq(apple2_ncache_path(buf, sizeof(buf), "/a", 0x1234, 2), OK);
+    cr_assert_str_eq(buf, "/a/0000000000001234-2.nib");
+
+    cr_assert_eq(apple2_ncache_path(buf, 8, "/a", 0x1234, 2), ERR_OOB);
+}
+
+Test(apple2_ncache, load)
+{
+    cr_assert_eq(apple2_ncache_load("/tmp/erc-ncache-nothing.nib"), NULL);
+}
+
+Test(apple2_ncache, store)
+{
+    char path[NCACHE_PATH_MAX];
+    vm_segment *seg, *loaded;
+
+    seg = vm_segment_create(_140K_NIB_);
+    seg->memory[0] = 0xd5;
+
+    snprintf(path, sizeof(path), "%s/store.nib", dir);
+    cr_assert_eq(apple2_ncache_store(path, seg), OK);
+
+    loaded = apple2_ncache_load(path);
+    cr_assert_neq(loaded, NULL);
+    cr_assert_eq(loaded->mapped, true);
+    cr_assert_eq(loaded->memory[0], 0xd5);
+
+    vm_segment_free(loaded);
+    vm_segment_free(seg);
+    unlink(path);
+}
+
+Test(apple2_ncache, encode)
+{
+    vm_segment *miss, *hit;
+
+    // The first time should miss, and give us a normal segment from the
+    // encoder; the second should map in what we saved the first time.
+    miss = apple2_ncache_encode(DD_DOS33, image);
+    cr_assert_neq(miss, NULL);
+    cr_assert_eq(miss->mapped, false);
+
+    hit = apple2_ncache_encode(DD_DOS33, image);
+    cr_assert_neq(hit, NULL);
+    cr_assert_eq(hit->mapped, true);
+    cr_assert_eq(memcmp(miss->memory, hit->memory, _140K_NIB_), 0);
+
+    vm_segment_free(miss);
+    vm_segment_free(hit);
+}
@@ -0,0 +1,180 @@
+#include <criterion/criterion.h>
+
+#include "apple2/apple2.h"
+#include "apple2/pool.h"
+
+#define NMACHS 4
+
+static apple2 *machs[NMACHS];
+static apple2_pool *pool;
+
+static void
+setup()
+{
+    for (int i = 0; i < NMACHS; i++) {
+        machs[i] = apple2_create(100, 100);
+
+        // A little program that counts up in $10 forever
+        mos6502_set(machs[i]->cpu, 0x800, 0xE6);        // INC $10
+        mos6502_set(machs[i]->cpu, 0x801, 0x10);
+        mos6502_set(machs[i]->cpu, 0x802, 0x4C);        // JMP $0800
+        mos6502_set16(machs[i]->cpu, 0x803, 0x0800);
+
+        machs[i]->cpu->PC = 0x800;
+    }
+
+    pool = apple2_pool_create(2, 1000);
+}
+
+static void
+teardown()
+{
+    apple2_pool_free(pool);
+
+    for (int i = 0; i < NMACHS; i++) {
+        apple2_free(machs[i]);
+    }
+}
+
+TestSuite(apple2_pool, .init = setup, .fini = teardown);
+
+Test(apple2_pool, create)
+{
+    cr_assert_neq(pool, NULL);
+    cr_assert_eq(pool->nworkers, 2);
+    cr_assert_eq(pool->quantum, 1000);
+    cr_assert_eq(pool->ninsts, 0);
+
+    apple2_pool *other = apple2_pool_create(1, 0);
+    cr_assert_eq(other->quantum, APPLE2_FRAME_CYCLES);
+    apple2_pool_free(other);
+
+    cr_assert_eq(apple2_pool_create(0, 0), NULL);
+}
+
+Test(apple2_pool, budget)
+{
+    apple2_pool_inst *insts[NMACHS];
+
+    for (int i = 0; i < NMACHS; i++) {
+        insts[i] = apple2_pool_add(pool, machs[i], 50000);
+        cr_assert_neq(insts[i], NULL);
+        cr_assert_eq(insts[i]->state, POOL_READY);
+    }
+
+    cr_assert_eq(pool->pending, NMACHS);
+    cr_assert_eq(apple2_pool_start(pool), OK);
+    apple2_pool_wait(pool);
+
+    for (int i = 0; i < NMACHS; i++) {
+        cr_assert_eq(insts[i]->state, POOL_DONE);
+        cr_assert(insts[i]->cycles >= 50000);
+        cr_assert(insts[i]->cycles < 50000 + 8);
+        cr_assert(insts[i]->slices >= 50);
+        cr_assert_eq(insts[i]->parks, 0);
+        cr_assert_neq(mos6502_get(machs[i]->cpu, 0x10), 0);
+    }
+
+    cr_assert_eq(pool->pending, 0);
+    cr_assert_eq(pool->running, 0);
+    cr_assert(apple2_pool_fairness(pool) > 0.0);
+    cr_assert(apple2_pool_fairness(pool) <= 1.0);
+}
+
+Test(apple2_pool, park)
+{
+    apple2 *mach = machs[0];
+    apple2_pool_inst *inst;
+
+    // This program waits for a key, and puts it in $10
+    mos6502_set(mach->cpu, 0x800, 0xAD);        // LDA $C000
+    mos6502_set16(mach->cpu, 0x801, 0xC000);
+    mos6502_set(mach->cpu, 0x803, 0x10);        // BPL $0800
+    mos6502_set(mach->cpu, 0x804, 0xFB);
+    mos6502_set(mach->cpu, 0x805, 0x85);        // STA $10
+    mos6502_set(mach->cpu, 0x806, 0x10);
+    mos6502_set(mach->cpu, 0x807, 0x2C);        // BIT $C010
+    mos6502_set16(mach->cpu, 0x808, 0xC010);
+    mos6502_set(mach->cpu, 0x80A, 0x4C);        // JMP $0800
+    mos6502_set16(mach->cpu, 0x80B, 0x0800);
+
+    inst = apple2_pool_add(pool, mach, 0);
+    cr_assert_eq(apple2_pool_start(pool), OK);
+
+    // With nothing to do but wait, it should park after its first slice
+    apple2_pool_wait(pool);
+    cr_assert_eq(inst->state, POOL_PARKED);
+    cr_assert_eq(inst->parks, 1);
+    cr_assert_eq(inst->slices, 1);
+
+    cr_assert_eq(apple2_pool_key(pool, inst, 'A'), OK);
+    apple2_pool_wait(pool);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x10), 'A' | 0x80);
+    cr_assert_eq(inst->state, POOL_PARKED);
+    cr_assert_eq(inst->parks, 2);
+
+    // Keys we give it while it's stopped wait their turn
+    apple2_pool_stop(pool);
+    for (int i = 0; i < POOL_KEYS; i++) {
+        cr_assert_eq(apple2_pool_key(pool, inst, 'B'), OK);
+    }
+
+    cr_assert_eq(apple2_pool_key(pool, inst, 'B'), ERR_OOB);
+    cr_assert_eq(inst->state, POOL_READY);
+}
+
+Test(apple2_pool, steal)
+{
+    apple2_pool_worker *w0 = &pool->workers[0], *w1 = &pool->workers[1];
+    apple2_pool_inst *insts[NMACHS];
+    uint64_t slices = 0;
+
+    for (int i = 0; i < NMACHS; i++) {
+        insts[i] = apple2_pool_add(pool, machs[i], 20000);
+    }
+
+    // Move everything into the first worker's queue, so the second can
+    // only get work by stealing it. (Nothing is running yet, so we can
+    // get away with this.)
+    while (w1->count) {
+        w0->queue[(w0->head + w0->count++) % w0->cap] =
+            w1->queue[w1->head];
+        w1->head = (w1->head + 1) % w1->cap;
+        w1->count--;
+    }
+
+    cr_assert_eq(w0->count, NMACHS);
+
+    apple2_pool_start(pool);
+    apple2_pool_wait(pool);
+
+    for (int i = 0; i < NMACHS; i++) {
+        cr_assert_eq(insts[i]->state, POOL_DONE);
+        slices += insts[i]->slices;
+    }
+
+    cr_assert_eq(w0->slices + w1->slices, slices);
+
+    if (w1->slices) {
+        cr_assert(w1->steals > 0);
+    }
+}
+
+Test(apple2_pool, stats_dump)
+{
+    char line[128];
+    FILE *stream;
+
+    apple2_pool_add(pool, machs[0], 5000);
+    apple2_pool_start(pool);
+    apple2_pool_wait(pool);
+
+    stream = tmpfile();
+    apple2_pool_stats_dump(pool, stream);
+    rewind(stream);
+
+    fgets(line, sizeof(line), stream);
+    cr_assert_str_eq(line, "pool: 2 workers, 1 instances, quantum 1000\n");
+
+    fclose(stream);
+}
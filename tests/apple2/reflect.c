@@ -1,59 +1,114 @@
 #include <criterion/criterion.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "apple2/apple2.h"
-#include "apple2/event.h"
-#include "vm_di.h"
+#include "apple2/reflect.h"
 
 static apple2 *mach;
+static apple2_reflect *rf;
 
 static void
 setup()
 {
     mach = apple2_create(100, 100);
-
-    mach->paused = false;
-    mach->debug = false;
-
-    vm_di_set(VM_PAUSE_FUNC, NULL);
-    vm_di_set(VM_DEBUG_FUNC, NULL);
-
-    apple2_event_init();
+    rf = apple2_reflect_create("erc-test-reflect");
 }
 
 static void
 teardown()
 {
-    apple2_free(mach);
+    if (rf) {
+        apple2_reflect_free(rf);
+    }
 
-    vm_di_set(VM_PAUSE_FUNC, NULL);
-    vm_di_set(VM_DEBUG_FUNC, NULL);
+    apple2_free(mach);
 }
 
-TestSuite(apple2_event, .init = setup, .fini = teardown);
+TestSuite(apple2_reflect, .init = setup, .fini = teardown);
 
-Test(apple2_event, init)
+Test(apple2_reflect, create)
 {
-    cr_assert_neq(vm_di_get(VM_PAUSE_FUNC), NULL);
-    cr_assert_neq(vm_di_get(VM_DEBUG_FUNC), NULL);
+    cr_assert_neq(rf, NULL);
+    cr_assert_str_eq(rf->name, "/erc-test-reflect");
+    cr_assert_eq(rf->state->magic, REFLECT_MAGIC);
+    cr_assert_eq(rf->state->version, REFLECT_VERSION);
+    cr_assert_eq(rf->state->size, sizeof(apple2_reflect_state));
+    cr_assert_eq(rf->state->seq, 0);
 }
 
-/* Test(apple2_reflect, cpu_info) */
-/* Test(apple2_reflect, machine_info) */
+Test(apple2_reflect, free)
+{
+    apple2_reflect_free(rf);
+    rf = NULL;
+
+    cr_assert_eq(shm_open("/erc-test-reflect", O_RDONLY, 0), -1);
+}
 
-Test(apple2_event, pause)
+Test(apple2_reflect, update)
 {
-    apple2_event_pause(mach);
-    cr_assert_eq(mach->paused, true);
-    apple2_event_pause(mach);
-    cr_assert_eq(mach->paused, false);
+    apple2_reflect_state *view;
+    int fd;
+
+    mach->cpu->PC = 0x1234;
+    mach->cpu->A = 0x56;
+    mach->display_mode = DISPLAY_HIRES;
+    mos6502_set(mach->cpu, 0x2000, 0x77);
+    vm_segment_set(mach->aux, 0x2000, 0x88);
+
+    apple2_reflect_update(rf, mach);
+
+    // Someone else looking at the shared memory should see what we
+    // published
+    fd = shm_open("/erc-test-reflect", O_RDONLY, 0);
+    cr_assert(fd >= 0);
+
+    view = mmap(NULL, sizeof(apple2_reflect_state), PROT_READ, MAP_SHARED,
+                fd, 0);
+    cr_assert_neq(view, MAP_FAILED);
+
+    cr_assert_eq(view->seq, 2);
+    cr_assert_eq(view->frames, 1);
+    cr_assert_eq(view->PC, 0x1234);
+    cr_assert_eq(view->A, 0x56);
+    cr_assert_eq(view->display_mode, DISPLAY_HIRES);
+    cr_assert_eq(view->selected_drive, 1);
+    cr_assert_eq(view->main[0x2000], 0x77);
+    cr_assert_eq(view->aux[0x2000], 0x88);
+
+    munmap(view, sizeof(apple2_reflect_state));
+    close(fd);
 }
 
-Test(apple2_event, debug)
+Test(apple2_reflect, tick)
 {
-    apple2_event_debug(mach);
-    cr_assert_eq(mach->paused, true);
-    cr_assert_eq(mach->debug, true);
-    apple2_event_debug(mach);
-    cr_assert_eq(mach->paused, true);
-    cr_assert_eq(mach->debug, true);
+    // A program that does nothing but jump to itself
+    mos6502_set(mach->cpu, 0x800, 0x4C);        // JMP $0800
+    mos6502_set16(mach->cpu, 0x801, 0x0800);
+    mach->cpu->PC = 0x800;
+
+    apple2_reflect_tick(rf, mach);
+    cr_assert_eq(rf->state->frames, 1);
+    cr_assert_eq(rf->instructions, 1);
+
+    // Nothing more is published until a frame has gone by
+    while (mach->cpu->cycles < APPLE2_FRAME_CYCLES - 3) {
+        mos6502_execute(mach->cpu);
+        apple2_reflect_tick(rf, mach);
+    }
+
+    cr_assert_eq(rf->state->frames, 1);
+
+    mos6502_execute(mach->cpu);
+    apple2_reflect_tick(rf, mach);
+    cr_assert_eq(rf->state->frames, 2);
+    cr_assert_eq(rf->state->cycles, mach->cpu->cycles);
+    cr_assert_eq(rf->state->instructions, rf->instructions);
+    cr_assert_eq(rf->state->seq, 4);
+
+    // If the machine goes back in time, we publish at once
+    mach->cpu->cycles = 0;
+    apple2_reflect_tick(rf, mach);
+    cr_assert_eq(rf->state->frames, 3);
 }
@@ -0,0 +1,152 @@
+#include <criterion/criterion.h>
+
+#include "apple2/apple2.h"
+#include "apple2/dd.h"
+#include "apple2/replay.h"
+#include "apple2/state.h"
+
+static apple2 *mach;
+static apple2 *copy;
+static FILE *stream;
+
+static void
+setup()
+{
+    mach = apple2_create(100, 100);
+    copy = apple2_create(100, 100);
+    stream = tmpfile();
+}
+
+static void
+teardown()
+{
+    apple2_free(mach);
+    apple2_free(copy);
+    fclose(stream);
+}
+
+TestSuite(apple2_replay, .init = setup, .fini = teardown);
+
+Test(apple2_replay, create)
+{
+    cr_assert_neq(mach->replay, NULL);
+    cr_assert_eq(mach->replay->mode, REPLAY_OFF);
+    cr_assert_eq(mach->replay->stream, NULL);
+}
+
+Test(apple2_replay, record_play)
+{
+    apple2_replay *rp = mach->replay;
+    vm_8bit noise[3];
+    FILE *disk;
+
+    mach->cpu->cycles = 1000;
+    mach->main->memory[0x300] = 0xEA;
+    cr_assert_eq(apple2_replay_record(rp, mach, stream), OK);
+    cr_assert_eq(rp->mode, REPLAY_RECORD);
+
+    // Nothing has changed, so there's nothing to record
+    apple2_replay_tick(rp, mach);
+    cr_assert_eq(rp->events, 0);
+
+    mach->cpu->cycles = 1500;
+    mach->screen->last_key = 'A';
+    mach->screen->key_pressed = true;
+    apple2_replay_tick(rp, mach);
+    cr_assert_eq(rp->events, 1);
+
+    for (int i = 0; i < 3; i++) {
+        noise[i] = apple2_replay_noise(rp);
+    }
+
+    mach->cpu->cycles = 2000;
+    disk = fopen("../data/zero.img", "r");
+    cr_assert_eq(apple2_replay_insert(rp, mach, 2, disk, DD_DOS33), OK);
+    cr_assert_eq(rp->events, 5);
+
+    mach->cpu->cycles = 2500;
+    mach->screen->key_pressed = false;
+    apple2_replay_tick(rp, mach);
+
+    apple2_replay_stop(rp);
+    cr_assert_eq(rp->mode, REPLAY_OFF);
+
+    // Now let's see if we get all of that back
+    rp = copy->replay;
+    rewind(stream);
+    cr_assert_eq(apple2_replay_play(rp, copy, stream), OK);
+    cr_assert_eq(rp->mode, REPLAY_PLAY);
+    cr_assert_eq(copy->cpu->cycles, 1000);
+    cr_assert_eq(copy->main->memory[0x300], 0xEA);
+    cr_assert_eq(rp->next, REPLAY_KEY);
+    cr_assert_eq(rp->next_cycles, 1500);
+
+    // Keys from the host shouldn't get through
+    copy->screen->last_key = 'Z';
+    copy->cpu->cycles = 1499;
+    apple2_replay_tick(rp, copy);
+    cr_assert_eq(copy->screen->last_key, '\0');
+
+    copy->cpu->cycles = 1500;
+    apple2_replay_tick(rp, copy);
+    cr_assert_eq(copy->screen->last_key, 'A');
+    cr_assert_eq(copy->screen->key_pressed, true);
+
+    for (int i = 0; i < 3; i++) {
+        cr_assert_eq(apple2_replay_noise(rp), noise[i]);
+    }
+
+    cr_assert_eq(copy->drive2->data, NULL);
+    copy->cpu->cycles = 2600;
+    apple2_replay_tick(rp, copy);
+    cr_assert_neq(copy->drive2->data, NULL);
+    cr_assert_eq(copy->drive2->image->size, mach->drive2->image->size);
+    cr_assert_eq(memcmp(copy->drive2->image->memory,
+                        mach->drive2->image->memory,
+                        mach->drive2->image->size), 0);
+    cr_assert_eq(copy->screen->key_pressed, false);
+
+    // And that's the end of the recording
+    cr_assert_eq(rp->mode, REPLAY_OFF);
+
+    mach->drive2->stream = NULL;
+    fclose(disk);
+}
+
+Test(apple2_replay, out_of_step)
+{
+    cr_assert_eq(apple2_replay_record(mach->replay, mach, stream), OK);
+
+    mach->screen->last_key = 'A';
+    apple2_replay_tick(mach->replay, mach);
+    apple2_replay_stop(mach->replay);
+
+    rewind(stream);
+    cr_assert_eq(apple2_replay_play(copy->replay, copy, stream), OK);
+
+    // The recording says a key comes next, so the machine shouldn't be
+    // asking for noise; if it does, we have to give up
+    apple2_replay_noise(copy->replay);
+    cr_assert_eq(copy->replay->mode, REPLAY_OFF);
+}
+
+Test(apple2_replay, play_bad)
+{
+    // A state with nothing after it isn't a recording
+    cr_assert_eq(apple2_state_save(mach, stream, STATE_DEFAULT), OK);
+    rewind(stream);
+    cr_assert_eq(apple2_replay_play(copy->replay, copy, stream),
+                 ERR_BADFILE);
+    cr_assert_eq(copy->replay->mode, REPLAY_OFF);
+
+    // And while we're playing, we can't insert a disk
+    rewind(stream);
+    cr_assert_eq(apple2_replay_record(mach->replay, mach, stream), OK);
+    mach->screen->last_key = 'A';
+    apple2_replay_tick(mach->replay, mach);
+    apple2_replay_stop(mach->replay);
+    rewind(stream);
+    cr_assert_eq(apple2_replay_play(copy->replay, copy, stream), OK);
+    cr_assert_eq(apple2_replay_insert(copy->replay, copy, 1, stream,
+                                      DD_DOS33), ERR_INVALID);
+}
@@ -0,0 +1,280 @@
+#include <criterion/criterion.h>
+
+#include "apple2/apple2.h"
+#include "apple2/debug.h"
+#include "apple2/heat.h"
+#include "apple2/rewind.h"
+#include "vm_di.h"
+
+static apple2 *mach;
+static apple2_rewind *rw;
+
+static void
+setup()
+{
+    mach = apple2_create(100, 100);
+    vm_di_set(VM_MACHINE, mach);
+
+    // The machine's own ring, so that it sees what the machine is given
+    rw = mach->rewind;
+    rw->interval = 10;
+
+    // A little program that counts up in $10 and $11 forever
+    mos6502_set(mach->cpu, 0x800, 0xE6);        // INC $10
+    mos6502_set(mach->cpu, 0x801, 0x10);
+    mos6502_set(mach->cpu, 0x802, 0xE6);        // INC $11
+    mos6502_set(mach->cpu, 0x803, 0x11);
+    mos6502_set(mach->cpu, 0x804, 0x4C);        // JMP $0800
+    mos6502_set16(mach->cpu, 0x805, 0x0800);
+
+    mach->cpu->PC = 0x800;
+}
+
+static void
+teardown()
+{
+    apple2_free(mach);
+    apple2_debug_unbreak_all();
+    vm_di_set(VM_MACHINE, NULL);
+}
+
+TestSuite(apple2_rewind, .init = setup, .fini = teardown);
+
+/*
+ * Run the program for the given number of instructions, taking
+ * checkpoints as the run loop would.
+ */
+static void
+run(int n)
+{
+    for (int i = 0; i < n; i++) {
+        mos6502_execute(mach->cpu);
+        apple2_rewind_tick(rw, mach);
+    }
+}
+
+Test(apple2_rewind, delta)
+{
+    vm_8bit base[100], target[120], *delta, *patched;
+    size_t len;
+
+    for (int i = 0; i < 100; i++) {
+        base[i] = i;
+    }
+
+    memcpy(target, base, 100);
+    memset(target + 100, 0xAA, 20);
+    target[3] = 0xFF;
+    target[50] = 0xFF;
+    target[52] = 0xFF;
+
+    len = apple2_rewind_delta(&delta, target, 120, base, 100);
+    cr_assert_neq(delta, NULL);
+    cr_assert(len < 100);
+
+    patched = apple2_rewind_patch(delta, len, base, 100, 120);
+    cr_assert_neq(patched, NULL);
+    cr_assert_eq(memcmp(patched, target, 120), 0);
+    free(patched);
+    free(delta);
+
+    // And if they're the same, the delta should be tiny
+    len = apple2_rewind_delta(&delta, base, 100, base, 100);
+    cr_assert(len <= 8);
+
+    patched = apple2_rewind_patch(delta, len, base, 100, 100);
+    cr_assert_eq(memcmp(patched, base, 100), 0);
+    free(patched);
+    free(delta);
+}
+
+Test(apple2_rewind, checkpoint)
+{
+    apple2_rewind_checkpoint(rw, mach);
+    cr_assert_eq(rw->count, 1);
+    cr_assert_eq(rw->next, 10);
+
+    run(20);
+    cr_assert(rw->count > 1);
+
+    // Every checkpoint but the newest should be a delta
+    for (int i = 0; i < rw->count - 1; i++) {
+        cr_assert_neq(rw->points[i].delta, NULL);
+    }
+
+    cr_assert_eq(rw->points[rw->count - 1].delta, NULL);
+}
+
+Test(apple2_rewind, ring)
+{
+    run(REWIND_POINTS * 10);
+    cr_assert_eq(rw->count, REWIND_POINTS);
+
+    // We should still be able to get to the oldest checkpoint
+    uint64_t cycles = rw->points[rw->first].cycles;
+    cr_assert_eq(apple2_rewind_restore(rw, mach, 0), OK);
+    cr_assert_eq(mach->cpu->cycles, cycles);
+    cr_assert_eq(rw->count, 1);
+}
+
+Test(apple2_rewind, restore)
+{
+    apple2_rewind_checkpoint(rw, mach);
+    run(30);
+
+    cr_assert_eq(apple2_rewind_restore(rw, mach, 0), OK);
+    cr_assert_eq(mach->cpu->PC, 0x800);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x10), 0);
+    cr_assert_eq(mach->cpu->cycles, 0);
+    cr_assert_eq(rw->count, 1);
+
+    cr_assert_eq(apple2_rewind_restore(rw, mach, 1), ERR_OOB);
+}
+
+Test(apple2_rewind, step)
+{
+    vm_8bit a, b;
+    vm_16bit pc;
+    uint64_t cycles;
+
+    apple2_rewind_checkpoint(rw, mach);
+    run(31);
+
+    pc = mach->cpu->PC;
+    a = mos6502_get(mach->cpu, 0x10);
+    b = mos6502_get(mach->cpu, 0x11);
+    cycles = mach->cpu->cycles;
+
+    run(1);
+    cr_assert_neq(mos6502_get(mach->cpu, 0x11), b);
+
+    cr_assert_eq(apple2_rewind_step(rw, mach), OK);
+    cr_assert_eq(mach->cpu->PC, pc);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x10), a);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x11), b);
+    cr_assert_eq(mach->cpu->cycles, cycles);
+
+    // We can't go back before the first checkpoint
+    apple2_rewind_restore(rw, mach, 0);
+    cr_assert_eq(apple2_rewind_step(rw, mach), ERR_OOB);
+}
+
+Test(apple2_rewind, continue)
+{
+    apple2_rewind_checkpoint(rw, mach);
+    run(30);
+
+    // The INC $11 at $802 has been executed ten times; we want the last
+    apple2_debug_break(0x802);
+    cr_assert_eq(apple2_rewind_continue(rw, mach), OK);
+    cr_assert_eq(mach->cpu->PC, 0x802);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x10), 10);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x11), 9);
+
+    // And again, to the time before that
+    cr_assert_eq(apple2_rewind_continue(rw, mach), OK);
+    cr_assert_eq(mach->cpu->PC, 0x802);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x10), 9);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x11), 8);
+
+    // With no breakpoints, we go back as far as we can
+    apple2_debug_unbreak_all();
+    cr_assert_eq(apple2_rewind_continue(rw, mach), OK);
+    cr_assert_eq(mach->cpu->cycles, 0);
+}
+
+Test(apple2_rewind, noise)
+{
+    vm_8bit a, b, c;
+    vm_16bit pc;
+
+    // Read noise from the disk controller, over and over
+    mos6502_set(mach->cpu, 0x900, 0xAD);        // LDA $C0E0
+    mos6502_set16(mach->cpu, 0x901, 0xC0E0);
+    mos6502_set(mach->cpu, 0x903, 0x85);        // STA $12
+    mos6502_set(mach->cpu, 0x904, 0x12);
+    mos6502_set(mach->cpu, 0x905, 0xAD);        // LDA $C0E0
+    mos6502_set16(mach->cpu, 0x906, 0xC0E0);
+    mos6502_set(mach->cpu, 0x908, 0x85);        // STA $13
+    mos6502_set(mach->cpu, 0x909, 0x13);
+    mos6502_set(mach->cpu, 0x90A, 0x4C);        // JMP $0900
+    mos6502_set16(mach->cpu, 0x90B, 0x0900);
+    mach->cpu->PC = 0x900;
+
+    // One checkpoint, so that stepping back runs through all of it
+    rw->interval = 1000;
+    apple2_rewind_checkpoint(rw, mach);
+    run(8);
+
+    pc = mach->cpu->PC;
+    a = mach->cpu->A;
+    b = mos6502_get(mach->cpu, 0x12);
+    c = mos6502_get(mach->cpu, 0x13);
+
+    run(1);
+    cr_assert_eq(apple2_rewind_step(rw, mach), OK);
+    cr_assert_eq(mach->cpu->PC, pc);
+    cr_assert_eq(mach->cpu->A, a);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x12), b);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x13), c);
+
+    // Running on from there, we make new noise, and a later step back
+    // replays that instead
+    run(5);
+    a = mach->cpu->A;
+    c = mos6502_get(mach->cpu, 0x13);
+
+    run(1);
+    cr_assert_eq(apple2_rewind_step(rw, mach), OK);
+    cr_assert_eq(mach->cpu->A, a);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x13), c);
+}
+
+Test(apple2_rewind, keys)
+{
+    vm_16bit pc;
+
+    // Keep what the keyboard says in $13
+    mos6502_set(mach->cpu, 0xA00, 0xAD);        // LDA $C000
+    mos6502_set16(mach->cpu, 0xA01, 0xC000);
+    mos6502_set(mach->cpu, 0xA03, 0x85);        // STA $13
+    mos6502_set(mach->cpu, 0xA04, 0x13);
+    mos6502_set(mach->cpu, 0xA05, 0x4C);        // JMP $0A00
+    mos6502_set16(mach->cpu, 0xA06, 0x0A00);
+    mach->cpu->PC = 0xA00;
+
+    apple2_rewind_checkpoint(rw, mach);
+    run(9);
+
+    // Press a key just after a checkpoint, the way the run loop would
+    // see it
+    mach->screen->last_key = 'A';
+    mach->screen->key_pressed = true;
+    mach->strobe = true;
+    apple2_rewind_tick(rw, mach);
+
+    run(2);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x13), 'A' | 0x80);
+    pc = mach->cpu->PC;
+
+    // The checkpoint we go back to is from before the key was pressed
+    run(1);
+    cr_assert_eq(apple2_rewind_step(rw, mach), OK);
+    cr_assert_eq(mach->cpu->PC, pc);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x13), 'A' | 0x80);
+}
+
+Test(apple2_rewind, uncounted)
+{
+    uint64_t reads;
+
+    apple2_heat_start(mach);
+    apple2_rewind_checkpoint(rw, mach);
+    run(31);
+
+    // Running forward again doesn't count what we've counted already
+    reads = mach->heat->page_reads[HEAT_MAIN][0x00];
+    cr_assert_eq(apple2_rewind_step(rw, mach), OK);
+    cr_assert_eq(mach->heat->page_reads[HEAT_MAIN][0x00], reads);
+    cr_assert_eq(mach->heat->counting, true);
+}
@@ -0,0 +1,57 @@
+#include <criterion/criterion.h>
+
+#include "apple2/apple2.h"
+#include "apple2/runahead.h"
+
+static apple2 *mach;
+
+static void
+setup()
+{
+    mach = apple2_create(100, 100);
+
+    // Count up in the first byte of the text page forever
+    mos6502_set(mach->cpu, 0x800, 0xEE);        // INC $0400
+    mos6502_set16(mach->cpu, 0x801, 0x0400);
+    mos6502_set(mach->cpu, 0x803, 0x4C);        // JMP $0800
+    mos6502_set16(mach->cpu, 0x804, 0x0800);
+
+    mach->cpu->PC = 0x800;
+}
+
+static void
+teardown()
+{
+    apple2_free(mach);
+}
+
+TestSuite(apple2_runahead, .init = setup, .fini = teardown);
+
+Test(apple2_runahead, runahead)
+{
+    apple2 *fork;
+
+    mach->cpu->cycles = 1000;
+
+    fork = apple2_runahead(mach, 2);
+    cr_assert_neq(fork, NULL);
+    cr_assert(fork->cpu->cycles >= 1000 + 2 * APPLE2_FRAME_CYCLES);
+    cr_assert_neq(fork->main->memory[0x400], 0);
+
+    // The machine itself shouldn't have gone anywhere
+    cr_assert_eq(mach->cpu->cycles, 1000);
+    cr_assert_eq(mach->cpu->PC, 0x800);
+    cr_assert_eq(mach->main->memory[0x400], 0);
+
+    apple2_free(fork);
+}
+
+Test(apple2_runahead, draw)
+{
+    apple2_runahead_draw(mach, 1);
+
+    cr_assert_eq(mach->cpu->cycles, 0);
+    cr_assert_eq(mach->cpu->PC, 0x800);
+    cr_assert_eq(mach->main->memory[0x400], 0);
+    cr_assert_neq(mach->sysfont, NULL);
+}
@@ -0,0 +1,94 @@
+#include <criterion/criterion.h>
+#include <unistd.h>
+
+#include "apple2/apple2.h"
+#include "apple2/snap.h"
+#include "vm_di.h"
+
+static apple2 *mach;
+static char dir[] = "/tmp/erc-snap.XXXXXX";
+
+static void
+setup()
+{
+    mach = apple2_create(100, 100);
+
+    strcpy(dir, "/tmp/erc-snap.XXXXXX");
+    mkdtemp(dir);
+    vm_di_set(VM_SNAPCACHE, dir);
+}
+
+static void
+teardown()
+{
+    char path[SNAP_PATH_MAX];
+
+    apple2_snap_path(path, sizeof(path), dir, apple2_snap_key(mach));
+    unlink(path);
+    rmdir(dir);
+
+    vm_di_set(VM_SNAPCACHE, NULL);
+    apple2_free(mach);
+}
+
+TestSuite(apple2_snap, .init = setup, .fini = teardown);
+
+Test(apple2_snap, key)
+{
+    uint64_t key = apple2_snap_key(mach);
+
+    // The key shouldn't depend on anything but our inputs
+    mach->cpu->PC = 0x1234;
+    mach->main->memory[0x300] = 0x11;
+    cr_assert_eq(apple2_snap_key(mach), key);
+
+    mach->rom->memory[0] ^= 0xFF;
+    cr_assert_neq(apple2_snap_key(mach), key);
+}
+
+Test(apple2_snap, path)
+{
+    char buf[64];
+
+    cr_assert_eq(apple2_snap_path(buf, sizeof(buf), "/a", 0x1234), OK);
+    cr_assert_str_eq(buf, "/a/0000000000001234.state");
+
+    cr_assert_eq(apple2_snap_path(buf, 8, "/a", 0x1234), ERR_OOB);
+}
+
+Test(apple2_snap, poll)
+{
+    mach->snap_pending = true;
+    mach->kb_polls = 0;
+
+    apple2_snap_poll(mach, false);
+    apple2_snap_poll(mach, false);
+    cr_assert_eq(mach->kb_polls, 2);
+
+    // Once someone presses a key, we don't want a snapshot
+    apple2_snap_poll(mach, true);
+    cr_assert_eq(mach->snap_pending, false);
+}
+
+Test(apple2_snap, restore)
+{
+    // There's nothing to restore at first, but now we'll be waiting to
+    // record a snapshot
+    cr_assert_eq(apple2_snap_restore(mach), ERR_BADFILE);
+    cr_assert_eq(mach->snap_pending, true);
+
+    mach->cpu->PC = 0x1234;
+
+    // Not idle yet...
+    apple2_snap_idle(mach);
+    cr_assert_eq(mach->snap_pending, true);
+
+    mach->kb_polls = SNAP_IDLE_POLLS;
+    apple2_snap_idle(mach);
+    cr_assert_eq(mach->snap_pending, false);
+
+    mach->cpu->PC = 0;
+    cr_assert_eq(apple2_snap_restore(mach), OK);
+    cr_assert_eq(mach->cpu->PC, 0x1234);
+    cr_assert_eq(mach->snap_pending, false);
+}
@@ -0,0 +1,192 @@
+#include <criterion/criterion.h>
+
+#include "apple2/apple2.h"
+#include "apple2/dd.h"
+#include "apple2/enc.h"
+#include "apple2/state.h"
+
+static apple2 *mach;
+static apple2 *copy;
+
+static void
+setup()
+{
+    mach = apple2_create(100, 100);
+    copy = apple2_create(100, 100);
+}
+
+static void
+teardown()
+{
+    apple2_free(mach);
+    apple2_free(copy);
+}
+
+TestSuite(apple2_state, .init = setup, .fini = teardown);
+
+/*
+ * Put a machine in a state that is different from what it would be
+ * just after it was created.
+ */
+static void
+scribble(apple2 *m)
+{
+    m->cpu->PC = 0x1234;
+    m->cpu->A = 0x12;
+    m->cpu->X = 0x34;
+    m->cpu->Y = 0x56;
+    m->cpu->S = 0x78;
+    m->cpu->cycles = 123456789;
+
+    m->main->memory[0x300] = 0xEA;
+    m->aux->memory[0x2000] = 0x44;
+
+    m->strobe = true;
+    m->bank_switch = BANK_RAM | BANK_WRITE;
+    apple2_set_memory_mode(m, MEMORY_READ_AUX | MEMORY_SLOTCXROM);
+    m->selected_drive = m->drive2;
+}
+
+Test(apple2_state, encode_decode)
+{
+    apple2_state_buf buf = { NULL, 0, 0, OK };
+
+    scribble(mach);
+
+    cr_assert_eq(apple2_state_encode(mach, &buf), OK);
+    cr_assert_eq(apple2_state_decode(copy, buf.data, buf.pos), OK);
+
+    cr_assert_eq(copy->cpu->PC, 0x1234);
+    cr_assert_eq(copy->cpu->A, 0x12);
+    cr_assert_eq(copy->cpu->X, 0x34);
+    cr_assert_eq(copy->cpu->Y, 0x56);
+    cr_assert_eq(copy->cpu->S, 0x78);
+    cr_assert_eq(copy->cpu->cycles, 123456789);
+
+    cr_assert_eq(copy->main->memory[0x300], 0xEA);
+    cr_assert_eq(copy->aux->memory[0x2000], 0x44);
+
+    cr_assert_eq(copy->strobe, true);
+    cr_assert_eq(copy->bank_switch, BANK_RAM | BANK_WRITE);
+    cr_assert_eq(copy->memory_mode, MEMORY_READ_AUX | MEMORY_SLOTCXROM);
+    cr_assert_eq(copy->selected_drive, copy->drive2);
+
+    // The CPU should read from copy's memory, not from mach's
+    cr_assert_eq(copy->cpu->rmem, copy->aux);
+    cr_assert_eq(copy->cpu->wmem, copy->main);
+
+    // A state which is cut short should be refused, and leave the
+    // machine alone
+    copy->cpu->PC = 0;
+    cr_assert_eq(apple2_state_decode(copy, buf.data, buf.pos - 1),
+                 ERR_BADFILE);
+    cr_assert_eq(copy->cpu->PC, 0);
+
+    free(buf.data);
+}
+
+Test(apple2_state, drives)
+{
+    apple2_state_buf buf = { NULL, 0, 0, OK };
+    FILE *stream;
+
+    stream = fopen("../data/zero.img", "r");
+    cr_assert_eq(apple2_dd_insert(mach->drive1, stream, DD_DOS33), OK);
+
+    mach->drive1->track_pos = 6;
+    mach->drive1->sector_pos = 100;
+    mach->drive1->write_protect = false;
+    mach->drive1->latch = 0xD5;
+    apple2_dd_write(mach->drive1);
+
+    cr_assert(mach->drive1->dirty[3]);
+    cr_assert_eq(apple2_state_encode(mach, &buf), OK);
+
+    // Copy has no disk in drive 1, so it can't load this state
+    cr_assert_eq(apple2_state_decode(copy, buf.data, buf.pos), ERR_BADFILE);
+
+    rewind(stream);
+    cr_assert_eq(apple2_dd_insert(copy->drive1, stream, DD_DOS33), OK);
+    cr_assert_eq(apple2_state_decode(copy, buf.data, buf.pos), OK);
+
+    cr_assert_eq(copy->drive1->track_pos, 6);
+    cr_assert_eq(copy->drive1->sector_pos, 101);
+    cr_assert_eq(copy->drive1->write_protect, false);
+    cr_assert(copy->drive1->dirty[3]);
+    cr_assert_eq(vm_segment_get(copy->drive1->data, 3 * ENC_ETRACK + 100),
+                 0xD5);
+
+    // If we write to some other track after the state was saved,
+    // loading the state should undo that
+    vm_8bit clean = vm_segment_get(copy->drive1->data, 5 * ENC_ETRACK);
+    copy->drive1->track_pos = 10;
+    copy->drive1->sector_pos = 0;
+    copy->drive1->latch = clean ^ 0x7F;
+    apple2_dd_write(copy->drive1);
+    cr_assert(copy->drive1->dirty[5]);
+
+    cr_assert_eq(apple2_state_decode(copy, buf.data, buf.pos), OK);
+    cr_assert(!copy->drive1->dirty[5]);
+    cr_assert_eq(vm_segment_get(copy->drive1->data, 5 * ENC_ETRACK), clean);
+    cr_assert_eq(vm_segment_get(copy->drive1->data, 3 * ENC_ETRACK + 100),
+                 0xD5);
+
+    // Don't write anything back to our test data when we free the
+    // drives
+    mach->drive1->stream = NULL;
+    copy->drive1->stream = NULL;
+    fclose(stream);
+    free(buf.data);
+}
+
+Test(apple2_state, save_load)
+{
+    FILE *stream;
+    int flags[] = { STATE_DEFAULT, STATE_COMPRESS };
+
+    scribble(mach);
+
+    for (int i = 0; i < 2; i++) {
+        stream = tmpfile();
+        cr_assert_eq(apple2_state_save(mach, stream, flags[i]), OK);
+
+        copy->cpu->PC = 0;
+        copy->main->memory[0x300] = 0;
+
+        cr_assert_eq(apple2_state_load(copy, stream), OK);
+        cr_assert_eq(copy->cpu->PC, 0x1234);
+        cr_assert_eq(copy->main->memory[0x300], 0xEA);
+
+        fclose(stream);
+    }
+}
+
+Test(apple2_state, load_bad)
+{
+    FILE *stream;
+
+    // Too short to be anything
+    stream = tmpfile();
+    fputs("ERCS", stream);
+    fflush(stream);
+    cr_assert_eq(apple2_state_load(copy, stream), ERR_BADFILE);
+    fclose(stream);
+
+    // A state whose data has been tampered with
+    stream = tmpfile();
+    cr_assert_eq(apple2_state_save(mach, stream, STATE_DEFAULT), OK);
+    fseek(stream, STATE_HEADER_SIZE + 100, SEEK_SET);
+    fputc(0xFF, stream);
+    fflush(stream);
+    cr_assert_eq(apple2_state_load(copy, stream), ERR_BADFILE);
+    fclose(stream);
+
+    // A state from some version we don't know
+    stream = tmpfile();
+    cr_assert_eq(apple2_state_save(mach, stream, STATE_DEFAULT), OK);
+    fseek(stream, 4, SEEK_SET);
+    fputc(STATE_VERSION + 1, stream);
+    fflush(stream);
+    cr_assert_eq(apple2_state_load(copy, stream), ERR_BADFILE);
+    fclose(stream);
+}
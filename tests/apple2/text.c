@@ -1,6 +1,7 @@
 #include <criterion/criterion.h>
 
 #include "apple2/text.h"
+#include "apple2/watch.h"
 #include "objstore.h"
 
 /*
@@ -116,3 +117,46 @@ Test(apple2_text, col)
         cr_assert_eq(apple2_text_col(cols[i]), i);
     }
 }
+
+Test(apple2_text, dump)
+{
+    apple2 *mach;
+    char line[64];
+    FILE *stream;
+
+    mach = apple2_create(100, 100);
+
+    // Fill the screen with spaces, and put a little something in the
+    // first and last rows
+    for (int addr = 0x400; addr < 0x800; addr++) {
+        mos6502_set(mach->cpu, addr, 0xA0);
+    }
+
+    mos6502_set(mach->cpu, 0x400, 0xC8);    // H
+    mos6502_set(mach->cpu, 0x401, 0xC9);    // I
+    mos6502_set(mach->cpu, 0x7F7, 0xDA);    // Z
+
+    // Dumping the screen shouldn't look to a watchpoint like a read
+    apple2_watch_add(mach, 0x400, 0x7FF, WATCH_READ);
+
+    stream = tmpfile();
+    apple2_text_dump(mach, stream);
+    rewind(stream);
+    cr_assert_eq(mach->paused, false);
+
+    fgets(line, sizeof(line), stream);
+    cr_assert_eq(strlen(line), 41);
+    cr_assert_eq(line[0], 'H');
+    cr_assert_eq(line[1], 'I');
+    cr_assert_eq(line[2], ' ');
+
+    for (int i = 1; i < 24; i++) {
+        fgets(line, sizeof(line), stream);
+    }
+
+    cr_assert_eq(line[39], 'Z');
+    cr_assert_eq(fgets(line, sizeof(line), stream), NULL);
+
+    fclose(stream);
+    apple2_free(mach);
+}
@@ -0,0 +1,131 @@
+#include <criterion/criterion.h>
+
+#include "apple2/tests.h"
+#include "apple2/watch.h"
+
+TestSuite(apple2_watch, .init = setup, .fini = teardown);
+
+Test(apple2_watch, kind)
+{
+    cr_assert_eq(apple2_watch_kind(NULL), WATCH_WRITE);
+    cr_assert_eq(apple2_watch_kind(""), WATCH_WRITE);
+    cr_assert_eq(apple2_watch_kind("r"), WATCH_READ);
+    cr_assert_eq(apple2_watch_kind("rc"), WATCH_READ | WATCH_CHANGE);
+    cr_assert_eq(apple2_watch_kind("rx"), 0);
+}
+
+Test(apple2_watch, add_remove)
+{
+    cr_assert_eq(apple2_watch_add(mach, 0x310, 0x300, WATCH_WRITE),
+                 ERR_INVALID);
+    cr_assert_eq(apple2_watch_add(mach, 0x300, 0x30F, 0), ERR_INVALID);
+
+    cr_assert_eq(apple2_watch_add(mach, 0x300, 0x30F, WATCH_WRITE), OK);
+    cr_assert_eq(apple2_watch_add(mach, 0x308, 0x317, WATCH_READ), OK);
+    cr_assert_eq(mach->watch->npoints, 2);
+    cr_assert_neq(mach->main->write_table[0x300], NULL);
+    cr_assert_neq(mach->aux->write_table[0x317], NULL);
+
+    // Taking away the first leaves what the second still covers
+    cr_assert_eq(apple2_watch_remove(mach, 0x300), OK);
+    cr_assert_eq(mach->watch->npoints, 1);
+    cr_assert_eq(mach->main->write_table[0x300], NULL);
+    cr_assert_neq(mach->main->write_table[0x308], NULL);
+
+    cr_assert_eq(apple2_watch_remove(mach, 0x300), ERR_INVALID);
+    cr_assert_eq(apple2_watch_remove(mach, 0x310), OK);
+    cr_assert_eq(mach->main->read_table[0x310], NULL);
+}
+
+Test(apple2_watch, write)
+{
+    apple2_watch_add(mach, 0x300, 0x30F, WATCH_WRITE);
+
+    mos6502_set(mach->cpu, 0x2FF, 0x12);
+    cr_assert_eq(mach->paused, false);
+
+    mos6502_set(mach->cpu, 0x300, 0x12);
+    cr_assert_eq(mach->paused, true);
+    cr_assert_eq(mach->debug, true);
+    cr_assert_eq(mach->watch->points[0].hits, 1);
+
+    // The write itself went through
+    cr_assert_eq(mos6502_get(mach->cpu, 0x300), 0x12);
+}
+
+Test(apple2_watch, read)
+{
+    apple2_watch_add(mach, 0x300, 0x30F, WATCH_READ);
+
+    mos6502_set(mach->cpu, 0x300, 0x34);
+    cr_assert_eq(mach->paused, false);
+
+    cr_assert_eq(mos6502_get(mach->cpu, 0x300), 0x34);
+    cr_assert_eq(mach->paused, true);
+    cr_assert_eq(mach->watch->points[0].hits, 1);
+}
+
+Test(apple2_watch, change)
+{
+    mos6502_set(mach->cpu, 0x300, 0x12);
+    apple2_watch_add(mach, 0x300, 0x30F, WATCH_CHANGE);
+
+    // Writing the same thing again changes nothing
+    mos6502_set(mach->cpu, 0x300, 0x12);
+    cr_assert_eq(mach->paused, false);
+
+    mos6502_set(mach->cpu, 0x300, 0x13);
+    cr_assert_eq(mach->paused, true);
+    cr_assert_eq(mach->watch->points[0].hits, 1);
+}
+
+Test(apple2_watch, change_where)
+{
+    mos6502_set(mach->cpu, 0x300, 0x12);
+    apple2_watch_add(mach, 0x300, 0x30F, WATCH_CHANGE);
+
+    // Memory can change without the CPU writing it (say, when we load
+    // a saved state); what counts is what's there when the write comes
+    mach->main->memory[0x300] = 0x55;
+    mos6502_set(mach->cpu, 0x300, 0x55);
+    cr_assert_eq(mach->paused, false);
+
+    // A write to aux memory is no change to main memory
+    vm_segment_set(mach->aux, 0x300, 0x77);
+    cr_assert_eq(mach->paused, true);
+    mach->paused = false;
+    mos6502_set(mach->cpu, 0x300, 0x55);
+    cr_assert_eq(mach->paused, false);
+
+    // Reading from ROM and writing to RAM, what was there is what's in
+    // RAM
+    apple2_set_bank_switch(mach, BANK_WRITE);
+    mach->main->memory[0xE000] = 0x99;
+    apple2_watch_add(mach, 0xE000, 0xE000, WATCH_CHANGE);
+    mos6502_set(mach->cpu, 0xE000, 0x99);
+    cr_assert_eq(mach->paused, false);
+    mos6502_set(mach->cpu, 0xE000, 0x98);
+    cr_assert_eq(mach->paused, true);
+    cr_assert_eq(mach->main->memory[0xE000], 0x98);
+}
+
+Test(apple2_watch, mapped)
+{
+    // The zero page has mappers of its own, which must still be the
+    // ones that do the work
+    apple2_watch_add(mach, 0x80, 0x80, WATCH_WRITE);
+
+    mos6502_set(mach->cpu, 0x80, 0x56);
+    cr_assert_eq(mach->paused, true);
+    cr_assert_eq(mos6502_get(mach->cpu, 0x80), 0x56);
+}
+
+Test(apple2_watch, quiet)
+{
+    apple2_watch_add(mach, 0x300, 0x30F, WATCH_WRITE);
+    mach->watch->quiet = true;
+
+    mos6502_set(mach->cpu, 0x300, 0x12);
+    cr_assert_eq(mach->paused, false);
+    cr_assert_eq(mach->watch->points[0].hits, 1);
+}
@@ -0,0 +1,134 @@
+#include <criterion/criterion.h>
+
+#include "erc.h"
+
+static erc_machine *m;
+
+static void
+setup()
+{
+    m = erc_create();
+}
+
+static void
+teardown()
+{
+    erc_free(m);
+}
+
+TestSuite(erc, .init = setup, .fini = teardown);
+
+Test(erc, create)
+{
+    cr_assert_neq(m, NULL);
+    cr_assert_eq(erc_cycles(m), 0);
+}
+
+Test(erc, read_write)
+{
+    uint8_t in[] = { 1, 2, 3, 4 };
+    uint8_t out[4] = { 0 };
+
+    cr_assert_eq(erc_write(m, 0x2000, in, sizeof(in)), ERC_OK);
+    cr_assert_eq(erc_read(m, 0x2000, out, sizeof(out)), ERC_OK);
+    cr_assert_eq(memcmp(in, out, sizeof(in)), 0);
+
+    cr_assert_eq(erc_read(m, 0xFFFE, out, 2), ERC_OK);
+    cr_assert_eq(erc_read(m, 0xFFFE, out, 3), ERC_ERR_OOB);
+    cr_assert_eq(erc_write(m, 0xFFFF, in, 2), ERC_ERR_OOB);
+
+    // Soft switches read as zero, and don't flip anything
+    cr_assert_eq(erc_key(m, 'A'), ERC_OK);
+    cr_assert_eq(erc_read(m, 0xC000, out, 1), ERC_OK);
+    cr_assert_eq(out[0], 0);
+    cr_assert_eq(erc_read(m, 0xC010, out, 1), ERC_OK);
+    cr_assert_eq(erc_key_ready(m), false);
+}
+
+Test(erc, run)
+{
+    uint64_t start, ran;
+
+    erc_reset(m);
+    start = erc_cycles(m);
+
+    ran = erc_run(m, 1000);
+    cr_assert(ran >= 1000);
+    cr_assert(ran < 1000 + 8);
+    cr_assert_eq(erc_cycles(m), start + ran);
+}
+
+Test(erc, key)
+{
+    cr_assert_eq(erc_key_ready(m), true);
+    cr_assert_eq(erc_key(m, 'A'), ERC_OK);
+    cr_assert_eq(erc_key_ready(m), false);
+    cr_assert_eq(erc_key(m, 'B'), ERC_ERR_INVALID);
+}
+
+Test(erc, frame)
+{
+    static uint8_t buf[ERC_FRAME_SIZE];
+    uint8_t white[] = { 0x7F, 0x7F };
+
+    cr_assert_eq(erc_frame(m, buf, sizeof(buf) - 1), ERC_ERR_OOB);
+
+    // The first two bytes of hires page 1 lit up make the first
+    // fourteen dots of the screen white
+    erc_write(m, 0x2000, white, sizeof(white));
+    cr_assert_eq(erc_frame(m, buf, sizeof(buf)), ERC_OK);
+    cr_assert_eq(buf[3], 0xFF);
+    cr_assert_eq(buf[4], 0xFF);
+    cr_assert_eq(buf[5], 0xFF);
+}
+
+Test(erc, text)
+{
+    char buf[ERC_TEXT_SIZE];
+    uint8_t hi[] = { 'H' | 0x80, 'I' | 0x80 };
+
+    cr_assert_eq(erc_text(m, buf, sizeof(buf) - 1), ERC_ERR_OOB);
+
+    erc_write(m, 0x400, hi, sizeof(hi));
+    cr_assert_eq(erc_text(m, buf, sizeof(buf)), ERC_OK);
+    cr_assert_eq(strlen(buf), ERC_TEXT_SIZE - 1);
+    cr_assert_eq(buf[0], 'H');
+    cr_assert_eq(buf[1], 'I');
+    cr_assert_eq(buf[40], '\n');
+}
+
+Test(erc, save_load)
+{
+    uint8_t *data;
+    uint8_t byte = 0x12;
+    size_t len;
+
+    erc_write(m, 0x2000, &byte, 1);
+    cr_assert_eq(erc_save(m, &data, &len), ERC_OK);
+    cr_assert(len > 0);
+
+    byte = 0x34;
+    erc_write(m, 0x2000, &byte, 1);
+
+    cr_assert_eq(erc_load(m, data, len), ERC_OK);
+    erc_read(m, 0x2000, &byte, 1);
+    cr_assert_eq(byte, 0x12);
+
+    cr_assert_neq(erc_load(m, data, len / 2), ERC_OK);
+    free(data);
+}
+
+Test(erc, insert)
+{
+    cr_assert_eq(erc_insert(m, 3, "../data/zero.img", ERC_DISK_DEFAULT),
+                 ERC_ERR_BADOPT);
+    cr_assert_eq(erc_insert(m, 1, "../data/nothing.img", ERC_DISK_DEFAULT),
+                 ERC_ERR_BADFILE);
+    cr_assert_eq(erc_insert(m, 1, "../data/zero.img", ERC_DISK_DEFAULT),
+                 ERC_OK);
+    cr_assert_eq(erc_insert(m, 2, "../data/zero.img", ERC_DISK_DEFAULT),
+                 ERC_OK);
+
+    erc_eject(m, 1);
+    erc_eject(m, 3);
+}
@@ -0,0 +1,180 @@
+#include <criterion/criterion.h>
+
+#include "mos6502/mos6502.h"
+#include "mos6502/calls.h"
+#include "mos6502/enums.h"
+#include "mos6502/tests.h"
+
+TestSuite(mos6502_calls, .init = setup, .fini = teardown);
+
+/*
+ * Put a program in memory which, from $0800, calls a subroutine at
+ * $0900, which itself calls one at $0A00; then loops forever.
+ */
+static void
+calls_prog()
+{
+    mos6502_set(cpu, 0x800, 0x20);      // JSR $0900
+    mos6502_set16(cpu, 0x801, 0x0900);
+    mos6502_set(cpu, 0x803, 0x4C);      // JMP $0803
+    mos6502_set16(cpu, 0x804, 0x0803);
+
+    mos6502_set(cpu, 0x900, 0xEA);      // NOP
+    mos6502_set(cpu, 0x901, 0x20);      // JSR $0A00
+    mos6502_set16(cpu, 0x902, 0x0A00);
+    mos6502_set(cpu, 0x904, 0x60);      // RTS
+
+    mos6502_set(cpu, 0xA00, 0xEA);      // NOP
+    mos6502_set(cpu, 0xA01, 0x60);      // RTS
+
+    cpu->PC = 0x800;
+}
+
+Test(mos6502_calls, start_stop)
+{
+    cr_assert_eq(cpu->calls, NULL);
+    cr_assert_eq(mos6502_calls_start(cpu), OK);
+    cr_assert_neq(cpu->calls, NULL);
+    cr_assert_eq(cpu->calls->nnodes, 1);
+
+    mos6502_calls_stop(cpu);
+    cr_assert_eq(cpu->calls, NULL);
+}
+
+Test(mos6502_calls, count)
+{
+    mos6502_calls *calls;
+
+    calls_prog();
+    mos6502_calls_start(cpu);
+    calls = cpu->calls;
+
+    mos6502_execute(cpu);               // JSR $0900
+    cr_assert_eq(calls->depth, 1);
+    cr_assert_eq(calls->stack[0].addr, 0x900);
+    cr_assert_eq(calls->calls[0x900], 1);
+
+    mos6502_execute(cpu);               // NOP
+    mos6502_execute(cpu);               // JSR $0A00
+    cr_assert_eq(calls->depth, 2);
+
+    mos6502_execute(cpu);               // NOP
+    mos6502_execute(cpu);               // RTS
+    cr_assert_eq(calls->depth, 1);
+    cr_assert_eq(cpu->PC, 0x904);
+
+    mos6502_execute(cpu);               // RTS
+    cr_assert_eq(calls->depth, 0);
+    cr_assert_eq(cpu->PC, 0x803);
+
+    // $0A00 ran a NOP and an RTS; $0900 ran those, and a NOP, a JSR,
+    // and an RTS of its own.
+    cr_assert_eq(calls->exclusive[0xA00], 2 + 6);
+    cr_assert_eq(calls->inclusive[0xA00], 6 + 2 + 6);
+    cr_assert_eq(calls->exclusive[0x900], 2 + 6 + 6);
+    cr_assert_eq(calls->inclusive[0x900], 6 + 2 + 6 + 2 + 6 + 6);
+    cr_assert_eq(calls->top_cycles, 6);
+    cr_assert_eq(calls->cycles, cpu->cycles);
+}
+
+Test(mos6502_calls, resync)
+{
+    calls_prog();
+
+    // Instead of returning, $0A00 pulls its return address off the
+    // stack, and jumps back to the top
+    mos6502_set(cpu, 0xA00, 0x68);      // PLA
+    mos6502_set(cpu, 0xA01, 0x68);      // PLA
+    mos6502_set(cpu, 0xA02, 0x4C);      // JMP $0800
+    mos6502_set16(cpu, 0xA03, 0x0800);
+
+    mos6502_calls_start(cpu);
+
+    for (int i = 0; i < 3; i++) {
+        mos6502_execute(cpu);
+    }
+
+    cr_assert_eq(cpu->calls->depth, 2);
+
+    // One PLA leaves half of the return address on the stack, so the
+    // call isn't over yet
+    mos6502_execute(cpu);
+    cr_assert_eq(cpu->calls->depth, 2);
+
+    mos6502_execute(cpu);
+    cr_assert_eq(cpu->calls->depth, 1);
+
+    // Resetting the stack ends every call
+    cpu->S = 0xFF;
+    mos6502_execute(cpu);
+    cr_assert_eq(cpu->calls->depth, 0);
+}
+
+Test(mos6502_calls, wrap)
+{
+    calls_prog();
+    mos6502_calls_start(cpu);
+
+    // With S at $01, the return address of the JSR goes in $0101 and
+    // $0100, and S wraps around to $FF
+    cpu->S = 0x01;
+    mos6502_execute(cpu);               // JSR $0900
+    cr_assert_eq(cpu->S, 0xFF);
+    cr_assert_eq(cpu->calls->depth, 1);
+
+    mos6502_execute(cpu);               // NOP
+    cr_assert_eq(cpu->calls->depth, 1);
+
+    mos6502_execute(cpu);               // JSR $0A00
+    mos6502_execute(cpu);               // NOP
+    mos6502_execute(cpu);               // RTS
+    cr_assert_eq(cpu->calls->depth, 1);
+
+    mos6502_execute(cpu);               // RTS
+    cr_assert_eq(cpu->S, 0x01);
+    cr_assert_eq(cpu->calls->depth, 0);
+}
+
+Test(mos6502_calls, folded)
+{
+    char buf[1024] = { 0 };
+    FILE *stream;
+
+    calls_prog();
+    mos6502_calls_start(cpu);
+
+    for (int i = 0; i < 6; i++) {
+        mos6502_execute(cpu);
+    }
+
+    stream = fmemopen(buf, sizeof(buf), "w");
+    mos6502_calls_folded(cpu->calls, stream);
+    fclose(stream);
+
+    cr_assert_str_eq(buf,
+                     "top 6\n"
+                     "top;0900 14\n"
+                     "top;0900;0A00 8\n");
+}
+
+Test(mos6502_calls, dump)
+{
+    char buf[1024] = { 0 };
+    FILE *stream;
+
+    calls_prog();
+    mos6502_calls_start(cpu);
+
+    for (int i = 0; i < 6; i++) {
+        mos6502_execute(cpu);
+    }
+
+    stream = fmemopen(buf, sizeof(buf), "w");
+    mos6502_calls_dump(cpu->calls, stream, 0);
+    fclose(stream);
+
+    cr_assert_neq(strstr(buf, "$0900           1             28             14\n"),
+                  NULL);
+    cr_assert_neq(strstr(buf, "$0A00           1             14              8\n"),
+                  NULL);
+}
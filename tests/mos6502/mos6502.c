@@ -16,6 +16,7 @@ Test(mos6502, create)
     cr_assert_eq(cpu->wmem->size, MOS6502_MEMSIZE);
 
     cr_assert_eq(cpu->PC, 0);
+    cr_assert_eq(cpu->cycles, 0);
     cr_assert_eq(cpu->A, 0);
     cr_assert_eq(cpu->X, 0);
     cr_assert_eq(cpu->Y, 0);
@@ -101,6 +102,9 @@ Test(mos6502, execute)
 
     mos6502_execute(cpu);
     cr_assert_eq(cpu->A, 34);
+
+    // ADC in immediate mode takes two cycles
+    cr_assert_eq(cpu->cycles, 2);
 }
 
 Test(mos6502, would_jump)
@@ -158,6 +162,12 @@ Test(mos6502, get)
     cr_assert_eq(mos6502_get(cpu, 0), 123);
 }
 
+Test(mos6502, peek)
+{
+    vm_segment_set(cpu->wmem, 0, 123);
+    cr_assert_eq(mos6502_peek(cpu, 0), 123);
+}
+
 Test(mos6502, get16)
 {
     vm_segment_set16(cpu->wmem, 0, 0x3344);
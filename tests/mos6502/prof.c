@@ -0,0 +1,100 @@
+#include <criterion/criterion.h>
+
+#include "mos6502/mos6502.h"
+#include "mos6502/enums.h"
+#include "mos6502/prof.h"
+#include "mos6502/tests.h"
+
+TestSuite(mos6502_prof, .init = setup, .fini = teardown);
+
+Test(mos6502_prof, start_stop)
+{
+    cr_assert_eq(cpu->prof, NULL);
+
+    cr_assert_eq(mos6502_prof_start(cpu), OK);
+    cr_assert_neq(cpu->prof, NULL);
+    cr_assert_eq(cpu->prof->execs, 0);
+
+    // Starting again keeps what we have
+    cpu->prof->execs = 5;
+    cr_assert_eq(mos6502_prof_start(cpu), OK);
+    cr_assert_eq(cpu->prof->execs, 5);
+
+    mos6502_prof_stop(cpu);
+    cr_assert_eq(cpu->prof, NULL);
+}
+
+Test(mos6502_prof, count)
+{
+    mos6502_prof_start(cpu);
+
+    mos6502_prof_count(cpu->prof, 0x1234, 0xAD, ABS, 4);
+    mos6502_prof_count(cpu->prof, 0x1234, 0xAD, ABS, 4);
+    mos6502_prof_count(cpu->prof, 0x1237, 0xEA, IMP, 2);
+
+    cr_assert_eq(cpu->prof->pc_execs[0x1234], 2);
+    cr_assert_eq(cpu->prof->pc_cycles[0x1234], 8);
+    cr_assert_eq(cpu->prof->op_execs[0xAD], 2);
+    cr_assert_eq(cpu->prof->op_cycles[0xEA], 2);
+    cr_assert_eq(cpu->prof->mode_execs[ABS], 2);
+    cr_assert_eq(cpu->prof->mode_cycles[IMP], 2);
+    cr_assert_eq(cpu->prof->execs, 3);
+    cr_assert_eq(cpu->prof->cycles, 10);
+
+    mos6502_prof_clear(cpu->prof);
+    cr_assert_eq(cpu->prof->pc_execs[0x1234], 0);
+    cr_assert_eq(cpu->prof->execs, 0);
+}
+
+Test(mos6502_prof, execute)
+{
+    mos6502_set(cpu, 0x800, 0xA9);      // LDA #$01
+    mos6502_set(cpu, 0x801, 0x01);
+    mos6502_set(cpu, 0x802, 0xEA);      // NOP
+    cpu->PC = 0x800;
+
+    // Without a profile, we count nothing (and don't crash)
+    mos6502_execute(cpu);
+    cpu->PC = 0x800;
+
+    mos6502_prof_start(cpu);
+    mos6502_execute(cpu);
+    mos6502_execute(cpu);
+
+    cr_assert_eq(cpu->prof->pc_execs[0x800], 1);
+    cr_assert_eq(cpu->prof->pc_execs[0x802], 1);
+    cr_assert_eq(cpu->prof->mode_execs[IMM], 1);
+    cr_assert_eq(cpu->prof->mode_execs[IMP], 1);
+    cr_assert_eq(cpu->prof->cycles, 4);
+}
+
+Test(mos6502_prof, dump)
+{
+    char buf[4096] = { 0 };
+    FILE *stream;
+
+    stream = fmemopen(buf, sizeof(buf), "w");
+    mos6502_prof_dump(cpu, stream, 0);
+    fflush(stream);
+    cr_assert_str_eq(buf, "profile: not profiling\n");
+
+    rewind(stream);
+    memset(buf, 0, sizeof(buf));
+
+    mos6502_set(cpu, 0x800, 0xA9);      // LDA #$01
+    mos6502_set(cpu, 0x801, 0x01);
+    cpu->PC = 0x800;
+
+    mos6502_prof_start(cpu);
+    mos6502_execute(cpu);
+    mos6502_prof_dump(cpu, stream, 0);
+    fclose(stream);
+
+    cr_assert_neq(strstr(buf, "profile: 1 instructions, 2 cycles\n"), NULL);
+    cr_assert_neq(strstr(buf, "0800:A9 01"), NULL);
+    cr_assert_neq(strstr(buf, "LDA"), NULL);
+    cr_assert_neq(strstr(buf, "$A9 LDA IMM"), NULL);
+
+    // The registers we show in the debugger aren't part of a profile
+    cr_assert_eq(strchr(buf, ';'), NULL);
+}
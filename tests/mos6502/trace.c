@@ -0,0 +1,168 @@
+#include <criterion/criterion.h>
+#include <string.h>
+
+#include "mos6502/mos6502.h"
+#include "mos6502/dis.h"
+#include "mos6502/enums.h"
+#include "mos6502/tests.h"
+#include "mos6502/trace.h"
+
+TestSuite(mos6502_trace, .init = setup, .fini = teardown);
+
+static char buf[4096];
+
+/*
+ * Put a short program at $0800: LDA #$12, STA $2000, then a JMP back
+ * to the start.
+ */
+static void
+trace_prog()
+{
+    mos6502_set(cpu, 0x800, 0xA9);      // LDA #$12
+    mos6502_set(cpu, 0x801, 0x12);
+    mos6502_set(cpu, 0x802, 0x8D);      // STA $2000
+    mos6502_set16(cpu, 0x803, 0x2000);
+    mos6502_set(cpu, 0x805, 0x4C);      // JMP $0800
+    mos6502_set16(cpu, 0x806, 0x0800);
+
+    cpu->PC = 0x800;
+}
+
+/*
+ * Return the number of records in a trace file of the given size.
+ */
+static long
+trace_records(long size)
+{
+    return (size - (long)sizeof(mos6502_trace_header)) /
+        (long)sizeof(mos6502_trace_rec);
+}
+
+Test(mos6502_trace, start_stop)
+{
+    mos6502_trace_header header;
+    FILE *stream = tmpfile();
+
+    cr_assert_eq(mos6502_trace_start(cpu, stream, 0, 0xFFFF, 1), OK);
+    cr_assert_neq(cpu->trace, NULL);
+    cr_assert_eq(mos6502_trace_start(cpu, stream, 0, 0xFFFF, 1),
+                 ERR_INVALID);
+
+    mos6502_trace_stop(cpu);
+    cr_assert_eq(cpu->trace, NULL);
+
+    rewind(stream);
+    cr_assert_eq(fread(&header, sizeof(header), 1, stream), 1);
+    cr_assert_eq(header.magic, TRACE_MAGIC);
+    cr_assert_eq(header.version, TRACE_VERSION);
+    cr_assert_eq(header.rec_size, sizeof(mos6502_trace_rec));
+
+    fclose(stream);
+}
+
+Test(mos6502_trace, record)
+{
+    mos6502_trace_rec rec;
+    FILE *stream = tmpfile();
+
+    trace_prog();
+    mos6502_trace_start(cpu, stream, 0, 0xFFFF, 1);
+
+    mos6502_execute(cpu);               // LDA #$12
+    mos6502_execute(cpu);               // STA $2000
+    mos6502_execute(cpu);               // JMP $0800
+    cr_assert_eq(cpu->trace->records, 3);
+
+    mos6502_trace_stop(cpu);
+    cr_assert_eq(trace_records(ftell(stream)), 3);
+
+    fseek(stream, sizeof(mos6502_trace_header) + sizeof(rec), SEEK_SET);
+    cr_assert_eq(fread(&rec, sizeof(rec), 1, stream), 1);
+
+    // The record shows the CPU before it ran the STA, and the address
+    // it stored into after
+    cr_assert_eq(rec.PC, 0x802);
+    cr_assert_eq(rec.opcode, 0x8D);
+    cr_assert_eq(rec.oper[0], 0x00);
+    cr_assert_eq(rec.oper[1], 0x20);
+    cr_assert_eq(rec.A, 0x12);
+    cr_assert_eq(rec.eff_addr, 0x2000);
+
+    fclose(stream);
+}
+
+Test(mos6502_trace, range)
+{
+    FILE *stream = tmpfile();
+
+    trace_prog();
+    mos6502_trace_start(cpu, stream, 0x802, 0x804, 1);
+
+    for (int i = 0; i < 9; i++) {
+        mos6502_execute(cpu);
+    }
+
+    // Only the STA is in range, and we ran it three times
+    cr_assert_eq(cpu->trace->records, 3);
+
+    mos6502_trace_stop(cpu);
+    fclose(stream);
+}
+
+Test(mos6502_trace, sample)
+{
+    FILE *stream = tmpfile();
+
+    trace_prog();
+    mos6502_trace_start(cpu, stream, 0, 0xFFFF, 4);
+
+    for (int i = 0; i < 9; i++) {
+        mos6502_execute(cpu);
+    }
+
+    // We record the 1st, 5th, and 9th
+    cr_assert_eq(cpu->trace->records, 3);
+
+    mos6502_trace_stop(cpu);
+    fclose(stream);
+}
+
+Test(mos6502_trace, decode)
+{
+    FILE *stream = tmpfile();
+    FILE *out;
+    char expect[256];
+
+    trace_prog();
+    mos6502_execute(cpu);               // LDA #$12
+
+    // What the disassembler says about the STA, just before it runs
+    out = fmemopen(expect, sizeof(expect), "w");
+    mos6502_dis_opcode(cpu, out, cpu->PC);
+    fclose(out);
+
+    mos6502_trace_start(cpu, stream, 0, 0xFFFF, 1);
+    mos6502_execute(cpu);               // STA $2000
+    mos6502_trace_stop(cpu);
+
+    rewind(stream);
+    out = fmemopen(buf, sizeof(buf), "w");
+    cr_assert_eq(mos6502_trace_decode(stream, out), OK);
+    fclose(out);
+
+    cr_assert_str_eq(buf, expect);
+
+    fclose(stream);
+}
+
+Test(mos6502_trace, decode_bad)
+{
+    FILE *stream = tmpfile();
+
+    fputs("this is not a trace", stream);
+    rewind(stream);
+
+    cr_assert_eq(mos6502_trace_decode(stream, stdout), ERR_BADFILE);
+
+    fclose(stream);
+}
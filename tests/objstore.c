@@ -1,4 +1,5 @@
 #include <criterion/criterion.h>
+#include <pthread.h>
 
 #include "log.h"
 #include "objstore.h"
@@ -10,6 +11,33 @@ Test(objstore, init)
     cr_assert_eq(objstore_ready(), true);
 }
 
+static void *
+init_thread(void *arg)
+{
+    *(int *)arg = objstore_init();
+    return NULL;
+}
+
+Test(objstore, init_threads)
+{
+    pthread_t threads[8];
+    int results[8];
+
+    // However many threads go first at once, each should find the store
+    // ready when it's done
+    objstore_clear();
+    for (int i = 0; i < 8; i++) {
+        pthread_create(&threads[i], NULL, init_thread, &results[i]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        pthread_join(threads[i], NULL);
+        cr_assert_eq(results[i], OK);
+    }
+
+    cr_assert_eq(objstore_ready(), true);
+}
+
 Test(objstore, ready)
 {
     objstore_clear();
@@ -6,6 +6,8 @@
 #include "apple2/apple2.h"
 #include "apple2/debug.h"
 #include "apple2/event.h"
+#include "apple2/heat.h"
+#include "apple2/watch.h"
 #include "vm_di.h"
 
 static char buf[BUFSIZ];
@@ -127,6 +129,12 @@ Test(apple2_debug, cmd_resume)
     cr_assert_eq(mach->paused, false);
 }
 
+Test(apple2_debug, cmd_dstat)
+{
+    apple2_debug_cmd_dstat(&args);
+    cr_assert_neq(strlen(buf), 0);
+}
+
 Test(apple2_debug, cmd_printstate)
 {
     apple2_debug_cmd_printstate(&args);
@@ -229,6 +237,37 @@ Test(apple2_debug, unbreak)
     cr_assert_eq(apple2_debug_broke(0x23), false);
 }
 
+/*
+ * Return true if the CPU would trap at addr.
+ */
+static bool
+trap_at(vm_16bit addr)
+{
+    mach->cpu->PC = addr;
+    return apple2_debug_trap(mach->cpu);
+}
+
+Test(apple2_debug, trap)
+{
+    cr_assert_eq(trap_at(0x1234), false);
+
+    apple2_debug_break(0x1234);
+    apple2_debug_break(0x1234);
+    apple2_debug_break(0x12FF);
+    cr_assert_eq(apple2_debug_break_pages[0x12], 2);
+    cr_assert_eq(trap_at(0x1234), true);
+    cr_assert_eq(trap_at(0x1235), false);
+
+    apple2_debug_unbreak(0x1234);
+    apple2_debug_unbreak(0x1234);
+    cr_assert_eq(apple2_debug_break_pages[0x12], 1);
+    cr_assert_eq(trap_at(0x1234), false);
+
+    apple2_debug_unbreak_all();
+    cr_assert_eq(apple2_debug_break_pages[0x12], 0);
+    cr_assert_eq(trap_at(0x12FF), false);
+}
+
 Test(apple2_debug, cmd_break)
 {
     args.addr1 = 123;
@@ -237,6 +276,64 @@ Test(apple2_debug, cmd_break)
     cr_assert_eq(apple2_debug_broke(123), true);
 }
 
+Test(apple2_debug, cmd_break_if)
+{
+    mach->cpu->A = 0x20;
+    mach->cpu->PC = 0x803;
+
+    apple2_debug_execute("break 803 A == $20 && mem[$FF] > 3");
+    cr_assert_eq(apple2_debug_broke(0x803), true);
+
+    mos6502_set(mach->cpu, 0xFF, 3);
+    cr_assert_eq(apple2_debug_stop(mach->cpu), false);
+    mos6502_set(mach->cpu, 0xFF, 4);
+    cr_assert_eq(apple2_debug_stop(mach->cpu), true);
+
+    // Resuming leaves a conditional breakpoint where it is
+    apple2_debug_cmd_resume(&args);
+    cr_assert_eq(apple2_debug_broke(0x803), true);
+
+    // And a break with no condition takes the condition away
+    apple2_debug_execute("break 803");
+    mos6502_set(mach->cpu, 0xFF, 3);
+    cr_assert_eq(apple2_debug_stop(mach->cpu), true);
+
+    apple2_debug_execute("break 900 A ==");
+    cr_assert_eq(apple2_debug_broke(0x900), false);
+    cr_assert_neq(strlen(buf), 0);
+}
+
+Test(apple2_debug, cmd_watch)
+{
+    apple2_debug_execute("watch 300 30f rc");
+    cr_assert_neq(mach->watch, NULL);
+    cr_assert_eq(mach->watch->npoints, 1);
+    cr_assert_eq(mach->watch->points[0].kind, WATCH_READ | WATCH_CHANGE);
+
+    apple2_debug_execute("watch 400 40f");
+    cr_assert_eq(mach->watch->points[1].kind, WATCH_WRITE);
+
+    apple2_debug_cmd_watches(&args);
+    cr_assert_neq(strlen(buf), 0);
+
+    apple2_debug_execute("unwatch 305");
+    cr_assert_eq(mach->watch->npoints, 1);
+    cr_assert_eq(mach->watch->points[0].from, 0x400);
+}
+
+Test(apple2_debug, cmd_heatmap)
+{
+    apple2_debug_execute("heatmap");
+    cr_assert_neq(mach->heat, NULL);
+    cr_assert_eq(mach->heat->counting, true);
+
+    mos6502_get(mach->cpu, 0xC030);
+    cr_assert_eq(mach->heat->switch_reads[0x30], 1);
+
+    apple2_debug_execute("heatmap");
+    cr_assert_neq(strlen(buf), 0);
+}
+
 Test(apple2_debug, cmd_unbreak)
 {
     args.addr1 = 123;
@@ -277,6 +374,50 @@ Test(apple2_debug, cmd_step)
     cr_assert_eq(mach->cpu->PC, 2);
 }
 
+Test(apple2_debug, cmd_step_cond)
+{
+    mos6502_set(mach->cpu, 0x803, 0xEA);
+    mos6502_set(mach->cpu, 0x804, 0xEA);
+    mach->cpu->PC = 0x803;
+
+    apple2_debug_execute("break 803 A == $20");
+    apple2_debug_cmd_step(&args);
+    cr_assert_eq(mach->cpu->PC, 0x804);
+
+    // Stepping off a conditional breakpoint leaves it, and its
+    // condition, where they were
+    cr_assert_eq(apple2_debug_broke(0x803), true);
+    mach->cpu->PC = 0x803;
+    mach->cpu->A = 0x10;
+    cr_assert_eq(apple2_debug_stop(mach->cpu), false);
+    mach->cpu->A = 0x20;
+    cr_assert_eq(apple2_debug_stop(mach->cpu), true);
+}
+
+Test(apple2_debug, break_if_full)
+{
+    int addr;
+
+    // Use up every condition we have room for
+    for (addr = 0x1000; addr < 0x2000; addr++) {
+        if (apple2_debug_break_if(addr, "A == 1") != OK) {
+            break;
+        }
+    }
+
+    cr_assert_neq(addr, 0x2000);
+
+    // With no room for a condition, the breakpoint that's already
+    // there stays
+    apple2_debug_break(0x300);
+    cr_assert_eq(apple2_debug_break_if(0x300, "A == 1"), ERR_INVALID);
+    cr_assert_eq(apple2_debug_broke(0x300), true);
+
+    // But one that has a condition can still get a new one
+    cr_assert_eq(apple2_debug_break_if(0x1000, "A == 2"), OK);
+    cr_assert_eq(apple2_debug_broke(0x1000), true);
+}
+
 /* Test(apple2_debug, cmd_quit) */
 
 Test(apple2_debug, cmd_dblock)
@@ -301,3 +442,189 @@ Test(apple2_debug, cmd_hdump)
 
     cr_assert_neq(strlen(buf), 0);
 }
+
+Test(apple2_debug, cmd_profile)
+{
+    cr_assert_eq(mach->cpu->prof, NULL);
+
+    apple2_debug_cmd_profile(&args);
+    cr_assert_neq(mach->cpu->prof, NULL);
+    cr_assert_str_eq(buf, "Profiling started\n");
+
+    mos6502_set(mach->cpu, 0, 0xEA);        // NOP
+    mach->cpu->PC = 0;
+    mos6502_execute(mach->cpu);
+
+    apple2_debug_cmd_profile(&args);
+    fflush(stream);
+    cr_assert_neq(strstr(buf, "profile: 1 instructions, 2 cycles"), NULL);
+}
+
+Test(apple2_debug, cmd_calls)
+{
+    cr_assert_eq(mach->cpu->calls, NULL);
+
+    apple2_debug_cmd_calls(&args);
+    cr_assert_neq(mach->cpu->calls, NULL);
+    cr_assert_str_eq(buf, "Following calls\n");
+
+    apple2_debug_cmd_calls(&args);
+    fflush(stream);
+    cr_assert_neq(strstr(buf, "calls: 0 cycles"), NULL);
+}
+
+/*
+ * Write the bytes into memory from addr on, and point the PC at addr
+ */
+static void
+load_at(vm_16bit addr, const vm_8bit *bytes, int len)
+{
+    for (int i = 0; i < len; i++) {
+        mos6502_set(mach->cpu, addr + i, bytes[i]);
+    }
+
+    mach->cpu->PC = addr;
+}
+
+Test(apple2_debug, cmd_until)
+{
+    vm_8bit nops[] = { 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA };
+
+    load_at(0x300, nops, sizeof(nops));
+
+    apple2_debug_execute("until 305");
+    cr_assert_eq(mach->cpu->PC, 0x305);
+    cr_assert_eq(mach->paused, true);
+    cr_assert_eq(mach->debug, true);
+
+    // We stop at a breakpoint along the way, but not at the one we
+    // start from
+    apple2_debug_break(0x305);
+    apple2_debug_break(0x306);
+    apple2_debug_execute("until 307");
+    cr_assert_eq(mach->cpu->PC, 0x306);
+}
+
+Test(apple2_debug, cmd_until_watch)
+{
+    vm_8bit code[] = {
+        0x8D, 0x20, 0x03,       // STA $0320
+        0xEA, 0xEA,             // NOP; NOP
+    };
+
+    load_at(0x300, code, sizeof(code));
+    apple2_watch_add(mach, 0x320, 0x320, WATCH_WRITE);
+
+    apple2_debug_execute("until 304");
+    cr_assert_eq(mach->cpu->PC, 0x303);
+    cr_assert_eq(mach->paused, true);
+}
+
+Test(apple2_debug, cmd_run)
+{
+    vm_8bit nops[] = { 0xEA, 0xEA, 0xEA, 0xEA };
+    uint64_t cycles;
+
+    load_at(0x300, nops, sizeof(nops));
+    cycles = mach->cpu->cycles;
+
+    apple2_debug_execute("run 4");
+    cr_assert_eq(mach->cpu->PC, 0x302);
+    cr_assert_eq(mach->cpu->cycles, cycles + 4);
+
+    apple2_debug_execute("run 4x");
+    cr_assert_eq(mach->cpu->PC, 0x302);
+    cr_assert_neq(strlen(buf), 0);
+}
+
+Test(apple2_debug, cmd_until_frame)
+{
+    vm_8bit code[] = {
+        0x4C, 0x00, 0x03,       // JMP $0300
+    };
+
+    load_at(0x300, code, sizeof(code));
+    mach->cpu->cycles = 10;
+
+    apple2_debug_cmd_until_frame(&args);
+    cr_assert(mach->cpu->cycles >= APPLE2_FRAME_CYCLES);
+    cr_assert(mach->cpu->cycles < APPLE2_FRAME_CYCLES + 3);
+}
+
+Test(apple2_debug, cmd_next)
+{
+    vm_8bit code[] = {
+        0x20, 0x10, 0x03,       // JSR $0310
+        0xEA,                   // NOP
+        0xEA,                   // NOP
+    };
+    vm_8bit sub[] = {
+        0xEA,                   // NOP
+        0x60,                   // RTS
+    };
+
+    load_at(0x310, sub, sizeof(sub));
+    load_at(0x300, code, sizeof(code));
+    mach->cpu->S = 0xFF;
+
+    apple2_debug_cmd_next(&args);
+    cr_assert_eq(mach->cpu->PC, 0x303);
+    cr_assert_eq(mach->cpu->S, 0xFF);
+
+    apple2_debug_cmd_next(&args);
+    cr_assert_eq(mach->cpu->PC, 0x304);
+}
+
+Test(apple2_debug, cmd_finish)
+{
+    vm_8bit code[] = {
+        0x20, 0x10, 0x03,       // JSR $0310
+        0xEA,                   // NOP
+    };
+    vm_8bit sub[] = {
+        0x20, 0x20, 0x03,       // JSR $0320
+        0xEA,                   // NOP
+        0x60,                   // RTS
+    };
+    vm_8bit inner[] = {
+        0x60,                   // RTS
+    };
+
+    load_at(0x320, inner, sizeof(inner));
+    load_at(0x310, sub, sizeof(sub));
+    load_at(0x300, code, sizeof(code));
+    mach->cpu->S = 0xFF;
+
+    mos6502_execute(mach->cpu);
+    cr_assert_eq(mach->cpu->PC, 0x310);
+
+    // The RTS in the subroutine we call doesn't count; only ours does
+    apple2_debug_cmd_finish(&args);
+    cr_assert_eq(mach->cpu->PC, 0x303);
+    cr_assert_eq(mach->cpu->S, 0xFF);
+}
+
+Test(apple2_debug, cmd_finish_wrap)
+{
+    vm_8bit code[] = {
+        0x20, 0x10, 0x03,       // JSR $0310
+        0xEA,                   // NOP
+    };
+    vm_8bit sub[] = {
+        0xEA,                   // NOP
+        0x60,                   // RTS
+    };
+
+    load_at(0x310, sub, sizeof(sub));
+    load_at(0x300, code, sizeof(code));
+
+    // The JSR leaves S at $FF, and the RTS takes it around to $01
+    mach->cpu->S = 0x01;
+    mos6502_execute(mach->cpu);
+    cr_assert_eq(mach->cpu->S, 0xFF);
+
+    apple2_debug_cmd_finish(&args);
+    cr_assert_eq(mach->cpu->PC, 0x303);
+    cr_assert_eq(mach->cpu->S, 0x01);
+    cr_assert(mach->cpu->cycles < 100);
+}
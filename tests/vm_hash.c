@@ -0,0 +1,51 @@
+#include <criterion/criterion.h>
+
+#include "vm_hash.h"
+
+Test(vm_hash, buf)
+{
+    vm_8bit a[] = { 1, 2, 3 };
+    vm_8bit b[] = { 1, 2, 4 };
+
+    // Nothing hashed means nothing changed
+    cr_assert_eq(vm_hash_buf(VM_HASH_INIT, a, 0), VM_HASH_INIT);
+
+    cr_assert_eq(vm_hash_buf(VM_HASH_INIT, a, 3),
+                 vm_hash_buf(VM_HASH_INIT, a, 3));
+    cr_assert_neq(vm_hash_buf(VM_HASH_INIT, a, 3),
+                  vm_hash_buf(VM_HASH_INIT, b, 3));
+
+    // Hashing in pieces should be the same as hashing all at once
+    cr_assert_eq(vm_hash_buf(vm_hash_buf(VM_HASH_INIT, a, 1), a + 1, 2),
+                 vm_hash_buf(VM_HASH_INIT, a, 3));
+}
+
+Test(vm_hash, int)
+{
+    cr_assert_neq(vm_hash_int(VM_HASH_INIT, 1),
+                  vm_hash_int(VM_HASH_INIT, 2));
+}
+
+Test(vm_hash, segment)
+{
+    vm_segment *a, *b;
+
+    a = vm_segment_create(64);
+    b = vm_segment_create(65);
+
+    // Same contents (all zeroes), but different sizes
+    cr_assert_neq(vm_hash_segment(VM_HASH_INIT, a),
+                  vm_hash_segment(VM_HASH_INIT, b));
+
+    vm_segment_free(b);
+    b = vm_segment_create(64);
+    cr_assert_eq(vm_hash_segment(VM_HASH_INIT, a),
+                 vm_hash_segment(VM_HASH_INIT, b));
+
+    vm_segment_set(b, 3, 0x12);
+    cr_assert_neq(vm_hash_segment(VM_HASH_INIT, a),
+                  vm_hash_segment(VM_HASH_INIT, b));
+
+    vm_segment_free(a);
+    vm_segment_free(b);
+}
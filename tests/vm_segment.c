@@ -132,6 +132,80 @@ Test(vm_segment, use_write_map)
     cr_assert_eq(vm_segment_get(segment, addr + 1), 111);
 }
 
+Test(vm_segment, read_range)
+{
+    vm_8bit buf[32];
+
+    for (int i = 0; i < length; i++) {
+        segment->memory[i] = i;
+    }
+
+    vm_segment_read_map(segment, 10, read_fn);
+    vm_segment_read_map(segment, 11, read_fn);
+    vm_segment_read_map(segment, 20, read_fn);
+
+    // We should get just what we'd get a byte at a time
+    cr_assert_eq(vm_segment_read_range(segment, buf, 5, 20), OK);
+    for (int i = 0; i < 20; i++) {
+        cr_assert_eq(buf[i], vm_segment_get(segment, 5 + i));
+    }
+
+    cr_assert_eq(vm_segment_read_range(segment, buf, length - 8, 9), ERR_OOB);
+}
+
+Test(vm_segment, write_range)
+{
+    vm_8bit buf[32];
+
+    for (int i = 0; i < 32; i++) {
+        buf[i] = 100 + i;
+    }
+
+    // write_fn writes into the address after the one it's given, so
+    // the byte at 11 should come from buf[6], not buf[5]
+    vm_segment_write_map(segment, 10, write_fn);
+
+    cr_assert_eq(vm_segment_write_range(segment, buf, 5, 5), OK);
+    cr_assert_eq(segment->memory[9], 104);
+    cr_assert_eq(segment->memory[10], 0);
+
+    cr_assert_eq(vm_segment_write_range(segment, buf, 5, 20), OK);
+    cr_assert_eq(segment->memory[10], 0);
+    cr_assert_eq(segment->memory[11], 106);
+    cr_assert_eq(segment->memory[24], 119);
+
+    cr_assert_eq(vm_segment_write_range(segment, buf, length - 8, 9), ERR_OOB);
+}
+
+Test(vm_segment, peek)
+{
+    size_t addr = 123;
+    vm_8bit buf[3];
+
+    vm_segment_set(segment, addr, 111);
+    vm_segment_read_map(segment, addr, read_fn);
+    vm_segment_write_map(segment, addr, write_fn);
+
+    // With no peek function, we peek right past the mappers at memory
+    cr_assert_eq(vm_segment_peek(segment, addr), 111);
+    cr_assert_eq(vm_segment_peek(segment, length), 0);
+
+    cr_assert_eq(vm_segment_poke(segment, addr, 99), OK);
+    cr_assert_eq(segment->memory[addr], 99);
+    cr_assert_eq(vm_segment_poke(segment, length, 99), ERR_OOB);
+
+    cr_assert_eq(vm_segment_peek_range(segment, buf, addr - 1, 3), OK);
+    cr_assert_eq(buf[1], 99);
+    cr_assert_eq(vm_segment_peek_range(segment, buf, length - 2, 3), ERR_OOB);
+
+    // But with one, it's the peek function that decides
+    segment->peek = read_fn;
+    cr_assert_eq(vm_segment_peek(segment, addr), 222);
+    cr_assert_eq(vm_segment_peek_range(segment, buf, addr - 1, 3), OK);
+    cr_assert_eq(buf[0], 222);
+    cr_assert_eq(buf[2], 222);
+}
+
 Test(vm_segment, copy_buf)
 {
     vm_8bit buf[] = {1, 2, 3, 4, 5};
@@ -207,3 +281,84 @@ Test(vm_segment, hexdump)
     cr_assert_str_eq(buf, 
                      "00000000    48 65 6C 6C 6F 20 4E 65  72 64 73 00 00 00 00 00   [Hello Nerds.....]\n");
 }
+
+Test(vm_segment, map)
+{
+    vm_segment *seg;
+    FILE *stream;
+
+    stream = fopen("/tmp/erc-map.img", "w+");
+    vm_segment_set(segment, 0, 0x12);
+    vm_segment_set(segment, 1, 0x34);
+    vm_segment_fwrite(segment, stream, 0, 123);
+    fflush(stream);
+
+    seg = vm_segment_map(fileno(stream), 123);
+    fclose(stream);
+
+    cr_assert_neq(seg, NULL);
+    cr_assert_eq(seg->mapped, true);
+    cr_assert_eq(seg->size, 123);
+    cr_assert_eq(vm_segment_get(seg, 0), 0x12);
+    cr_assert_eq(vm_segment_get(seg, 1), 0x34);
+
+    // Since the mapping is private, this shouldn't change the file
+    vm_segment_set(seg, 0, 0x56);
+    cr_assert_eq(vm_segment_get(seg, 0), 0x56);
+
+    vm_segment_free(seg);
+    unlink("/tmp/erc-map.img");
+}
+
+Test(vm_segment, fork)
+{
+    vm_segment *fork, *fork2;
+    const vm_8bit *base;
+
+    vm_segment_set(segment, 0, 0x12);
+    vm_segment_read_map(segment, 10, read_fn);
+
+    fork = vm_segment_fork(segment);
+    cr_assert_neq(fork, NULL);
+    cr_assert_eq(fork->size, segment->size);
+    cr_assert_neq(fork->memory, segment->memory);
+    cr_assert_eq(fork->base, segment->base);
+    cr_assert_eq(fork->read_table, segment->read_table);
+    cr_assert_eq(*fork->table_refs, 2);
+
+    // The fork starts out with what we had...
+    cr_assert_eq(vm_segment_get(fork, 0), 0x12);
+    cr_assert_eq(vm_segment_get(fork, 10), 222);
+
+    // ...but from here on, we go our separate ways
+    vm_segment_set(fork, 0, 0x34);
+    vm_segment_set(segment, 1, 0x56);
+    cr_assert_eq(vm_segment_get(segment, 0), 0x12);
+    cr_assert_eq(vm_segment_get(fork, 1), 0);
+
+    // Changing a mapper in the fork gives it its own tables
+    vm_segment_read_map(fork, 10, NULL);
+    cr_assert_neq(fork->read_table, segment->read_table);
+    cr_assert_eq(vm_segment_get(segment, 10), 222);
+    cr_assert_eq(*segment->table_refs, 1);
+
+    // We've changed since we forked, so forking again must freeze our
+    // memory anew; but if we haven't changed, we can use the same base
+    base = segment->base->view;
+    fork2 = vm_segment_fork(segment);
+    cr_assert_neq(segment->base->view, base);
+    cr_assert_eq(vm_segment_get(fork2, 1), 0x56);
+    vm_segment_free(fork2);
+
+    base = segment->base->view;
+    fork2 = vm_segment_fork(segment);
+    cr_assert_eq(segment->base->view, base);
+    cr_assert_eq(segment->base->refs, 2);
+
+    // The first fork should be fine without us
+    vm_segment_free(fork2);
+    vm_segment_free(segment);
+    cr_assert_eq(vm_segment_get(fork, 0), 0x34);
+
+    segment = fork;
+}